@@ -16,6 +16,9 @@ if "%1" == "RELEASE" (
     SET COMPILERFLAGS=/nologo /Od /MTd /Zi
 )
 
+REM src\embedded_pack.c comes from pacman_pack --embed, see build.sh
+if "%2" == "EMBED" SET DEFINES=%DEFINES% /DPACMAN_EMBED_ASSETS
+
 pushd bin
 
 cl %DEFINES% %COMMON_DEFINES% %COMPILERFLAGS% %COMMON_COMPILERFLAGS% ..\src\win\win_pacman.c %LIBRARIES% %LINKERFLAGS%
@@ -5,4 +5,21 @@ else
     compiler_flags="-O0 -g"
 fi
 
-clang $compiler_flags -std=c99 -Wall src/linux/linux_pacman.c -D_GNU_SOURCE -lX11 -lGL -lm -o pacman
+clang $compiler_flags -std=c99 -Wall src/linux/linux_levelc.c -D_GNU_SOURCE -lm -lpthread -o pacman_levelc
+clang $compiler_flags -std=c99 -Wall src/linux/linux_pack.c -D_GNU_SOURCE -lm -lpthread -o pacman_pack
+
+# Compiled levels load without parsing, the game falls back to the .csv files without them
+./pacman_levelc
+# The pack holds all of the assets in one mapped file, it comes before the loose files
+./pacman_pack
+
+# With EMBED the pack is built into the executables instead, so they don't read data/ at all
+if [[ ${2^^} == "EMBED" ]]; then
+    ./pacman_pack --embed src/embedded_pack.c || exit 1
+    compiler_flags="$compiler_flags -DPACMAN_EMBED_ASSETS"
+fi
+
+clang $compiler_flags -std=c99 -Wall src/linux/linux_pacman.c -D_GNU_SOURCE -lX11 -lGL -lm -lpthread -o pacman
+clang $compiler_flags -std=c99 -Wall src/linux/linux_headless.c -D_GNU_SOURCE -lm -lpthread -o pacman_headless
+clang $compiler_flags -std=c99 -Wall src/linux/linux_server.c -D_GNU_SOURCE -lm -lpthread -o pacman_server
+clang $compiler_flags -std=c99 -Wall src/linux/linux_loadgen.c -D_GNU_SOURCE -lm -lpthread -o pacman_loadgen
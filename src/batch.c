@@ -0,0 +1,264 @@
+/*
+ * Pacman Clone
+ *
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "batch.h"
+
+#define BATCH_ROUND_UP_LANES(n) (((n) + (LANE_WIDTH - 1)) & ~(uint32_t)(LANE_WIDTH - 1))
+
+struct GameBatch {
+    GameContext **games;
+    uint32_t count;
+
+    // Games that are not paused this tick, so that the lanes stay dense
+    uint32_t *active;
+    uint32_t active_count;
+
+    // Ghost g of active game k lives in lane (g * stride + k), where stride is the
+    // active count rounded up to the lane width. For collisions, lanes [0, stride)
+    // hold the players and the ghosts are shifted up by one stride.
+    EntityLanes lanes;
+    fixed32 *default_speed;
+    int32_t *eaten;
+    int32_t *frightened;
+    int32_t *old_x;
+    int32_t *old_y;
+    int32_t *target_x;
+    int32_t *target_y;
+    int32_t *candidates;
+    int32_t *best_dir;
+    int32_t *overlaps;
+
+    void *lane_memory;
+};
+
+// Positions in tiles, as fixed point
+static inline void get_position_lanes(const EntityLanes *lanes, uint32_t i, __m128i *x, __m128i *y) {
+    *x = _mm_add_epi32(_mm_slli_epi32(load_lanes(lanes->x + i), FIXED_SHIFT), load_lanes(lanes->sub_x + i));
+    *y = _mm_add_epi32(_mm_slli_epi32(load_lanes(lanes->y + i), FIXED_SHIFT), load_lanes(lanes->sub_y + i));
+}
+
+// Same test as the first tilecoords_overlap in handle_player_ghosts_collisions.
+// Sets bit g of overlaps[k] when ghost g of game k touches the player.
+static void find_player_ghost_overlaps(const EntityLanes *lanes, uint32_t stride, int32_t *overlaps) {
+    const __m128i max_dist = _mm_set1_epi32(PLAYER_GHOST_TOUCH_SIZE);
+    const __m128i min_dist = _mm_set1_epi32(-PLAYER_GHOST_TOUCH_SIZE);
+
+    for(uint32_t k = 0; k < stride; k += LANE_WIDTH) {
+        __m128i player_x, player_y;
+        get_position_lanes(lanes, k, &player_x, &player_y);
+
+        __m128i mask = _mm_setzero_si128();
+        for(int32_t g = 0; g < GHOST_COUNT; g++) {
+            __m128i ghost_x, ghost_y;
+            get_position_lanes(lanes, (g + 1) * stride + k, &ghost_x, &ghost_y);
+
+            __m128i dist_x = _mm_sub_epi32(player_x, ghost_x);
+            __m128i dist_y = _mm_sub_epi32(player_y, ghost_y);
+            __m128i hit = _mm_and_si128(_mm_and_si128(_mm_cmplt_epi32(dist_x, max_dist), _mm_cmpgt_epi32(dist_x, min_dist)),
+                                        _mm_and_si128(_mm_cmplt_epi32(dist_y, max_dist), _mm_cmpgt_epi32(dist_y, min_dist)));
+
+            mask = _mm_or_si128(mask, _mm_and_si128(hit, _mm_set1_epi32(1 << g)));
+        }
+
+        store_lanes(overlaps + k, mask);
+    }
+}
+
+GameBatch * create_game_batch(const GameAssets *assets, uint32_t count) {
+    if(!assets || count == 0) {
+        return NULL;
+    }
+
+    GameBatch *batch = calloc(1, sizeof(*batch));
+    if(!batch) {
+        return NULL;
+    }
+
+    batch->count = count;
+    batch->games = calloc(count, sizeof(*batch->games));
+    batch->active = calloc(count, sizeof(*batch->active));
+
+    // Enough lanes for the players plus every ghost, 18 arrays in total
+    size_t lane_count = (size_t)BATCH_ROUND_UP_LANES(count) * (GHOST_COUNT + 1);
+    batch->lane_memory = _mm_malloc(lane_count * sizeof(int32_t) * 18, 16);
+
+    if(!batch->games || !batch->active || !batch->lane_memory) {
+        destroy_game_batch(&batch);
+        return NULL;
+    }
+
+    memset(batch->lane_memory, 0, lane_count * sizeof(int32_t) * 18);
+    int32_t *lane_array = batch->lane_memory;
+#define NEXT_LANE_ARRAY(type) (type *)lane_array; lane_array += lane_count
+
+    batch->lanes.x = NEXT_LANE_ARRAY(int32_t);
+    batch->lanes.y = NEXT_LANE_ARRAY(int32_t);
+    batch->lanes.sub_x = NEXT_LANE_ARRAY(fixed32);
+    batch->lanes.sub_y = NEXT_LANE_ARRAY(fixed32);
+    batch->lanes.dir = NEXT_LANE_ARRAY(int32_t);
+    batch->lanes.speed = NEXT_LANE_ARRAY(fixed32);
+    batch->lanes.columns = NEXT_LANE_ARRAY(int32_t);
+    batch->lanes.rows = NEXT_LANE_ARRAY(int32_t);
+    batch->default_speed = NEXT_LANE_ARRAY(fixed32);
+    batch->eaten = NEXT_LANE_ARRAY(int32_t);
+    batch->frightened = NEXT_LANE_ARRAY(int32_t);
+    batch->old_x = NEXT_LANE_ARRAY(int32_t);
+    batch->old_y = NEXT_LANE_ARRAY(int32_t);
+    batch->target_x = NEXT_LANE_ARRAY(int32_t);
+    batch->target_y = NEXT_LANE_ARRAY(int32_t);
+    batch->candidates = NEXT_LANE_ARRAY(int32_t);
+    batch->best_dir = NEXT_LANE_ARRAY(int32_t);
+    batch->overlaps = NEXT_LANE_ARRAY(int32_t);
+
+#undef NEXT_LANE_ARRAY
+
+    for(uint32_t i = 0; i < count; i++) {
+        batch->games[i] = create_game_context(assets);
+        if(!batch->games[i]) {
+            destroy_game_batch(&batch);
+            return NULL;
+        }
+    }
+
+    return batch;
+}
+
+void destroy_game_batch(GameBatch **batch) {
+    if(batch && *batch) {
+        if((*batch)->games) {
+            for(uint32_t i = 0; i < (*batch)->count; i++) {
+                destroy_game_context(&(*batch)->games[i]);
+            }
+        }
+
+        if((*batch)->lane_memory) {
+            _mm_free((*batch)->lane_memory);
+        }
+        free((*batch)->active);
+        free((*batch)->games);
+        free(*batch);
+        *batch = NULL;
+    }
+}
+
+uint32_t get_game_batch_count(const GameBatch *batch) {
+    return batch ? batch->count : 0;
+}
+
+GameContext * get_game_batch_context(GameBatch *batch, uint32_t index) {
+    return (batch && index < batch->count) ? batch->games[index] : NULL;
+}
+
+// Runs the same phases as update_loop, one phase for every game at a time. The
+// state machine, pellets, ghost targets and the actual collision responses stay
+// scalar, everything that runs per entity and per tick goes through the lanes.
+void step_game_batch(GameBatch *batch, float dt, const uint32_t *inputs, bool *running) {
+    assert(batch && inputs);
+
+    batch->active_count = 0;
+    for(uint32_t i = 0; i < batch->count; i++) {
+        bool game_running = true;
+        if(begin_simulation_tick(batch->games[i], dt, inputs[i], &game_running)) {
+            batch->active[batch->active_count++] = i;
+        }
+
+        if(running) {
+            running[i] = game_running;
+        }
+    }
+
+    if(batch->active_count == 0) {
+        return;
+    }
+
+    // Padding lanes past the active count hold stale data, their results are never read
+    uint32_t stride = BATCH_ROUND_UP_LANES(batch->active_count);
+    EntityLanes *lanes = &batch->lanes;
+
+    for(uint32_t k = 0; k < batch->active_count; k++) {
+        GameContext *ctx = batch->games[batch->active[k]];
+        store_entity_lane(lanes, k, &ctx->player.entity, ctx->level);
+    }
+
+    move_entity_lanes(lanes, stride, dt);
+
+    for(uint32_t k = 0; k < batch->active_count; k++) {
+        GameContext *ctx = batch->games[batch->active[k]];
+        load_entity_lane(lanes, k, &ctx->player.entity);
+
+        TileCoord next_tile;
+        get_destination_tile(ctx, &ctx->player.entity, &next_tile);
+        finish_player_movement(ctx, &next_tile);
+    }
+
+    for(uint32_t k = 0; k < batch->active_count; k++) {
+        GameContext *ctx = batch->games[batch->active[k]];
+        for(int32_t g = 0; g < GHOST_COUNT; g++) {
+            const GhostEntity *ghost = &ctx->ghosts[g];
+            uint32_t lane = g * stride + k;
+
+            store_entity_lane(lanes, lane, &ghost->entity, ctx->level);
+            batch->default_speed[lane] = ghost->entity.default_speed;
+            batch->eaten[lane] = (ghost->state == GHOST_STATE_EATEN) ? -1 : 0;
+            batch->frightened[lane] = ghost->frightened ? -1 : 0;
+            batch->old_x[lane] = ghost->entity.coord.x;
+            batch->old_y[lane] = ghost->entity.coord.y;
+        }
+    }
+
+    select_ghost_speeds(lanes->speed, batch->default_speed, batch->eaten, batch->frightened, GHOST_COUNT * stride);
+    move_entity_lanes(lanes, GHOST_COUNT * stride, dt);
+
+    // Steering has to run in ghost order, since Inky's target depends on Blinky
+    for(uint32_t k = 0; k < batch->active_count; k++) {
+        GameContext *ctx = batch->games[batch->active[k]];
+        for(int32_t g = 0; g < GHOST_COUNT; g++) {
+            GhostEntity *ghost = &ctx->ghosts[g];
+            uint32_t lane = g * stride + k;
+
+            load_entity_lane(lanes, lane, &ghost->entity);
+
+            TileCoord old_tile = { .x = batch->old_x[lane], .y = batch->old_y[lane] };
+            batch->candidates[lane] = (int32_t)begin_ghost_steering(ctx, g, &old_tile);
+            batch->target_x[lane] = ghost->target.x;
+            batch->target_y[lane] = ghost->target.y;
+        }
+    }
+
+    pick_ghost_directions(lanes, batch->target_x, batch->target_y, batch->candidates,
+                          batch->best_dir, GHOST_COUNT * stride);
+
+    for(uint32_t k = 0; k < batch->active_count; k++) {
+        GameContext *ctx = batch->games[batch->active[k]];
+        for(int32_t g = 0; g < GHOST_COUNT; g++) {
+            uint32_t lane = g * stride + k;
+            MovementDirection dir = (MovementDirection)batch->best_dir[lane];
+            set_ghost_direction(&ctx->ghosts[g], steer_controlled_ghost(ctx, g, (uint32_t)batch->candidates[lane], dir));
+        }
+    }
+
+    for(uint32_t k = 0; k < batch->active_count; k++) {
+        GameContext *ctx = batch->games[batch->active[k]];
+        store_entity_lane(lanes, k, &ctx->player.entity, ctx->level);
+        for(int32_t g = 0; g < GHOST_COUNT; g++) {
+            store_entity_lane(lanes, (g + 1) * stride + k, &ctx->ghosts[g].entity, ctx->level);
+        }
+    }
+
+    find_player_ghost_overlaps(lanes, stride, batch->overlaps);
+
+    for(uint32_t k = 0; k < batch->active_count; k++) {
+        GameContext *ctx = batch->games[batch->active[k]];
+        if(batch->overlaps[k]) {
+            handle_player_ghosts_collisions(ctx);
+        }
+    }
+}
+
+#undef BATCH_ROUND_UP_LANES
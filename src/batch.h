@@ -0,0 +1,29 @@
+/*
+ * Pacman Clone
+ *
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "game.h"
+
+// Steps many independent games in lockstep. The hot per-entity work (movement,
+// ghost direction scoring and player/ghost overlap tests) runs as SSE kernels over
+// structure-of-arrays lanes, one lane per game, four games at a time.
+typedef struct GameBatch GameBatch;
+
+GameBatch * create_game_batch(const GameAssets *assets, uint32_t count);
+void destroy_game_batch(GameBatch **batch);
+
+// inputs holds one input bitmask per game. If running is not NULL, it receives
+// false for every game that was exited through the menu this tick.
+void step_game_batch(GameBatch *batch, float dt, const uint32_t *inputs, bool *running);
+
+uint32_t get_game_batch_count(const GameBatch *batch);
+GameContext * get_game_batch_context(GameBatch *batch, uint32_t index);
+
+#endif /* BATCH_H */
@@ -0,0 +1,494 @@
+/*
+ * Pacman Clone
+ *
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ */
+
+#include <assert.h>
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "behavior.h"
+
+static const char *ghost_names[GHOST_COUNT] = {
+    [GHOST_BLINKY] = "blinky",
+    [GHOST_PINKY] = "pinky",
+    [GHOST_CLYDE] = "clyde",
+    [GHOST_INKY] = "inky",
+};
+
+typedef struct {
+    GhostBehaviors *behaviors;
+    const char *p;
+    uint32_t line;
+    uint32_t used_regs; // One bit per scratch register
+    char *error;
+    size_t error_size;
+    bool failed;
+} BehaviorCompiler;
+
+static void fail_behavior(BehaviorCompiler *c, const char *format, ...) {
+    if(!c->failed) {
+        int length = snprintf(c->error, c->error_size, "line %u: ", c->line);
+        if(length >= 0 && (size_t)length < c->error_size) {
+            va_list args;
+            va_start(args, format);
+            vsnprintf(c->error + length, c->error_size - length, format, args);
+            va_end(args);
+        }
+        c->failed = true;
+    }
+}
+
+static void skip_behavior_spaces(BehaviorCompiler *c) {
+    while(*c->p == ' ' || *c->p == '\t') {
+        c->p++;
+    }
+}
+
+static bool accept_behavior_char(BehaviorCompiler *c, char ch) {
+    skip_behavior_spaces(c);
+    if(*c->p == ch) {
+        c->p++;
+        return true;
+    }
+
+    return false;
+}
+
+static void expect_behavior_char(BehaviorCompiler *c, char ch) {
+    if(!accept_behavior_char(c, ch)) {
+        fail_behavior(c, "expected '%c'", ch);
+    }
+}
+
+// Copies the next word into name, or leaves it empty if there is none
+static void read_behavior_name(BehaviorCompiler *c, char *name, size_t size) {
+    skip_behavior_spaces(c);
+
+    size_t length = 0;
+    while(isalnum((unsigned char)*c->p) || *c->p == '_') {
+        if(length + 1 < size) {
+            name[length++] = *c->p;
+        }
+        c->p++;
+    }
+    name[length] = '\0';
+}
+
+static int16_t read_behavior_int(BehaviorCompiler *c) {
+    skip_behavior_spaces(c);
+
+    char *end;
+    long value = strtol(c->p, &end, 10);
+    if(end == c->p) {
+        fail_behavior(c, "expected a number");
+    } else if(value < INT16_MIN || value > INT16_MAX) {
+        fail_behavior(c, "%ld is out of range", value);
+    }
+
+    c->p = end;
+    return (int16_t)value;
+}
+
+static bool behavior_number_follows(BehaviorCompiler *c) {
+    skip_behavior_spaces(c);
+    return isdigit((unsigned char)c->p[0]) || (c->p[0] == '-' && isdigit((unsigned char)c->p[1]));
+}
+
+static uint32_t emit_ghost_op(BehaviorCompiler *c, GhostOpCode op, uint8_t dst, uint8_t a, uint8_t b,
+                              int16_t x, int16_t y) {
+    GhostBehaviors *behaviors = c->behaviors;
+    if(behaviors->code_count == GHOST_BEHAVIOR_CODE_MAX) {
+        fail_behavior(c, "more than %d ops in total", GHOST_BEHAVIOR_CODE_MAX);
+        return 0;
+    }
+
+    GhostOp *code = &behaviors->code[behaviors->code_count];
+    code->op = (uint8_t)op;
+    code->dst = dst;
+    code->a = a;
+    code->b = b;
+    code->x = x;
+    code->y = y;
+    return behaviors->code_count++;
+}
+
+static uint8_t alloc_behavior_reg(BehaviorCompiler *c) {
+    for(uint8_t reg = 0; reg < GHOST_REG_SCRATCH_COUNT; reg++) {
+        if(!(c->used_regs & (1u << reg))) {
+            c->used_regs |= 1u << reg;
+            return reg;
+        }
+    }
+
+    fail_behavior(c, "the expression is too complex");
+    return 0;
+}
+
+static void free_behavior_reg(BehaviorCompiler *c, uint8_t reg) {
+    if(reg < GHOST_REG_SCRATCH_COUNT) {
+        c->used_regs &= ~(1u << reg);
+    }
+}
+
+// Results go into a scratch register of an operand where possible
+static uint8_t get_behavior_dst(BehaviorCompiler *c, uint8_t a, uint8_t b) {
+    if(a < GHOST_REG_SCRATCH_COUNT) {
+        if(b != a) {
+            free_behavior_reg(c, b);
+        }
+        return a;
+    } else if(b < GHOST_REG_SCRATCH_COUNT) {
+        return b;
+    }
+
+    return alloc_behavior_reg(c);
+}
+
+static void skip_ghost_ops_to_here(BehaviorCompiler *c, uint32_t op) {
+    if(!c->failed) {
+        c->behaviors->code[op].y = (int16_t)(c->behaviors->code_count - op - 1);
+    }
+}
+
+static uint8_t compile_behavior_expression(BehaviorCompiler *c);
+
+static uint8_t compile_behavior_atom(BehaviorCompiler *c) {
+    if(accept_behavior_char(c, '(')) {
+        if(behavior_number_follows(c)) {
+            int16_t x = read_behavior_int(c);
+            expect_behavior_char(c, ',');
+            int16_t y = read_behavior_int(c);
+            expect_behavior_char(c, ')');
+
+            uint8_t dst = alloc_behavior_reg(c);
+            emit_ghost_op(c, GHOST_OP_CONST, dst, 0, 0, x, y);
+            return dst;
+        }
+
+        uint8_t reg = compile_behavior_expression(c);
+        expect_behavior_char(c, ')');
+        return reg;
+    }
+
+    char name[16];
+    read_behavior_name(c, name, sizeof(name));
+
+    if(strcmp(name, "mirror") == 0) {
+        expect_behavior_char(c, '(');
+        uint8_t a = compile_behavior_expression(c);
+        expect_behavior_char(c, ',');
+        uint8_t b = compile_behavior_expression(c);
+        expect_behavior_char(c, ')');
+
+        uint8_t dst = get_behavior_dst(c, a, b);
+        emit_ghost_op(c, GHOST_OP_MIRROR, dst, a, b, 0, 0);
+        return dst;
+    }
+
+    static const struct {
+        const char *name;
+        uint8_t reg;
+    } inputs[] = {
+        { "player", GHOST_REG_PLAYER },
+        { "heading", GHOST_REG_HEADING },
+        { "self", GHOST_REG_SELF },
+        { "corner", GHOST_REG_CORNER },
+        { "size", GHOST_REG_SIZE },
+    };
+
+    for(uint32_t i = 0; i < sizeof(inputs) / sizeof(*inputs); i++) {
+        if(strcmp(name, inputs[i].name) == 0) {
+            return inputs[i].reg;
+        }
+    }
+
+    for(uint8_t i = 0; i < GHOST_COUNT; i++) {
+        if(strcmp(name, ghost_names[i]) == 0) {
+            return GHOST_REG_GHOSTS + i;
+        }
+    }
+
+    if(name[0]) {
+        fail_behavior(c, "unknown name '%s'", name);
+    } else {
+        fail_behavior(c, "expected a tile");
+    }
+    return 0;
+}
+
+static uint8_t compile_behavior_term(BehaviorCompiler *c) {
+    uint8_t reg = compile_behavior_atom(c);
+
+    while(!c->failed && accept_behavior_char(c, '*')) {
+        int16_t x, y;
+        if(accept_behavior_char(c, '(')) {
+            x = read_behavior_int(c);
+            expect_behavior_char(c, ',');
+            y = read_behavior_int(c);
+            expect_behavior_char(c, ')');
+        } else {
+            x = y = read_behavior_int(c);
+        }
+
+        uint8_t dst = get_behavior_dst(c, reg, reg);
+        emit_ghost_op(c, GHOST_OP_SCALE, dst, reg, reg, x, y);
+        reg = dst;
+    }
+
+    return reg;
+}
+
+static uint8_t compile_behavior_sum(BehaviorCompiler *c) {
+    uint8_t reg = compile_behavior_term(c);
+
+    while(!c->failed) {
+        GhostOpCode op;
+        if(accept_behavior_char(c, '+')) {
+            op = GHOST_OP_ADD;
+        } else if(accept_behavior_char(c, '-')) {
+            op = GHOST_OP_SUB;
+        } else {
+            break;
+        }
+
+        uint8_t b = compile_behavior_term(c);
+        uint8_t dst = get_behavior_dst(c, reg, b);
+        emit_ghost_op(c, op, dst, reg, b, 0, 0);
+        reg = dst;
+    }
+
+    return reg;
+}
+
+// Both branches leave their result in the same register
+static uint8_t compile_behavior_condition(BehaviorCompiler *c) {
+    expect_behavior_char(c, '(');
+    uint8_t a = compile_behavior_expression(c);
+    expect_behavior_char(c, ',');
+    uint8_t b = compile_behavior_expression(c);
+    expect_behavior_char(c, ')');
+
+    GhostOpCode skip_then;
+    if(accept_behavior_char(c, '<')) {
+        skip_then = GHOST_OP_SKIP_IF_FAR;
+    } else if(accept_behavior_char(c, '>') && accept_behavior_char(c, '=')) {
+        skip_then = GHOST_OP_SKIP_IF_NEAR;
+    } else {
+        fail_behavior(c, "expected < or >= after dist2");
+        return 0;
+    }
+
+    int16_t threshold = read_behavior_int(c);
+    expect_behavior_char(c, '?');
+
+    uint32_t skip = emit_ghost_op(c, skip_then, 0, a, b, threshold, 0);
+    free_behavior_reg(c, a);
+    free_behavior_reg(c, b);
+
+    uint8_t dst = compile_behavior_expression(c);
+    if(dst >= GHOST_REG_SCRATCH_COUNT) {
+        uint8_t reg = alloc_behavior_reg(c);
+        emit_ghost_op(c, GHOST_OP_MOVE, reg, dst, 0, 0, 0);
+        dst = reg;
+    }
+
+    uint32_t skip_else = emit_ghost_op(c, GHOST_OP_SKIP, 0, 0, 0, 0, 0);
+    skip_ghost_ops_to_here(c, skip);
+
+    expect_behavior_char(c, ':');
+    uint8_t reg = compile_behavior_expression(c);
+    if(reg != dst) {
+        emit_ghost_op(c, GHOST_OP_MOVE, dst, reg, 0, 0, 0);
+        free_behavior_reg(c, reg);
+    }
+    skip_ghost_ops_to_here(c, skip_else);
+
+    return dst;
+}
+
+static uint8_t compile_behavior_expression(BehaviorCompiler *c) {
+    skip_behavior_spaces(c);
+    if(strncmp(c->p, "dist2", 5) == 0 && !isalnum((unsigned char)c->p[5]) && c->p[5] != '_') {
+        c->p += 5;
+        return compile_behavior_condition(c);
+    }
+
+    return compile_behavior_sum(c);
+}
+
+static void compile_ghost_program(BehaviorCompiler *c, GhostProgram *program) {
+    uint32_t start = c->behaviors->code_count;
+    c->used_regs = 0;
+
+    uint8_t result = compile_behavior_expression(c);
+    skip_behavior_spaces(c);
+    if(*c->p != '\0') {
+        fail_behavior(c, "unexpected '%s'", c->p);
+    }
+
+    if(!c->failed) {
+        program->start = (uint16_t)start;
+        program->count = (uint16_t)(c->behaviors->code_count - start);
+        program->result = result;
+    }
+}
+
+static float read_behavior_float(BehaviorCompiler *c, float min, float max) {
+    char *end;
+    float value = strtof(c->p, &end);
+    if(end == c->p || !(value >= min && value <= max)) {
+        fail_behavior(c, "expected a number from %g to %g", (double)min, (double)max);
+    }
+
+    c->p = end;
+    skip_behavior_spaces(c);
+    if(*c->p != '\0') {
+        fail_behavior(c, "unexpected '%s'", c->p);
+    }
+
+    return value;
+}
+
+static void compile_behavior_line(BehaviorCompiler *c, int32_t *ghost) {
+    skip_behavior_spaces(c);
+    if(*c->p == '\0') {
+        return;
+    }
+
+    char name[16];
+    if(accept_behavior_char(c, '[')) {
+        read_behavior_name(c, name, sizeof(name));
+        expect_behavior_char(c, ']');
+
+        *ghost = -1;
+        for(int32_t i = 0; i < GHOST_COUNT; i++) {
+            if(strcmp(name, ghost_names[i]) == 0) {
+                *ghost = i;
+            }
+        }
+
+        if(*ghost < 0) {
+            fail_behavior(c, "unknown ghost '%s'", name);
+        }
+        return;
+    }
+
+    read_behavior_name(c, name, sizeof(name));
+    expect_behavior_char(c, '=');
+    if(c->failed) {
+        return;
+    } else if(*ghost < 0) {
+        fail_behavior(c, "'%s' comes before the first [ghost]", name);
+        return;
+    }
+
+    GhostBehavior *behavior = &c->behaviors->ghosts[*ghost];
+    skip_behavior_spaces(c);
+    if(strcmp(name, "speed") == 0) {
+        behavior->speed = read_behavior_float(c, 0.0f, 100.0f);
+    } else if(strcmp(name, "gate") == 0) {
+        behavior->gate_pass_percentage = read_behavior_float(c, 0.0f, 1.0f);
+    } else if(strcmp(name, "chase") == 0) {
+        compile_ghost_program(c, &behavior->chase);
+    } else if(strcmp(name, "scatter") == 0) {
+        compile_ghost_program(c, &behavior->scatter);
+    } else {
+        fail_behavior(c, "unknown key '%s'", name);
+    }
+}
+
+GhostBehaviors * compile_ghost_behaviors(const char *source, char *error, size_t error_size) {
+    assert(source && error && error_size > 0);
+
+    GhostBehaviors *behaviors = calloc(1, sizeof(*behaviors));
+    if(!behaviors) {
+        snprintf(error, error_size, "out of memory");
+        return NULL;
+    }
+
+    for(int32_t i = 0; i < GHOST_COUNT; i++) {
+        behaviors->ghosts[i].speed = -1.0f;
+        behaviors->ghosts[i].gate_pass_percentage = -1.0f;
+        behaviors->ghosts[i].chase.result = GHOST_REG_BUILT_IN;
+        behaviors->ghosts[i].scatter.result = GHOST_REG_BUILT_IN;
+    }
+
+    BehaviorCompiler c = {
+        .behaviors = behaviors,
+        .error = error,
+        .error_size = error_size
+    };
+
+    // Lines are compiled one at a time from a copy without the comment
+    char line[256];
+    int32_t ghost = -1;
+    while(*source && !c.failed) {
+        size_t length = strcspn(source, "\r\n");
+        size_t code_length = MIN(length, strcspn(source, "#"));
+
+        c.line++;
+        if(code_length >= sizeof(line)) {
+            fail_behavior(&c, "the line is too long");
+            break;
+        }
+
+        memcpy(line, source, code_length);
+        line[code_length] = '\0';
+        c.p = line;
+        compile_behavior_line(&c, &ghost);
+
+        source += length;
+        source += (source[0] == '\r' && source[1] == '\n') ? 2 : (source[0] ? 1 : 0);
+    }
+
+    if(c.failed) {
+        free(behaviors);
+        return NULL;
+    }
+
+    return behaviors;
+}
+
+GhostBehaviors * load_ghost_behaviors(const char *path, char *error, size_t error_size) {
+    assert(path && error && error_size > 0);
+    error[0] = '\0';
+
+    FILE *f = fopen(path, "rb");
+    if(!f) {
+        return NULL;
+    }
+
+    char *source = NULL;
+    if(fseek(f, 0, SEEK_END) == 0) {
+        long size = ftell(f);
+        source = (size >= 0) ? malloc((size_t)size + 1) : NULL;
+
+        if(source && fseek(f, 0, SEEK_SET) == 0 && fread(source, 1, (size_t)size, f) == (size_t)size) {
+            source[size] = '\0';
+        } else {
+            free(source);
+            source = NULL;
+        }
+    }
+    fclose(f);
+
+    if(!source) {
+        return NULL;
+    }
+
+    GhostBehaviors *behaviors = compile_ghost_behaviors(source, error, error_size);
+    free(source);
+
+    return behaviors;
+}
+
+void destroy_ghost_behaviors(GhostBehaviors **behaviors) {
+    if(behaviors && *behaviors) {
+        free(*behaviors);
+        *behaviors = NULL;
+    }
+}
@@ -0,0 +1,175 @@
+/*
+ * Pacman Clone
+ *
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ */
+
+#ifndef BEHAVIOR_H
+#define BEHAVIOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "common.h"
+#include "render.h"
+
+// Ghost behavior files set how fast each ghost is, when it may leave the ghost
+// house and where it heads when chasing and scattering. Every ghost has its own
+// section of `key = value` lines, and # starts a comment:
+//
+//   [inky]
+//   speed = 4.25
+//   gate = 0.3
+//   chase = mirror(player + heading * 2, blinky)
+//
+// speed is in tiles per second, and gate is the share of the pellets that have
+// to be eaten before the ghost leaves the house. chase and scatter are tile
+// positions built from:
+//
+//   player, heading              the player's tile and direction, (0, 0) if it stands still
+//   self, corner                 the ghost's own tile and its scatter corner
+//   size                         the level's column and row count
+//   blinky, pinky, inky, clyde   the ghosts' tiles
+//   (x, y)                       a constant
+//   a + b, a - b                 tile by tile
+//   a * k, a * (kx, ky)          by constants
+//   mirror(a, b)                 b mirrored through a, a + (a - b)
+//   dist2(a, b) < k ? c : d      the squared distance in tiles, also with >=
+//
+// Anything that's left out stays the way the game has it built in. Each target
+// compiles to a short program for a small register machine, which
+// run_ghost_program steps through. Targets end up within GHOST_TARGET_MARGIN
+// tiles of the range the built-in ones cover, from minus the level size to
+// twice of it, so on levels up to 16000 tiles across the tile distances fit in
+// 16 bits.
+
+#define GHOST_BEHAVIOR_CODE_MAX 512
+#define GHOST_TARGET_MARGIN 8
+// Registers stay within this, so none of the steps can overflow
+#define GHOST_REG_LIMIT (1 << 20)
+
+// The first registers are scratch space for the programs, the ones after that
+// hold the inputs
+#define GHOST_REG_SCRATCH_COUNT 8
+enum {
+    GHOST_REG_PLAYER = GHOST_REG_SCRATCH_COUNT,
+    GHOST_REG_HEADING,
+    GHOST_REG_SELF,
+    GHOST_REG_CORNER,
+    GHOST_REG_SIZE,
+    GHOST_REG_GHOSTS, // One per ghost, in GHOST_BLINKY order
+
+    GHOST_REG_COUNT = GHOST_REG_GHOSTS + GHOST_COUNT
+};
+#define GHOST_REG_BUILT_IN UINT8_MAX
+
+typedef enum {
+    GHOST_OP_CONST, // dst = (x, y)
+    GHOST_OP_MOVE, // dst = a
+    GHOST_OP_ADD, // dst = a + b
+    GHOST_OP_SUB, // dst = a - b
+    GHOST_OP_SCALE, // dst = a * (x, y)
+    GHOST_OP_MIRROR, // dst = a + (a - b)
+    GHOST_OP_SKIP_IF_NEAR, // Skips y ops if the squared distance of a and b is below x
+    GHOST_OP_SKIP_IF_FAR, // Skips y ops unless the squared distance of a and b is below x
+    GHOST_OP_SKIP // Skips y ops
+} GhostOpCode;
+
+typedef struct {
+    uint8_t op;
+    uint8_t dst;
+    uint8_t a;
+    uint8_t b;
+    int16_t x;
+    int16_t y;
+} GhostOp;
+
+typedef struct {
+    uint16_t start;
+    uint16_t count;
+    uint8_t result; // Register with the target, GHOST_REG_BUILT_IN if there's no program
+} GhostProgram;
+
+typedef struct {
+    float speed; // Negative when it's left out
+    float gate_pass_percentage; // Negative when it's left out
+    GhostProgram chase;
+    GhostProgram scatter;
+} GhostBehavior;
+
+typedef struct {
+    GhostBehavior ghosts[GHOST_COUNT];
+    uint32_t code_count;
+    GhostOp code[GHOST_BEHAVIOR_CODE_MAX];
+} GhostBehaviors;
+
+// Both return NULL when the source doesn't compile, with the line and the reason
+// in error. load_ghost_behaviors leaves error empty if the file can't be read.
+GhostBehaviors * compile_ghost_behaviors(const char *source, char *error, size_t error_size);
+GhostBehaviors * load_ghost_behaviors(const char *path, char *error, size_t error_size);
+void destroy_ghost_behaviors(GhostBehaviors **behaviors);
+
+static inline int32_t clamp_ghost_reg(int64_t value) {
+    return (int32_t)CLAMP(value, -GHOST_REG_LIMIT, GHOST_REG_LIMIT);
+}
+
+// Expects the input registers to be set, and overwrites the scratch ones
+static inline Vector2i run_ghost_program(const GhostBehaviors *behaviors, const GhostProgram *program, Vector2i *regs) {
+    const GhostOp *code = behaviors->code + program->start;
+
+    for(uint32_t pc = 0; pc < program->count; pc++) {
+        const GhostOp *op = &code[pc];
+        Vector2i a = regs[op->a];
+        Vector2i b = regs[op->b];
+        Vector2i *dst = &regs[op->dst];
+
+        switch(op->op) {
+            case GHOST_OP_CONST:
+                dst->x = op->x;
+                dst->y = op->y;
+                break;
+            case GHOST_OP_MOVE:
+                *dst = a;
+                break;
+            case GHOST_OP_ADD:
+                dst->x = clamp_ghost_reg((int64_t)a.x + b.x);
+                dst->y = clamp_ghost_reg((int64_t)a.y + b.y);
+                break;
+            case GHOST_OP_SUB:
+                dst->x = clamp_ghost_reg((int64_t)a.x - b.x);
+                dst->y = clamp_ghost_reg((int64_t)a.y - b.y);
+                break;
+            case GHOST_OP_SCALE:
+                dst->x = clamp_ghost_reg((int64_t)a.x * op->x);
+                dst->y = clamp_ghost_reg((int64_t)a.y * op->y);
+                break;
+            case GHOST_OP_MIRROR:
+                dst->x = clamp_ghost_reg((int64_t)a.x * 2 - b.x);
+                dst->y = clamp_ghost_reg((int64_t)a.y * 2 - b.y);
+                break;
+            case GHOST_OP_SKIP_IF_NEAR:
+            case GHOST_OP_SKIP_IF_FAR: {
+                int64_t dist_x = (int64_t)a.x - b.x;
+                int64_t dist_y = (int64_t)a.y - b.y;
+                bool is_near = (dist_x * dist_x + dist_y * dist_y) < op->x;
+                if(is_near == (op->op == GHOST_OP_SKIP_IF_NEAR)) {
+                    pc += op->y;
+                }
+                break;
+            }
+            case GHOST_OP_SKIP:
+                pc += op->y;
+                break;
+            default:
+                break;
+        }
+    }
+
+    Vector2i size = regs[GHOST_REG_SIZE];
+    Vector2i result = regs[program->result];
+    result.x = CLAMP(result.x, -size.x - GHOST_TARGET_MARGIN, size.x * 2 + GHOST_TARGET_MARGIN);
+    result.y = CLAMP(result.y, -size.y - GHOST_TARGET_MARGIN, size.y * 2 + GHOST_TARGET_MARGIN);
+    return result;
+}
+
+#endif /* BEHAVIOR_H */
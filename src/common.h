@@ -8,6 +8,7 @@
 #define COMMON_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #define DEFAULT_WINDOW_WIDTH 1024
 #define DEFAULT_WINDOW_HEIGHT 576
@@ -36,6 +37,27 @@ typedef struct {
     int32_t height;
 } Rect;
 
+// Q16.16 fixed point, used for positions within a tile and for movement speeds
+typedef int32_t fixed32;
+
+#define FIXED_SHIFT 16
+#define FIXED_ONE (1 << FIXED_SHIFT)
+#define FIXED_FROM_FLOAT(f) ((fixed32)((f) * (float)FIXED_ONE + (((f) < 0.0f) ? -0.5f : 0.5f)))
+#define FIXED_TO_FLOAT(v) ((float)(v) / (float)FIXED_ONE)
+
+typedef struct {
+    fixed32 x;
+    fixed32 y;
+} Vector2x;
+
+static inline fixed32 fixed_mul(fixed32 a, fixed32 b) {
+    return (fixed32)(((int64_t)a * (int64_t)b) >> FIXED_SHIFT);
+}
+
+static inline fixed32 fixed_abs(fixed32 v) {
+    return (v >= 0) ? v : -v;
+}
+
 enum {
     GHOST_BLINKY,
     GHOST_PINKY,
@@ -45,6 +67,9 @@ enum {
     GHOST_COUNT
 };
 
+// Pixels of this color in the texture atlas are transparent
+#define ATLAS_CHROMA_KEY 0xff00ff
+
 typedef enum {
     ATLAS_SPRITE_EMPTY,
     ATLAS_SPRITE_PLAYER_FRAME1,
@@ -0,0 +1,206 @@
+/*
+ * Pacman Clone
+ *
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "env.h"
+
+struct GameEnv {
+    GameBatch *batch;
+    uint32_t ticks_per_step;
+    uint32_t *inputs;
+    bool *running;
+
+    uint32_t rows;
+    uint32_t columns;
+};
+
+static const uint32_t action_inputs[ENV_ACTION_COUNT] = {
+    [ENV_ACTION_NONE] = 0,
+    [ENV_ACTION_UP] = INPUT_UP,
+    [ENV_ACTION_LEFT] = INPUT_LEFT,
+    [ENV_ACTION_DOWN] = INPUT_DOWN,
+    [ENV_ACTION_RIGHT] = INPUT_RIGHT
+};
+
+// Channel + 1 for every tile type that shows up in an observation, 0 otherwise
+static const uint8_t tile_channels[ATLAS_SPRITE_COUNT] = {
+    [ATLAS_SPRITE_WALL_NORMAL] = ENV_CHANNEL_WALL + 1,
+    [ATLAS_SPRITE_WALL_BOTTOM] = ENV_CHANNEL_WALL + 1,
+    [ATLAS_SPRITE_GHOST_HOUSE_GATE] = ENV_CHANNEL_GATE + 1,
+    [ATLAS_SPRITE_PELLET] = ENV_CHANNEL_PELLET + 1,
+    [ATLAS_SPRITE_POWER_PELLET] = ENV_CHANNEL_POWER_PELLET + 1
+};
+
+GameEnv * create_game_env(const GameAssets *assets, uint32_t count, uint32_t ticks_per_step) {
+    if(!assets || count == 0 || ticks_per_step == 0) {
+        return NULL;
+    }
+
+    GameEnv *env = calloc(1, sizeof(*env));
+    if(!env) {
+        return NULL;
+    }
+
+    env->ticks_per_step = ticks_per_step;
+    env->batch = create_game_batch(assets, count);
+    env->inputs = calloc(count, sizeof(*env->inputs));
+    env->running = calloc(count, sizeof(*env->running));
+
+    if(!env->batch || !env->inputs || !env->running) {
+        destroy_game_env(&env);
+        return NULL;
+    }
+
+    for(uint32_t i = 0; i < assets->level_count; i++) {
+        env->rows = MAX(env->rows, assets->levels[i]->rows);
+        env->columns = MAX(env->columns, assets->levels[i]->columns);
+    }
+
+    return env;
+}
+
+void destroy_game_env(GameEnv **env) {
+    if(env && *env) {
+        destroy_game_batch(&(*env)->batch);
+        free((*env)->running);
+        free((*env)->inputs);
+        free(*env);
+        *env = NULL;
+    }
+}
+
+uint32_t get_game_env_count(const GameEnv *env) {
+    return env ? get_game_batch_count(env->batch) : 0;
+}
+
+const GameContext * get_game_env_context(const GameEnv *env, uint32_t index) {
+    return env ? get_game_batch_context(env->batch, index) : NULL;
+}
+
+void get_game_env_observation_shape(const GameEnv *env, uint32_t *channels, uint32_t *rows, uint32_t *columns) {
+    assert(env);
+
+    if(channels) {
+        *channels = ENV_CHANNEL_COUNT;
+    }
+    if(rows) {
+        *rows = env->rows;
+    }
+    if(columns) {
+        *columns = env->columns;
+    }
+}
+
+size_t get_game_env_observation_size(const GameEnv *env) {
+    assert(env);
+    return (size_t)ENV_CHANNEL_COUNT * env->rows * env->columns;
+}
+
+void reset_game_env(GameEnv *env, uint32_t index, uint64_t seed) {
+    GameContext *ctx = get_game_batch_context(env->batch, index);
+    assert(ctx);
+
+    seed_game(ctx, seed, 0);
+    reset_game(ctx);
+    ctx->events = 0;
+    ctx->points = 0;
+}
+
+void step_game_env(GameEnv *env, const uint8_t *actions, float *rewards, bool *dones) {
+    assert(env && actions);
+
+    uint32_t count = get_game_batch_count(env->batch);
+    for(uint32_t i = 0; i < count; i++) {
+        env->inputs[i] = (actions[i] < ENV_ACTION_COUNT) ? action_inputs[actions[i]] : 0;
+
+        if(rewards) {
+            rewards[i] = 0.0f;
+        }
+        if(dones) {
+            dones[i] = false;
+        }
+    }
+
+    for(uint32_t tick = 0; tick < env->ticks_per_step; tick++) {
+        step_game_batch(env->batch, SIMULATION_TICK_TIME, env->inputs, env->running);
+
+        for(uint32_t i = 0; i < count; i++) {
+            const GameContext *ctx = get_game_batch_context(env->batch, i);
+            uint32_t events = get_game_events(ctx);
+
+            if(rewards) {
+                rewards[i] += (float)get_game_points(ctx);
+                if(events & GAME_EVENT_PLAYER_DIED) {
+                    rewards[i] += ENV_REWARD_PLAYER_DIED;
+                }
+            }
+            if(dones && (events & GAME_EVENT_GAME_OVER)) {
+                dones[i] = true;
+            }
+        }
+    }
+}
+
+static inline void mark_observation_tile(uint8_t *buffer, const GameEnv *env, EnvChannel channel,
+                                         const TileCoord *coord, uint8_t value) {
+    // Entities in the tunnels can be one tile outside of the level
+    if(coord->x >= 0 && coord->x < (int32_t)env->columns &&
+       coord->y >= 0 && coord->y < (int32_t)env->rows) {
+        uint8_t *tile = &buffer[(channel * env->rows + coord->y) * env->columns + coord->x];
+        *tile = MAX(*tile, value);
+    }
+}
+
+void observe_game_env(const GameEnv *env, uint32_t index, uint8_t *buffer) {
+    assert(env && buffer);
+
+    const GameContext *ctx = get_game_batch_context(env->batch, index);
+    assert(ctx);
+
+    const Level *level = ctx->level;
+    memset(buffer, 0, get_game_env_observation_size(env));
+
+    size_t plane_size = (size_t)env->rows * env->columns;
+    for(uint32_t y = 0; y < level->rows; y++) {
+        uint32_t row = get_level_tile_index(level, 0, y);
+        for(uint32_t x = 0; x < level->columns; x++) {
+            uint8_t sprite = get_level_tile_sprite(level, row + x);
+            uint8_t channel = (sprite < ATLAS_SPRITE_COUNT) ? tile_channels[sprite] : 0;
+            if(channel) {
+                buffer[(channel - 1) * plane_size + y * env->columns + x] = UINT8_MAX;
+            }
+        }
+    }
+
+    mark_observation_tile(buffer, env, ENV_CHANNEL_PLAYER, &ctx->player.entity.coord, UINT8_MAX);
+
+    float frightened_left = 1.0f - get_wheel_timer_progress(&ctx->timers, ctx->frightened_timer);
+    uint8_t frightened_value = (uint8_t)CLAMP(frightened_left * (float)UINT8_MAX, 1.0f, (float)UINT8_MAX);
+
+    for(int32_t i = 0; i < GHOST_COUNT; i++) {
+        const GhostEntity *ghost = &ctx->ghosts[i];
+
+        if(ghost->state == GHOST_STATE_EATEN) {
+            mark_observation_tile(buffer, env, ENV_CHANNEL_GHOST_EATEN, &ghost->entity.coord, UINT8_MAX);
+        } else if(ghost->frightened) {
+            mark_observation_tile(buffer, env, ENV_CHANNEL_GHOST_FRIGHTENED, &ghost->entity.coord, frightened_value);
+        } else {
+            mark_observation_tile(buffer, env, ENV_CHANNEL_GHOST, &ghost->entity.coord, UINT8_MAX);
+        }
+    }
+}
+
+void observe_game_env_batch(const GameEnv *env, uint8_t *buffer) {
+    assert(env && buffer);
+
+    size_t size = get_game_env_observation_size(env);
+    uint32_t count = get_game_batch_count(env->batch);
+    for(uint32_t i = 0; i < count; i++) {
+        observe_game_env(env, i, buffer + i * size);
+    }
+}
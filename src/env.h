@@ -0,0 +1,71 @@
+/*
+ * Pacman Clone
+ *
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ */
+
+#ifndef ENV_H
+#define ENV_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "game.h"
+
+// Environment interface for training agents. Wraps a GameBatch, so all of the
+// environments of one GameEnv are stepped in lockstep.
+
+typedef enum {
+    ENV_ACTION_NONE,
+    ENV_ACTION_UP,
+    ENV_ACTION_LEFT,
+    ENV_ACTION_DOWN,
+    ENV_ACTION_RIGHT,
+
+    ENV_ACTION_COUNT
+} EnvAction;
+
+// Observations are one byte per tile and channel, laid out as
+// [environment][channel][row][column]. Levels smaller than the largest one
+// are padded with zeros on the right and bottom.
+typedef enum {
+    ENV_CHANNEL_WALL,
+    ENV_CHANNEL_GATE,
+    ENV_CHANNEL_PELLET,
+    ENV_CHANNEL_POWER_PELLET,
+    ENV_CHANNEL_PLAYER,
+    ENV_CHANNEL_GHOST,
+    ENV_CHANNEL_GHOST_FRIGHTENED, // Scaled by the frightened time that is left
+    ENV_CHANNEL_GHOST_EATEN,
+
+    ENV_CHANNEL_COUNT
+} EnvChannel;
+
+#define ENV_REWARD_PLAYER_DIED -500.0f
+
+typedef struct GameEnv GameEnv;
+
+// Every step advances the games by ticks_per_step simulation ticks with the same action
+GameEnv * create_game_env(const GameAssets *assets, uint32_t count, uint32_t ticks_per_step);
+void destroy_game_env(GameEnv **env);
+
+uint32_t get_game_env_count(const GameEnv *env);
+// Read only, for checking an environment against the game it wraps
+const GameContext * get_game_env_context(const GameEnv *env, uint32_t index);
+void get_game_env_observation_shape(const GameEnv *env, uint32_t *channels, uint32_t *rows, uint32_t *columns);
+// Size in bytes of the observation of a single environment
+size_t get_game_env_observation_size(const GameEnv *env);
+
+// Starts a new game with its random stream seeded from seed
+void reset_game_env(GameEnv *env, uint32_t index, uint64_t seed);
+
+// actions, rewards and dones hold one entry per environment. The reward is the
+// sum of the points scored, plus ENV_REWARD_PLAYER_DIED per lost life. A game
+// that is done has already restarted by itself.
+void step_game_env(GameEnv *env, const uint8_t *actions, float *rewards, bool *dones);
+
+void observe_game_env(const GameEnv *env, uint32_t index, uint8_t *buffer);
+// Writes the observations of all environments back to back
+void observe_game_env_batch(const GameEnv *env, uint8_t *buffer);
+
+#endif /* ENV_H */
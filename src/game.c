@@ -4,23 +4,39 @@
  * Copyright (c) 2021 Amanch Esmailzadeh
  */
 
+#ifndef PACMAN_HEADLESS
 #ifdef _WIN32
 #include <gl/gl.h>
 #elif __linux__
 #include <GL/gl.h>
 #endif
+#endif
 #include <assert.h>
 #include <limits.h>
 #include <math.h>
+#include <stddef.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "game.h"
 
 #include "level.c"
+#include "levelgraph.c"
+#include "levelfile.c"
+#include "pack.c"
+#include "timerwheel.c"
+#include "behavior.c"
+#ifndef PACMAN_HEADLESS
 #include "texture.c"
 #include "render.c"
+#endif
+#ifdef PACMAN_EMBED_ASSETS
+#include "embedded_pack.c"
+#endif
 
 #define EPSILON 0.05f
+#define SUB_TILE_EPSILON FIXED_FROM_FLOAT(EPSILON)
 #define DEFAULT_MOVEMENT_SPEED 5.0f
 #define FRIGHTENED_SPEED_MOD 0.65f
 #define SCATTER_MODE_TIME 5.0f
@@ -28,25 +44,41 @@
 #define FRIGHTENED_MODE_TIME 10.0f
 #define INPUT_QUEUE_TIME_MAX 0.5f
 #define DEFAULT_EATEN_ANIM_TIMER_TARGET 1.0f
+// Wheel timer events, the eaten animations have one per ghost
+#define TIMER_EVENT_GHOST_MODE 0
+#define TIMER_EVENT_FRIGHTENED 1
+#define TIMER_EVENT_EATEN_ANIM(ghost) (2 + (ghost))
+// Built-in ghost speeds in tiles per second and gate_pass_percentage, ghost
+// behavior files can change them
+static const float default_ghost_speeds[GHOST_COUNT] = {
+    [GHOST_BLINKY] = DEFAULT_MOVEMENT_SPEED - 0.25f,
+    [GHOST_PINKY] = DEFAULT_MOVEMENT_SPEED - 0.5f,
+    [GHOST_CLYDE] = DEFAULT_MOVEMENT_SPEED - 1.0f,
+    [GHOST_INKY] = DEFAULT_MOVEMENT_SPEED - 0.75f,
+};
+static const float default_gate_pass_percentages[GHOST_COUNT] = {
+    [GHOST_BLINKY] = 0.0f,
+    [GHOST_PINKY] = 0.15f,
+    [GHOST_CLYDE] = 0.5f,
+    [GHOST_INKY] = 0.3f,
+};
+// Collision box sizes in tiles
+#define PLAYER_GHOST_TOUCH_SIZE FIXED_FROM_FLOAT(0.75f)
+#define PLAYER_GHOST_HIT_SIZE FIXED_FROM_FLOAT(0.35f)
 
-static const Vector2 direction_vectors[4] = {
+static const Vector2 direction_vectors[5] = {
     { .x = 0.0f, .y = -1.0f }, // Up
     { .x = -1.0f, .y = 0.0f }, // Left
     { .x = 0.0f, .y = 1.0f },  // Down
     { .x = 1.0f, .y = 0.0f },  // Right
+    { .x = 0.0f, .y = 0.0f },  // None
 };
 
-static struct {
-    enum MenuItem {
-        MENU_ITEM_CONTINUE,
-        MENU_ITEM_EXIT,
-
-        MENU_ITEM_COUNT
-    } id;
-    const char *str;
-} menu_items[MENU_ITEM_COUNT] = {
-    { .id = MENU_ITEM_CONTINUE, "CONTINUE" },
-    { .id = MENU_ITEM_EXIT, "EXIT" }
+enum MenuItem {
+    MENU_ITEM_CONTINUE,
+    MENU_ITEM_EXIT,
+
+    MENU_ITEM_COUNT
 };
 
 #define LIVES_COUNT_START   3
@@ -65,9 +97,35 @@ typedef enum {
     GAME_STATE_MENU
 } GameState;
 
-static struct {
+struct GameAssets {
     Texture2D *atlas;
-    Level *level;
+    Level **levels;
+    LevelGraph **graphs;
+    uint32_t level_count;
+    bool *levels_in_pack; // Those point into it
+    bool atlas_in_pack; // The same for the atlas
+    GhostBehaviors *behaviors; // NULL when the built-in ones are used
+    Pack *pack; // NULL when everything comes from the loose files
+};
+
+struct GameContext {
+    const GameAssets *assets;
+    Level *level; // Points at level_storage
+    size_t level_capacity;
+    // Runs the ghosts through update_ghosts instead of the SSE lanes
+    bool scalar_ghosts;
+
+    // Only touched by the renderer
+    struct {
+        int32_t width;
+        int32_t height;
+        bool should_resize;
+    } window_box;
+    float spotlight_bias;
+
+    // Everything from here to the end of the level tiles is the simulation state,
+    // which snapshots copy as a single block
+    uint32_t level_index;
 
     GameState previous_state;
     GameState current_state;
@@ -75,97 +133,114 @@ static struct {
     GhostEntity ghosts[GHOST_COUNT];
     PlayerEntity player;
 
+    // The ready timer runs while everything else is paused, the others are on the
+    // wheel, which only moves on in ticks where the world does
     Timer ready_timer;
-    Timer ghost_mode_timer;
-    Timer frightened_timer;
+    TimerWheel timers;
+    TimerHandle ghost_mode_timer;
+    TimerHandle frightened_timer; // TIMER_NONE unless the ghosts are frightened
+    float tick_time; // Timer lengths are converted to ticks of this length
 
     int32_t lives;
     uint32_t score;
+    // Points and events of the current tick
+    uint32_t points;
+    uint32_t events;
 
     enum MenuItem selected_menu_id;
+    RandomState random;
+
+    // Ghost steered by a second player in versus mode, -1 if all of them are AI
+    int32_t controlled_ghost;
+    uint32_t ghost_input;
+    GhostPathing ghost_pathing;
 
     enum {
         GAME_MODE_SCATTER,
         GAME_MODE_CHASE
     } mode;
-} game_data = { 0 };
 
-static inline void set_game_state(GameState state) {
+    struct {
+        Vector2i scroll;
+        Vector2 offset;
+        float zoom;
+    } camera;
+
+    uint32_t level_storage[];
+};
+
+#define SNAPSHOT_START offsetof(GameContext, level_index)
+#define SNAPSHOT_LEVEL_OFFSET (offsetof(GameContext, level_storage) - SNAPSHOT_START)
+
+static inline void set_game_state(GameContext *ctx, GameState state) {
     switch(state) {
         case GAME_STATE_READY:
-            game_data.ready_timer.running = true;
-            game_data.ready_timer.elapsed = 0.0f;
-            game_data.ready_timer.target = 3.0f;
+            ctx->ready_timer.running = true;
+            ctx->ready_timer.elapsed = 0.0f;
+            ctx->ready_timer.target = 3.0f;
             break;
         default:
             break;
     }
-    game_data.previous_state = game_data.current_state;
-    game_data.current_state = state;
+    ctx->previous_state = ctx->current_state;
+    ctx->current_state = state;
 }
 
-static inline void increase_player_score(uint32_t points) {
-    uint32_t value = game_data.score / SCORE_GHOST_EXTRA_LIFE;
-    game_data.score += points;
-    game_data.score = MIN(SCORE_MAX, game_data.score);
+static inline void increase_player_score(GameContext *ctx, uint32_t points) {
+    uint32_t value = ctx->score / SCORE_GHOST_EXTRA_LIFE;
+    uint32_t previous_score = ctx->score;
+    ctx->score += points;
+    ctx->score = MIN(SCORE_MAX, ctx->score);
+    ctx->points += ctx->score - previous_score;
 
-    if((game_data.score / SCORE_GHOST_EXTRA_LIFE) > value) {
-        game_data.lives++;
-        game_data.lives = MIN(LIVES_MAX, game_data.lives);
+    if((ctx->score / SCORE_GHOST_EXTRA_LIFE) > value) {
+        ctx->lives++;
+        ctx->lives = MIN(LIVES_MAX, ctx->lives);
     }
 }
 
-static GLuint gl_program;
-
-static struct {
-    Vector2i scroll;
-    Vector2 offset;
-    float zoom;
-} game_camera;
-
-static inline void camera_set_default_offset(void) {
-    game_camera.offset.x = 0.5f;
-    game_camera.offset.y = 0.5f;
+static inline void camera_set_default_offset(GameContext *ctx) {
+    ctx->camera.offset.x = 0.5f;
+    ctx->camera.offset.y = 0.5f;
 }
 
 // Obligatory camera shake function
-static inline void camera_shake(void) {
+static inline void camera_shake(GameContext *ctx) {
     const float SHAKE_FACTOR = 0.0025f;
 
-    camera_set_default_offset();
+    camera_set_default_offset(ctx);
 
     Vector2 intensity = {
-        .x = LERP(((float)(rand() % RAND_MAX) / (float)RAND_MAX) * SHAKE_FACTOR, -SHAKE_FACTOR, SHAKE_FACTOR),
-        .y = LERP(((float)(rand() % RAND_MAX) / (float)RAND_MAX) * SHAKE_FACTOR, -SHAKE_FACTOR, SHAKE_FACTOR)
+        .x = LERP(next_random_float(&ctx->random) * SHAKE_FACTOR, -SHAKE_FACTOR, SHAKE_FACTOR),
+        .y = LERP(next_random_float(&ctx->random) * SHAKE_FACTOR, -SHAKE_FACTOR, SHAKE_FACTOR)
     };
 
-    game_camera.offset.x += intensity.x;
-    game_camera.offset.y += intensity.y;
+    ctx->camera.offset.x += intensity.x;
+    ctx->camera.offset.y += intensity.y;
 }
 
-#define TILE_COUNT_X (int32_t)game_data.level->columns
-#define TILE_COUNT_Y (int32_t)game_data.level->rows
-#define LAST_TILE_X (int32_t)(game_data.level->columns - 1)
-#define LAST_TILE_Y (int32_t)(game_data.level->rows - 1)
+#define TILE_COUNT_X (int32_t)ctx->level->columns
+#define TILE_COUNT_Y (int32_t)ctx->level->rows
+#define LAST_TILE_X (int32_t)(ctx->level->columns - 1)
+#define LAST_TILE_Y (int32_t)(ctx->level->rows - 1)
 
 // Util functions
-static bool rect_aabb_test(const Rect *a, const Rect *b) {
+
+// AABB test of two square boxes centered on the tile coordinates. They overlap
+// when both axis distances are below the average of their sizes (in tiles).
+static bool tilecoords_overlap(const TileCoord *a, const TileCoord *b, fixed32 size_a, fixed32 size_b) {
     if(a && b) {
-        int32_t ax2 = a->x + (int32_t)a->width;
-        int32_t ay2 = a->y + (int32_t)a->height;
-        int32_t bx2 = b->x + (int32_t)b->width;
-        int32_t by2 = b->y + (int32_t)b->height;
-
-        return a->x < bx2 &&
-            ax2 > b->x &&
-            a->y < by2 &&
-            ay2 > b->y;
+        fixed32 dist_x = (a->x - b->x) * FIXED_ONE + (a->sub.x - b->sub.x);
+        fixed32 dist_y = (a->y - b->y) * FIXED_ONE + (a->sub.y - b->sub.y);
+        fixed32 extent = (size_a + size_b) / 2;
+
+        return fixed_abs(dist_x) < extent && fixed_abs(dist_y) < extent;
     }
 
     return false;
 }
 
-static inline bool coords_within_bounds(const TileCoord *coord) {
+static inline bool coords_within_bounds(const GameContext *ctx, const TileCoord *coord) {
     return (coord) ? coord->x >= 0 && coord->x <= LAST_TILE_X &&
         coord->y >= 0 && coord->y <= LAST_TILE_Y : 0;
 }
@@ -174,27 +249,31 @@ static inline bool float_nearly_equal(float a, float b) {
     return fabsf(a - b) <= EPSILON;
 }
 
+static inline bool sub_tile_near_center(fixed32 sub) {
+    return fixed_abs(sub) <= SUB_TILE_EPSILON;
+}
+
 static inline float dot_product(MovementDirection dir1, MovementDirection dir2) {
     assert(dir1 != MOVEMENT_DIR_NONE && dir2 != MOVEMENT_DIR_NONE);
     return direction_vectors[dir1].x * direction_vectors[dir2].x +
         direction_vectors[dir1].y * direction_vectors[dir2].y;
 }
 
-static inline float pellets_eaten_percentage(void) {
-    return (float)game_data.level->pellets_eaten / (float)game_data.level->pellet_count;
+static inline float pellets_eaten_percentage(const GameContext *ctx) {
+    return (float)ctx->level->pellets_eaten / (float)ctx->level->pellet_count;
 }
 
-static inline bool ghost_can_pass_gate(GhostEntity *ghost) {
+static inline bool ghost_can_pass_gate(GameContext *ctx, GhostEntity *ghost) {
     return ghost && (ghost->state == GHOST_STATE_EATEN ||
-        (ghost->in_ghost_house && ghost->gate_pass_percentage <= pellets_eaten_percentage()));
+        (ghost->in_ghost_house && ghost->gate_pass_percentage <= pellets_eaten_percentage(ctx)));
 }
 
-static bool tile_is_wall(const TileCoord *coord, GhostEntity *ghost) {
-    if(coord && coords_within_bounds(coord)) {
-        uint32_t type = get_level_tile_data(game_data.level, coord);
+static bool tile_is_wall(GameContext *ctx, const TileCoord *coord, GhostEntity *ghost) {
+    if(coord && coords_within_bounds(ctx, coord)) {
+        uint8_t type = get_level_tile_data(ctx->level, coord);
 
-        if(ghost_can_pass_gate(ghost)) {
-            ghost->target = game_data.level->gate_tile;
+        if(ghost_can_pass_gate(ctx, ghost)) {
+            ghost->target = ctx->level->gate_tile;
             return type == ATLAS_SPRITE_WALL_NORMAL || type == ATLAS_SPRITE_WALL_BOTTOM;
         }
 
@@ -204,264 +283,436 @@ static bool tile_is_wall(const TileCoord *coord, GhostEntity *ghost) {
     return false;
 }
 
-static Vector2i get_entity_abs_position(const GameEntity *entity) {
-    const float TILE_SIZE_F = (float)TILE_SIZE;
-
-    if(entity) {
-        return (Vector2i) {
-            .x = (entity->coord.x * TILE_SIZE) + (int32_t)(entity->coord.sub.x * TILE_SIZE_F),
-            .y = (entity->coord.y * TILE_SIZE) + (int32_t)(entity->coord.sub.y * TILE_SIZE_F)
-        };
-    }
+static inline const LevelGraph * get_level_graph(const GameContext *ctx) {
+    return ctx->assets->graphs[ctx->level_index];
+}
 
-    return (Vector2i) { 0 };
+// Exits of the tile an entity is on, entities are never further out than the border
+static inline uint32_t get_entity_exits(const GameContext *ctx, const GameEntity *entity, bool gate_open,
+                                        bool include_border) {
+    uint32_t index = get_level_tile_index(ctx->level, entity->coord.x, entity->coord.y);
+    return get_level_exits(get_level_graph(ctx), index, gate_open, include_border);
 }
 
 // Function prototypes
-static void handle_player_ghosts_collisions(float dt);
-static void tilecoord_to_rect(const TileCoord *coord, Rect *rect, float scale);
-static void move_entity(GameEntity *entity, TileCoord *destination, float dt);
-static void set_ghost_behavior(GhostEntity *ghost, uint32_t type);
+static void handle_player_ghosts_collisions(GameContext *ctx);
+static void move_entity(GameContext *ctx, GameEntity *entity, TileCoord *destination, float dt);
+static void set_ghost_behavior(GameContext *ctx, GhostEntity *ghost, uint32_t type);
 static void set_ghost_speed(GhostEntity *ghost);
-static void wrap_tile_coords(TileCoord *coord, bool outside_area);
-static void tile_coords_from_direction(TileCoord *coord, MovementDirection direction);
+static void update_ghost_lanes(GameContext *ctx, float dt);
+static void wrap_tile_coords(const GameContext *ctx, TileCoord *coord, bool outside_area);
 
-static void set_starting_data(void) {
-    memset(&game_data.player, 0, sizeof(game_data.player));
-    memset(&game_data.ghosts, 0, sizeof(game_data.ghosts));
+static TimerHandle start_game_timer(GameContext *ctx, float seconds, uint16_t event) {
+    TimerHandle timer = start_wheel_timer(&ctx->timers, (uint32_t)(seconds / ctx->tick_time + 0.5f), event);
+    assert(timer != TIMER_NONE);
+    return timer;
+}
 
-    game_data.player.input_queue.target = INPUT_QUEUE_TIME_MAX;
-    game_data.player.entity.dir = MOVEMENT_DIR_NONE;
-    game_data.player.entity.facing = MOVEMENT_DIR_RIGHT;
-    game_data.player.entity.default_speed = DEFAULT_MOVEMENT_SPEED;
-    game_data.player.entity.speed = DEFAULT_MOVEMENT_SPEED;
+// In tiles per second, from the behaviors file when it sets one
+static float get_ghost_speed(const GameContext *ctx, int32_t ghost) {
+    const GhostBehaviors *behaviors = ctx->assets->behaviors;
+    if(behaviors && behaviors->ghosts[ghost].speed >= 0.0f) {
+        return behaviors->ghosts[ghost].speed;
+    }
+    return default_ghost_speeds[ghost];
+}
 
+static void set_starting_data(GameContext *ctx) {
     for(int32_t i = 0; i < GHOST_COUNT; i++) {
-        game_data.ghosts[i].entity.dir = MOVEMENT_DIR_UP;
-        game_data.ghosts[i].entity.facing = MOVEMENT_DIR_RIGHT;
-        game_data.ghosts[i].state = GHOST_STATE_SCATTER;
-        game_data.ghosts[i].entity.coord.sub.x = 0.0f;
-        game_data.ghosts[i].entity.coord.sub.y = 0.0f;
-        game_data.ghosts[i].in_ghost_house = true;
-        game_data.ghosts[i].eaten_anim_timer.running = false;
-        game_data.ghosts[i].eaten_anim_timer.elapsed = 0.0f;
-        game_data.ghosts[i].eaten_anim_timer.target = DEFAULT_EATEN_ANIM_TIMER_TARGET;
+        stop_wheel_timer(&ctx->timers, ctx->ghosts[i].eaten_anim_timer);
     }
 
-    game_data.ghosts[GHOST_BLINKY].entity.dir = MOVEMENT_DIR_RIGHT;
-    game_data.ghosts[GHOST_BLINKY].gate_pass_percentage = 0.0f;
-    game_data.ghosts[GHOST_BLINKY].in_ghost_house = false;
-    game_data.ghosts[GHOST_PINKY].gate_pass_percentage = 0.15f;
-    game_data.ghosts[GHOST_CLYDE].gate_pass_percentage = 0.5f;
-    game_data.ghosts[GHOST_INKY].gate_pass_percentage = 0.3f;
-
-    game_data.ghosts[GHOST_BLINKY].entity.default_speed = DEFAULT_MOVEMENT_SPEED - 0.25f;
-    game_data.ghosts[GHOST_BLINKY].entity.speed = game_data.ghosts[GHOST_BLINKY].entity.default_speed;
-    game_data.ghosts[GHOST_PINKY].entity.default_speed = DEFAULT_MOVEMENT_SPEED - 0.5f;
-    game_data.ghosts[GHOST_PINKY].entity.speed = game_data.ghosts[GHOST_PINKY].entity.default_speed;
-    game_data.ghosts[GHOST_CLYDE].entity.default_speed = DEFAULT_MOVEMENT_SPEED - 1.0f;
-    game_data.ghosts[GHOST_CLYDE].entity.speed = game_data.ghosts[GHOST_CLYDE].entity.default_speed;
-    game_data.ghosts[GHOST_INKY].entity.default_speed = DEFAULT_MOVEMENT_SPEED - 0.75f;
-    game_data.ghosts[GHOST_INKY].entity.speed = game_data.ghosts[GHOST_INKY].entity.default_speed;
-
-    game_camera.scroll.x = 0;
-    game_camera.scroll.y = 0;
-    camera_set_default_offset();
-    game_camera.zoom = 1.0f;
-
-    set_game_state(GAME_STATE_READY);
-
-    game_data.player.entity.coord = game_data.level->player_start;
-    game_data.ghosts[GHOST_BLINKY].entity.coord = game_data.level->ghost_start[GHOST_BLINKY];
-    game_data.ghosts[GHOST_PINKY].entity.coord = game_data.level->ghost_start[GHOST_PINKY];
-    game_data.ghosts[GHOST_CLYDE].entity.coord = game_data.level->ghost_start[GHOST_CLYDE];
-    game_data.ghosts[GHOST_INKY].entity.coord = game_data.level->ghost_start[GHOST_INKY];
-}
-
-static void start_next_level(bool reset) {
-    if(!game_data.atlas) {
-        game_data.atlas = load_texture("data/texture_atlas.bmp", 0xff00ff);
+    memset(&ctx->player, 0, sizeof(ctx->player));
+    memset(&ctx->ghosts, 0, sizeof(ctx->ghosts));
+
+    ctx->player.input_queue.target = INPUT_QUEUE_TIME_MAX;
+    ctx->player.entity.dir = MOVEMENT_DIR_NONE;
+    ctx->player.entity.facing = MOVEMENT_DIR_RIGHT;
+    ctx->player.entity.default_speed = FIXED_FROM_FLOAT(DEFAULT_MOVEMENT_SPEED);
+    ctx->player.entity.speed = ctx->player.entity.default_speed;
+
+    for(int32_t i = 0; i < GHOST_COUNT; i++) {
+        ctx->ghosts[i].entity.dir = MOVEMENT_DIR_UP;
+        ctx->ghosts[i].entity.facing = MOVEMENT_DIR_RIGHT;
+        ctx->ghosts[i].state = GHOST_STATE_SCATTER;
+        ctx->ghosts[i].entity.coord.sub.x = 0;
+        ctx->ghosts[i].entity.coord.sub.y = 0;
+        ctx->ghosts[i].in_ghost_house = true;
+        ctx->ghosts[i].eaten_anim_timer = TIMER_NONE;
     }
 
-    game_data.mode = GAME_MODE_SCATTER;
-    game_data.ghost_mode_timer.running = true;
-    game_data.ghost_mode_timer.elapsed = 0.0f;
-    game_data.ghost_mode_timer.target = SCATTER_MODE_TIME;
-    game_data.frightened_timer.running = false;
-    game_data.frightened_timer.elapsed = 0.0f;
-    game_data.frightened_timer.target = FRIGHTENED_MODE_TIME;
+    ctx->ghosts[GHOST_BLINKY].entity.dir = MOVEMENT_DIR_RIGHT;
+    ctx->ghosts[GHOST_BLINKY].in_ghost_house = false;
 
-    if(game_data.level) {
-        unload_level(&game_data.level);
+    const GhostBehaviors *behaviors = ctx->assets->behaviors;
+    for(int32_t i = 0; i < GHOST_COUNT; i++) {
+        GhostEntity *ghost = &ctx->ghosts[i];
+        float speed = get_ghost_speed(ctx, i);
+        ghost->gate_pass_percentage = default_gate_pass_percentages[i];
+
+        if(behaviors && behaviors->ghosts[i].gate_pass_percentage >= 0.0f) {
+            ghost->gate_pass_percentage = behaviors->ghosts[i].gate_pass_percentage;
+        }
+
+        ghost->entity.default_speed = FIXED_FROM_FLOAT(speed);
+        ghost->entity.speed = ghost->entity.default_speed;
     }
 
-    game_data.level = reset ? load_first_level() : load_next_level();
-    set_starting_data();
+    ctx->camera.scroll.x = 0;
+    ctx->camera.scroll.y = 0;
+    camera_set_default_offset(ctx);
+    ctx->camera.zoom = 1.0f;
+
+    set_game_state(ctx, GAME_STATE_READY);
+
+    ctx->player.entity.coord = ctx->level->player_start;
+    ctx->ghosts[GHOST_BLINKY].entity.coord = ctx->level->ghost_start[GHOST_BLINKY];
+    ctx->ghosts[GHOST_PINKY].entity.coord = ctx->level->ghost_start[GHOST_PINKY];
+    ctx->ghosts[GHOST_CLYDE].entity.coord = ctx->level->ghost_start[GHOST_CLYDE];
+    ctx->ghosts[GHOST_INKY].entity.coord = ctx->level->ghost_start[GHOST_INKY];
 }
 
-static void reset_game(void) {
-    game_data.lives = LIVES_COUNT_START;
-    game_data.score = 0;
+static void start_next_level(GameContext *ctx, bool reset) {
+    ctx->mode = GAME_MODE_SCATTER;
+    stop_wheel_timer(&ctx->timers, ctx->ghost_mode_timer);
+    stop_wheel_timer(&ctx->timers, ctx->frightened_timer);
+    ctx->ghost_mode_timer = start_game_timer(ctx, SCATTER_MODE_TIME, TIMER_EVENT_GHOST_MODE);
+    ctx->frightened_timer = TIMER_NONE;
 
-    start_next_level(true);
+    ctx->level_index = reset ? 0 : (ctx->level_index + 1) % ctx->assets->level_count;
+
+    const Level *level = ctx->assets->levels[ctx->level_index];
+    assert(get_level_size(level) <= ctx->level_capacity);
+    memcpy(ctx->level, level, get_level_size(level));
+    set_starting_data(ctx);
 }
 
-static inline void check_gl_status(GLuint id, GLenum parameter) {
-    GLint status;
-    static char error_log[512];
+static void reset_game(GameContext *ctx) {
+    ctx->lives = LIVES_COUNT_START;
+    ctx->score = 0;
 
-    if(parameter == GL_COMPILE_STATUS) {
-        glGetShaderiv(id, parameter, &status);
-        if(status != GL_TRUE) {
-            glGetShaderInfoLog(id, sizeof(error_log), NULL, error_log);
-            if(status == 0) {
-                fprintf(stderr, "Could not compile the shader!\n");
-                exit(-1);
-            }
+    init_timer_wheel(&ctx->timers);
+    ctx->ghost_mode_timer = TIMER_NONE;
+    ctx->frightened_timer = TIMER_NONE;
+    for(int32_t i = 0; i < GHOST_COUNT; i++) {
+        ctx->ghosts[i].eaten_anim_timer = TIMER_NONE;
+    }
+
+    start_next_level(ctx, true);
+}
+
+#define LEVEL_SOURCE_NO_PACK_ENTRY UINT32_MAX
+
+// A level can be in the pack, in data/level or in both, then the pack's is used
+// unless the file has changed since the pack was made
+typedef struct {
+    uint32_t pack_entry;
+    const char *file_name; // NULL if there's no loose file
+    const char *name; // Either one, for sorting
+} LevelSource;
+
+typedef struct {
+    const Pack *pack;
+    const LevelSource *sources;
+    Level **levels;
+    LevelGraph **graphs;
+    bool *levels_in_pack;
+} LevelLoadJobs;
+
+// The games only ever copy the levels loaded here, so all of the file reads and
+// parsing happen up front. Each level is loaded and gets its graph on one of the
+// worker threads.
+static void load_level_job(void *data, uint32_t index) {
+    LevelLoadJobs *jobs = data;
+    const LevelSource *source = &jobs->sources[index];
+
+    if(source->pack_entry != LEVEL_SOURCE_NO_PACK_ENTRY) {
+        size_t size = 0;
+        const void *compiled = get_pack_entry(jobs->pack, source->pack_entry, &size);
+        const Level *level = NULL;
+
+        if(compiled && source->file_name && compiled_level_out_of_date(compiled, size, source->file_name)) {
+            fprintf(stderr, "data/level/%s has changed since the pack was made, it's used instead\n",
+                    source->file_name);
+        } else if(compiled && open_compiled_level(compiled, size, &level, &jobs->graphs[index])) {
+            // Levels in the pack are used in place, they're never written or freed
+            jobs->levels[index] = (Level *)level;
+            jobs->levels_in_pack[index] = true;
+            return;
+        } else if(compiled) {
+            fprintf(stderr, "%s in the pack isn't a compiled level of version %d\n",
+                    get_pack_entry_name(jobs->pack, source->pack_entry), COMPILED_LEVEL_VERSION);
         }
-    } else if(parameter == GL_LINK_STATUS) {
-        glGetProgramiv(id, parameter, &status);
-        if(status != GL_TRUE) {
-            glGetProgramInfoLog(id, sizeof(error_log), NULL, error_log);
-            if(status == 0) {
-                fprintf(stderr, "Could not link the GL program!\n");
-                exit(-1);
-            }
+    }
+
+    if(source->file_name) {
+        load_level_and_graph(source->file_name, &jobs->levels[index], &jobs->graphs[index]);
+    }
+}
+
+static bool is_pack_level(const char *name) {
+    size_t length = strlen(name);
+    return strncmp(name, "level/", 6) == 0 && length > 10 && strcmp(&name[length - 4], ".lvl") == 0;
+}
+
+// Pack entries are level/<name>.lvl and the loose files <name>.csv, which both
+// sort by <name> followed by the dot
+static size_t get_level_name_length(const char *name) {
+    const char *extension = strrchr(name, '.');
+    return extension ? (size_t)(extension - name) : strlen(name);
+}
+
+static int compare_level_sources(const void *lhs, const void *rhs) {
+    const LevelSource *a = lhs;
+    const LevelSource *b = rhs;
+    size_t a_length = get_level_name_length(a->name);
+    size_t b_length = get_level_name_length(b->name);
+
+    for(size_t i = 0; i <= MAX(a_length, b_length); i++) {
+        uint8_t a_char = (i < a_length) ? (uint8_t)a->name[i] : '.';
+        uint8_t b_char = (i < b_length) ? (uint8_t)b->name[i] : '.';
+        if(a_char != b_char) {
+            return (a_char < b_char) ? -1 : 1;
+        }
+    }
+
+    // For the same name the pack's comes first, so the two can be put together
+    if(a_length != b_length) {
+        return (a_length < b_length) ? -1 : 1;
+    }
+    return (a->file_name ? 1 : 0) - (b->file_name ? 1 : 0);
+}
+
+static bool same_level_name(const LevelSource *a, const LevelSource *b) {
+    size_t length = get_level_name_length(a->name);
+    return length == get_level_name_length(b->name) && memcmp(a->name, b->name, length) == 0;
+}
+
+// A level that is both in the pack and in data/level is only loaded once
+static uint32_t find_level_sources(const Pack *pack, const LevelFileData *files, LevelSource *sources) {
+    uint32_t count = 0;
+    for(uint32_t i = 0; pack && i < get_pack_entry_count(pack); i++) {
+        if(is_pack_level(get_pack_entry_name(pack, i))) {
+            LevelSource source = { i, NULL, get_pack_entry_name(pack, i) + 6 };
+            sources[count++] = source;
+        }
+    }
+    for(uint32_t i = 0; i < files->count; i++) {
+        LevelSource source = { LEVEL_SOURCE_NO_PACK_ENTRY, get_level_file_name(files, i), get_level_file_name(files, i) };
+        sources[count++] = source;
+    }
+
+    qsort(sources, count, sizeof(*sources), compare_level_sources);
+
+    uint32_t merged = 0;
+    for(uint32_t i = 0; i < count; i++) {
+        LevelSource *source = &sources[i];
+        if(i + 1 < count && !source->file_name && sources[i + 1].file_name && same_level_name(source, &sources[i + 1])) {
+            source->file_name = sources[++i].file_name;
         }
+
+        sources[merged++] = *source;
     }
+
+    return merged;
 }
 
-static void resize_window(int32_t new_width, int32_t new_height) {
-    new_width = MAX(DEFAULT_WINDOW_WIDTH, new_width);
-    new_height = MAX(DEFAULT_WINDOW_HEIGHT, new_height);
+static void load_game_levels(GameAssets *assets) {
+    LevelFileData level_files = { 0 };
+    init_level_names(&level_files);
 
-    float aspect_ratio = (float)DEFAULT_FRAMEBUFFER_WIDTH / (float)DEFAULT_FRAMEBUFFER_HEIGHT;
-    float w = (float)new_width;
-    float h = w / aspect_ratio;
+    uint32_t max_count = level_files.count + (assets->pack ? get_pack_entry_count(assets->pack) : 0);
+    LevelSource *sources = malloc(MAX(max_count, 1) * sizeof(*sources));
+    uint32_t count = sources ? find_level_sources(assets->pack, &level_files, sources) : 0;
 
-    if(h > new_height) {
-        h = (float)new_height;
-        w = h * aspect_ratio;
+    assets->levels = calloc(MAX(count, 1), sizeof(*assets->levels));
+    assets->graphs = calloc(MAX(count, 1), sizeof(*assets->graphs));
+    assets->levels_in_pack = calloc(MAX(count, 1), sizeof(*assets->levels_in_pack));
+    if(!assets->levels || !assets->graphs || !assets->levels_in_pack) {
+        count = 0;
     }
 
-    GLint x = (new_width - (GLint)w) / 2;
-    GLint y = (new_height - (GLint)h) / 2;
+    LevelLoadJobs jobs = { assets->pack, sources, assets->levels, assets->graphs, assets->levels_in_pack };
+    run_parallel_jobs(load_level_job, &jobs, count);
 
-    glViewport(x, y, (GLsizei)w, (GLsizei)h);
+    // Closes the gaps left by the levels that didn't load
+    for(uint32_t i = 0; i < count; i++) {
+        if(assets->levels[i]) {
+            assets->graphs[assets->level_count] = assets->graphs[i];
+            assets->levels_in_pack[assets->level_count] = assets->levels_in_pack[i];
+            assets->levels[assets->level_count++] = assets->levels[i];
+        }
+    }
+
+    free(sources);
+    destroy_level_names(&level_files);
 }
 
-static void initialize_opengl(void) {
-    // Setup core OpenGL
-    static const char *vertex_shader_source = {
-        "#version 330 core\n"
-        "layout(location = 0) in vec2 pos;\n"
-        "layout(location = 1) in vec2 uvs;\n"
-        "out vec2 texcoords;\n"
-        "uniform vec3 camera;\n"
-        "void main(void) {\n"
-        "    texcoords = ((vec2(uvs.s, 1.0 - uvs.t) - vec2(0.5))* camera.z) + camera.xy;\n"
-        "    gl_Position = vec4(pos, 0.0, 1.0);\n"
-        "}"
-    };
-    static const char *fragment_shader_source = {
-        "#version 330 core\n"
-        "uniform sampler2D sampler;\n"
-        "in vec2 texcoords;\n"
-        "out vec4 out_color;\n"
-        "void main(void) {\n"
-        "    out_color = texture(sampler, texcoords);\n"
-        "}"
-    };
-    gl_program = glCreateProgram();
-    GLuint vertex_shader = glCreateShader(GL_VERTEX_SHADER);
-    GLuint fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
+GameAssets * create_game_assets(void) {
+    GameAssets *assets = calloc(1, sizeof(*assets));
 
-    glShaderSource(vertex_shader, 1, &vertex_shader_source, NULL);
-    glShaderSource(fragment_shader, 1, &fragment_shader_source, NULL);
+    // Anything that isn't in the pack comes from the loose files in data/
+#ifdef PACMAN_EMBED_ASSETS
+    assets->pack = open_pack_in_memory(embedded_pack, embedded_pack_size);
+#else
+    assets->pack = open_pack(PACK_PATH);
+#endif
+    load_game_levels(assets);
+
+    // The file is optional, without it the ghosts behave as built in
+    char error[256] = { 0 };
+    size_t size = 0;
+    const char *source = assets->pack ? find_pack_entry(assets->pack, "ghosts.txt", &size) : NULL;
+    if(source) {
+        assets->behaviors = compile_ghost_behaviors(source, error, sizeof(error));
+    } else {
+        assets->behaviors = load_ghost_behaviors("data/ghosts.txt", error, sizeof(error));
+    }
+    if(!assets->behaviors && error[0]) {
+        fprintf(stderr, "data/ghosts.txt: %s\n", error);
+    }
 
-    glCompileShader(vertex_shader);
-    check_gl_status(vertex_shader, GL_COMPILE_STATUS);
-    glCompileShader(fragment_shader);
-    check_gl_status(fragment_shader, GL_COMPILE_STATUS);
+#ifndef PACMAN_HEADLESS
+    // The pack has the atlas already decoded, so it's used in place
+    const void *atlas = assets->pack ? find_pack_entry(assets->pack, "texture_atlas.tex", &size) : NULL;
+    assets->atlas = atlas ? (Texture2D *)open_decoded_texture(atlas, size) : NULL;
+    assets->atlas_in_pack = (assets->atlas != NULL);
+    if(!assets->atlas) {
+        assets->atlas = load_texture("data/texture_atlas.bmp", ATLAS_CHROMA_KEY);
+    }
+#endif
 
-    glAttachShader(gl_program, vertex_shader);
-    glAttachShader(gl_program, fragment_shader);
+    if(assets->level_count == 0) {
+        destroy_game_assets(&assets);
+    }
 
-    glLinkProgram(gl_program);
-    check_gl_status(gl_program, GL_LINK_STATUS);
+    return assets;
+}
 
-    glUseProgram(gl_program);
+void destroy_game_assets(GameAssets **assets) {
+    if(assets && *assets) {
+        for(uint32_t i = 0; i < (*assets)->level_count; i++) {
+            if(!(*assets)->levels_in_pack[i]) {
+                unload_level(&(*assets)->levels[i]);
+            }
+            destroy_level_graph(&(*assets)->graphs[i]);
+        }
+        destroy_ghost_behaviors(&(*assets)->behaviors);
 
-    glDetachShader(gl_program, vertex_shader);
-    glDetachShader(gl_program, fragment_shader);
+#ifndef PACMAN_HEADLESS
+        if(!(*assets)->atlas_in_pack) {
+            destroy_texture(&(*assets)->atlas);
+        }
+#endif
+        free((*assets)->levels);
+        free((*assets)->graphs);
+        free((*assets)->levels_in_pack);
+        close_pack(&(*assets)->pack);
+        free(*assets);
+        *assets = NULL;
+    }
+}
 
-    glDeleteShader(vertex_shader);
-    glDeleteShader(fragment_shader);
+uint32_t get_game_level_count(const GameAssets *assets) {
+    return assets ? assets->level_count : 0;
+}
 
-    static const GLfloat vertex_buffer_data[] = {
-        // Position       // UV coordinates
-        -1.0f, -1.0f,     0.0f, 0.0f,
-         1.0f, -1.0f,     1.0f, 0.0f,
-         1.0f,  1.0f,     1.0f, 1.0f,
+size_t build_game_next_hops(GameAssets *assets, uint32_t level) {
+    assert(assets && level < assets->level_count);
+    return build_level_next_hops(assets->levels[level], assets->graphs[level]);
+}
 
-         1.0f,  1.0f,     1.0f, 1.0f,
-        -1.0f,  1.0f,     0.0f, 1.0f,
-        -1.0f, -1.0f,     0.0f, 0.0f,
-    };
+bool load_game_ghost_behaviors(GameAssets *assets, const char *path) {
+    assert(assets);
 
-    GLuint vao, vbo;
-    glGenVertexArrays(1, &vao);
-    glBindVertexArray(vao);
-    glGenBuffers(1, &vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertex_buffer_data), vertex_buffer_data, GL_STATIC_DRAW);
+    GhostBehaviors *behaviors = NULL;
+    if(path) {
+        char error[256];
+        behaviors = load_ghost_behaviors(path, error, sizeof(error));
+        if(!behaviors) {
+            fprintf(stderr, "%s: %s\n", path, error[0] ? error : "can't be read");
+            return false;
+        }
+    }
 
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 4, NULL);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 4, (const void *)(2 * sizeof(GLfloat)));
+    destroy_ghost_behaviors(&assets->behaviors);
+    assets->behaviors = behaviors;
+    return true;
+}
 
-    glEnable(GL_TEXTURE_2D);
-    GLuint framebuffer_texture;
-    glGenTextures(1, &framebuffer_texture);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, framebuffer_texture);
+GameContext * create_game_context(const GameAssets *assets) {
+    assert(assets && assets->level_count > 0);
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    // Room for the largest level, so switching levels never moves the context
+    size_t level_capacity = 0;
+    for(uint32_t i = 0; i < assets->level_count; i++) {
+        level_capacity = MAX(level_capacity, get_level_size(assets->levels[i]));
+    }
 
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, DEFAULT_FRAMEBUFFER_WIDTH, DEFAULT_FRAMEBUFFER_HEIGHT,
-                 0, GL_RGBA, GL_FLOAT, get_framebuffer());
+    GameContext *ctx = calloc(1, sizeof(*ctx) + level_capacity);
+    if(!ctx) {
+        return NULL;
+    }
 
-    resize_window(DEFAULT_WINDOW_WIDTH, DEFAULT_WINDOW_HEIGHT);
+    ctx->assets = assets;
+    ctx->level = (Level *)ctx->level_storage;
+    ctx->level_capacity = level_capacity;
+    ctx->controlled_ghost = -1;
+    ctx->tick_time = SIMULATION_TICK_TIME;
+    seed_game(ctx, 0, 0);
+    reset_game(ctx);
 
-    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    return ctx;
 }
 
-void initialize_game(void) {
-    initialize_opengl();
-    init_levels();
-    reset_game();
+void seed_game(GameContext *ctx, uint64_t seed, uint32_t stream) {
+    assert(ctx);
+
+    seed_random_stream(&ctx->random, seed, stream);
+}
+
+size_t get_game_snapshot_size(const GameContext *ctx) {
+    assert(ctx);
+    return SNAPSHOT_LEVEL_OFFSET + get_level_size(ctx->level);
+}
+
+size_t get_game_snapshot_capacity(const GameContext *ctx) {
+    assert(ctx);
+    return SNAPSHOT_LEVEL_OFFSET + ctx->level_capacity;
+}
+
+void save_game_snapshot(const GameContext *ctx, void *buffer) {
+    assert(ctx && buffer);
+    memcpy(buffer, (const uint8_t *)ctx + SNAPSHOT_START, get_game_snapshot_size(ctx));
+}
+
+void load_game_snapshot(GameContext *ctx, const void *buffer) {
+    assert(ctx && buffer);
+
+    // The snapshot's own level header says how large it is
+    Level level;
+    memcpy(&level, (const uint8_t *)buffer + SNAPSHOT_LEVEL_OFFSET, sizeof(level));
+    size_t size = SNAPSHOT_LEVEL_OFFSET + get_level_size(&level);
+
+    assert(size <= get_game_snapshot_capacity(ctx));
+    memcpy((uint8_t *)ctx + SNAPSHOT_START, buffer, size);
 }
 
-void close_game(void) {
-    destroy_texture(&game_data.atlas);
-    close_levels();
-    unload_level(&game_data.level);
+void get_game_random_state(const GameContext *ctx, RandomState *state) {
+    assert(ctx && state);
+    *state = ctx->random;
 }
 
-static struct {
-    int32_t width;
-    int32_t height;
-    bool should_resize;
-} window_box = { 0 };
+void set_game_random_state(GameContext *ctx, const RandomState *state) {
+    assert(ctx && state);
+    ctx->random = *state;
+}
 
-void signal_window_resize(int32_t new_width, int32_t new_height) {
-    window_box.should_resize = true;
-    window_box.width = new_width;
-    window_box.height = new_height;
+void destroy_game_context(GameContext **ctx) {
+    if(ctx && *ctx) {
+        free(*ctx);
+        *ctx = NULL;
+    }
 }
 
 bool update_timer(Timer *timer, float ms) {
@@ -478,121 +729,164 @@ bool update_timer(Timer *timer, float ms) {
     return false;
 }
 
-static void update_camera_pos(void) {
-    Vector2i abs_pos = get_entity_abs_position(&game_data.player.entity);
-    game_camera.scroll.x = abs_pos.x - (DEFAULT_FRAMEBUFFER_WIDTH / 2);
-    game_camera.scroll.y = abs_pos.y - (DEFAULT_FRAMEBUFFER_HEIGHT / 2);
+static void handle_timer_event(void *data, TimerHandle timer, uint16_t event) {
+    GameContext *ctx = data;
 
-    if(game_camera.scroll.x < 0) {
-        game_camera.scroll.x = 0;
-    } else if((game_camera.scroll.x + DEFAULT_FRAMEBUFFER_WIDTH) > (TILE_COUNT_X * TILE_SIZE)) {
-        game_camera.scroll.x = TILE_COUNT_X * TILE_SIZE - DEFAULT_FRAMEBUFFER_WIDTH;
-    }
-
-    if(game_camera.scroll.y < 0) {
-        game_camera.scroll.y = 0;
-    } else if((game_camera.scroll.y + DEFAULT_FRAMEBUFFER_HEIGHT) > (TILE_COUNT_Y * TILE_SIZE)) {
-        game_camera.scroll.y = TILE_COUNT_Y * TILE_SIZE - DEFAULT_FRAMEBUFFER_HEIGHT;
-    }
-}
-
-static void update_ghost_timers(float dt) {
-    if(update_timer(&game_data.ghost_mode_timer, dt)) {
-        game_data.ghost_mode_timer.elapsed = 0.0f;
-        game_data.ghost_mode_timer.running = true;
-
-        if(game_data.mode == GAME_MODE_SCATTER) {
-            game_data.mode = GAME_MODE_CHASE;
-            game_data.ghost_mode_timer.target = CHASE_MODE_TIME;
+    if(event == TIMER_EVENT_GHOST_MODE) {
+        if(ctx->mode == GAME_MODE_SCATTER) {
+            ctx->mode = GAME_MODE_CHASE;
+            ctx->ghost_mode_timer = start_game_timer(ctx, CHASE_MODE_TIME, event);
             for(int32_t i = 0; i < GHOST_COUNT; i++) {
-                if(game_data.ghosts[i].state == GHOST_STATE_SCATTER) {
-                    game_data.ghosts[i].state = GHOST_STATE_CHASE;
+                if(ctx->ghosts[i].state == GHOST_STATE_SCATTER) {
+                    ctx->ghosts[i].state = GHOST_STATE_CHASE;
                 }
             }
         } else {
-            game_data.mode = GAME_MODE_SCATTER;
-            game_data.ghost_mode_timer.target = SCATTER_MODE_TIME;
+            ctx->mode = GAME_MODE_SCATTER;
+            ctx->ghost_mode_timer = start_game_timer(ctx, SCATTER_MODE_TIME, event);
             for(int32_t i = 0; i < GHOST_COUNT; i++) {
-                if(game_data.ghosts[i].state == GHOST_STATE_CHASE) {
-                    game_data.ghosts[i].state = GHOST_STATE_SCATTER;
+                if(ctx->ghosts[i].state == GHOST_STATE_CHASE) {
+                    ctx->ghosts[i].state = GHOST_STATE_SCATTER;
                 }
             }
         }
-    }
-
-    if(update_timer(&game_data.frightened_timer, dt)) {
+    } else if(event == TIMER_EVENT_FRIGHTENED) {
+        ctx->frightened_timer = TIMER_NONE;
         for(int32_t i = 0; i < GHOST_COUNT; i++) {
-            game_data.ghosts[i].frightened = false;
+            ctx->ghosts[i].frightened = false;
         }
+    } else {
+        GhostEntity *ghost = &ctx->ghosts[event - TIMER_EVENT_EATEN_ANIM(0)];
+        ghost->eaten_anim_timer = (ghost->state == GHOST_STATE_EATEN) ?
+            start_game_timer(ctx, DEFAULT_EATEN_ANIM_TIMER_TARGET, event) : TIMER_NONE;
     }
 }
 
-#define INPUT_PRESS(action) ((input & action) && !(game_data.player.prev_input & action))
+#define INPUT_PRESS(action) ((input & action) && !(ctx->player.prev_input & action))
+
+uint32_t get_game_events(const GameContext *ctx) {
+    return ctx->events;
+}
+
+uint32_t get_game_score(const GameContext *ctx) {
+    return ctx->score;
+}
+
+uint32_t get_game_points(const GameContext *ctx) {
+    return ctx->points;
+}
 
-bool update_loop(float dt, uint32_t input) {
-    if(window_box.should_resize) {
-        resize_window(window_box.width, window_box.height);
-        window_box.should_resize = false;
+static inline uint64_t hash_bytes(uint64_t hash, const void *data, size_t size) {
+    const uint8_t *bytes = data;
+    for(size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
     }
 
-    switch(game_data.current_state) {
+    return hash;
+}
+
+// FNV-1a over everything that affects the simulation, but not the renderer
+uint64_t get_game_state_hash(const GameContext *ctx) {
+    assert(ctx);
+
+#define HASH_FIELD(field) hash = hash_bytes(hash, &(field), sizeof(field))
+    uint64_t hash = 14695981039346656037ull;
+    HASH_FIELD(ctx->level_index);
+    HASH_FIELD(ctx->previous_state);
+    HASH_FIELD(ctx->current_state);
+    HASH_FIELD(ctx->ghosts);
+    HASH_FIELD(ctx->player);
+    HASH_FIELD(ctx->ready_timer);
+    HASH_FIELD(ctx->timers);
+    HASH_FIELD(ctx->ghost_mode_timer);
+    HASH_FIELD(ctx->frightened_timer);
+    HASH_FIELD(ctx->tick_time);
+    HASH_FIELD(ctx->lives);
+    HASH_FIELD(ctx->score);
+    HASH_FIELD(ctx->selected_menu_id);
+    HASH_FIELD(ctx->mode);
+    HASH_FIELD(ctx->random);
+    HASH_FIELD(ctx->controlled_ghost);
+    HASH_FIELD(ctx->ghost_input);
+    HASH_FIELD(ctx->ghost_pathing);
+    HASH_FIELD(ctx->camera.offset);
+    HASH_FIELD(ctx->level->pellets_eaten);
+#undef HASH_FIELD
+
+    // Tile types never change while playing, only the pellets do
+    return hash_bytes(hash, get_level_pellets(ctx->level), get_level_pellets_size(ctx->level));
+}
+
+// Runs the state machine, timers and player input for one tick. Returns false when
+// the world is paused (ready screen, menu) and nothing should move this tick
+static bool begin_simulation_tick(GameContext *ctx, float dt, uint32_t input, bool *running) {
+    ctx->events = 0;
+    ctx->points = 0;
+    ctx->tick_time = dt;
+
+    ctx->player.entity.prev_coord = ctx->player.entity.coord;
+    for(int32_t i = 0; i < GHOST_COUNT; i++) {
+        ctx->ghosts[i].entity.prev_coord = ctx->ghosts[i].entity.coord;
+    }
+
+    switch(ctx->current_state) {
         case GAME_STATE_READY:
-            update_camera_pos();
-            if(update_timer(&game_data.ready_timer, dt)) {
-                set_game_state(GAME_STATE_NORMAL);
+            if(update_timer(&ctx->ready_timer, dt)) {
+                set_game_state(ctx, GAME_STATE_NORMAL);
                 break;
             }
-            return true;
+            return false;
         case GAME_STATE_NORMAL:
             if(INPUT_PRESS(INPUT_MENU)) {
-                set_game_state(GAME_STATE_MENU);
+                set_game_state(ctx, GAME_STATE_MENU);
             }
             break;
         case GAME_STATE_MENU:
             if(INPUT_PRESS(INPUT_MENU)) {
-                set_game_state(game_data.previous_state);
+                set_game_state(ctx, ctx->previous_state);
                 break;
             } else if(INPUT_PRESS(INPUT_UP)) {
-                game_data.selected_menu_id = (game_data.selected_menu_id - 1) % MENU_ITEM_COUNT;
-                game_data.selected_menu_id = game_data.selected_menu_id + ((game_data.selected_menu_id < 0) ? MENU_ITEM_COUNT : 0);
+                ctx->selected_menu_id = (ctx->selected_menu_id - 1) % MENU_ITEM_COUNT;
+                ctx->selected_menu_id = ctx->selected_menu_id + ((ctx->selected_menu_id < 0) ? MENU_ITEM_COUNT : 0);
             } else if(INPUT_PRESS(INPUT_DOWN)) {
-                game_data.selected_menu_id = (game_data.selected_menu_id + 1) % MENU_ITEM_COUNT;
+                ctx->selected_menu_id = (ctx->selected_menu_id + 1) % MENU_ITEM_COUNT;
             }
             if(INPUT_PRESS(INPUT_CONFIRM)) {
-                switch(game_data.selected_menu_id) {
+                switch(ctx->selected_menu_id) {
                     case MENU_ITEM_CONTINUE:
-                        set_game_state(game_data.previous_state);
+                        set_game_state(ctx, ctx->previous_state);
                         break;
                     case MENU_ITEM_EXIT:
+                        *running = false;
                         return false;
                     default:
                         break;
                 }
             }
-            game_data.player.prev_input = input;
-            return true;
+            ctx->player.prev_input = input;
+            return false;
         default:
             break;
     }
 
-    camera_set_default_offset();
-    update_ghost_timers(dt);
+    camera_set_default_offset(ctx);
+    advance_timer_wheel(&ctx->timers, handle_timer_event, ctx);
 
     if(input == 0) {
-        game_data.player.prev_input &= ~INPUT_MENU; // Unset, because the input for bringing up the menu shouldn't be held on to
-        if(game_data.player.prev_input != 0 && !update_timer(&game_data.player.input_queue, dt)) {
-            input = game_data.player.prev_input;
+        ctx->player.prev_input &= ~INPUT_MENU; // Unset, because the input for bringing up the menu shouldn't be held on to
+        if(ctx->player.prev_input != 0 && !update_timer(&ctx->player.input_queue, dt)) {
+            input = ctx->player.prev_input;
         } else {
-            game_data.player.prev_input = 0;
+            ctx->player.prev_input = 0;
         }
     } else {
-        game_data.player.prev_input = input;
-        game_data.player.input_queue.elapsed = 0.0f;
-        game_data.player.input_queue.running = true;
+        ctx->player.prev_input = input;
+        ctx->player.input_queue.elapsed = 0.0f;
+        ctx->player.input_queue.running = true;
     }
 
-#define MAP_INPUT_TO_MOV_DIR(d) if(input & INPUT_##d) { game_data.player.entity.dir = MOVEMENT_DIR_##d; }
-    MovementDirection previous_dir = game_data.player.entity.dir;
+#define MAP_INPUT_TO_MOV_DIR(d) if(input & INPUT_##d) { ctx->player.entity.dir = MOVEMENT_DIR_##d; }
+    MovementDirection previous_dir = ctx->player.entity.dir;
 
     MAP_INPUT_TO_MOV_DIR(UP);
     MAP_INPUT_TO_MOV_DIR(DOWN);
@@ -602,295 +896,409 @@ bool update_loop(float dt, uint32_t input) {
 #undef MAP_INPUT_TO_MOV_DIR
 
     if(previous_dir != MOVEMENT_DIR_NONE) {
-        if(coords_within_bounds(&game_data.player.entity.coord)) {
-            bool is_quarter_turn = float_nearly_equal(dot_product(previous_dir, game_data.player.entity.dir), 0.0f);
+        if(coords_within_bounds(ctx, &ctx->player.entity.coord)) {
+            bool is_quarter_turn = float_nearly_equal(dot_product(previous_dir, ctx->player.entity.dir), 0.0f);
             if(is_quarter_turn) {
-                bool near_center = float_nearly_equal(game_data.player.entity.coord.sub.x, 0.0f) &&
-                    float_nearly_equal(game_data.player.entity.coord.sub.y, 0.0f);
+                bool near_center = sub_tile_near_center(ctx->player.entity.coord.sub.x) &&
+                    sub_tile_near_center(ctx->player.entity.coord.sub.y);
 
                 if(near_center) {
-                    TileCoord projected = game_data.player.entity.coord;
-                    tile_coords_from_direction(&projected, game_data.player.entity.dir);
-                    if(tile_is_wall(&projected, NULL)) {
+                    uint32_t exits = get_entity_exits(ctx, &ctx->player.entity, false, true);
+                    if(!(exits & (1 << ctx->player.entity.dir))) {
                         // Make sure we're not stopped by walls if we try to
                         // move 90 degrees clockwise or counterclockwise
-                        game_data.player.entity.dir = previous_dir;
+                        ctx->player.entity.dir = previous_dir;
                     }
                 } else {
-                    game_data.player.entity.dir = previous_dir;
+                    ctx->player.entity.dir = previous_dir;
                 }
             }
         } else {
-            game_data.player.entity.dir = previous_dir;
+            ctx->player.entity.dir = previous_dir;
         }
 
-        game_data.player.entity.facing = game_data.player.entity.dir;
+        ctx->player.entity.facing = ctx->player.entity.dir;
     }
 
-    TileCoord next_tile;
-    move_entity(&game_data.player.entity, &next_tile, dt);
-    if(tile_is_wall(&next_tile, NULL)) {
-        Rect player_rect, wall_rect;
-        tilecoord_to_rect(&game_data.player.entity.coord, &player_rect, 1.0f);
-        tilecoord_to_rect(&next_tile, &wall_rect, 1.0f);
-
-        if(rect_aabb_test(&player_rect, &wall_rect)) {
-            wrap_tile_coords(&game_data.player.entity.coord, true);
-            game_data.player.prev_input = 0;
-            game_data.player.input_queue.elapsed = 0.0f;
-
-            game_data.player.entity.coord.sub.x = 0.0f;
-            game_data.player.entity.coord.sub.y = 0.0f;
-            game_data.player.entity.dir = MOVEMENT_DIR_NONE;
+    return true;
+}
+
+static void finish_player_movement(GameContext *ctx, const TileCoord *next_tile) {
+    if(tile_is_wall(ctx, next_tile, NULL)) {
+        if(tilecoords_overlap(&ctx->player.entity.coord, next_tile, FIXED_ONE, FIXED_ONE)) {
+            wrap_tile_coords(ctx, &ctx->player.entity.coord, true);
+            ctx->player.prev_input = 0;
+            ctx->player.input_queue.elapsed = 0.0f;
+
+            ctx->player.entity.coord.sub.x = 0;
+            ctx->player.entity.coord.sub.y = 0;
+            ctx->player.entity.dir = MOVEMENT_DIR_NONE;
         }
     }
 
-    uint32_t *player_tile = get_level_tile(game_data.level, game_data.player.entity.coord.x,
-                                           game_data.player.entity.coord.y);
-    if(player_tile) {
-        if(*player_tile == ATLAS_SPRITE_PELLET) {
-            game_data.level->pellets_eaten++;
-            *player_tile = ATLAS_SPRITE_EMPTY;
+    if(coords_within_bounds(ctx, &ctx->player.entity.coord)) {
+        uint32_t index = get_level_tile_index(ctx->level, ctx->player.entity.coord.x,
+                                              ctx->player.entity.coord.y);
+        uint8_t type = level_tile_has_pellet(ctx->level, index) ? ctx->level->data[index] : ATLAS_SPRITE_EMPTY;
+
+        if(type == ATLAS_SPRITE_PELLET) {
+            ctx->level->pellets_eaten++;
+            clear_level_pellet(ctx->level, index);
 
-            increase_player_score(SCORE_PELLET_EATEN);
-            camera_shake();
-        } else if(*player_tile == ATLAS_SPRITE_POWER_PELLET) {
-            game_data.level->pellets_eaten++;
-            *player_tile = ATLAS_SPRITE_EMPTY;
+            increase_player_score(ctx, SCORE_PELLET_EATEN);
+            ctx->events |= GAME_EVENT_PELLET_EATEN;
+            camera_shake(ctx);
+        } else if(type == ATLAS_SPRITE_POWER_PELLET) {
+            ctx->level->pellets_eaten++;
+            clear_level_pellet(ctx->level, index);
 
-            game_data.frightened_timer.running = true;
-            game_data.frightened_timer.elapsed = 0.0f;
+            stop_wheel_timer(&ctx->timers, ctx->frightened_timer);
+            ctx->frightened_timer = start_game_timer(ctx, FRIGHTENED_MODE_TIME, TIMER_EVENT_FRIGHTENED);
 
             for(int32_t i = 0; i < GHOST_COUNT; i++) {
-                if(game_data.ghosts[i].state != GHOST_STATE_EATEN) {
-                    game_data.ghosts[i].frightened = true;
+                if(ctx->ghosts[i].state != GHOST_STATE_EATEN) {
+                    ctx->ghosts[i].frightened = true;
                 }
             }
 
-            increase_player_score(SCORE_POWER_PELLET_EATEN);
-            camera_shake();
+            increase_player_score(ctx, SCORE_POWER_PELLET_EATEN);
+            ctx->events |= GAME_EVENT_POWER_PELLET_EATEN;
+            camera_shake(ctx);
         }
 
-        if(game_data.level->pellets_eaten == game_data.level->pellet_count) {
-            start_next_level(false);
+        if(ctx->level->pellets_eaten == ctx->level->pellet_count) {
+            ctx->events |= GAME_EVENT_LEVEL_CLEARED;
+            start_next_level(ctx, false);
         }
     }
+}
 
-    for(int32_t i = 0; i < GHOST_COUNT; i++) {
-        TileCoord old_tile = game_data.ghosts[i].entity.coord;
-        set_ghost_speed(&game_data.ghosts[i]);
-        move_entity(&game_data.ghosts[i].entity, NULL, dt);
+// Points the target at the neighbor that is closest to the gate, scatter corner or
+// chase target through the maze, which the greedy choice then takes
+static void set_shortest_path_target(GameContext *ctx, GhostEntity *ghost, int32_t i, uint32_t index,
+                                     uint32_t candidates, bool gate_open) {
+    const LevelGraph *graph = get_level_graph(ctx);
+
+    uint32_t field;
+    if(gate_open) {
+        field = LEVEL_GATE_FIELD;
+    } else if(!ghost->frightened && ghost->state == GHOST_STATE_SCATTER) {
+        field = LEVEL_SCATTER_FIELD(i);
+    } else {
+        // Chase targets can be anywhere, including walls and off the level
+        uint32_t dir;
+        if(!ghost->frightened && graph->next_hops && level_coords_valid(ctx->level, ghost->target.x, ghost->target.y) &&
+           get_level_next_hop(graph->next_hops, index, get_level_tile_index(ctx->level, ghost->target.x, ghost->target.y), &dir) &&
+           (candidates & (1 << dir))) {
+            ghost->target.x = ghost->entity.coord.x + (int32_t)direction_vectors[dir].x;
+            ghost->target.y = ghost->entity.coord.y + (int32_t)direction_vectors[dir].y;
+        }
+
+        return;
+    }
 
-        MovementDirection ghost_dir = game_data.ghosts[i].entity.dir;
+    const uint16_t *distances = get_level_distance_field(graph, field);
+    uint32_t best_distance = LEVEL_DISTANCE_UNREACHABLE;
 
-        if(ghost_dir == MOVEMENT_DIR_NONE ||
-           (old_tile.x == game_data.ghosts[i].entity.coord.x &&
-            old_tile.y == game_data.ghosts[i].entity.coord.y)) {
-            continue;
+    for(int32_t dir = 0; dir < 4; dir++) {
+        if(candidates & (1 << dir)) {
+            uint32_t distance = distances[get_neighboring_tile_index(ctx->level, index, (TileNeighbor)dir)];
+            if(distance < best_distance) {
+                best_distance = distance;
+                ghost->target.x = ghost->entity.coord.x + (int32_t)direction_vectors[dir].x;
+                ghost->target.y = ghost->entity.coord.y + (int32_t)direction_vectors[dir].y;
+            }
         }
+    }
+}
 
-        game_data.ghosts[i].target.sub.x = 0.0f;
-        game_data.ghosts[i].target.sub.y = 0.0f;
+// Called after a ghost moved. When it entered a new tile this updates its state and
+// target, and returns the directions it may take from here (one bit per direction)
+static uint32_t begin_ghost_steering(GameContext *ctx, int32_t i, const TileCoord *old_tile) {
+    GhostEntity *ghost = &ctx->ghosts[i];
+    MovementDirection ghost_dir = ghost->entity.dir;
 
-        TileCoord current = game_data.ghosts[i].entity.coord;
-        if(ghost_can_pass_gate(&game_data.ghosts[i]) &&
-           get_level_tile_data(game_data.level, &current) == ATLAS_SPRITE_GHOST_HOUSE_GATE) {
+    if(ghost_dir == MOVEMENT_DIR_NONE ||
+       (old_tile->x == ghost->entity.coord.x &&
+        old_tile->y == ghost->entity.coord.y)) {
+        return 0;
+    }
 
-            game_data.ghosts[i].in_ghost_house = game_data.ghosts[i].state == GHOST_STATE_EATEN;
-            if(game_data.ghosts[i].in_ghost_house) {
-                game_data.ghosts[i].eaten_anim_timer.running = false;
-                game_data.ghosts[i].eaten_anim_timer.elapsed = 0.0f;
-            }
+    ghost->target.sub.x = 0;
+    ghost->target.sub.y = 0;
+
+    // Between junctions there is only one way on, so there's nothing to decide
+    const LevelGraph *graph = get_level_graph(ctx);
+    uint32_t index = get_level_tile_index(ctx->level, ghost->entity.coord.x, ghost->entity.coord.y);
+    if(level_tile_is_corridor(graph, index)) {
+        return get_level_exits(graph, index, false, false) & get_forward_exits(ghost_dir);
+    }
 
-            game_data.ghosts[i].state = (game_data.mode == GAME_MODE_SCATTER) ?
-                GHOST_STATE_SCATTER : GHOST_STATE_CHASE;
+    if(ghost_can_pass_gate(ctx, ghost) && ctx->level->data[index] == ATLAS_SPRITE_GHOST_HOUSE_GATE) {
+        ghost->in_ghost_house = ghost->state == GHOST_STATE_EATEN;
+        if(ghost->in_ghost_house) {
+            stop_wheel_timer(&ctx->timers, ghost->eaten_anim_timer);
+            ghost->eaten_anim_timer = TIMER_NONE;
         }
 
-        set_ghost_behavior(&game_data.ghosts[i], i);
+        ghost->state = (ctx->mode == GAME_MODE_SCATTER) ?
+            GHOST_STATE_SCATTER : GHOST_STATE_CHASE;
+    }
 
-        MovementDirection best_dir = MOVEMENT_DIR_NONE;
-        int32_t dist = INT_MAX;
-        for(int32_t dir = 0; dir < 4; dir++) {
-            if(dot_product(ghost_dir, dir) >= 0.0f) {
-                int32_t next_x = game_data.ghosts[i].entity.coord.x + (int32_t)direction_vectors[dir].x;
-                int32_t next_y = game_data.ghosts[i].entity.coord.y + (int32_t)direction_vectors[dir].y;
+    set_ghost_behavior(ctx, ghost, i);
 
-                TileCoord temp = {
-                    .x = next_x,
-                    .y = next_y
-                };
+    bool gate_open = ghost_can_pass_gate(ctx, ghost);
+    if(gate_open) {
+        ghost->target = ctx->level->gate_tile;
+    }
 
-                if(next_x >= 0 && next_x < TILE_COUNT_X &&
-                   next_y >= 0 && next_y < TILE_COUNT_Y &&
-                   !tile_is_wall(&temp, &game_data.ghosts[i])) {
+    // Ghosts never turn into a tunnel
+    uint32_t candidates = get_level_exits(graph, index, gate_open, false) & get_forward_exits(ghost_dir);
+    if(ctx->ghost_pathing == GHOST_PATHING_SHORTEST) {
+        set_shortest_path_target(ctx, ghost, i, index, candidates, gate_open);
+    }
 
-                    int32_t dist_x = game_data.ghosts[i].target.x - next_x;
-                    int32_t dist_y = game_data.ghosts[i].target.y - next_y;
-                    int32_t squared_dist = dist_x * dist_x + dist_y * dist_y;
+    return candidates;
+}
 
-                    if(squared_dist < dist) {
-                        dist = squared_dist;
-                        best_dir = (MovementDirection)dir;
-                    }
-                }
+// Picks the candidate direction whose next tile is closest to the ghost's target
+static MovementDirection pick_ghost_direction(const GhostEntity *ghost, uint32_t candidates) {
+    MovementDirection best_dir = MOVEMENT_DIR_NONE;
+    int32_t dist = INT_MAX;
+
+    for(int32_t dir = 0; dir < 4; dir++) {
+        if(candidates & (1 << dir)) {
+            int32_t dist_x = ghost->target.x - (ghost->entity.coord.x + (int32_t)direction_vectors[dir].x);
+            int32_t dist_y = ghost->target.y - (ghost->entity.coord.y + (int32_t)direction_vectors[dir].y);
+            int32_t squared_dist = dist_x * dist_x + dist_y * dist_y;
+
+            if(squared_dist < dist) {
+                dist = squared_dist;
+                best_dir = (MovementDirection)dir;
             }
         }
+    }
 
-        if(best_dir != MOVEMENT_DIR_NONE) {
-            game_data.ghosts[i].entity.dir = best_dir;
-            if(best_dir == MOVEMENT_DIR_LEFT ||
-               best_dir == MOVEMENT_DIR_RIGHT) {
-                game_data.ghosts[i].entity.facing = best_dir;
-            }
+    return best_dir;
+}
+
+// The controlled ghost takes the second player's direction whenever it can go
+// that way, and falls back to its AI choice otherwise
+static MovementDirection steer_controlled_ghost(const GameContext *ctx, int32_t i, uint32_t candidates,
+                                                MovementDirection ai_dir) {
+    const GhostEntity *ghost = &ctx->ghosts[i];
+    if(i != ctx->controlled_ghost || ghost->state == GHOST_STATE_EATEN || ghost->in_ghost_house) {
+        return ai_dir;
+    }
+
+    static const uint32_t direction_inputs[4] = { INPUT_UP, INPUT_LEFT, INPUT_DOWN, INPUT_RIGHT };
+    for(int32_t dir = 0; dir < 4; dir++) {
+        if((ctx->ghost_input & direction_inputs[dir]) && (candidates & (1 << dir))) {
+            return (MovementDirection)dir;
+        }
+    }
+
+    return ai_dir;
+}
+
+static void set_ghost_direction(GhostEntity *ghost, MovementDirection dir) {
+    if(dir != MOVEMENT_DIR_NONE) {
+        ghost->entity.dir = dir;
+        if(dir == MOVEMENT_DIR_LEFT || dir == MOVEMENT_DIR_RIGHT) {
+            ghost->entity.facing = dir;
         }
     }
+}
 
-    handle_player_ghosts_collisions(dt);
-    update_camera_pos();
+// Scalar reference for update_ghost_lanes, one ghost at a time
+static void update_ghosts(GameContext *ctx, float dt) {
+    for(int32_t i = 0; i < GHOST_COUNT; i++) {
+        TileCoord old_tile = ctx->ghosts[i].entity.coord;
+        set_ghost_speed(&ctx->ghosts[i]);
+        move_entity(ctx, &ctx->ghosts[i].entity, NULL, dt);
+
+        uint32_t candidates = begin_ghost_steering(ctx, i, &old_tile);
+        MovementDirection dir = pick_ghost_direction(&ctx->ghosts[i], candidates);
+        set_ghost_direction(&ctx->ghosts[i], steer_controlled_ghost(ctx, i, candidates, dir));
+    }
+
+    handle_player_ghosts_collisions(ctx);
+}
+
+bool update_loop(GameContext *ctx, float dt, uint32_t input) {
+    bool running = true;
+    if(!begin_simulation_tick(ctx, dt, input, &running)) {
+        return running;
+    }
+
+    TileCoord next_tile;
+    move_entity(ctx, &ctx->player.entity, &next_tile, dt);
+    finish_player_movement(ctx, &next_tile);
+
+    if(ctx->scalar_ghosts) {
+        update_ghosts(ctx, dt);
+    } else {
+        update_ghost_lanes(ctx, dt);
+    }
 
     return true;
 }
 
-void handle_player_ghosts_collisions(float dt) {
-    Rect player_rect;
-    tilecoord_to_rect(&game_data.player.entity.coord, &player_rect, 0.75f);
-    for(int32_t i = 0; i < GHOST_COUNT; i++) {
-        GhostEntity *ghost = &game_data.ghosts[i];
-        Rect ghost_rect;
-        tilecoord_to_rect(&ghost->entity.coord, &ghost_rect, 0.75f);
+bool update_versus_loop(GameContext *ctx, float dt, uint32_t input, uint32_t ghost_input) {
+    assert(ctx);
 
-        if(update_timer(&ghost->eaten_anim_timer, dt) && ghost->state == GHOST_STATE_EATEN) {
-            ghost->eaten_anim_timer.elapsed = 0.0f;
-            ghost->eaten_anim_timer.running = true;
-        }
+    ctx->ghost_input = ghost_input;
+    return update_loop(ctx, dt, input);
+}
+
+void set_game_controlled_ghost(GameContext *ctx, int32_t ghost) {
+    assert(ctx && ghost >= -1 && ghost < GHOST_COUNT);
+    ctx->controlled_ghost = ghost;
+}
+
+void set_game_ghost_pathing(GameContext *ctx, GhostPathing pathing) {
+    assert(ctx);
+    ctx->ghost_pathing = pathing;
+}
+
+void set_game_scalar_ghosts(GameContext *ctx, bool scalar) {
+    assert(ctx);
+    ctx->scalar_ghosts = scalar;
+}
+
+static void kill_player(GameContext *ctx) {
+    ctx->lives--;
+    ctx->events |= GAME_EVENT_PLAYER_DIED;
+    if(ctx->lives >= 0) {
+        set_starting_data(ctx);
+    } else {
+        ctx->events |= GAME_EVENT_GAME_OVER;
+        reset_game(ctx);
+    }
+}
+
+void handle_player_ghosts_collisions(GameContext *ctx) {
+    fixed32 player_size = PLAYER_GHOST_TOUCH_SIZE;
+    for(int32_t i = 0; i < GHOST_COUNT; i++) {
+        GhostEntity *ghost = &ctx->ghosts[i];
 
-        if(rect_aabb_test(&player_rect, &ghost_rect)) {
+        if(tilecoords_overlap(&ctx->player.entity.coord, &ghost->entity.coord, player_size, PLAYER_GHOST_TOUCH_SIZE)) {
             if(ghost->frightened) {
                 ghost->frightened = false;
                 ghost->state = GHOST_STATE_EATEN;
-                ghost->eaten_anim_timer.running = true;
-
-                increase_player_score(SCORE_GHOST_EATEN);
-                camera_shake();
-            } else if(game_data.ghosts[i].state != GHOST_STATE_EATEN) {
-                tilecoord_to_rect(&game_data.player.entity.coord, &player_rect, 0.35f);
-                tilecoord_to_rect(&ghost->entity.coord, &ghost_rect, 0.35f);
-
-                if(rect_aabb_test(&player_rect, &ghost_rect)) {
-                    game_data.lives--;
-                    if(game_data.lives >= 0) {
-                        set_starting_data();
-                    } else {
-                        reset_game();
-                    }
+                if(ghost->eaten_anim_timer == TIMER_NONE) {
+                    ghost->eaten_anim_timer = start_game_timer(ctx, DEFAULT_EATEN_ANIM_TIMER_TARGET,
+                                                               TIMER_EVENT_EATEN_ANIM(i));
+                }
+
+                increase_player_score(ctx, SCORE_GHOST_EATEN);
+                ctx->events |= GAME_EVENT_GHOST_EATEN;
+                camera_shake(ctx);
+            } else if(ctx->ghosts[i].state != GHOST_STATE_EATEN) {
+                player_size = PLAYER_GHOST_HIT_SIZE;
+
+                if(tilecoords_overlap(&ctx->player.entity.coord, &ghost->entity.coord,
+                                      PLAYER_GHOST_HIT_SIZE, PLAYER_GHOST_HIT_SIZE)) {
+                    kill_player(ctx);
                 }
             }
         }
     }
 }
 
-void tilecoord_to_rect(const TileCoord *coord, Rect *rect, float scale) {
-    static const float TILE_SIZE_F = (float)TILE_SIZE;
+// The tile an entity is heading towards, based on its current position and direction
+static void get_destination_tile(const GameContext *ctx, const GameEntity *entity, TileCoord *destination) {
+    assert(entity && destination);
 
-    if(coord && rect && scale > 0.0f) {
-        int32_t xpos = TILE_SIZE * coord->x +
-            (int32_t)(coord->sub.x * TILE_SIZE_F);
-        int32_t ypos = TILE_SIZE * coord->y +
-            (int32_t)(coord->sub.y * TILE_SIZE_F);
+    destination->sub.x = 0;
+    destination->sub.y = 0;
+    destination->x = entity->coord.x;
+    destination->y = entity->coord.y;
 
-        int32_t offset = (int32_t)(0.5f * ((1.0f - scale) * TILE_SIZE_F));
-        rect->x = xpos + offset;
-        rect->y = ypos + offset;
-        rect->width = rect->height = (uint32_t)(TILE_SIZE_F * scale);
+    if(entity->dir != MOVEMENT_DIR_NONE) {
+        destination->x += (int32_t)direction_vectors[entity->dir].x;
+        destination->y += (int32_t)direction_vectors[entity->dir].y;
     }
+
+    wrap_tile_coords(ctx, destination, false);
 }
 
-void move_entity(GameEntity *entity, TileCoord *destination, float dt) {
+void move_entity(GameContext *ctx, GameEntity *entity, TileCoord *destination, float dt) {
     if(entity) {
-        int32_t dir_x = 0;
-        int32_t dir_y = 0;
-
-        float speed = entity->speed * dt;
+        fixed32 speed = fixed_mul(entity->speed, FIXED_FROM_FLOAT(dt));
 
         switch(entity->dir) {
             case MOVEMENT_DIR_UP:
                 entity->coord.sub.y -= speed;
-                entity->coord.sub.x = 0.0f;
-                dir_y = -1;
+                entity->coord.sub.x = 0;
                 break;
             case MOVEMENT_DIR_DOWN:
                 entity->coord.sub.y += speed;
-                entity->coord.sub.x = 0.0f;
-                dir_y = 1;
+                entity->coord.sub.x = 0;
                 break;
             case MOVEMENT_DIR_LEFT:
                 entity->coord.sub.x -= speed;
-                entity->coord.sub.y = 0.0f;
-                dir_x = -1;
+                entity->coord.sub.y = 0;
                 break;
             case MOVEMENT_DIR_RIGHT:
                 entity->coord.sub.x += speed;
-                entity->coord.sub.y = 0.0f;
-                dir_x = 1;
+                entity->coord.sub.y = 0;
                 break;
             case MOVEMENT_DIR_NONE:
             default:
                 break;
         }
 
-        float intpart;
-        entity->coord.sub.x = modff(entity->coord.sub.x, &intpart);
-        entity->coord.x += (int32_t)intpart;
-        entity->coord.sub.y = modff(entity->coord.sub.y, &intpart);
-        entity->coord.y += (int32_t)intpart;
+        // Whole tiles move into the tile coordinates, C division keeps the
+        // sign of the remainder the same as the sign of the sub-tile position
+        entity->coord.x += entity->coord.sub.x / FIXED_ONE;
+        entity->coord.sub.x %= FIXED_ONE;
+        entity->coord.y += entity->coord.sub.y / FIXED_ONE;
+        entity->coord.sub.y %= FIXED_ONE;
 
-        wrap_tile_coords(&entity->coord, true);
+        wrap_tile_coords(ctx, &entity->coord, true);
 
         if(destination) {
-            destination->sub.x = 0.0f;
-            destination->sub.y = 0.0f;
-            destination->x = entity->coord.x + dir_x;
-            destination->y = entity->coord.y + dir_y;
-
-            wrap_tile_coords(destination, false);
+            get_destination_tile(ctx, entity, destination);
         }
     }
 }
 
-static void set_ghost_chase_behavior(GhostEntity *ghost, uint32_t type) {
-    assert(ghost);
-
+static void get_built_in_chase_target(const GameContext *ctx, uint32_t type, const TileCoord *coord,
+                                      TileCoord *target) {
     switch(type) {
         case GHOST_BLINKY:
-            ghost->target = game_data.player.entity.coord;
+            target->x = ctx->player.entity.coord.x;
+            target->y = ctx->player.entity.coord.y;
             break;
         case GHOST_PINKY:
-            ghost->target.x = game_data.player.entity.coord.x +
-                ((int32_t)direction_vectors[game_data.player.entity.dir].x * 4);
-            ghost->target.y = game_data.player.entity.coord.y +
-                ((int32_t)direction_vectors[game_data.player.entity.dir].y * 4);
+            target->x = ctx->player.entity.coord.x +
+                ((int32_t)direction_vectors[ctx->player.entity.dir].x * 4);
+            target->y = ctx->player.entity.coord.y +
+                ((int32_t)direction_vectors[ctx->player.entity.dir].y * 4);
             break;
         case GHOST_CLYDE: {
-            int32_t dist_x = game_data.player.entity.coord.x - ghost->entity.coord.x;
-            int32_t dist_y = game_data.player.entity.coord.y - ghost->entity.coord.y;
+            int32_t dist_x = ctx->player.entity.coord.x - coord->x;
+            int32_t dist_y = ctx->player.entity.coord.y - coord->y;
 
             if((dist_x * dist_x + dist_y * dist_y) >= 8) {
-                ghost->target = game_data.player.entity.coord;
+                target->x = ctx->player.entity.coord.x;
+                target->y = ctx->player.entity.coord.y;
             } else {
-                ghost->target.x = 8;
-                ghost->target.y = TILE_COUNT_Y;
+                target->x = 8;
+                target->y = TILE_COUNT_Y;
             }
 
             break;
         }
         case GHOST_INKY:
-            ghost->target.x = game_data.player.entity.coord.x +
-                ((int32_t)direction_vectors[game_data.player.entity.dir].x * 2);
-            ghost->target.y = game_data.player.entity.coord.y +
-                ((int32_t)direction_vectors[game_data.player.entity.dir].y * 2);
+            target->x = ctx->player.entity.coord.x +
+                ((int32_t)direction_vectors[ctx->player.entity.dir].x * 2);
+            target->y = ctx->player.entity.coord.y +
+                ((int32_t)direction_vectors[ctx->player.entity.dir].y * 2);
 
-            ghost->target.x += (ghost->target.x - game_data.ghosts[GHOST_BLINKY].entity.coord.x);
-            ghost->target.y += (ghost->target.y - game_data.ghosts[GHOST_BLINKY].entity.coord.y);
+            target->x += (target->x - ctx->ghosts[GHOST_BLINKY].entity.coord.x);
+            target->y += (target->y - ctx->ghosts[GHOST_BLINKY].entity.coord.y);
 
             break;
         default:
@@ -898,66 +1306,107 @@ static void set_ghost_chase_behavior(GhostEntity *ghost, uint32_t type) {
     }
 }
 
-static void set_ghost_default_behavior(GhostEntity *ghost, uint32_t type) {
-    assert(ghost);
+static void set_ghost_behavior_inputs(const GameContext *ctx, uint32_t type, const TileCoord *coord,
+                                      Vector2i *regs) {
+    regs[GHOST_REG_PLAYER].x = ctx->player.entity.coord.x;
+    regs[GHOST_REG_PLAYER].y = ctx->player.entity.coord.y;
+    regs[GHOST_REG_HEADING].x = (int32_t)direction_vectors[ctx->player.entity.dir].x;
+    regs[GHOST_REG_HEADING].y = (int32_t)direction_vectors[ctx->player.entity.dir].y;
+    regs[GHOST_REG_SELF].x = coord->x;
+    regs[GHOST_REG_SELF].y = coord->y;
+
+    TileCoord corner = get_level_scatter_corner(ctx->level, type);
+    regs[GHOST_REG_CORNER].x = corner.x;
+    regs[GHOST_REG_CORNER].y = corner.y;
+    regs[GHOST_REG_SIZE].x = (int32_t)ctx->level->columns;
+    regs[GHOST_REG_SIZE].y = (int32_t)ctx->level->rows;
 
-    switch(type) {
-        case GHOST_BLINKY:
-            ghost->target.x = LAST_TILE_X - 1;
-            ghost->target.y = 1;
-            break;
-        case GHOST_PINKY:
-            ghost->target.x = 1;
-            ghost->target.y = 1;
-            break;
-        case GHOST_CLYDE:
-            ghost->target.x = 1;
-            ghost->target.y = LAST_TILE_Y - 1;
-            break;
-        case GHOST_INKY:
-            ghost->target.x = LAST_TILE_X - 1;
-            ghost->target.y = LAST_TILE_Y - 1;
-            break;
-        default:
-            break;
+    for(int32_t i = 0; i < GHOST_COUNT; i++) {
+        regs[GHOST_REG_GHOSTS + i].x = ctx->ghosts[i].entity.coord.x;
+        regs[GHOST_REG_GHOSTS + i].y = ctx->ghosts[i].entity.coord.y;
+    }
+}
+
+// Where a ghost of the given type standing on coord heads when chasing or
+// scattering, from its behavior program if it has one. Only the whole tiles of
+// target change.
+static void get_ghost_target(const GameContext *ctx, const GhostBehaviors *behaviors, uint32_t type, bool chase,
+                             const TileCoord *coord, TileCoord *target) {
+    const GhostProgram *program = NULL;
+    if(behaviors) {
+        program = chase ? &behaviors->ghosts[type].chase : &behaviors->ghosts[type].scatter;
+    }
+
+    if(program && program->result != GHOST_REG_BUILT_IN) {
+        Vector2i regs[GHOST_REG_COUNT];
+        set_ghost_behavior_inputs(ctx, type, coord, regs);
+
+        Vector2i result = run_ghost_program(behaviors, program, regs);
+        target->x = result.x;
+        target->y = result.y;
+    } else if(chase) {
+        get_built_in_chase_target(ctx, type, coord, target);
+    } else {
+        TileCoord corner = get_level_scatter_corner(ctx->level, type);
+        target->x = corner.x;
+        target->y = corner.y;
+    }
+}
+
+static void get_ghost_chase_target(const GameContext *ctx, uint32_t type, const TileCoord *coord, TileCoord *target) {
+    get_ghost_target(ctx, ctx->assets->behaviors, type, true, coord, target);
+}
+
+static void get_ghost_scatter_target(const GameContext *ctx, uint32_t type, const TileCoord *coord, TileCoord *target) {
+    get_ghost_target(ctx, ctx->assets->behaviors, type, false, coord, target);
+}
+
+void get_game_ghost_targets(const GameContext *ctx, bool built_in, TileCoord *chase, TileCoord *scatter) {
+    assert(ctx && chase && scatter);
+
+    const GhostBehaviors *behaviors = built_in ? NULL : ctx->assets->behaviors;
+    for(int32_t i = 0; i < GHOST_COUNT; i++) {
+        const TileCoord *coord = &ctx->ghosts[i].entity.coord;
+        memset(&chase[i], 0, sizeof(chase[i]));
+        memset(&scatter[i], 0, sizeof(scatter[i]));
+        get_ghost_target(ctx, behaviors, i, true, coord, &chase[i]);
+        get_ghost_target(ctx, behaviors, i, false, coord, &scatter[i]);
     }
 }
 
-void set_ghost_behavior(GhostEntity *ghost, uint32_t type) {
+static void set_ghost_chase_behavior(GameContext *ctx, GhostEntity *ghost, uint32_t type) {
+    assert(ghost);
+    get_ghost_chase_target(ctx, type, &ghost->entity.coord, &ghost->target);
+}
+
+static void set_ghost_default_behavior(GameContext *ctx, GhostEntity *ghost, uint32_t type) {
+    assert(ghost);
+    get_ghost_scatter_target(ctx, type, &ghost->entity.coord, &ghost->target);
+}
+
+void set_ghost_behavior(GameContext *ctx, GhostEntity *ghost, uint32_t type) {
     if(ghost && type >= 0 && type < GHOST_COUNT) {
         if(!ghost->frightened) {
             switch(ghost->state) {
                 case GHOST_STATE_CHASE:
-                    set_ghost_chase_behavior(ghost, type);
+                    set_ghost_chase_behavior(ctx, ghost, type);
                     break;
                 case GHOST_STATE_EATEN:
-                    ghost->target = game_data.level->gate_tile;
+                    ghost->target = ctx->level->gate_tile;
                     break;
                 case GHOST_STATE_SCATTER:
                 default:
-                    set_ghost_default_behavior(ghost, type);
+                    set_ghost_default_behavior(ctx, ghost, type);
                     break;
             }
         } else {
             // Frightened ghosts pick a random direction
             // whenever they're at an intersection
-            uint32_t potential_targets = 0;
-            MovementDirection directions[4] = {0};
-
-            for(int32_t i = 0; i < 4; i++) {
-                TileCoord new_coord = {
-                    .x = ghost->entity.coord.x + (int32_t)direction_vectors[i].x,
-                    .y = ghost->entity.coord.y + (int32_t)direction_vectors[i].y
-                };
-
-                if(!tile_is_wall(&new_coord, ghost) && dot_product(i, ghost->entity.dir) >= 0.0f) {
-                    potential_targets++;
-                    directions[i] = (MovementDirection)i;
-                }
-            }
+            uint32_t exits = get_entity_exits(ctx, &ghost->entity, ghost_can_pass_gate(ctx, ghost), true);
+            uint32_t potential_targets = get_level_exit_count(exits & get_forward_exits(ghost->entity.dir));
 
             if(potential_targets > 0) {
-                int32_t index = rand() % (potential_targets + 1);
+                int32_t index = (int32_t)next_random_range(&ctx->random, potential_targets + 1);
                 ghost->target.x = ghost->entity.coord.x + (int32_t)direction_vectors[index].x;
                 ghost->target.y = ghost->entity.coord.y + (int32_t)direction_vectors[index].y;
             }
@@ -968,16 +1417,16 @@ void set_ghost_behavior(GhostEntity *ghost, uint32_t type) {
 void set_ghost_speed(GhostEntity *ghost) {
     if(ghost) {
         if(ghost->state == GHOST_STATE_EATEN) {
-            ghost->entity.speed = DEFAULT_MOVEMENT_SPEED;
+            ghost->entity.speed = FIXED_FROM_FLOAT(DEFAULT_MOVEMENT_SPEED);
         } else if(ghost->frightened) {
-            ghost->entity.speed = ghost->entity.default_speed * FRIGHTENED_SPEED_MOD;
+            ghost->entity.speed = fixed_mul(ghost->entity.default_speed, FIXED_FROM_FLOAT(FRIGHTENED_SPEED_MOD));
         } else {
             ghost->entity.speed = ghost->entity.default_speed;
         }
     }
 }
 
-void wrap_tile_coords(TileCoord *coord, bool outside_area) {
+void wrap_tile_coords(const GameContext *ctx, TileCoord *coord, bool outside_area) {
     if(coord) {
         int32_t min, max_x, max_y;
         if(outside_area) {
@@ -1004,280 +1453,25 @@ void wrap_tile_coords(TileCoord *coord, bool outside_area) {
     }
 }
 
-void tile_coords_from_direction(TileCoord *coord, MovementDirection direction) {
-    if(coord && direction != MOVEMENT_DIR_NONE) {
-        switch(direction) {
-            case MOVEMENT_DIR_UP: coord->y--; break;
-            case MOVEMENT_DIR_LEFT: coord->x--; break;
-            case MOVEMENT_DIR_RIGHT: coord->x++; break;
-            case MOVEMENT_DIR_DOWN: coord->y++; break;
-            default: break;
-        }
-
-        wrap_tile_coords(coord, true);
-    }
-}
-
-static inline AtlasSprite get_entity_frame(GameEntity *entity, AtlasSprite frame1, AtlasSprite frame2) {
-    assert(entity);
-
-    float sub = MAX(fabsf(entity->coord.sub.x), fabsf(entity->coord.sub.y));
-    return (sub < 0.25f || sub >= 0.75f) ? frame1 : frame2;
-}
-
-static inline AtlasSprite get_ghost_eaten_frame(GhostEntity *ghost, AtlasSprite frame1, AtlasSprite frame2) {
-    assert(ghost);
-
-    float n = ghost->eaten_anim_timer.elapsed / ghost->eaten_anim_timer.target;
-    if((n > 0.25f && n <= 0.5f) || (n > 0.75f)) {
-        return frame2;
-    } else if(n > 0.5f && n <= 0.75f) {
-        return ATLAS_SPRITE_GHOST_EATEN_FRAME3;
-    }
-
-    return frame1;
-}
-
-void render_loop(float dt) {
-    Color4 *fb = get_framebuffer();
-    memset(fb, 0, sizeof(*fb) * DEFAULT_FRAMEBUFFER_WIDTH * DEFAULT_FRAMEBUFFER_HEIGHT);
-
-    clear_spotlights();
-
-    set_draw_intensity(game_data.current_state == GAME_STATE_READY ?
-                       game_data.ready_timer.elapsed / game_data.ready_timer.target : 1.0f);
-
-    glUniform3f(glGetUniformLocation(gl_program, "camera"),
-                game_camera.offset.x, game_camera.offset.y, game_camera.zoom);
-
-    Rect sprite_rect = { 0 };
-
-    float gradient;
-    int32_t radius;
-    {
-        static float bias = 0.0f;
-        bias += 0.75f * dt;
-        if(bias >= M_PI_2) {
-            bias -= M_PI_2;
-        }
-        float t = (sinf(bias) + 1.0f) * 0.5f;
-        gradient = LERP(t, 1.5f, 3.0f);
-        radius = (int32_t)(LERP(t, 30.0f, 45.f));
-    }
-
-    // Level
-    for(int32_t y = 0; y < TILE_COUNT_Y; y++) {
-        for(int32_t x = 0; x < TILE_COUNT_X; x++) {
-            TileCoord coord = { .x = x, .y = y };
-            AtlasSprite sprite = get_level_tile_data(game_data.level, &coord);
-            get_atlas_sprite_rect(sprite, &sprite_rect);
-
-            int32_t xpos = x * TILE_SIZE - game_camera.scroll.x;
-            int32_t ypos = y * TILE_SIZE - game_camera.scroll.y;
-            blit_texture(game_data.atlas, xpos, ypos, &sprite_rect, NULL);
-
-            if(sprite == ATLAS_SPRITE_POWER_PELLET) {
-                draw_spotlight(xpos + TILE_SIZE / 2, ypos + TILE_SIZE / 2, radius, gradient);
-            }
-        }
-    }
-
-    Rect rdest;
-    // Ghosts
-    for(int32_t i = 0; i < GHOST_COUNT; i++) {
-        GhostEntity *ghost = &game_data.ghosts[i];
-        tilecoord_to_rect(&ghost->entity.coord, &rdest, 1.0f);
-
-#define SELECT_GHOST_SPRITE(ghost_name, f1, f2) \
-        case GHOST_##ghost_name: \
-            get_atlas_sprite_rect(get_entity_frame(&game_data.ghosts[GHOST_##ghost_name].entity, f1, f2), &sprite_rect); \
-            break;
-
-        if(ghost->frightened) {
-            switch(i) {
-                SELECT_GHOST_SPRITE(BLINKY, ATLAS_SPRITE_GHOST_FRIGHTENED_FRAME1, ATLAS_SPRITE_GHOST_FRIGHTENED_FRAME2);
-                SELECT_GHOST_SPRITE(PINKY, ATLAS_SPRITE_GHOST_FRIGHTENED_FRAME1, ATLAS_SPRITE_GHOST_FRIGHTENED_FRAME2);
-                SELECT_GHOST_SPRITE(CLYDE, ATLAS_SPRITE_GHOST_FRIGHTENED_FRAME1, ATLAS_SPRITE_GHOST_FRIGHTENED_FRAME2);
-                SELECT_GHOST_SPRITE(INKY, ATLAS_SPRITE_GHOST_FRIGHTENED_FRAME1, ATLAS_SPRITE_GHOST_FRIGHTENED_FRAME2);
-            }
-        } else if(ghost->state == GHOST_STATE_EATEN) {
-            AtlasSprite base = ATLAS_SPRITE_GHOST_EATEN_UP_FRAME1 + (ghost->entity.dir * 2);
-            get_atlas_sprite_rect(get_ghost_eaten_frame(ghost, base, base + 1), &sprite_rect);
-        } else {
-            switch(i) {
-                SELECT_GHOST_SPRITE(BLINKY, ATLAS_SPRITE_BLINKY_FRAME1, ATLAS_SPRITE_BLINKY_FRAME2);
-                SELECT_GHOST_SPRITE(PINKY, ATLAS_SPRITE_PINKY_FRAME1, ATLAS_SPRITE_PINKY_FRAME2);
-                SELECT_GHOST_SPRITE(CLYDE, ATLAS_SPRITE_CLYDE_FRAME1, ATLAS_SPRITE_CLYDE_FRAME2);
-                SELECT_GHOST_SPRITE(INKY, ATLAS_SPRITE_INKY_FRAME1, ATLAS_SPRITE_INKY_FRAME2);
-            }
-        }
-
-#undef SELECT_GHOST_SPRITE
-
-        Matrix3x3 transform = get_scaling_mat3((ghost->state != GHOST_STATE_EATEN &&
-                                                ghost->entity.facing == MOVEMENT_DIR_LEFT) ?
-                                               -1.0f : 1.0f, 1.0f);
-        blit_texture(game_data.atlas, rdest.x - game_camera.scroll.x,
-                     rdest.y - game_camera.scroll.y, &sprite_rect, &transform);
-
-        draw_spotlight(rdest.x - game_camera.scroll.x + TILE_SIZE / 2,
-                       rdest.y - game_camera.scroll.y + TILE_SIZE / 2, radius, gradient);
-    }
-
-    // Player
-    tilecoord_to_rect(&game_data.player.entity.coord, &rdest, 1.0f);
-
-    int32_t player_x, player_y;
-    if(game_camera.scroll.x <= 0) {
-        player_x = rdest.x;
-    } else if((game_camera.scroll.x + DEFAULT_FRAMEBUFFER_WIDTH) >= (TILE_COUNT_X * TILE_SIZE)) {
-        player_x = DEFAULT_FRAMEBUFFER_WIDTH - (TILE_COUNT_X * TILE_SIZE - rdest.x);
-    } else {
-        player_x = DEFAULT_FRAMEBUFFER_WIDTH / 2;
-    }
-
-    if(game_camera.scroll.y <= 0) {
-        player_y = rdest.y;
-    } else if((game_camera.scroll.y + DEFAULT_FRAMEBUFFER_HEIGHT) >= (TILE_COUNT_Y * TILE_SIZE)) {
-        player_y = DEFAULT_FRAMEBUFFER_HEIGHT - (TILE_COUNT_Y * TILE_SIZE - rdest.y);
-    } else {
-        player_y = DEFAULT_FRAMEBUFFER_HEIGHT / 2;
-    }
-
-    Matrix3x3 transform;
-    switch(game_data.player.entity.facing) {
-        case MOVEMENT_DIR_UP:
-            transform = get_rotation_mat3(M_PI * 0.5f);
-            break;
-        case MOVEMENT_DIR_LEFT:
-            transform = get_scaling_mat3(-1.0f, 1.0f);
-            break;
-        case MOVEMENT_DIR_DOWN:
-            transform = get_rotation_mat3(M_PI * 1.5f);
-            break;
-        case MOVEMENT_DIR_RIGHT:
-        default:
-            transform = get_identity_mat3();
-            break;
-    }
-
-    get_atlas_sprite_rect(get_entity_frame(&game_data.player.entity, ATLAS_SPRITE_PLAYER_FRAME1, ATLAS_SPRITE_PLAYER_FRAME2),
-                          &sprite_rect);
-    blit_texture(game_data.atlas, player_x, player_y, &sprite_rect, &transform);
-
-    draw_spotlight(player_x + TILE_SIZE / 2, player_y + TILE_SIZE / 2, radius * 2, gradient);
-    submit_spotlights();
-
-    // Score and lives
-    int32_t xend = DEFAULT_FRAMEBUFFER_WIDTH - (TILE_SIZE * 3);
-    int32_t ypos = DEFAULT_FRAMEBUFFER_HEIGHT - TILE_SIZE;
-
-    draw_formatted_text(game_data.atlas, 16, ypos, "Score %d", game_data.score);
-
-    get_atlas_sprite_rect(ATLAS_SPRITE_PLAYER_FRAME1, &sprite_rect);
-
-    blit_texture(game_data.atlas, xend, ypos - TILE_SIZE_ALT, &sprite_rect, NULL);
-    draw_formatted_text(game_data.atlas, xend + TILE_SIZE, ypos, "X%d", game_data.lives);
-
-    switch(game_data.current_state) {
-        case GAME_STATE_READY: {
-            int32_t xoff = TILE_SIZE * 2;
-            int32_t centerx = (DEFAULT_FRAMEBUFFER_WIDTH / 2) - (TILE_SIZE_ALT / 2);
-            int32_t centery = (DEFAULT_FRAMEBUFFER_HEIGHT / 2) - (TILE_SIZE_ALT / 2);
-
-            float intpart;
-            float fract = modff(game_data.ready_timer.elapsed, &intpart);
-
-            if(fract <= 0.5f) {
-                set_draw_intensity(1.0f);
-                draw_text(game_data.atlas, centerx - xoff, centery, "GET");
-                draw_text(game_data.atlas, centerx + xoff, centery, "READY");
-            }
-            break;
-        }
-        case GAME_STATE_MENU: {
-#define MENU_TILE_COUNT_WIDTH 10
-#define MENU_TILE_COUNT_HEIGHT 3
-            int32_t xstart = ((DEFAULT_FRAMEBUFFER_WIDTH / 2) - (TILE_SIZE_ALT * (MENU_TILE_COUNT_WIDTH / 2))) + (TILE_SIZE_ALT / 2);
-            int32_t ystart = ((DEFAULT_FRAMEBUFFER_HEIGHT / 2) - (TILE_SIZE_ALT * (MENU_TILE_COUNT_HEIGHT / 2))) + (TILE_SIZE_ALT / 2);
-            int32_t ystep = TILE_SIZE_ALT + (TILE_SIZE_ALT / 2);
-            Rect r = {
-                .x = xstart,
-                .y = ystart,
-                .width = TILE_SIZE_ALT * MENU_TILE_COUNT_WIDTH,
-                .height = TILE_SIZE_ALT * MENU_TILE_COUNT_HEIGHT
-            };
-
-            // Draw the corners first
-            get_atlas_sprite_rect(ATLAS_SPRITE_MENU_SLICE_TOPLEFT, &sprite_rect);
-            blit_texture(game_data.atlas, r.x, r.y, &sprite_rect, NULL);
-
-            get_atlas_sprite_rect(ATLAS_SPRITE_MENU_SLICE_TOPRIGHT, &sprite_rect);
-            blit_texture(game_data.atlas, r.x + r.width, r.y, &sprite_rect, NULL);
-
-            get_atlas_sprite_rect(ATLAS_SPRITE_MENU_SLICE_BOTTOMLEFT, &sprite_rect);
-            blit_texture(game_data.atlas, r.x, r.y + r.height, &sprite_rect, NULL);
-
-            get_atlas_sprite_rect(ATLAS_SPRITE_MENU_SLICE_BOTTOMRIGHT, &sprite_rect);
-            blit_texture(game_data.atlas, r.x + r.width, r.y + r.height, &sprite_rect, NULL);
-
-            // Draw the tiling menu
-            get_atlas_sprite_rect(ATLAS_SPRITE_MENU_SLICE_TOP, &sprite_rect);
-            for(int32_t i = r.x + TILE_SIZE_ALT; i < (r.x + r.width); i += TILE_SIZE_ALT) {
-                blit_texture(game_data.atlas, i, r.y, &sprite_rect, NULL);
-            }
-
-            get_atlas_sprite_rect(ATLAS_SPRITE_MENU_SLICE_LEFT, &sprite_rect);
-            for(int32_t i = r.y + TILE_SIZE_ALT; i < (r.y + r.height); i += TILE_SIZE_ALT) {
-                blit_texture(game_data.atlas, r.x, i, &sprite_rect, NULL);
-            }
-
-            get_atlas_sprite_rect(ATLAS_SPRITE_MENU_SLICE_RIGHT, &sprite_rect);
-            for(int32_t i = r.y + TILE_SIZE_ALT; i < (r.y + r.height); i += TILE_SIZE_ALT) {
-                blit_texture(game_data.atlas, r.x + r.width, i, &sprite_rect, NULL);
-            }
-
-            get_atlas_sprite_rect(ATLAS_SPRITE_MENU_SLICE_BOTTOM, &sprite_rect);
-            for(int32_t i = r.x + TILE_SIZE_ALT; i < (r.x + r.width); i += TILE_SIZE_ALT) {
-                blit_texture(game_data.atlas, i, r.y + r.height, &sprite_rect, NULL);
-            }
-
-            get_atlas_sprite_rect(ATLAS_SPRITE_MENU_SLICE_CENTER, &sprite_rect);
-            for(int32_t i = r.x + TILE_SIZE_ALT; i < (r.x + r.width); i += TILE_SIZE_ALT) {
-                for(int32_t j = r.y + TILE_SIZE_ALT; j < (r.y + r.height); j += TILE_SIZE_ALT) {
-                    blit_texture(game_data.atlas, i, j, &sprite_rect, NULL);
-                }
-            }
-
-            // Draw menu text
-            xstart += (TILE_SIZE_ALT / 2);
-            ystart += (TILE_SIZE_ALT / 2);
-
-            for(int32_t i = 0; i < MENU_ITEM_COUNT; i++) {
-                set_draw_intensity(0.35f);
-                if(i == game_data.selected_menu_id) {
-                    set_draw_intensity(1.0f);
-                }
-                draw_text(game_data.atlas, xstart, ystart + (ystep * i), menu_items[i].str);
-            }
-
-#undef MENU_TILE_COUNT_WIDTH
-#undef MENU_TILE_COUNT_HEIGHT
-
-            break;
-        }
-        default:
-            break;
-    }
-
-    // OpenGL stuff
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, DEFAULT_FRAMEBUFFER_WIDTH,
-                    DEFAULT_FRAMEBUFFER_HEIGHT, GL_RGBA, GL_FLOAT, get_framebuffer());
-    glClear(GL_COLOR_BUFFER_BIT);
-    glDrawArrays(GL_TRIANGLES, 0, 6);
-}
+#include "lanes.c"
+#include "batch.c"
+#include "swarm.c"
+#include "env.c"
+#include "replay.c"
+#include "rewind.c"
+#include "rollback.c"
+#include "netstate.c"
+
+#ifndef PACMAN_HEADLESS
+#include "game_render.c"
+#endif
 
+#undef SNAPSHOT_START
+#undef SNAPSHOT_LEVEL_OFFSET
 #undef EPSILON
+#undef SUB_TILE_EPSILON
+#undef PLAYER_GHOST_TOUCH_SIZE
+#undef PLAYER_GHOST_HIT_SIZE
 #undef DEFAULT_MOVEMENT_SPEED
 #undef FRIGHTENED_SPEED_MOD
 #undef SCATTER_MODE_TIME
@@ -1285,6 +1479,7 @@ void render_loop(float dt) {
 #undef FRIGHTENED_MODE_TIME
 #undef INPUT_QUEUE_TIME_MAX
 #undef INPUT_PRESS
+#undef LANE_WIDTH
 
 static const Rect atlas_sprites[ATLAS_SPRITE_COUNT] = {
     [ATLAS_SPRITE_EMPTY] = { .x = 0, .y = 0, .width = 32, .height = 32 },
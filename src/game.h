@@ -11,7 +11,9 @@
 #include <stdbool.h>
 #include "common.h"
 #include "level.h"
+#include "random.h"
 #include "render.h"
+#include "timerwheel.h"
 
 enum {
     INPUT_UP = 1 << 0,
@@ -22,9 +24,24 @@ enum {
     INPUT_MENU = 1 << 5
 };
 
+// Raised by update_loop, only valid until the next call
+enum {
+    GAME_EVENT_PELLET_EATEN = 1 << 0,
+    GAME_EVENT_POWER_PELLET_EATEN = 1 << 1,
+    GAME_EVENT_GHOST_EATEN = 1 << 2,
+    GAME_EVENT_PLAYER_DIED = 1 << 3,
+    GAME_EVENT_LEVEL_CLEARED = 1 << 4,
+    GAME_EVENT_GAME_OVER = 1 << 5
+};
+
 #define TILE_SIZE 32
 #define TILE_SIZE_ALT 16
 
+// The simulation always advances in fixed steps, independent of the display refresh rate
+#define SIMULATION_TICK_RATE 120
+#define SIMULATION_TICK_TIME (1.0f / (float)SIMULATION_TICK_RATE)
+#define SIMULATION_MAX_FRAME_TIME 0.25f
+
 typedef enum {
     MOVEMENT_DIR_UP = 0,
     MOVEMENT_DIR_LEFT,
@@ -35,10 +52,11 @@ typedef enum {
 
 typedef struct {
     TileCoord coord;
+    TileCoord prev_coord;
     MovementDirection dir;
     MovementDirection facing;
-    float default_speed;
-    float speed;
+    fixed32 default_speed; // Tiles per second
+    fixed32 speed;
 } GameEntity;
 
 typedef struct {
@@ -50,7 +68,7 @@ typedef struct {
 typedef struct {
     TileCoord target;
     GameEntity entity;
-    Timer eaten_anim_timer;
+    TimerHandle eaten_anim_timer; // Loops while the ghost is eaten
 
     enum {
         GHOST_STATE_SCATTER,
@@ -68,11 +86,74 @@ typedef struct {
     };
 } GhostEntity;
 
-void initialize_game(void);
-void close_game(void);
-void signal_window_resize(int32_t new_width, int32_t new_height);
+typedef enum {
+    GHOST_PATHING_GREEDY, // Step towards whichever neighbor is closest to the target
+    // Follow the level's distance fields to the gate and scatter corners, and
+    // its next hop table when chasing if one was built
+    GHOST_PATHING_SHORTEST
+} GhostPathing;
+
+// Read-only data (levels, textures) that any number of game contexts can share
+typedef struct GameAssets GameAssets;
+// All of the mutable state of a single game
+typedef struct GameContext GameContext;
+
+GameAssets * create_game_assets(void);
+void destroy_game_assets(GameAssets **assets);
+uint32_t get_game_level_count(const GameAssets *assets);
+// Builds the all-pairs next hop table that chasing ghosts follow with shortest
+// pathing. Returns its size in bytes, or 0 when the level is too large for one.
+// Must not be called while games are running on these assets.
+size_t build_game_next_hops(GameAssets *assets, uint32_t level);
+// Ghost speeds, gate thresholds and targets come from data/ghosts.txt when it's
+// there (see src/behavior.h), and from the built-in code otherwise. This swaps in
+// another file, or the built-in behaviors for NULL, and applies to games started
+// afterwards. Returns false and keeps the current ones if the file doesn't load.
+// Must not be called while games are running on these assets.
+bool load_game_ghost_behaviors(GameAssets *assets, const char *path);
+
+GameContext * create_game_context(const GameAssets *assets);
+void destroy_game_context(GameContext **ctx);
+
+// Every game draws from its own random stream. Games with the same seed but a
+// different stream get unrelated numbers, see seed_random_stream.
+void seed_game(GameContext *ctx, uint64_t seed, uint32_t stream);
+void get_game_random_state(const GameContext *ctx, RandomState *state);
+void set_game_random_state(GameContext *ctx, const RandomState *state);
+
+// A snapshot is a plain copy of all of the simulation state, including the random
+// state and the level tiles. Its size depends on the current level and is never
+// larger than the capacity. Snapshots can only be loaded into contexts that were
+// created from the same assets.
+size_t get_game_snapshot_size(const GameContext *ctx);
+size_t get_game_snapshot_capacity(const GameContext *ctx);
+void save_game_snapshot(const GameContext *ctx, void *buffer);
+void load_game_snapshot(GameContext *ctx, const void *buffer);
+
+void initialize_renderer(void);
+void signal_window_resize(GameContext *ctx, int32_t new_width, int32_t new_height);
+
+bool update_loop(GameContext *ctx, float dt, uint32_t input);
+// Versus mode, where a second player steers the controlled ghost with the
+// direction bits of ghost_input. The ghost can't turn around, like the AI ones.
+bool update_versus_loop(GameContext *ctx, float dt, uint32_t input, uint32_t ghost_input);
+// Pass -1 to hand the ghost back to the AI
+void set_game_controlled_ghost(GameContext *ctx, int32_t ghost);
+// Frightened ghosts always steer greedily
+void set_game_ghost_pathing(GameContext *ctx, GhostPathing pathing);
+// The ghosts move and pick their directions four at a time with SSE2. The plain
+// scalar code is kept as the reference, both give exactly the same results.
+void set_game_scalar_ghosts(GameContext *ctx, bool scalar);
+// The chase and scatter targets every ghost would pick right now, from the loaded
+// behaviors or the built-in code, for comparing and benchmarking the two
+void get_game_ghost_targets(const GameContext *ctx, bool built_in, TileCoord *chase, TileCoord *scatter);
+void render_loop(GameContext *ctx, float dt, float alpha);
 
-bool update_loop(float dt, uint32_t input);
-void render_loop(float dt);
+uint32_t get_game_events(const GameContext *ctx);
+uint32_t get_game_score(const GameContext *ctx);
+// Points scored during the last update_loop call
+uint32_t get_game_points(const GameContext *ctx);
+// Changes whenever anything that affects the simulation differs between two games
+uint64_t get_game_state_hash(const GameContext *ctx);
 
 #endif /* GAME_H */
@@ -0,0 +1,482 @@
+/*
+ * Pacman Clone
+ *
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ */
+
+// Presentation side of the game: everything that needs OpenGL or the software
+// renderer lives here, so game.c can be compiled without it for headless runs
+
+static GLuint gl_program;
+
+static struct {
+    enum MenuItem id;
+    const char *str;
+} menu_items[MENU_ITEM_COUNT] = {
+    { .id = MENU_ITEM_CONTINUE, "CONTINUE" },
+    { .id = MENU_ITEM_EXIT, "EXIT" }
+};
+
+static Vector2i get_tilecoord_abs_position(const TileCoord *coord) {
+    if(coord) {
+        return (Vector2i) {
+            .x = (coord->x * TILE_SIZE) + (coord->sub.x * TILE_SIZE) / FIXED_ONE,
+            .y = (coord->y * TILE_SIZE) + (coord->sub.y * TILE_SIZE) / FIXED_ONE
+        };
+    }
+
+    return (Vector2i) { 0 };
+}
+
+// Blends between the positions of the last two simulation ticks
+static Vector2i get_entity_interpolated_position(const GameEntity *entity, float alpha) {
+    if(entity) {
+        Vector2i current = get_tilecoord_abs_position(&entity->coord);
+        Vector2i previous = get_tilecoord_abs_position(&entity->prev_coord);
+
+        // Entities that wrapped around the level or were reset jump more
+        // than a tile in a single tick, so don't smear them across the screen
+        if(ABSOLUTE_VAL(current.x - previous.x) > TILE_SIZE ||
+           ABSOLUTE_VAL(current.y - previous.y) > TILE_SIZE) {
+            return current;
+        }
+
+        return (Vector2i) {
+            .x = (int32_t)LERP(alpha, (float)previous.x, (float)current.x),
+            .y = (int32_t)LERP(alpha, (float)previous.y, (float)current.y)
+        };
+    }
+
+    return (Vector2i) { 0 };
+}
+
+static inline void check_gl_status(GLuint id, GLenum parameter) {
+    GLint status;
+    static char error_log[512];
+
+    if(parameter == GL_COMPILE_STATUS) {
+        glGetShaderiv(id, parameter, &status);
+        if(status != GL_TRUE) {
+            glGetShaderInfoLog(id, sizeof(error_log), NULL, error_log);
+            if(status == 0) {
+                fprintf(stderr, "Could not compile the shader!\n");
+                exit(-1);
+            }
+        }
+    } else if(parameter == GL_LINK_STATUS) {
+        glGetProgramiv(id, parameter, &status);
+        if(status != GL_TRUE) {
+            glGetProgramInfoLog(id, sizeof(error_log), NULL, error_log);
+            if(status == 0) {
+                fprintf(stderr, "Could not link the GL program!\n");
+                exit(-1);
+            }
+        }
+    }
+}
+
+static void resize_window(int32_t new_width, int32_t new_height) {
+    new_width = MAX(DEFAULT_WINDOW_WIDTH, new_width);
+    new_height = MAX(DEFAULT_WINDOW_HEIGHT, new_height);
+
+    float aspect_ratio = (float)DEFAULT_FRAMEBUFFER_WIDTH / (float)DEFAULT_FRAMEBUFFER_HEIGHT;
+    float w = (float)new_width;
+    float h = w / aspect_ratio;
+
+    if(h > new_height) {
+        h = (float)new_height;
+        w = h * aspect_ratio;
+    }
+
+    GLint x = (new_width - (GLint)w) / 2;
+    GLint y = (new_height - (GLint)h) / 2;
+
+    glViewport(x, y, (GLsizei)w, (GLsizei)h);
+}
+
+void initialize_renderer(void) {
+    // Setup core OpenGL
+    static const char *vertex_shader_source = {
+        "#version 330 core\n"
+        "layout(location = 0) in vec2 pos;\n"
+        "layout(location = 1) in vec2 uvs;\n"
+        "out vec2 texcoords;\n"
+        "uniform vec3 camera;\n"
+        "void main(void) {\n"
+        "    texcoords = ((vec2(uvs.s, 1.0 - uvs.t) - vec2(0.5))* camera.z) + camera.xy;\n"
+        "    gl_Position = vec4(pos, 0.0, 1.0);\n"
+        "}"
+    };
+    static const char *fragment_shader_source = {
+        "#version 330 core\n"
+        "uniform sampler2D sampler;\n"
+        "in vec2 texcoords;\n"
+        "out vec4 out_color;\n"
+        "void main(void) {\n"
+        "    out_color = texture(sampler, texcoords);\n"
+        "}"
+    };
+    gl_program = glCreateProgram();
+    GLuint vertex_shader = glCreateShader(GL_VERTEX_SHADER);
+    GLuint fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
+
+    glShaderSource(vertex_shader, 1, &vertex_shader_source, NULL);
+    glShaderSource(fragment_shader, 1, &fragment_shader_source, NULL);
+
+    glCompileShader(vertex_shader);
+    check_gl_status(vertex_shader, GL_COMPILE_STATUS);
+    glCompileShader(fragment_shader);
+    check_gl_status(fragment_shader, GL_COMPILE_STATUS);
+
+    glAttachShader(gl_program, vertex_shader);
+    glAttachShader(gl_program, fragment_shader);
+
+    glLinkProgram(gl_program);
+    check_gl_status(gl_program, GL_LINK_STATUS);
+
+    glUseProgram(gl_program);
+
+    glDetachShader(gl_program, vertex_shader);
+    glDetachShader(gl_program, fragment_shader);
+
+    glDeleteShader(vertex_shader);
+    glDeleteShader(fragment_shader);
+
+    static const GLfloat vertex_buffer_data[] = {
+        // Position       // UV coordinates
+        -1.0f, -1.0f,     0.0f, 0.0f,
+         1.0f, -1.0f,     1.0f, 0.0f,
+         1.0f,  1.0f,     1.0f, 1.0f,
+
+         1.0f,  1.0f,     1.0f, 1.0f,
+        -1.0f,  1.0f,     0.0f, 1.0f,
+        -1.0f, -1.0f,     0.0f, 0.0f,
+    };
+
+    GLuint vao, vbo;
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    glGenBuffers(1, &vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertex_buffer_data), vertex_buffer_data, GL_STATIC_DRAW);
+
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 4, NULL);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 4, (const void *)(2 * sizeof(GLfloat)));
+
+    glEnable(GL_TEXTURE_2D);
+    GLuint framebuffer_texture;
+    glGenTextures(1, &framebuffer_texture);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, framebuffer_texture);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, DEFAULT_FRAMEBUFFER_WIDTH, DEFAULT_FRAMEBUFFER_HEIGHT,
+                 0, GL_RGBA, GL_FLOAT, get_framebuffer());
+
+    resize_window(DEFAULT_WINDOW_WIDTH, DEFAULT_WINDOW_HEIGHT);
+
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+void signal_window_resize(GameContext *ctx, int32_t new_width, int32_t new_height) {
+    if(ctx) {
+        ctx->window_box.should_resize = true;
+        ctx->window_box.width = new_width;
+        ctx->window_box.height = new_height;
+    }
+}
+
+static void update_camera_pos(GameContext *ctx, Vector2i abs_pos) {
+    ctx->camera.scroll.x = abs_pos.x - (DEFAULT_FRAMEBUFFER_WIDTH / 2);
+    ctx->camera.scroll.y = abs_pos.y - (DEFAULT_FRAMEBUFFER_HEIGHT / 2);
+
+    if(ctx->camera.scroll.x < 0) {
+        ctx->camera.scroll.x = 0;
+    } else if((ctx->camera.scroll.x + DEFAULT_FRAMEBUFFER_WIDTH) > (TILE_COUNT_X * TILE_SIZE)) {
+        ctx->camera.scroll.x = TILE_COUNT_X * TILE_SIZE - DEFAULT_FRAMEBUFFER_WIDTH;
+    }
+
+    if(ctx->camera.scroll.y < 0) {
+        ctx->camera.scroll.y = 0;
+    } else if((ctx->camera.scroll.y + DEFAULT_FRAMEBUFFER_HEIGHT) > (TILE_COUNT_Y * TILE_SIZE)) {
+        ctx->camera.scroll.y = TILE_COUNT_Y * TILE_SIZE - DEFAULT_FRAMEBUFFER_HEIGHT;
+    }
+}
+
+static inline AtlasSprite get_entity_frame(GameEntity *entity, AtlasSprite frame1, AtlasSprite frame2) {
+    assert(entity);
+
+    fixed32 sub = MAX(fixed_abs(entity->coord.sub.x), fixed_abs(entity->coord.sub.y));
+    return (sub < FIXED_ONE / 4 || sub >= (FIXED_ONE * 3) / 4) ? frame1 : frame2;
+}
+
+static inline AtlasSprite get_ghost_eaten_frame(const GameContext *ctx, GhostEntity *ghost,
+                                                AtlasSprite frame1, AtlasSprite frame2) {
+    assert(ghost);
+
+    float n = get_wheel_timer_progress(&ctx->timers, ghost->eaten_anim_timer);
+    if((n > 0.25f && n <= 0.5f) || (n > 0.75f)) {
+        return frame2;
+    } else if(n > 0.5f && n <= 0.75f) {
+        return ATLAS_SPRITE_GHOST_EATEN_FRAME3;
+    }
+
+    return frame1;
+}
+
+void render_loop(GameContext *ctx, float dt, float alpha) {
+    const Texture2D *atlas = ctx->assets->atlas;
+
+    if(ctx->window_box.should_resize) {
+        resize_window(ctx->window_box.width, ctx->window_box.height);
+        ctx->window_box.should_resize = false;
+    }
+
+    Color4 *fb = get_framebuffer();
+    memset(fb, 0, sizeof(*fb) * DEFAULT_FRAMEBUFFER_WIDTH * DEFAULT_FRAMEBUFFER_HEIGHT);
+
+    clear_spotlights();
+
+    set_draw_intensity(ctx->current_state == GAME_STATE_READY ?
+                       ctx->ready_timer.elapsed / ctx->ready_timer.target : 1.0f);
+
+    Vector2i player_pos = get_entity_interpolated_position(&ctx->player.entity, alpha);
+    update_camera_pos(ctx, player_pos);
+
+    glUniform3f(glGetUniformLocation(gl_program, "camera"),
+                ctx->camera.offset.x, ctx->camera.offset.y, ctx->camera.zoom);
+
+    Rect sprite_rect = { 0 };
+
+    float gradient;
+    int32_t radius;
+    {
+        ctx->spotlight_bias += 0.75f * dt;
+        if(ctx->spotlight_bias >= M_PI_2) {
+            ctx->spotlight_bias -= M_PI_2;
+        }
+        float t = (sinf(ctx->spotlight_bias) + 1.0f) * 0.5f;
+        gradient = LERP(t, 1.5f, 3.0f);
+        radius = (int32_t)(LERP(t, 30.0f, 45.f));
+    }
+
+    // Level
+    for(int32_t y = 0; y < TILE_COUNT_Y; y++) {
+        uint32_t row = get_level_tile_index(ctx->level, 0, y);
+        for(int32_t x = 0; x < TILE_COUNT_X; x++) {
+            AtlasSprite sprite = get_level_tile_sprite(ctx->level, row + x);
+            get_atlas_sprite_rect(sprite, &sprite_rect);
+
+            int32_t xpos = x * TILE_SIZE - ctx->camera.scroll.x;
+            int32_t ypos = y * TILE_SIZE - ctx->camera.scroll.y;
+            blit_texture(atlas, xpos, ypos, &sprite_rect, NULL);
+
+            if(sprite == ATLAS_SPRITE_POWER_PELLET) {
+                draw_spotlight(xpos + TILE_SIZE / 2, ypos + TILE_SIZE / 2, radius, gradient);
+            }
+        }
+    }
+
+    Rect rdest;
+    // Ghosts
+    for(int32_t i = 0; i < GHOST_COUNT; i++) {
+        GhostEntity *ghost = &ctx->ghosts[i];
+        Vector2i ghost_pos = get_entity_interpolated_position(&ghost->entity, alpha);
+        rdest.x = ghost_pos.x;
+        rdest.y = ghost_pos.y;
+
+#define SELECT_GHOST_SPRITE(ghost_name, f1, f2) \
+        case GHOST_##ghost_name: \
+            get_atlas_sprite_rect(get_entity_frame(&ctx->ghosts[GHOST_##ghost_name].entity, f1, f2), &sprite_rect); \
+            break;
+
+        if(ghost->frightened) {
+            switch(i) {
+                SELECT_GHOST_SPRITE(BLINKY, ATLAS_SPRITE_GHOST_FRIGHTENED_FRAME1, ATLAS_SPRITE_GHOST_FRIGHTENED_FRAME2);
+                SELECT_GHOST_SPRITE(PINKY, ATLAS_SPRITE_GHOST_FRIGHTENED_FRAME1, ATLAS_SPRITE_GHOST_FRIGHTENED_FRAME2);
+                SELECT_GHOST_SPRITE(CLYDE, ATLAS_SPRITE_GHOST_FRIGHTENED_FRAME1, ATLAS_SPRITE_GHOST_FRIGHTENED_FRAME2);
+                SELECT_GHOST_SPRITE(INKY, ATLAS_SPRITE_GHOST_FRIGHTENED_FRAME1, ATLAS_SPRITE_GHOST_FRIGHTENED_FRAME2);
+            }
+        } else if(ghost->state == GHOST_STATE_EATEN) {
+            AtlasSprite base = ATLAS_SPRITE_GHOST_EATEN_UP_FRAME1 + (ghost->entity.dir * 2);
+            get_atlas_sprite_rect(get_ghost_eaten_frame(ctx, ghost, base, base + 1), &sprite_rect);
+        } else {
+            switch(i) {
+                SELECT_GHOST_SPRITE(BLINKY, ATLAS_SPRITE_BLINKY_FRAME1, ATLAS_SPRITE_BLINKY_FRAME2);
+                SELECT_GHOST_SPRITE(PINKY, ATLAS_SPRITE_PINKY_FRAME1, ATLAS_SPRITE_PINKY_FRAME2);
+                SELECT_GHOST_SPRITE(CLYDE, ATLAS_SPRITE_CLYDE_FRAME1, ATLAS_SPRITE_CLYDE_FRAME2);
+                SELECT_GHOST_SPRITE(INKY, ATLAS_SPRITE_INKY_FRAME1, ATLAS_SPRITE_INKY_FRAME2);
+            }
+        }
+
+#undef SELECT_GHOST_SPRITE
+
+        Matrix3x3 transform = get_scaling_mat3((ghost->state != GHOST_STATE_EATEN &&
+                                                ghost->entity.facing == MOVEMENT_DIR_LEFT) ?
+                                               -1.0f : 1.0f, 1.0f);
+        blit_texture(atlas, rdest.x - ctx->camera.scroll.x,
+                     rdest.y - ctx->camera.scroll.y, &sprite_rect, &transform);
+
+        draw_spotlight(rdest.x - ctx->camera.scroll.x + TILE_SIZE / 2,
+                       rdest.y - ctx->camera.scroll.y + TILE_SIZE / 2, radius, gradient);
+    }
+
+    // Player
+    rdest.x = player_pos.x;
+    rdest.y = player_pos.y;
+
+    int32_t player_x, player_y;
+    if(ctx->camera.scroll.x <= 0) {
+        player_x = rdest.x;
+    } else if((ctx->camera.scroll.x + DEFAULT_FRAMEBUFFER_WIDTH) >= (TILE_COUNT_X * TILE_SIZE)) {
+        player_x = DEFAULT_FRAMEBUFFER_WIDTH - (TILE_COUNT_X * TILE_SIZE - rdest.x);
+    } else {
+        player_x = DEFAULT_FRAMEBUFFER_WIDTH / 2;
+    }
+
+    if(ctx->camera.scroll.y <= 0) {
+        player_y = rdest.y;
+    } else if((ctx->camera.scroll.y + DEFAULT_FRAMEBUFFER_HEIGHT) >= (TILE_COUNT_Y * TILE_SIZE)) {
+        player_y = DEFAULT_FRAMEBUFFER_HEIGHT - (TILE_COUNT_Y * TILE_SIZE - rdest.y);
+    } else {
+        player_y = DEFAULT_FRAMEBUFFER_HEIGHT / 2;
+    }
+
+    Matrix3x3 transform;
+    switch(ctx->player.entity.facing) {
+        case MOVEMENT_DIR_UP:
+            transform = get_rotation_mat3(M_PI * 0.5f);
+            break;
+        case MOVEMENT_DIR_LEFT:
+            transform = get_scaling_mat3(-1.0f, 1.0f);
+            break;
+        case MOVEMENT_DIR_DOWN:
+            transform = get_rotation_mat3(M_PI * 1.5f);
+            break;
+        case MOVEMENT_DIR_RIGHT:
+        default:
+            transform = get_identity_mat3();
+            break;
+    }
+
+    get_atlas_sprite_rect(get_entity_frame(&ctx->player.entity, ATLAS_SPRITE_PLAYER_FRAME1, ATLAS_SPRITE_PLAYER_FRAME2),
+                          &sprite_rect);
+    blit_texture(atlas, player_x, player_y, &sprite_rect, &transform);
+
+    draw_spotlight(player_x + TILE_SIZE / 2, player_y + TILE_SIZE / 2, radius * 2, gradient);
+    submit_spotlights();
+
+    // Score and lives
+    int32_t xend = DEFAULT_FRAMEBUFFER_WIDTH - (TILE_SIZE * 3);
+    int32_t ypos = DEFAULT_FRAMEBUFFER_HEIGHT - TILE_SIZE;
+
+    draw_formatted_text(atlas, 16, ypos, "Score %d", ctx->score);
+
+    get_atlas_sprite_rect(ATLAS_SPRITE_PLAYER_FRAME1, &sprite_rect);
+
+    blit_texture(atlas, xend, ypos - TILE_SIZE_ALT, &sprite_rect, NULL);
+    draw_formatted_text(atlas, xend + TILE_SIZE, ypos, "X%d", ctx->lives);
+
+    switch(ctx->current_state) {
+        case GAME_STATE_READY: {
+            int32_t xoff = TILE_SIZE * 2;
+            int32_t centerx = (DEFAULT_FRAMEBUFFER_WIDTH / 2) - (TILE_SIZE_ALT / 2);
+            int32_t centery = (DEFAULT_FRAMEBUFFER_HEIGHT / 2) - (TILE_SIZE_ALT / 2);
+
+            float intpart;
+            float fract = modff(ctx->ready_timer.elapsed, &intpart);
+
+            if(fract <= 0.5f) {
+                set_draw_intensity(1.0f);
+                draw_text(atlas, centerx - xoff, centery, "GET");
+                draw_text(atlas, centerx + xoff, centery, "READY");
+            }
+            break;
+        }
+        case GAME_STATE_MENU: {
+#define MENU_TILE_COUNT_WIDTH 10
+#define MENU_TILE_COUNT_HEIGHT 3
+            int32_t xstart = ((DEFAULT_FRAMEBUFFER_WIDTH / 2) - (TILE_SIZE_ALT * (MENU_TILE_COUNT_WIDTH / 2))) + (TILE_SIZE_ALT / 2);
+            int32_t ystart = ((DEFAULT_FRAMEBUFFER_HEIGHT / 2) - (TILE_SIZE_ALT * (MENU_TILE_COUNT_HEIGHT / 2))) + (TILE_SIZE_ALT / 2);
+            int32_t ystep = TILE_SIZE_ALT + (TILE_SIZE_ALT / 2);
+            Rect r = {
+                .x = xstart,
+                .y = ystart,
+                .width = TILE_SIZE_ALT * MENU_TILE_COUNT_WIDTH,
+                .height = TILE_SIZE_ALT * MENU_TILE_COUNT_HEIGHT
+            };
+
+            // Draw the corners first
+            get_atlas_sprite_rect(ATLAS_SPRITE_MENU_SLICE_TOPLEFT, &sprite_rect);
+            blit_texture(atlas, r.x, r.y, &sprite_rect, NULL);
+
+            get_atlas_sprite_rect(ATLAS_SPRITE_MENU_SLICE_TOPRIGHT, &sprite_rect);
+            blit_texture(atlas, r.x + r.width, r.y, &sprite_rect, NULL);
+
+            get_atlas_sprite_rect(ATLAS_SPRITE_MENU_SLICE_BOTTOMLEFT, &sprite_rect);
+            blit_texture(atlas, r.x, r.y + r.height, &sprite_rect, NULL);
+
+            get_atlas_sprite_rect(ATLAS_SPRITE_MENU_SLICE_BOTTOMRIGHT, &sprite_rect);
+            blit_texture(atlas, r.x + r.width, r.y + r.height, &sprite_rect, NULL);
+
+            // Draw the tiling menu
+            get_atlas_sprite_rect(ATLAS_SPRITE_MENU_SLICE_TOP, &sprite_rect);
+            for(int32_t i = r.x + TILE_SIZE_ALT; i < (r.x + r.width); i += TILE_SIZE_ALT) {
+                blit_texture(atlas, i, r.y, &sprite_rect, NULL);
+            }
+
+            get_atlas_sprite_rect(ATLAS_SPRITE_MENU_SLICE_LEFT, &sprite_rect);
+            for(int32_t i = r.y + TILE_SIZE_ALT; i < (r.y + r.height); i += TILE_SIZE_ALT) {
+                blit_texture(atlas, r.x, i, &sprite_rect, NULL);
+            }
+
+            get_atlas_sprite_rect(ATLAS_SPRITE_MENU_SLICE_RIGHT, &sprite_rect);
+            for(int32_t i = r.y + TILE_SIZE_ALT; i < (r.y + r.height); i += TILE_SIZE_ALT) {
+                blit_texture(atlas, r.x + r.width, i, &sprite_rect, NULL);
+            }
+
+            get_atlas_sprite_rect(ATLAS_SPRITE_MENU_SLICE_BOTTOM, &sprite_rect);
+            for(int32_t i = r.x + TILE_SIZE_ALT; i < (r.x + r.width); i += TILE_SIZE_ALT) {
+                blit_texture(atlas, i, r.y + r.height, &sprite_rect, NULL);
+            }
+
+            get_atlas_sprite_rect(ATLAS_SPRITE_MENU_SLICE_CENTER, &sprite_rect);
+            for(int32_t i = r.x + TILE_SIZE_ALT; i < (r.x + r.width); i += TILE_SIZE_ALT) {
+                for(int32_t j = r.y + TILE_SIZE_ALT; j < (r.y + r.height); j += TILE_SIZE_ALT) {
+                    blit_texture(atlas, i, j, &sprite_rect, NULL);
+                }
+            }
+
+            // Draw menu text
+            xstart += (TILE_SIZE_ALT / 2);
+            ystart += (TILE_SIZE_ALT / 2);
+
+            for(int32_t i = 0; i < MENU_ITEM_COUNT; i++) {
+                set_draw_intensity(0.35f);
+                if(i == ctx->selected_menu_id) {
+                    set_draw_intensity(1.0f);
+                }
+                draw_text(atlas, xstart, ystart + (ystep * i), menu_items[i].str);
+            }
+
+#undef MENU_TILE_COUNT_WIDTH
+#undef MENU_TILE_COUNT_HEIGHT
+
+            break;
+        }
+        default:
+            break;
+    }
+
+    // OpenGL stuff
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, DEFAULT_FRAMEBUFFER_WIDTH,
+                    DEFAULT_FRAMEBUFFER_HEIGHT, GL_RGBA, GL_FLOAT, get_framebuffer());
+    glClear(GL_COLOR_BUFFER_BIT);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+}
@@ -0,0 +1,285 @@
+/*
+ * Pacman Clone
+ *
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ */
+
+#include <emmintrin.h>
+
+// SSE2 kernels for the per-tick entity work. They are shared by update_loop, which
+// runs the four ghosts of a game as the four lanes, and by the game batches.
+#define LANE_WIDTH 4
+
+// One entity per lane, every field in its own 16 byte aligned array
+typedef struct {
+    int32_t *x;
+    int32_t *y;
+    fixed32 *sub_x;
+    fixed32 *sub_y;
+    int32_t *dir;
+    fixed32 *speed;
+    int32_t *columns;
+    int32_t *rows;
+} EntityLanes;
+
+// Lane g holds ghost g
+typedef union {
+    __m128i v;
+    int32_t lane[LANE_WIDTH];
+} GhostLane;
+
+// The ghosts of a single game as a structure of arrays
+typedef struct {
+    GhostLane x;
+    GhostLane y;
+    GhostLane sub_x;
+    GhostLane sub_y;
+    GhostLane dir;
+    GhostLane speed;
+    GhostLane columns;
+    GhostLane rows;
+    GhostLane default_speed;
+    GhostLane eaten;
+    GhostLane frightened;
+    GhostLane old_x;
+    GhostLane old_y;
+    GhostLane target_x;
+    GhostLane target_y;
+    GhostLane candidates;
+    GhostLane best_dir;
+} GhostLanes;
+
+typedef char ghost_lanes_fit_one_register[(GHOST_COUNT == LANE_WIDTH) ? 1 : -1];
+
+static inline __m128i select_epi32(__m128i mask, __m128i a, __m128i b) {
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+static inline __m128i load_lanes(const int32_t *lanes) {
+    return _mm_load_si128((const __m128i *)lanes);
+}
+
+static inline void store_lanes(int32_t *lanes, __m128i value) {
+    _mm_store_si128((__m128i *)lanes, value);
+}
+
+// fixed_mul for non-negative values. SSE2 only multiplies two 32 bit lanes into
+// 64 bit results at a time, so the even and odd lanes are done separately.
+static inline __m128i fixed_mul_lanes(__m128i a, __m128i b) {
+    const __m128i low_lanes = _mm_set_epi32(0, -1, 0, -1);
+
+    __m128i even = _mm_srli_epi64(_mm_mul_epu32(a, b), FIXED_SHIFT);
+    __m128i odd = _mm_srli_epi64(_mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32)), FIXED_SHIFT);
+
+    return _mm_or_si128(_mm_and_si128(even, low_lanes), _mm_slli_epi64(odd, 32));
+}
+
+// Division by FIXED_ONE that rounds towards zero, like the / in move_entity
+static inline __m128i whole_tiles_lanes(__m128i sub) {
+    __m128i bias = _mm_and_si128(_mm_srai_epi32(sub, 31), _mm_set1_epi32(FIXED_ONE - 1));
+    return _mm_srai_epi32(_mm_add_epi32(sub, bias), FIXED_SHIFT);
+}
+
+// Lane version of move_entity, without the destination tile
+static void move_entity_lanes(EntityLanes *lanes, uint32_t count, float dt) {
+    const __m128i dt_v = _mm_set1_epi32(FIXED_FROM_FLOAT(dt));
+    const __m128i dir_up = _mm_set1_epi32(MOVEMENT_DIR_UP);
+    const __m128i dir_left = _mm_set1_epi32(MOVEMENT_DIR_LEFT);
+    const __m128i dir_down = _mm_set1_epi32(MOVEMENT_DIR_DOWN);
+    const __m128i dir_right = _mm_set1_epi32(MOVEMENT_DIR_RIGHT);
+    const __m128i minus_one = _mm_set1_epi32(-1);
+
+    for(uint32_t i = 0; i < count; i += LANE_WIDTH) {
+        __m128i dir = load_lanes(lanes->dir + i);
+        __m128i speed = fixed_mul_lanes(load_lanes(lanes->speed + i), dt_v);
+
+        __m128i is_up = _mm_cmpeq_epi32(dir, dir_up);
+        __m128i is_left = _mm_cmpeq_epi32(dir, dir_left);
+        __m128i is_down = _mm_cmpeq_epi32(dir, dir_down);
+        __m128i is_right = _mm_cmpeq_epi32(dir, dir_right);
+
+        __m128i vertical = _mm_or_si128(is_up, is_down);
+        __m128i horizontal = _mm_or_si128(is_left, is_right);
+        __m128i negative = _mm_or_si128(is_up, is_left);
+        // Negate through (speed ^ -1) + 1 where the direction is up or left
+        __m128i delta = _mm_sub_epi32(_mm_xor_si128(speed, negative), negative);
+
+        // Moving along one axis puts the entity back in the middle of the other one
+        __m128i sub_x = load_lanes(lanes->sub_x + i);
+        __m128i sub_y = load_lanes(lanes->sub_y + i);
+        sub_x = _mm_andnot_si128(vertical, _mm_add_epi32(sub_x, _mm_and_si128(horizontal, delta)));
+        sub_y = _mm_andnot_si128(horizontal, _mm_add_epi32(sub_y, _mm_and_si128(vertical, delta)));
+
+        __m128i whole_x = whole_tiles_lanes(sub_x);
+        __m128i whole_y = whole_tiles_lanes(sub_y);
+        sub_x = _mm_sub_epi32(sub_x, _mm_slli_epi32(whole_x, FIXED_SHIFT));
+        sub_y = _mm_sub_epi32(sub_y, _mm_slli_epi32(whole_y, FIXED_SHIFT));
+
+        __m128i x = _mm_add_epi32(load_lanes(lanes->x + i), whole_x);
+        __m128i y = _mm_add_epi32(load_lanes(lanes->y + i), whole_y);
+        __m128i columns = load_lanes(lanes->columns + i);
+        __m128i rows = load_lanes(lanes->rows + i);
+
+        // wrap_tile_coords with outside_area set
+        x = select_epi32(_mm_cmplt_epi32(x, minus_one), columns,
+                         select_epi32(_mm_cmpgt_epi32(x, columns), minus_one, x));
+        y = select_epi32(_mm_cmplt_epi32(y, minus_one), rows,
+                         select_epi32(_mm_cmpgt_epi32(y, rows), minus_one, y));
+
+        store_lanes(lanes->x + i, x);
+        store_lanes(lanes->y + i, y);
+        store_lanes(lanes->sub_x + i, sub_x);
+        store_lanes(lanes->sub_y + i, sub_y);
+    }
+}
+
+// Lane version of set_ghost_speed
+static void select_ghost_speeds(fixed32 *speed, const fixed32 *default_speed, const int32_t *eaten,
+                                const int32_t *frightened, uint32_t count) {
+    const __m128i eaten_speed = _mm_set1_epi32(FIXED_FROM_FLOAT(DEFAULT_MOVEMENT_SPEED));
+    const __m128i frightened_mod = _mm_set1_epi32(FIXED_FROM_FLOAT(FRIGHTENED_SPEED_MOD));
+
+    for(uint32_t i = 0; i < count; i += LANE_WIDTH) {
+        __m128i base = load_lanes(default_speed + i);
+
+        __m128i result = select_epi32(load_lanes(frightened + i), fixed_mul_lanes(base, frightened_mod), base);
+        result = select_epi32(load_lanes(eaten + i), eaten_speed, result);
+        store_lanes(speed + i, result);
+    }
+}
+
+// Lane version of pick_ghost_direction
+static void pick_ghost_directions(const EntityLanes *lanes, const int32_t *target_x, const int32_t *target_y,
+                                  const int32_t *candidates, int32_t *best_dir, uint32_t count) {
+    const __m128i low_half = _mm_set1_epi32(0xffff);
+
+    for(uint32_t i = 0; i < count; i += LANE_WIDTH) {
+        __m128i x = load_lanes(lanes->x + i);
+        __m128i y = load_lanes(lanes->y + i);
+        __m128i tx = load_lanes(target_x + i);
+        __m128i ty = load_lanes(target_y + i);
+        __m128i allowed = load_lanes(candidates + i);
+
+        __m128i best = _mm_set1_epi32(MOVEMENT_DIR_NONE);
+        __m128i best_dist = _mm_set1_epi32(INT_MAX);
+
+        for(int32_t dir = 0; dir < 4; dir++) {
+            __m128i dist_x = _mm_sub_epi32(tx, _mm_add_epi32(x, _mm_set1_epi32((int32_t)direction_vectors[dir].x)));
+            __m128i dist_y = _mm_sub_epi32(ty, _mm_add_epi32(y, _mm_set1_epi32((int32_t)direction_vectors[dir].y)));
+
+            // Tile distances fit in 16 bits, so a single madd gives x * x + y * y
+            __m128i packed = _mm_or_si128(_mm_and_si128(dist_x, low_half), _mm_slli_epi32(dist_y, 16));
+            __m128i squared_dist = _mm_madd_epi16(packed, packed);
+
+            __m128i bit = _mm_set1_epi32(1 << dir);
+            __m128i closer = _mm_and_si128(_mm_cmpeq_epi32(_mm_and_si128(allowed, bit), bit),
+                                           _mm_cmplt_epi32(squared_dist, best_dist));
+
+            best_dist = select_epi32(closer, squared_dist, best_dist);
+            best = select_epi32(closer, _mm_set1_epi32(dir), best);
+        }
+
+        store_lanes(best_dir + i, best);
+    }
+}
+
+static inline void store_entity_lane(EntityLanes *lanes, uint32_t lane, const GameEntity *entity, const Level *level) {
+    lanes->x[lane] = entity->coord.x;
+    lanes->y[lane] = entity->coord.y;
+    lanes->sub_x[lane] = entity->coord.sub.x;
+    lanes->sub_y[lane] = entity->coord.sub.y;
+    lanes->dir[lane] = entity->dir;
+    lanes->speed[lane] = entity->speed;
+    lanes->columns[lane] = (int32_t)level->columns;
+    lanes->rows[lane] = (int32_t)level->rows;
+}
+
+static inline void load_entity_lane(const EntityLanes *lanes, uint32_t lane, GameEntity *entity) {
+    entity->coord.x = lanes->x[lane];
+    entity->coord.y = lanes->y[lane];
+    entity->coord.sub.x = lanes->sub_x[lane];
+    entity->coord.sub.y = lanes->sub_y[lane];
+    entity->speed = lanes->speed[lane];
+}
+
+static inline EntityLanes get_ghost_entity_lanes(GhostLanes *ghosts) {
+    EntityLanes lanes = {
+        .x = ghosts->x.lane,
+        .y = ghosts->y.lane,
+        .sub_x = ghosts->sub_x.lane,
+        .sub_y = ghosts->sub_y.lane,
+        .dir = ghosts->dir.lane,
+        .speed = ghosts->speed.lane,
+        .columns = ghosts->columns.lane,
+        .rows = ghosts->rows.lane
+    };
+
+    return lanes;
+}
+
+// The first tilecoords_overlap of handle_player_ghosts_collisions for all of the
+// ghosts at once. Bit g is set when ghost g touches the player.
+static uint32_t find_ghost_overlaps(const GhostLanes *ghosts, const TileCoord *player) {
+    const __m128i max_dist = _mm_set1_epi32(PLAYER_GHOST_TOUCH_SIZE);
+    const __m128i min_dist = _mm_set1_epi32(-PLAYER_GHOST_TOUCH_SIZE);
+
+    __m128i player_x = _mm_set1_epi32(player->x * FIXED_ONE + player->sub.x);
+    __m128i player_y = _mm_set1_epi32(player->y * FIXED_ONE + player->sub.y);
+    __m128i ghost_x = _mm_add_epi32(_mm_slli_epi32(ghosts->x.v, FIXED_SHIFT), ghosts->sub_x.v);
+    __m128i ghost_y = _mm_add_epi32(_mm_slli_epi32(ghosts->y.v, FIXED_SHIFT), ghosts->sub_y.v);
+
+    __m128i dist_x = _mm_sub_epi32(player_x, ghost_x);
+    __m128i dist_y = _mm_sub_epi32(player_y, ghost_y);
+    __m128i hit = _mm_and_si128(_mm_and_si128(_mm_cmplt_epi32(dist_x, max_dist), _mm_cmpgt_epi32(dist_x, min_dist)),
+                                _mm_and_si128(_mm_cmplt_epi32(dist_y, max_dist), _mm_cmpgt_epi32(dist_y, min_dist)));
+
+    return (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(hit));
+}
+
+// Same steps as update_ghosts, with speed selection, movement, direction scoring
+// and the overlap test done for all four ghosts at once. Steering and collision
+// responses stay scalar and run in ghost order, so the results are identical.
+static void update_ghost_lanes(GameContext *ctx, float dt) {
+    GhostLanes ghosts;
+    EntityLanes lanes = get_ghost_entity_lanes(&ghosts);
+
+    for(int32_t i = 0; i < GHOST_COUNT; i++) {
+        const GhostEntity *ghost = &ctx->ghosts[i];
+
+        store_entity_lane(&lanes, i, &ghost->entity, ctx->level);
+        ghosts.default_speed.lane[i] = ghost->entity.default_speed;
+        ghosts.eaten.lane[i] = (ghost->state == GHOST_STATE_EATEN) ? -1 : 0;
+        ghosts.frightened.lane[i] = ghost->frightened ? -1 : 0;
+        ghosts.old_x.lane[i] = ghost->entity.coord.x;
+        ghosts.old_y.lane[i] = ghost->entity.coord.y;
+    }
+
+    select_ghost_speeds(lanes.speed, ghosts.default_speed.lane, ghosts.eaten.lane, ghosts.frightened.lane, LANE_WIDTH);
+    move_entity_lanes(&lanes, LANE_WIDTH, dt);
+
+    // Each ghost is loaded back right before its own steering, so ghost i sees the
+    // ghosts after it where they were before moving, the same as in update_ghosts.
+    // Targets such as Inky's depend on that order.
+    for(int32_t i = 0; i < GHOST_COUNT; i++) {
+        GhostEntity *ghost = &ctx->ghosts[i];
+        load_entity_lane(&lanes, i, &ghost->entity);
+
+        TileCoord old_tile = { .x = ghosts.old_x.lane[i], .y = ghosts.old_y.lane[i] };
+        ghosts.candidates.lane[i] = (int32_t)begin_ghost_steering(ctx, i, &old_tile);
+        ghosts.target_x.lane[i] = ghost->target.x;
+        ghosts.target_y.lane[i] = ghost->target.y;
+    }
+
+    pick_ghost_directions(&lanes, ghosts.target_x.lane, ghosts.target_y.lane, ghosts.candidates.lane,
+                          ghosts.best_dir.lane, LANE_WIDTH);
+
+    for(int32_t i = 0; i < GHOST_COUNT; i++) {
+        MovementDirection dir = (MovementDirection)ghosts.best_dir.lane[i];
+        set_ghost_direction(&ctx->ghosts[i], steer_controlled_ghost(ctx, i, (uint32_t)ghosts.candidates.lane[i], dir));
+    }
+
+    // Steering doesn't move anything, the lanes still hold the ghost positions
+    if(find_ghost_overlaps(&ghosts, &ctx->player.entity.coord)) {
+        handle_player_ghosts_collisions(ctx);
+    }
+}
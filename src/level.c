@@ -5,174 +5,346 @@
  */
 
 #include <assert.h>
+#include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "level.h"
 
-static LevelFileData level_files;
-
 #ifndef __WIN32
 #define MAX_PATH 260 // Defined to be the same as Windows
 #endif
 
-static const char * get_next_level_name(void) {
-    const char *name = &level_files.names[level_files.current * (MAX_PATH + 1)];
-    level_files.current = (level_files.current + 1) % level_files.count;
-    return name;
+const char * get_level_file_name(const LevelFileData *data, uint32_t index) {
+    assert(data && index < data->count);
+    return &data->names[index * (MAX_PATH + 1)];
 }
 
-static void set_next_level_index(uint32_t index) {
-    level_files.current = index % level_files.count;
+static inline bool is_level_delimiter(char c) {
+    return c == ',' || c == ' ' || c == '\t' || c == '\r';
 }
 
-void init_levels(void) {
-    if(!level_files.names) {
-        memset(&level_files, 0, sizeof(level_files));
-        init_level_names(&level_files);
+// Stops counting past three digits, those are out of range anyway
+static inline uint32_t scan_level_number(const char **c, const char *end) {
+    const char *digit = *c;
+    uint32_t value = 0;
+
+    for(; digit < end && (uint32_t)(*digit - '0') <= 9; digit++) {
+        value = MIN(value * 10 + (uint32_t)(*digit - '0'), 1000);
     }
+
+    *c = digit;
+    return value;
 }
 
-void close_levels(void) {
-    if(level_files.names) {
-        destroy_level_names(&level_files);
-        memset(&level_files, 0, sizeof(level_files));
+// Moves the player and the ghosts out of the tiles and into their starts, and
+// marks which tiles have pellets
+static void find_level_starts(Level *level) {
+    uint32_t *pellets = (uint32_t *)(void *)&level->data[level->pellet_offset];
+
+    for(uint32_t y = 0; y < level->rows; y++) {
+        uint32_t index = get_level_tile_index(level, 0, y);
+        for(uint32_t x = 0; x < level->columns; x++, index++) {
+            uint8_t *tile = &level->data[index];
+
+            // Walls and pellets make up nearly all of it, and the pellet bits are
+            // set without a branch since those two alternate unpredictably
+            AtlasSprite sprite_id = *tile;
+            bool has_pellet = (sprite_id == ATLAS_SPRITE_PELLET || sprite_id == ATLAS_SPRITE_POWER_PELLET);
+            pellets[index / 32] |= (uint32_t)has_pellet << (index % 32);
+            if(sprite_id > ATLAS_SPRITE_CLYDE_FRAME2 && sprite_id != ATLAS_SPRITE_GHOST_HOUSE_GATE) {
+                continue;
+            }
+
+            switch(sprite_id) {
+                case ATLAS_SPRITE_GHOST_HOUSE_GATE:
+                    level->gate_tile.x = x;
+                    level->gate_tile.y = y;
+                    break;
+                case ATLAS_SPRITE_PLAYER_FRAME1:
+                case ATLAS_SPRITE_PLAYER_FRAME2:
+                    level->player_start.x = x;
+                    level->player_start.y = y;
+                    *tile = ATLAS_SPRITE_EMPTY;
+                    break;
+                case ATLAS_SPRITE_BLINKY_FRAME1:
+                case ATLAS_SPRITE_BLINKY_FRAME2:
+                    level->ghost_start[GHOST_BLINKY].x = x;
+                    level->ghost_start[GHOST_BLINKY].y = y;
+                    *tile = ATLAS_SPRITE_EMPTY;
+                    break;
+                case ATLAS_SPRITE_PINKY_FRAME1:
+                case ATLAS_SPRITE_PINKY_FRAME2:
+                    level->ghost_start[GHOST_PINKY].x = x;
+                    level->ghost_start[GHOST_PINKY].y = y;
+                    *tile = ATLAS_SPRITE_EMPTY;
+                    break;
+                case ATLAS_SPRITE_CLYDE_FRAME1:
+                case ATLAS_SPRITE_CLYDE_FRAME2:
+                    level->ghost_start[GHOST_CLYDE].x = x;
+                    level->ghost_start[GHOST_CLYDE].y = y;
+                    *tile = ATLAS_SPRITE_EMPTY;
+                    break;
+                case ATLAS_SPRITE_INKY_FRAME1:
+                case ATLAS_SPRITE_INKY_FRAME2:
+                    level->ghost_start[GHOST_INKY].x = x;
+                    level->ghost_start[GHOST_INKY].y = y;
+                    *tile = ATLAS_SPRITE_EMPTY;
+                    break;
+                default:
+                    break;
+            }
+        }
     }
+
+    level->pellet_count = count_level_pellets(level);
 }
 
-static Level * get_next_level(const char *file_name) {
-    assert(file_name);
+typedef struct {
+    uint8_t *tiles; // Row after row without padding
+    size_t *row_ends; // Tile count up to the end of each row
+    size_t tile_count;
+    size_t tile_capacity;
+    size_t row_count;
+    size_t row_capacity;
+    size_t column_count;
+} LevelTiles;
+
+// Without a reason it's about the character at c
+static void set_level_error(char *error, size_t error_size, size_t row, const char *line, const char *c, const char *reason) {
+    size_t column = (size_t)(c - line) + 1;
+    unsigned char bad = (unsigned char)*c;
 
-    static char buf[9999];
-    snprintf(buf, sizeof(buf), "data/level/%s", file_name);
-    FILE *f = fopen(buf, "rb");
+    if(reason) {
+        snprintf(error, error_size, "line %zu, column %zu: %s", row + 1, column, reason);
+    } else if(bad >= ' ' && bad < 0x7f) {
+        snprintf(error, error_size, "line %zu, column %zu: unexpected '%c'", row + 1, column, bad);
+    } else {
+        snprintf(error, error_size, "line %zu, column %zu: unexpected byte 0x%02x", row + 1, column, bad);
+    }
+}
 
-    if(f) {
-        static const char *delims = " ,\n\r";
+// Scans the lines with memchr and the numbers in place, without copying anything
+// but the tiles
+static bool scan_level_tiles(LevelTiles *scan, const char *text, size_t size, char *error, size_t error_size) {
+    const char *end = text + size;
 
-        int row_count = 0;
-        int max_column_count = 0;
+    for(const char *line = text; line < end; scan->row_count++) {
+        const char *line_end = memchr(line, '\n', (size_t)(end - line));
+        if(!line_end) {
+            line_end = end;
+        }
 
-        // First determine how many tiles there are
-        while(fgets(buf, sizeof(buf), f)) {
-            row_count++;
-            int column_count = 0;
+        // Kept in locals, the compiler can't tell that the tile stores leave scan alone
+        uint8_t *tiles = scan->tiles;
+        size_t tile_count = scan->tile_count;
+        size_t tile_capacity = scan->tile_capacity;
+        const char *c = line;
+        while(c < line_end) {
+            const char *token = c;
+            uint8_t tile;
 
-            char *token;
-            char *b = buf;
-            while((token = strtok(b, delims)) != NULL) {
-                b = NULL;
-                column_count++;
+            // Numbers first, they're most of the file
+            if((uint32_t)(*c - '0') <= 9) {
+                uint32_t value = scan_level_number(&c, line_end);
+                if(value >= LEVEL_TILE_BORDER) {
+                    set_level_error(error, error_size, scan->row_count, line, token, "tile numbers go from -1 to 254");
+                    return false;
+                }
+                tile = (uint8_t)value;
+            } else if(is_level_delimiter(*c)) {
+                c++;
+                continue;
+            } else if(*c == '-') {
+                c++;
+                const char *digits = c;
+                uint32_t value = scan_level_number(&c, line_end);
+                if(c == digits || value != 1) {
+                    set_level_error(error, error_size, scan->row_count, line, token, "tile numbers go from -1 to 254");
+                    return false;
+                }
+                tile = ATLAS_SPRITE_EMPTY;
+            } else {
+                set_level_error(error, error_size, scan->row_count, line, c, NULL);
+                return false;
             }
 
-            if(column_count > max_column_count) {
-                max_column_count = column_count;
+            // Takes the delimiter along, it saves going around the loop for it
+            if(c < line_end) {
+                if(!is_level_delimiter(*c)) {
+                    set_level_error(error, error_size, scan->row_count, line, c, NULL);
+                    return false;
+                }
+                c++;
             }
-        }
 
-        fseek(f, 0, SEEK_SET);
-
-        Level *level = calloc(1, offsetof(struct Level, data) + (row_count * max_column_count * sizeof(uint32_t)));
-        level->rows = row_count;
-        level->columns = max_column_count;
-
-        // Parse the level/tile data
-        int index = 0;
-        while(fgets(buf, sizeof(buf), f)) {
-            char *token;
-            char *b = buf;
-
-            while((token = strtok(b, delims)) != NULL) {
-                int value = atoi(token);
-                switch(value) {
-                    case -1:
-                        level->data[index] = ATLAS_SPRITE_EMPTY;
-                        break;
-                    default:
-                        level->data[index] = value;
-                        break;
+            if(tile_count == tile_capacity) {
+                tiles = realloc(tiles, tile_capacity * 2);
+                if(!tiles) {
+                    snprintf(error, error_size, "out of memory");
+                    return false;
                 }
+                scan->tiles = tiles;
+                scan->tile_capacity = tile_capacity *= 2;
+            }
+            tiles[tile_count++] = tile;
+        }
+
+        size_t row_start = scan->tile_count;
+        scan->tile_count = tile_count;
 
-                b = NULL;
-                index++;
+        if(scan->row_count == scan->row_capacity) {
+            size_t *row_ends = realloc(scan->row_ends, scan->row_capacity * 2 * sizeof(*row_ends));
+            if(!row_ends) {
+                snprintf(error, error_size, "out of memory");
+                return false;
             }
+            scan->row_ends = row_ends;
+            scan->row_capacity *= 2;
         }
+        scan->row_ends[scan->row_count] = scan->tile_count;
+        scan->column_count = MAX(scan->column_count, scan->tile_count - row_start);
+
+        line = line_end + 1;
+    }
 
-        fclose(f);
-        return level;
+    if(scan->column_count == 0) {
+        snprintf(error, error_size, "no tiles");
+        return false;
     }
 
-    return NULL;
+    // Tile indices are 32 bits, with room to spare for the pellet bits
+    if(scan->row_count + 2 > UINT32_MAX / 2 / (scan->column_count + 2)) {
+        snprintf(error, error_size, "%zu by %zu tiles is too large", scan->column_count, scan->row_count);
+        return false;
+    }
+
+    return true;
 }
 
-Level * load_next_level(void) {
-    init_levels();
+static Level * create_level(const LevelTiles *scan) {
+    uint32_t stride = (uint32_t)scan->column_count + 2;
+    uint32_t tile_count = ((uint32_t)scan->row_count + 2) * stride;
+    uint32_t pellet_offset = (tile_count + 3) & ~3u;
+    Level *level = calloc(1, offsetof(struct Level, data) + pellet_offset + (tile_count + 31) / 32 * sizeof(uint32_t));
 
-    Level *level = get_next_level(get_next_level_name());
     if(level) {
+        level->rows = (uint32_t)scan->row_count;
+        level->columns = (uint32_t)scan->column_count;
+        level->stride = stride;
+        level->pellet_offset = pellet_offset;
+        memset(level->data, LEVEL_TILE_BORDER, tile_count);
+
         for(uint32_t y = 0; y < level->rows; y++) {
-            for(uint32_t x = 0; x < level->columns; x++) {
-                uint32_t *tile = get_level_tile(level, x, y);
-                if(!tile) {
-                    continue;
-                }
+            size_t row_start = (y > 0) ? scan->row_ends[y - 1] : 0;
+            size_t length = scan->row_ends[y] - row_start;
+            uint8_t *row = &level->data[get_level_tile_index(level, 0, y)];
 
-                AtlasSprite sprite_id = *tile;
-                switch(sprite_id) {
-                    case ATLAS_SPRITE_GHOST_HOUSE_GATE:
-                        level->gate_tile.x = x;
-                        level->gate_tile.y = y;
-                        break;
-                    case ATLAS_SPRITE_PLAYER_FRAME1:
-                    case ATLAS_SPRITE_PLAYER_FRAME2:
-                        level->player_start.x = x;
-                        level->player_start.y = y;
-                        *tile = ATLAS_SPRITE_EMPTY;
-                        break;
-                    case ATLAS_SPRITE_BLINKY_FRAME1:
-                    case ATLAS_SPRITE_BLINKY_FRAME2:
-                        level->ghost_start[GHOST_BLINKY].x = x;
-                        level->ghost_start[GHOST_BLINKY].y = y;
-                        *tile = ATLAS_SPRITE_EMPTY;
-                        break;
-                    case ATLAS_SPRITE_PINKY_FRAME1:
-                    case ATLAS_SPRITE_PINKY_FRAME2:
-                        level->ghost_start[GHOST_PINKY].x = x;
-                        level->ghost_start[GHOST_PINKY].y = y;
-                        *tile = ATLAS_SPRITE_EMPTY;
-                        break;
-                    case ATLAS_SPRITE_CLYDE_FRAME1:
-                    case ATLAS_SPRITE_CLYDE_FRAME2:
-                        level->ghost_start[GHOST_CLYDE].x = x;
-                        level->ghost_start[GHOST_CLYDE].y = y;
-                        *tile = ATLAS_SPRITE_EMPTY;
-                        break;
-                    case ATLAS_SPRITE_INKY_FRAME1:
-                    case ATLAS_SPRITE_INKY_FRAME2:
-                        level->ghost_start[GHOST_INKY].x = x;
-                        level->ghost_start[GHOST_INKY].y = y;
-                        *tile = ATLAS_SPRITE_EMPTY;
-                        break;
-                    default:
-                        break;
-                }
+            // Short rows used to be padded with zeroes
+            memcpy(row, &scan->tiles[row_start], length);
+            memset(row + length, 0, level->columns - length);
+        }
 
-                if(sprite_id == ATLAS_SPRITE_PELLET || sprite_id == ATLAS_SPRITE_POWER_PELLET) {
-                    level->pellet_count++;
-                }
-            }
+        find_level_starts(level);
+    }
+
+    return level;
+}
+
+Level * parse_level(const char *text, size_t size, char *error, size_t error_size) {
+    assert(text && error && error_size > 0);
+    error[0] = '\0';
+
+    // Every tile takes at least a digit and a delimiter, so the tiles rarely have to grow
+    LevelTiles scan = {
+        .tile_capacity = size / 2 + 1,
+        .row_capacity = 64
+    };
+    scan.tiles = malloc(scan.tile_capacity);
+    scan.row_ends = malloc(scan.row_capacity * sizeof(*scan.row_ends));
+
+    Level *level = NULL;
+    if(!scan.tiles || !scan.row_ends) {
+        snprintf(error, error_size, "out of memory");
+    } else if(scan_level_tiles(&scan, text, size, error, error_size)) {
+        level = create_level(&scan);
+        if(!level) {
+            snprintf(error, error_size, "out of memory");
         }
+    }
 
-        return level;
+    free(scan.tiles);
+    free(scan.row_ends);
+
+    return level;
+}
+
+Level * load_level(const char *file_name) {
+    assert(file_name);
+
+    char path[MAX_PATH + 16];
+    snprintf(path, sizeof(path), "data/level/%s", file_name);
+    FILE *f = fopen(path, "rb");
+    if(!f) {
+        return NULL;
     }
 
-    return NULL;
+    char *text = NULL;
+    long size = -1;
+    if(fseek(f, 0, SEEK_END) == 0 && (size = ftell(f)) >= 0) {
+        text = malloc(MAX((size_t)size, 1));
+
+        if(text && (fseek(f, 0, SEEK_SET) != 0 || fread(text, 1, (size_t)size, f) != (size_t)size)) {
+            free(text);
+            text = NULL;
+        }
+    }
+    fclose(f);
+
+    if(!text) {
+        fprintf(stderr, "%s: could not be read\n", path);
+        return NULL;
+    }
+
+    char error[128];
+    Level *level = parse_level(text, (size_t)size, error, sizeof(error));
+    if(!level) {
+        fprintf(stderr, "%s: %s\n", path, error);
+    }
+    free(text);
+
+    return level;
+}
+
+size_t get_level_size(const Level *level) {
+    assert(level);
+    return offsetof(struct Level, data) + level->pellet_offset + get_level_pellets_size(level);
 }
 
-Level * load_first_level(void) {
-    init_levels();
+uint32_t count_level_pellets(const Level *level) {
+    assert(level);
+
+    const uint32_t *pellets = get_level_pellets(level);
+    uint32_t count = 0;
+    for(size_t i = 0; i < get_level_pellets_size(level) / sizeof(uint32_t); i++) {
+        uint32_t bits = pellets[i] - ((pellets[i] >> 1) & 0x55555555);
+        bits = (bits & 0x33333333) + ((bits >> 2) & 0x33333333);
+        count += (((bits + (bits >> 4)) & 0x0f0f0f0f) * 0x01010101) >> 24;
+    }
+
+    return count;
+}
+
+Level * copy_level(const Level *level) {
+    Level *copy = NULL;
+
+    if(level) {
+        size_t size = get_level_size(level);
+        copy = malloc(size);
+        memcpy(copy, level, size);
+    }
 
-    set_next_level_index(0);
-    return load_next_level();
+    return copy;
 }
 
 void unload_level(Level **level) {
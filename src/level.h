@@ -8,16 +8,23 @@
 #define LEVEL_H
 
 #include <assert.h>
+#include <stddef.h>
 #include <stdint.h>
 #include "common.h"
 #include "render.h"
 
 typedef struct {
-    Vector2 sub;
+    Vector2x sub;
     int32_t x;
     int32_t y;
 } TileCoord;
 
+// Tiles are stored one byte each with a one-tile border of LEVEL_TILE_BORDER around
+// the level, so the neighbors of any tile inside it can be read without bounds
+// checks. Pellet tiles keep their type, whether the pellet is still there lives in
+// a bitset after the tiles with one bit per stored tile.
+#define LEVEL_TILE_BORDER UINT8_MAX
+
 typedef struct Level {
     TileCoord ghost_start[GHOST_COUNT];
     TileCoord player_start;
@@ -26,29 +33,73 @@ typedef struct Level {
     uint32_t pellets_eaten;
     uint32_t rows;
     uint32_t columns;
-    uint32_t data[];
+    uint32_t stride; // Tiles per stored row, including the border
+    uint32_t pellet_offset; // Byte offset of the pellet bitset in data
+    uint8_t data[];
 } Level;
 
 typedef struct {
     char *names;
     uint32_t count;
-    uint32_t current;
 } LevelFileData;
 
-#define X_COORDS_VALID(xcoord, level) ((xcoord) >= 0 && (xcoord) < (int32_t)(level)->columns)
-#define Y_COORDS_VALID(ycoord, level) ((ycoord) >= 0 && (ycoord) < (int32_t)(level)->rows)
+static inline bool level_coords_valid(const Level *level, int32_t x, int32_t y) {
+    return x >= 0 && x < (int32_t)level->columns && y >= 0 && y < (int32_t)level->rows;
+}
+
+// Valid from -1 to columns/rows, which includes the border
+static inline uint32_t get_level_tile_index(const Level *level, int32_t x, int32_t y) {
+    assert(level && x >= -1 && x <= (int32_t)level->columns && y >= -1 && y <= (int32_t)level->rows);
+    return (uint32_t)(y + 1) * level->stride + (uint32_t)(x + 1);
+}
+
+static inline uint8_t get_level_tile_data(const Level *level, const TileCoord *coord) {
+    assert(level && coord);
+    return level->data[get_level_tile_index(level, coord->x, coord->y)];
+}
+
+static inline const uint32_t * get_level_pellets(const Level *level) {
+    return (const uint32_t *)(const void *)&level->data[level->pellet_offset];
+}
+
+static inline size_t get_level_pellets_size(const Level *level) {
+    return ((level->rows + 2) * level->stride + 31) / 32 * sizeof(uint32_t);
+}
+
+static inline bool level_tile_has_pellet(const Level *level, uint32_t index) {
+    return (get_level_pellets(level)[index / 32] >> (index % 32)) & 1;
+}
+
+static inline void clear_level_pellet(Level *level, uint32_t index) {
+    uint32_t *pellets = (uint32_t *)(void *)&level->data[level->pellet_offset];
+    pellets[index / 32] &= ~(1u << (index % 32));
+}
 
-static inline uint32_t * get_level_tile(Level *level, int32_t x, int32_t y) {
-    if(level && x >= 0 && X_COORDS_VALID(x, level) && Y_COORDS_VALID(y, level)) {
-        return &level->data[y * level->columns + x];
+// What should be drawn on a tile, eaten pellets are empty
+static inline uint8_t get_level_tile_sprite(const Level *level, uint32_t index) {
+    uint8_t type = level->data[index];
+    if((type == ATLAS_SPRITE_PELLET || type == ATLAS_SPRITE_POWER_PELLET) && !level_tile_has_pellet(level, index)) {
+        return ATLAS_SPRITE_EMPTY;
     }
 
-    return NULL;
+    return type;
 }
 
-static inline uint32_t get_level_tile_data(const Level *level, const TileCoord *coord) {
-    assert(level && coord);
-    return level->data[coord->y * level->columns + coord->x];
+// Where each ghost heads in scatter mode, one tile in from the corners
+static inline TileCoord get_level_scatter_corner(const Level *level, uint32_t ghost) {
+    int32_t right = (int32_t)level->columns - 2;
+    int32_t bottom = (int32_t)level->rows - 2;
+    TileCoord corner = { 0 };
+
+    switch(ghost) {
+        case GHOST_BLINKY: corner.x = right; corner.y = 1; break;
+        case GHOST_PINKY: corner.x = 1; corner.y = 1; break;
+        case GHOST_CLYDE: corner.x = 1; corner.y = bottom; break;
+        case GHOST_INKY: corner.x = right; corner.y = bottom; break;
+        default: break;
+    }
+
+    return corner;
 }
 
 typedef enum {
@@ -58,38 +109,30 @@ typedef enum {
     TILE_NEIGHBOR_RIGHT
 } TileNeighbor;
 
-static inline int32_t get_neighboring_tile_index(const Level *level, int32_t x, int32_t y, TileNeighbor dir) {
-    int32_t index = -1;
-
-    if(level) {
-#define NEIGHBOR_TILE_INDEX(neighbor_dir, xn, yn) \
-        case neighbor_dir: \
-            if(X_COORDS_VALID((xn), level) && Y_COORDS_VALID((yn), level)) { \
-                index = (yn) * level->columns + (xn); \
-            } \
-            break
-
-        switch(dir) {
-            NEIGHBOR_TILE_INDEX(TILE_NEIGHBOR_TOP, x, (y-1));
-            NEIGHBOR_TILE_INDEX(TILE_NEIGHBOR_LEFT, (x-1), y);
-            NEIGHBOR_TILE_INDEX(TILE_NEIGHBOR_BOTTOM, x, (y+1));
-            NEIGHBOR_TILE_INDEX(TILE_NEIGHBOR_RIGHT, (x+1), y);
-        }
-
-#undef NEIGHBOR_TILE_INDEX
+// Only valid for tiles inside the level, the border takes the place of the checks
+static inline uint32_t get_neighboring_tile_index(const Level *level, uint32_t index, TileNeighbor dir) {
+    switch(dir) {
+        case TILE_NEIGHBOR_TOP: return index - level->stride;
+        case TILE_NEIGHBOR_LEFT: return index - 1;
+        case TILE_NEIGHBOR_BOTTOM: return index + level->stride;
+        case TILE_NEIGHBOR_RIGHT: return index + 1;
     }
 
     return index;
 }
 
-void init_levels(void);
-void close_levels(void);
+uint32_t count_level_pellets(const Level *level);
 
-Level * load_next_level(void);
-Level * load_first_level(void);
-void unload_level(Level **level);
+const char * get_level_file_name(const LevelFileData *data, uint32_t index);
 
-#undef X_COORDS_VALID
-#undef Y_COORDS_VALID
+// Levels are text files with one row of tile numbers per line, separated by
+// commas or spaces. -1 is an empty tile and short rows are padded with zeroes.
+// parse_level returns NULL with the line, the column and the reason in error.
+// load_level reads data/level/<file_name> and reports errors on stderr.
+Level * parse_level(const char *text, size_t size, char *error, size_t error_size);
+Level * load_level(const char *file_name);
+Level * copy_level(const Level *level);
+size_t get_level_size(const Level *level);
+void unload_level(Level **level);
 
 #endif /* LEVEL_H */
@@ -0,0 +1,274 @@
+/*
+ * Pacman Clone
+ *
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "levelfile.h"
+
+static inline uint32_t get_compiled_level_fields_offset(uint32_t level_size) {
+    return (sizeof(CompiledLevelHeader) + level_size + 3) & ~3u;
+}
+
+static bool get_level_source_stamp(const char *file_name, uint32_t *size, uint32_t *time) {
+    char path[MAX_PATH + 16];
+    snprintf(path, sizeof(path), "data/level/%s", file_name);
+
+    uint64_t file_size = 0;
+    uint64_t write_time = 0;
+    bool found = get_file_stamp(path, &file_size, &write_time);
+    *size = (uint32_t)file_size;
+    *time = (uint32_t)write_time;
+    return found;
+}
+
+void * create_compiled_level(const Level *level, const LevelGraph *graph, const char *file_name, size_t *size) {
+    assert(level && file_name && size);
+
+    CompiledLevelHeader header = {
+        .magic = COMPILED_LEVEL_MAGIC,
+        .version = COMPILED_LEVEL_VERSION,
+        .level_size = (uint32_t)get_level_size(level)
+    };
+    get_level_source_stamp(file_name, &header.source_size, &header.source_time);
+    *size = sizeof(header) + header.level_size;
+    if(graph) {
+        header.fields_offset = get_compiled_level_fields_offset(header.level_size);
+        *size = header.fields_offset + get_level_graph_fields_size(graph);
+    }
+
+    uint8_t *compiled = calloc(1, *size);
+    if(compiled) {
+        memcpy(compiled, &header, sizeof(header));
+        memcpy(compiled + sizeof(header), level, header.level_size);
+        if(graph) {
+            memcpy(compiled + header.fields_offset, graph->exits, get_level_graph_fields_size(graph));
+        }
+    }
+
+    return compiled;
+}
+
+size_t save_compiled_level(const char *file_name, const Level *level, const LevelGraph *graph) {
+    assert(file_name && level);
+
+    char path[MAX_PATH + 16];
+    get_compiled_level_path(file_name, path, sizeof(path));
+
+    size_t size = 0;
+    void *compiled = create_compiled_level(level, graph, file_name, &size);
+    FILE *f = compiled ? fopen(path, "wb") : NULL;
+    bool written = false;
+    if(f) {
+        written = fwrite(compiled, size, 1, f) == 1;
+        written = (fclose(f) == 0) && written;
+    }
+    free(compiled);
+
+    return written ? size : 0;
+}
+
+static inline bool compiled_header_valid(const CompiledLevelHeader *header) {
+    return header->magic == COMPILED_LEVEL_MAGIC && header->version == COMPILED_LEVEL_VERSION &&
+           header->level_size > offsetof(struct Level, data) && header->level_size < UINT32_MAX / 2 &&
+           (header->fields_offset == 0 || header->fields_offset == get_compiled_level_fields_offset(header->level_size));
+}
+
+static inline size_t get_compiled_fields_size(const Level *level) {
+    return (size_t)(level->rows + 2) * level->stride * (1 + LEVEL_DISTANCE_FIELD_COUNT) * sizeof(uint16_t);
+}
+
+// The tiles have to be what parse_level makes: the border all around, the
+// starts already taken out of the tiles and a pellet bit for every pellet tile
+static bool compiled_level_tiles_valid(const Level *level) {
+    const uint32_t *pellets = get_level_pellets(level);
+    uint32_t tile_count = (level->rows + 2) * level->stride;
+    uint32_t expected = 0;
+
+    for(uint32_t index = 0; index < tile_count; index++) {
+        uint32_t x = index % level->stride;
+        uint32_t y = index / level->stride;
+        bool border = (x == 0 || x > level->columns || y == 0 || y > level->rows);
+
+        uint8_t tile = level->data[index];
+        if(border != (tile == LEVEL_TILE_BORDER) ||
+           (tile >= ATLAS_SPRITE_PLAYER_FRAME1 && tile <= ATLAS_SPRITE_CLYDE_FRAME2)) {
+            return false;
+        }
+
+        bool has_pellet = (tile == ATLAS_SPRITE_PELLET || tile == ATLAS_SPRITE_POWER_PELLET);
+        expected |= (uint32_t)has_pellet << (index % 32);
+        if(index % 32 == 31 || index == tile_count - 1) {
+            if(pellets[index / 32] != expected) {
+                return false;
+            }
+            expected = 0;
+        }
+    }
+
+    return level->pellets_eaten == 0 && level->pellet_count == count_level_pellets(level);
+}
+
+// The sizes are checked in 64 bits so that no header can wrap them around
+static bool compiled_level_valid(const Level *level, uint32_t level_size) {
+    if(level->rows == 0 || level->columns == 0 || (uint64_t)level->stride != (uint64_t)level->columns + 2 ||
+       ((uint64_t)level->rows + 2) * level->stride > UINT32_MAX / 2) {
+        return false;
+    }
+
+    uint32_t tile_count = (level->rows + 2) * level->stride;
+    if(level->pellet_offset != ((tile_count + 3) & ~3u) || get_level_size(level) != level_size) {
+        return false;
+    }
+
+    if(!level_coords_valid(level, level->player_start.x, level->player_start.y) ||
+       !level_coords_valid(level, level->gate_tile.x, level->gate_tile.y)) {
+        return false;
+    }
+
+    for(int32_t i = 0; i < GHOST_COUNT; i++) {
+        if(!level_coords_valid(level, level->ghost_start[i].x, level->ghost_start[i].y)) {
+            return false;
+        }
+    }
+
+    return compiled_level_tiles_valid(level);
+}
+
+static bool compiled_header_out_of_date(const CompiledLevelHeader *header, const char *file_name) {
+    uint32_t size = 0;
+    uint32_t time = 0;
+    return get_level_source_stamp(file_name, &size, &time) &&
+           (header->source_size != size || header->source_time != time);
+}
+
+bool compiled_level_out_of_date(const void *data, size_t size, const char *file_name) {
+    assert(data && file_name);
+
+    CompiledLevelHeader header;
+    if(size < sizeof(header)) {
+        return true;
+    }
+
+    memcpy(&header, data, sizeof(header));
+    return compiled_header_out_of_date(&header, file_name);
+}
+
+bool load_compiled_level(const char *file_name, Level **level, LevelGraph **graph) {
+    assert(file_name && level && graph);
+    *level = NULL;
+    *graph = NULL;
+
+    char path[MAX_PATH + 16];
+    get_compiled_level_path(file_name, path, sizeof(path));
+    FILE *f = fopen(path, "rb");
+    if(!f) {
+        return false;
+    }
+
+    CompiledLevelHeader header;
+    Level *compiled = NULL;
+    uint16_t *fields = NULL;
+
+    bool header_read = fread(&header, sizeof(header), 1, f) == 1 && compiled_header_valid(&header);
+    if(header_read && compiled_header_out_of_date(&header, file_name)) {
+        fprintf(stderr, "%s: %s has changed since it was compiled, run pacman_levelc again\n", path, file_name);
+        fclose(f);
+        return false;
+    }
+
+    if(header_read) {
+        compiled = malloc(header.level_size);
+    }
+
+    if(compiled && (fread(compiled, header.level_size, 1, f) != 1 || !compiled_level_valid(compiled, header.level_size))) {
+        unload_level(&compiled);
+    }
+
+    if(compiled && header.fields_offset) {
+        size_t fields_size = get_compiled_fields_size(compiled);
+        fields = malloc(fields_size);
+
+        if(!fields || fseek(f, header.fields_offset, SEEK_SET) != 0 || fread(fields, fields_size, 1, f) != 1) {
+            unload_level(&compiled);
+        }
+    }
+    fclose(f);
+
+    if(!compiled) {
+        fprintf(stderr, "%s: not a compiled level of version %d for this machine\n", path, COMPILED_LEVEL_VERSION);
+    } else {
+        *graph = create_level_graph_from_fields(compiled, fields);
+        *level = compiled;
+    }
+    free(fields);
+
+    if(compiled && !*graph) {
+        fprintf(stderr, "%s: the stored graph doesn't match the level\n", path);
+        unload_level(level);
+    }
+
+    return *level != NULL;
+}
+
+bool open_compiled_level(const void *data, size_t size, const Level **level, LevelGraph **graph) {
+    assert(data && level && graph);
+    *level = NULL;
+    *graph = NULL;
+
+    // The level is used in place, which needs it aligned
+    const CompiledLevelHeader *header = data;
+    if(((uintptr_t)data % sizeof(uint32_t)) != 0 || size < sizeof(*header) || !compiled_header_valid(header) ||
+       size - sizeof(*header) < header->level_size) {
+        return false;
+    }
+
+    const Level *compiled = (const Level *)(header + 1);
+    if(!compiled_level_valid(compiled, header->level_size)) {
+        return false;
+    }
+
+    const uint16_t *fields = NULL;
+    if(header->fields_offset) {
+        if(size < header->fields_offset || size - header->fields_offset < get_compiled_fields_size(compiled)) {
+            return false;
+        }
+        fields = (const uint16_t *)(const void *)((const uint8_t *)data + header->fields_offset);
+    }
+
+    *graph = create_level_graph_from_fields(compiled, fields);
+    *level = *graph ? compiled : NULL;
+
+    return *level != NULL;
+}
+
+void get_compiled_level_path(const char *file_name, char *path, size_t path_size) {
+    assert(file_name && path);
+
+    // Swaps the extension for the compiled one
+    const char *extension = strrchr(file_name, '.');
+    int32_t stem_length = (int32_t)(extension ? (size_t)(extension - file_name) : strlen(file_name));
+    snprintf(path, path_size, "data/level/%.*s.lvl", stem_length, file_name);
+}
+
+bool load_level_and_graph(const char *file_name, Level **level, LevelGraph **graph) {
+    assert(file_name && level && graph);
+
+    if(load_compiled_level(file_name, level, graph)) {
+        return true;
+    }
+
+    *level = load_level(file_name);
+    *graph = create_level_graph(*level);
+    if(!*level || !*graph) {
+        unload_level(level);
+        destroy_level_graph(graph);
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,59 @@
+/*
+ * Pacman Clone
+ *
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ */
+
+#ifndef LEVEL_FILE_H
+#define LEVEL_FILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "level.h"
+#include "levelgraph.h"
+
+// Compiled levels (.lvl, next to the .csv they come from) hold the Level the
+// same way it's laid out in memory, right after a header, so loading one is a
+// single read with nothing to parse or look up. The exit masks and distance
+// fields of the level graph may follow it, starting on four bytes. Everything
+// is in the byte order of the machine that compiled it, the magic doesn't match
+// on any other. The header also has the size and write time of the .csv, and
+// once that changes the compiled level is out of date.
+#define COMPILED_LEVEL_MAGIC 0x4c564c50 // "PLVL" little endian
+#define COMPILED_LEVEL_VERSION 2
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t level_size; // get_level_size of the level after the header
+    uint32_t fields_offset; // From the start of the file, 0 if the graph fields aren't there
+    uint32_t source_size; // Of data/level/<file_name>, the low 32 bits
+    uint32_t source_time; // When it was last written, in seconds since 1970
+} CompiledLevelHeader;
+
+// Both include the exit masks and distance fields of graph unless it's NULL.
+// level was loaded from data/level/<file_name>, which is where
+// save_compiled_level puts it, with the .lvl extension.
+void * create_compiled_level(const Level *level, const LevelGraph *graph, const char *file_name, size_t *size);
+// Returns the size of the file in bytes, or 0 if it couldn't be written
+size_t save_compiled_level(const char *file_name, const Level *level, const LevelGraph *graph);
+// Loads the compiled level of data/level/<file_name>. Returns false if it's
+// missing, out of date or isn't a compiled level of this version, the last two
+// are also reported on stderr. The graph is worked out from the level if the
+// file doesn't carry its fields.
+bool load_compiled_level(const char *file_name, Level **level, LevelGraph **graph);
+// Whether data/level/<file_name> has changed since the compiled level in data
+// was made from it. A missing file hasn't.
+bool compiled_level_out_of_date(const void *data, size_t size, const char *file_name);
+
+// For compiled levels that are already in memory, such as in a pack. The level
+// points into data, only the graph is allocated.
+bool open_compiled_level(const void *data, size_t size, const Level **level, LevelGraph **graph);
+
+// data/level/<file_name> with the .lvl extension
+void get_compiled_level_path(const char *file_name, char *path, size_t path_size);
+// Loads data/level/<file_name>, from the compiled level next to it if there is one
+bool load_level_and_graph(const char *file_name, Level **level, LevelGraph **graph);
+
+#endif /* LEVEL_FILE_H */
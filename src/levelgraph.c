@@ -0,0 +1,427 @@
+/*
+ * Pacman Clone
+ *
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "levelgraph.h"
+#include "platform.h"
+
+// Targets per parallel job
+#define NEXT_HOP_JOB_SIZE 64
+
+static const int32_t neighbor_offsets[4][2] = {
+    { 0, -1 }, // Top
+    { -1, 0 }, // Left
+    { 0, 1 },  // Bottom
+    { 1, 0 },  // Right
+};
+
+// Anything past the border is treated as more border
+static uint8_t get_graph_tile_type(const Level *level, int32_t x, int32_t y) {
+    if(x < -1 || y < -1 || x > (int32_t)level->columns || y > (int32_t)level->rows) {
+        return LEVEL_TILE_BORDER;
+    }
+
+    return level->data[get_level_tile_index(level, x, y)];
+}
+
+static inline bool tile_type_is_solid(uint8_t type) {
+    return type == ATLAS_SPRITE_WALL_NORMAL || type == ATLAS_SPRITE_WALL_BOTTOM;
+}
+
+static uint16_t get_tile_exits(const Level *level, int32_t x, int32_t y) {
+    uint16_t exits = 0;
+    for(uint32_t dir = 0; dir < 4; dir++) {
+        uint8_t type = get_graph_tile_type(level, x + neighbor_offsets[dir][0], y + neighbor_offsets[dir][1]);
+
+        if(!tile_type_is_solid(type)) {
+            exits |= 1 << (dir + LEVEL_EXITS_GATE_SHIFT);
+            if(type != ATLAS_SPRITE_GHOST_HOUSE_GATE) {
+                exits |= 1 << dir;
+            }
+        }
+        if(type == LEVEL_TILE_BORDER) {
+            exits |= 1 << (dir + LEVEL_EXITS_BORDER_SHIFT);
+        }
+    }
+
+    return exits;
+}
+
+// A ghost entering a corridor can only go on one way, whether the gate is open
+// or not. Tiles next to the gate or the border don't qualify.
+static bool tile_is_corridor(const LevelGraph *graph, uint32_t index, uint8_t type) {
+    uint32_t closed = get_level_exits(graph, index, false, false);
+    uint32_t open = get_level_exits(graph, index, true, false);
+
+    return type != ATLAS_SPRITE_GHOST_HOUSE_GATE && (graph->exits[index] >> LEVEL_EXITS_BORDER_SHIFT) == 0 &&
+        closed == open && get_level_exit_count(closed) == 2;
+}
+
+static inline uint32_t step_graph_tile(const LevelGraph *graph, uint32_t index, uint32_t dir) {
+    switch(dir) {
+        case TILE_NEIGHBOR_TOP: return index - graph->stride;
+        case TILE_NEIGHBOR_LEFT: return index - 1;
+        case TILE_NEIGHBOR_BOTTOM: return index + graph->stride;
+        default: return index + 1;
+    }
+}
+
+static void walk_level_segment(LevelGraph *graph, uint32_t junction, uint32_t dir) {
+    LevelSegment *segment = &graph->segments[junction * 4 + dir];
+    uint32_t index = graph->junction_tiles[junction];
+
+    for(uint32_t length = 1; length <= graph->tile_count; length++) {
+        index = step_graph_tile(graph, index, dir);
+
+        if(!level_tile_is_corridor(graph, index)) {
+            segment->junction = graph->junctions[index];
+            segment->length = length;
+            return;
+        }
+
+        uint32_t next = get_level_exits(graph, index, false, false) & get_forward_exits(dir);
+        for(dir = 0; !(next & (1u << dir)); dir++);
+    }
+}
+
+// Breadth first search out from one tile, queue has room for every tile
+static void fill_distance_field(LevelGraph *graph, uint16_t *distances, uint32_t source, bool gate_open,
+                                uint32_t *queue) {
+    for(uint32_t i = 0; i < graph->tile_count; i++) {
+        distances[i] = LEVEL_DISTANCE_UNREACHABLE;
+    }
+
+    uint32_t head = 0;
+    uint32_t tail = 0;
+    distances[source] = 0;
+    queue[tail++] = source;
+
+    while(head < tail) {
+        uint32_t index = queue[head++];
+        uint32_t exits = get_level_exits(graph, index, gate_open, false);
+
+        for(uint32_t dir = 0; dir < 4; dir++) {
+            uint32_t next = step_graph_tile(graph, index, dir);
+            if((exits & (1u << dir)) && distances[next] == LEVEL_DISTANCE_UNREACHABLE) {
+                distances[next] = (uint16_t)MIN(distances[index] + 1, LEVEL_DISTANCE_UNREACHABLE - 1);
+                queue[tail++] = next;
+            }
+        }
+    }
+}
+
+// The scatter corner itself can be a wall, the search starts from the closest tile a ghost can stand on
+static uint32_t find_scatter_source(const Level *level, const LevelGraph *graph, uint32_t ghost) {
+    TileCoord corner = get_level_scatter_corner(level, ghost);
+    uint32_t source = get_level_tile_index(level, 0, 0);
+    int32_t best = INT32_MAX;
+
+    for(int32_t y = 0; y < (int32_t)level->rows; y++) {
+        for(int32_t x = 0; x < (int32_t)level->columns; x++) {
+            uint32_t index = get_level_tile_index(level, x, y);
+            int32_t dist = (x - corner.x) * (x - corner.x) + (y - corner.y) * (y - corner.y);
+
+            if(graph->junctions[index] != LEVEL_NO_JUNCTION &&
+               level->data[index] != ATLAS_SPRITE_GHOST_HOUSE_GATE && dist < best) {
+                best = dist;
+                source = index;
+            }
+        }
+    }
+
+    return source;
+}
+
+LevelGraph * create_level_graph_from_fields(const Level *level, const uint16_t *fields) {
+    if(!level) {
+        return NULL;
+    }
+
+    uint32_t tile_count = (level->rows + 2) * level->stride;
+    uint32_t junction_count = 0;
+
+    // Exits and junctions share one block, segments are sized once the junctions are counted
+    LevelGraph *graph = calloc(1, sizeof(*graph) +
+                               tile_count * (2 * sizeof(uint32_t) + (1 + LEVEL_DISTANCE_FIELD_COUNT) * sizeof(uint16_t)));
+    if(!graph) {
+        return NULL;
+    }
+
+    graph->stride = level->stride;
+    graph->tile_count = tile_count;
+    graph->junctions = (uint32_t *)(graph + 1);
+    graph->junction_tiles = graph->junctions + tile_count;
+    graph->exits = (uint16_t *)(graph->junction_tiles + tile_count);
+    graph->distances = graph->exits + tile_count;
+
+    for(int32_t y = -1; y <= (int32_t)level->rows; y++) {
+        for(int32_t x = -1; x <= (int32_t)level->columns; x++) {
+            graph->exits[get_level_tile_index(level, x, y)] = get_tile_exits(level, x, y);
+        }
+    }
+
+    // Stored fields come from a file, the exits are cheap enough to check against
+    // the tiles and the distances must stay within the level
+    if(fields) {
+        size_t field_count = (size_t)LEVEL_DISTANCE_FIELD_COUNT * tile_count;
+        bool valid = memcmp(graph->exits, fields, tile_count * sizeof(*fields)) == 0;
+
+        memcpy(graph->distances, fields + tile_count, field_count * sizeof(*fields));
+        for(size_t i = 0; i < field_count && valid; i++) {
+            valid = graph->distances[i] == LEVEL_DISTANCE_UNREACHABLE || graph->distances[i] < tile_count;
+        }
+
+        if(!valid) {
+            destroy_level_graph(&graph);
+            return NULL;
+        }
+    }
+
+    for(uint32_t i = 0; i < tile_count; i++) {
+        uint8_t type = level->data[i];
+        if(type == LEVEL_TILE_BORDER || tile_type_is_solid(type)) {
+            graph->junctions[i] = LEVEL_NO_JUNCTION;
+        } else if(tile_is_corridor(graph, i, type)) {
+            graph->junctions[i] = LEVEL_CORRIDOR;
+        } else {
+            graph->junction_tiles[junction_count] = i;
+            graph->junctions[i] = junction_count++;
+        }
+    }
+
+    graph->junction_count = junction_count;
+    graph->segments = malloc(MAX(junction_count, 1) * 4 * sizeof(*graph->segments));
+    if(!graph->segments) {
+        destroy_level_graph(&graph);
+        return NULL;
+    }
+
+    for(uint32_t i = 0; i < junction_count; i++) {
+        uint32_t exits = get_level_exits(graph, graph->junction_tiles[i], true, false);
+        for(uint32_t dir = 0; dir < 4; dir++) {
+            graph->segments[i * 4 + dir].junction = LEVEL_NO_JUNCTION;
+            graph->segments[i * 4 + dir].length = 0;
+
+            if(exits & (1u << dir)) {
+                walk_level_segment(graph, i, dir);
+            }
+        }
+    }
+
+    if(fields) {
+        return graph;
+    }
+
+    uint32_t *queue = malloc(tile_count * sizeof(*queue));
+    if(!queue) {
+        destroy_level_graph(&graph);
+        return NULL;
+    }
+
+    uint32_t gate = get_level_tile_index(level, level->gate_tile.x, level->gate_tile.y);
+    fill_distance_field(graph, graph->distances, gate, true, queue);
+    for(uint32_t i = 0; i < GHOST_COUNT; i++) {
+        uint16_t *distances = graph->distances + (size_t)LEVEL_SCATTER_FIELD(i) * tile_count;
+        fill_distance_field(graph, distances, find_scatter_source(level, graph, i), false, queue);
+    }
+
+    free(queue);
+    return graph;
+}
+
+LevelGraph * create_level_graph(const Level *level) {
+    return create_level_graph_from_fields(level, NULL);
+}
+
+static void destroy_level_next_hops(LevelNextHops **hops) {
+    if(hops && *hops) {
+        free((*hops)->hops);
+        free(*hops);
+        *hops = NULL;
+    }
+}
+
+void destroy_level_graph(LevelGraph **graph) {
+    if(graph && *graph) {
+        destroy_level_next_hops(&(*graph)->next_hops);
+        free((*graph)->segments);
+        free(*graph);
+        *graph = NULL;
+    }
+}
+
+typedef struct {
+    LevelNextHops *hops;
+    // For every walkable tile, the tiles in each direction that can step onto it
+    const uint32_t *sources;
+    // One per job, so the jobs never write the same memory
+    bool *failed;
+} NextHopBuild;
+
+// Fills the rows of a range of targets, each with a search out from the target.
+// A tile found from its neighbor in some direction steps the opposite way.
+static void fill_next_hop_rows(void *data, uint32_t job) {
+    NextHopBuild *build = data;
+    LevelNextHops *hops = build->hops;
+
+    uint32_t *queue = malloc(hops->tile_count * sizeof(*queue));
+    uint32_t *seen = calloc(hops->tile_count, sizeof(*seen));
+    if(!queue || !seen) {
+        build->failed[job] = true;
+        free(queue);
+        free(seen);
+        return;
+    }
+
+    uint32_t end = MIN((job + 1) * NEXT_HOP_JOB_SIZE, hops->tile_count);
+    for(uint32_t target = job * NEXT_HOP_JOB_SIZE; target < end; target++) {
+        uint8_t *row = hops->hops + (size_t)target * hops->row_size;
+
+        // Marked with the target + 1, so nothing needs clearing between searches
+        uint32_t head = 0;
+        uint32_t tail = 0;
+        seen[target] = target + 1;
+        queue[tail++] = target;
+
+        while(head < tail) {
+            const uint32_t *sources = &build->sources[queue[head++] * 4];
+
+            for(uint32_t dir = 0; dir < 4; dir++) {
+                uint32_t tile = sources[dir];
+                if(tile != LEVEL_NO_TILE && seen[tile] != target + 1) {
+                    seen[tile] = target + 1;
+                    row[tile / 4] |= (uint8_t)((dir ^ 2) << ((tile % 4) * 2));
+                    queue[tail++] = tile;
+                }
+            }
+        }
+    }
+
+    free(queue);
+    free(seen);
+}
+
+size_t build_level_next_hops(const Level *level, LevelGraph *graph) {
+    assert(level && graph);
+
+    destroy_level_next_hops(&graph->next_hops);
+
+    // Walkable tiles are the ones with a junction or corridor entry, without the gate
+    uint32_t tile_count = 0;
+    for(uint32_t i = 0; i < graph->tile_count; i++) {
+        if(graph->junctions[i] != LEVEL_NO_JUNCTION && level->data[i] != ATLAS_SPRITE_GHOST_HOUSE_GATE) {
+            tile_count++;
+        }
+    }
+
+    if(tile_count == 0 || tile_count > LEVEL_NEXT_HOP_MAX_TILES) {
+        return 0;
+    }
+
+    uint32_t row_size = (tile_count + 3) / 4;
+    size_t size = sizeof(LevelNextHops) + graph->tile_count * sizeof(uint32_t) + tile_count * 2 * sizeof(uint32_t);
+    LevelNextHops *hops = calloc(1, size);
+    uint8_t *rows = calloc(tile_count, row_size);
+    if(!hops || !rows) {
+        free(hops);
+        free(rows);
+        return 0;
+    }
+
+    hops->tile_count = tile_count;
+    hops->row_size = row_size;
+    hops->tile_ids = (uint32_t *)(hops + 1);
+    hops->components = hops->tile_ids + graph->tile_count;
+    hops->hops = rows;
+
+    uint32_t *tiles = hops->components + tile_count;
+    for(uint32_t i = 0, tile = 0; i < graph->tile_count; i++) {
+        if(graph->junctions[i] != LEVEL_NO_JUNCTION && level->data[i] != ATLAS_SPRITE_GHOST_HOUSE_GATE) {
+            tiles[tile] = i;
+            hops->tile_ids[i] = tile++;
+        } else {
+            hops->tile_ids[i] = LEVEL_NO_TILE;
+        }
+    }
+
+    // Connected components, so that lookups can tell when there's no path at all
+    uint32_t *queue = malloc(tile_count * sizeof(*queue));
+    if(!queue) {
+        free(rows);
+        free(hops);
+        return 0;
+    }
+
+    for(uint32_t i = 0; i < tile_count; i++) {
+        hops->components[i] = LEVEL_NO_TILE;
+    }
+    for(uint32_t start = 0; start < tile_count; start++) {
+        if(hops->components[start] != LEVEL_NO_TILE) {
+            continue;
+        }
+
+        uint32_t head = 0;
+        uint32_t tail = 0;
+        hops->components[start] = start;
+        queue[tail++] = start;
+
+        while(head < tail) {
+            uint32_t index = tiles[queue[head++]];
+            uint32_t exits = get_level_exits(graph, index, false, false);
+
+            for(uint32_t dir = 0; dir < 4; dir++) {
+                uint32_t tile = hops->tile_ids[step_graph_tile(graph, index, dir)];
+                if((exits & (1u << dir)) && tile != LEVEL_NO_TILE && hops->components[tile] == LEVEL_NO_TILE) {
+                    hops->components[tile] = start;
+                    queue[tail++] = tile;
+                }
+            }
+        }
+    }
+    free(queue);
+
+    uint32_t job_count = (tile_count + NEXT_HOP_JOB_SIZE - 1) / NEXT_HOP_JOB_SIZE;
+    uint32_t *sources = malloc(tile_count * 4 * sizeof(*sources));
+    bool *failed = calloc(job_count, sizeof(*failed));
+    if(!sources || !failed) {
+        free(sources);
+        free(failed);
+        free(rows);
+        free(hops);
+        return 0;
+    }
+
+    for(uint32_t i = 0; i < tile_count; i++) {
+        for(uint32_t dir = 0; dir < 4; dir++) {
+            uint32_t next = step_graph_tile(graph, tiles[i], dir);
+            bool steps_back = get_level_exits(graph, next, false, false) & (1u << (dir ^ 2));
+            sources[i * 4 + dir] = steps_back ? hops->tile_ids[next] : LEVEL_NO_TILE;
+        }
+    }
+
+    graph->next_hops = hops;
+
+    NextHopBuild build = { .hops = hops, .sources = sources, .failed = failed };
+    run_parallel_jobs(fill_next_hop_rows, &build, job_count);
+    free(sources);
+
+    bool any_failed = false;
+    for(uint32_t job = 0; job < job_count; job++) {
+        any_failed |= failed[job];
+    }
+    free(failed);
+
+    if(any_failed) {
+        destroy_level_next_hops(&graph->next_hops);
+        return 0;
+    }
+
+    return size + (size_t)tile_count * row_size;
+}
+
+#undef NEXT_HOP_JOB_SIZE
@@ -0,0 +1,124 @@
+/*
+ * Pacman Clone
+ *
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ */
+
+#ifndef LEVEL_GRAPH_H
+#define LEVEL_GRAPH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "level.h"
+
+// Exit masks have one bit per TileNeighbor direction, which is the same order as
+// MovementDirection. The low bits are the ways out of a tile when the ghost house
+// gate is closed, the next four when it can be passed and the last four mark the
+// exits that lead outside the level. Those count as open, the same as tunnels.
+#define LEVEL_EXITS_MASK 0xf
+#define LEVEL_EXITS_GATE_SHIFT 4
+#define LEVEL_EXITS_BORDER_SHIFT 8
+#define LEVEL_NO_JUNCTION UINT32_MAX
+#define LEVEL_CORRIDOR (UINT32_MAX - 1)
+
+// Distance fields hold the number of steps to the gate or to a ghost's scatter
+// corner from every stored tile. Tunnels aren't used, and the scatter fields
+// don't go through the gate.
+#define LEVEL_GATE_FIELD 0
+#define LEVEL_SCATTER_FIELD(ghost) (1 + (ghost))
+#define LEVEL_DISTANCE_FIELD_COUNT (1 + GHOST_COUNT)
+#define LEVEL_DISTANCE_UNREACHABLE UINT16_MAX
+
+// All-pairs next hop table over the tiles a ghost with the gate closed can walk on,
+// with two bits per pair for the direction of the first step. There is one row per
+// target, rows start on a byte so they can be filled in parallel.
+#define LEVEL_NEXT_HOP_MAX_TILES 8192
+#define LEVEL_NO_TILE UINT32_MAX
+
+typedef struct {
+    uint32_t tile_count;
+    uint32_t row_size;
+    uint32_t *tile_ids; // Per stored tile, LEVEL_NO_TILE where ghosts can't walk
+    uint32_t *components; // Per tile, there's no path between different components
+    uint8_t *hops;
+} LevelNextHops;
+
+typedef struct {
+    uint32_t junction; // LEVEL_NO_JUNCTION when there is no exit that way
+    uint32_t length; // Tiles walked to reach the junction
+} LevelSegment;
+
+// Static data derived from a level at load time. Tiles where the way on is fixed
+// are corridors, everything else is a junction. Corridors join the junctions into
+// a graph with one segment per exit.
+typedef struct LevelGraph {
+    uint32_t stride;
+    uint32_t tile_count;
+    uint32_t junction_count;
+    uint16_t *exits; // One per stored tile, including the border
+    // Junction index per stored tile, LEVEL_CORRIDOR in corridors and
+    // LEVEL_NO_JUNCTION on walls and the border
+    uint32_t *junctions;
+    uint32_t *junction_tiles;
+    LevelSegment *segments; // Four per junction
+    uint16_t *distances; // LEVEL_DISTANCE_FIELD_COUNT fields of tile_count each
+    LevelNextHops *next_hops; // Only there when built with build_level_next_hops
+} LevelGraph;
+
+static inline uint32_t get_level_exit_count(uint32_t exits) {
+    static const uint8_t counts[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+    return counts[exits & LEVEL_EXITS_MASK];
+}
+
+// Every direction except going back
+static inline uint32_t get_forward_exits(uint32_t dir) {
+    return LEVEL_EXITS_MASK & ~(1u << (dir ^ 2));
+}
+
+static inline uint32_t get_level_exits(const LevelGraph *graph, uint32_t index, bool gate_open, bool include_border) {
+    uint32_t exits = graph->exits[index];
+    uint32_t open = (gate_open ? (exits >> LEVEL_EXITS_GATE_SHIFT) : exits) & LEVEL_EXITS_MASK;
+
+    return include_border ? open : open & ~(exits >> LEVEL_EXITS_BORDER_SHIFT);
+}
+
+static inline bool level_tile_is_corridor(const LevelGraph *graph, uint32_t index) {
+    return graph->junctions[index] == LEVEL_CORRIDOR;
+}
+
+static inline const uint16_t * get_level_distance_field(const LevelGraph *graph, uint32_t field) {
+    return graph->distances + (size_t)field * graph->tile_count;
+}
+
+// Looks up the first step from one stored tile towards another. Returns false
+// if either isn't walkable, they're the same or there's no path between them.
+static inline bool get_level_next_hop(const LevelNextHops *hops, uint32_t from, uint32_t to, uint32_t *dir) {
+    uint32_t source = hops->tile_ids[from];
+    uint32_t target = hops->tile_ids[to];
+    if(source == LEVEL_NO_TILE || target == LEVEL_NO_TILE || source == target ||
+       hops->components[source] != hops->components[target]) {
+        return false;
+    }
+
+    *dir = (hops->hops[(size_t)target * hops->row_size + source / 4] >> ((source % 4) * 2)) & 3;
+    return true;
+}
+
+// The exit masks and the distance fields sit next to each other, which is how
+// compiled levels store them
+static inline size_t get_level_graph_fields_size(const LevelGraph *graph) {
+    return (size_t)graph->tile_count * (1 + LEVEL_DISTANCE_FIELD_COUNT) * sizeof(uint16_t);
+}
+
+LevelGraph * create_level_graph(const Level *level);
+// Copies the distance fields from fields instead of working them out. Returns NULL
+// when the exit masks in fields don't match the tiles or a distance is out of range.
+LevelGraph * create_level_graph_from_fields(const Level *level, const uint16_t *fields);
+void destroy_level_graph(LevelGraph **graph);
+
+// Returns the size of the table in bytes, or 0 if the level has too many tiles
+// or the memory ran out. Uses every core through run_parallel_jobs.
+size_t build_level_next_hops(const Level *level, LevelGraph *graph);
+
+#endif /* LEVEL_GRAPH_H */
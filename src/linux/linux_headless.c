@@ -0,0 +1,1201 @@
+/*
+ * Pacman Clone
+ *
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ */
+
+// Runs the simulation as fast as possible without a window, OpenGL or X11.
+// Used for bot evaluation and regression runs.
+
+#define PACMAN_HEADLESS
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../platform.h"
+
+#include "../game.c"
+#include "linux_platform.c"
+#include "linux_net.c"
+
+#define HEADLESS_DEFAULT_TICKS (SIMULATION_TICK_RATE * 60 * 10)
+#define HEADLESS_BOT_DECISION_TICKS (SIMULATION_TICK_RATE / 2)
+#define HEADLESS_VERSUS_QUEUE_SIZE 256
+#define HEADLESS_BEHAVIOR_REPEATS 16
+#define HEADLESS_LEVEL_PARSE_REPEATS 5
+#define HEADLESS_LEVEL_PARSE_MIN_SIZE 16
+#define HEADLESS_ENV_TICKS_PER_STEP 4
+
+typedef uint32_t (*HeadlessInputCallback)(uint64_t tick, void *user_data);
+
+typedef struct {
+    uint64_t max_ticks;
+    float dt;
+    uint64_t seed;
+    GhostPathing ghost_pathing;
+    bool scalar_ghosts;
+    // Steps a scalar copy of every game alongside it and compares their states
+    bool check_lanes;
+    uint32_t swarm_size; // Extra ghosts per game
+    // Times every ghost's targets from the behavior file and the built-in code
+    bool bench_behaviors;
+} HeadlessConfig;
+
+typedef struct {
+    uint64_t ticks;
+    double seconds;
+    uint32_t score;
+    uint64_t lane_mismatches;
+    double swarm_seconds;
+    double built_in_behavior_seconds;
+    double behavior_seconds;
+    uint64_t behavior_mismatches;
+    bool game_over;
+} HeadlessResult;
+
+typedef struct {
+    HeadlessInputCallback input_callback;
+    void *user_data;
+    uint32_t stream;
+    ReplayRecorder *recorder;
+    HeadlessResult result;
+} HeadlessGame;
+
+typedef struct {
+    struct {
+        uint64_t ticks;
+        uint32_t input;
+    } *steps;
+    uint32_t count;
+} InputScript;
+
+typedef struct {
+    const InputScript *script;
+    uint32_t current;
+    uint64_t step_end;
+} InputScriptCursor;
+
+typedef struct {
+    unsigned int seed;
+    uint32_t input;
+} RandomBot;
+
+typedef struct {
+    uint64_t latency; // In frames
+    uint32_t loss; // Percentage of dropped packets
+} HeadlessNetConfig;
+
+// Packets held back to simulate latency
+typedef struct {
+    struct {
+        uint64_t due_frame;
+        size_t size;
+        uint8_t data[ROLLBACK_PACKET_SIZE_MAX];
+    } packets[HEADLESS_VERSUS_QUEUE_SIZE];
+    uint32_t first;
+    uint32_t count;
+} HeadlessPacketQueue;
+
+typedef struct {
+    GameContext *ctx;
+    RollbackSession *session;
+    int socket;
+    struct sockaddr_in peer;
+    HeadlessPacketQueue queue;
+    HeadlessInputCallback input_callback;
+    void *user_data;
+    double max_advance_seconds;
+    double advance_seconds;
+    uint64_t advances;
+} HeadlessVersusSide;
+
+// Hands out games to the worker threads until all of them have been run
+typedef struct {
+    const GameAssets *assets;
+    const HeadlessConfig *config;
+    HeadlessGame *games;
+    uint32_t game_count;
+    uint32_t next_game;
+    uint32_t batch_size;
+    pthread_mutex_t lock;
+} HeadlessJobQueue;
+
+static double get_time_seconds(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double)t.tv_sec + (double)t.tv_nsec / (double)1000000000;
+}
+
+// Script format: one step per line, "<ticks> <keys>", where keys is any
+// combination of U, L, D, R, C (confirm) and M (menu), or '-' for no input.
+// Lines starting with '#' are ignored.
+static bool load_input_script(const char *path, InputScript *script) {
+    FILE *f = fopen(path, "rb");
+    if(!f) {
+        return false;
+    }
+
+    memset(script, 0, sizeof(*script));
+
+    uint32_t capacity = 0;
+    char line[256];
+    uint32_t line_number = 0;
+    while(fgets(line, sizeof(line), f)) {
+        line_number++;
+
+        unsigned long long ticks;
+        char keys[32];
+        if(line[0] == '#' || line[0] == '\n' || line[0] == '\r') {
+            continue;
+        }
+
+        if(sscanf(line, "%llu %31s", &ticks, keys) != 2) {
+            fprintf(stderr, "%s:%u: expected \"<ticks> <keys>\"\n", path, line_number);
+            continue;
+        }
+
+        uint32_t input = 0;
+        for(char *c = keys; *c; c++) {
+            switch(*c) {
+                case 'U': case 'u': input |= INPUT_UP; break;
+                case 'L': case 'l': input |= INPUT_LEFT; break;
+                case 'D': case 'd': input |= INPUT_DOWN; break;
+                case 'R': case 'r': input |= INPUT_RIGHT; break;
+                case 'C': case 'c': input |= INPUT_CONFIRM; break;
+                case 'M': case 'm': input |= INPUT_MENU; break;
+                default: break;
+            }
+        }
+
+        if(script->count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            script->steps = realloc(script->steps, capacity * sizeof(*script->steps));
+        }
+
+        script->steps[script->count].ticks = ticks;
+        script->steps[script->count].input = input;
+        script->count++;
+    }
+
+    fclose(f);
+    return true;
+}
+
+static uint32_t script_input_callback(uint64_t tick, void *user_data) {
+    InputScriptCursor *cursor = user_data;
+    const InputScript *script = cursor->script;
+
+    if(tick == 0) {
+        cursor->current = 0;
+        cursor->step_end = (script->count > 0) ? script->steps[0].ticks : 0;
+    }
+
+    while(cursor->current < script->count && tick >= cursor->step_end) {
+        cursor->current++;
+        if(cursor->current < script->count) {
+            cursor->step_end += script->steps[cursor->current].ticks;
+        }
+    }
+
+    return (cursor->current < script->count) ? script->steps[cursor->current].input : 0;
+}
+
+// Fallback when no script is given: holds a random direction for a short while
+static uint32_t random_input_callback(uint64_t tick, void *user_data) {
+    RandomBot *bot = user_data;
+
+    if((tick % HEADLESS_BOT_DECISION_TICKS) == 0) {
+        static const uint32_t directions[4] = { INPUT_UP, INPUT_LEFT, INPUT_DOWN, INPUT_RIGHT };
+        bot->input = directions[rand_r(&bot->seed) % 4];
+    }
+
+    return bot->input;
+}
+
+static void bench_ghost_behaviors(const GameContext *ctx, HeadlessResult *result) {
+    TileCoord chase[2][GHOST_COUNT];
+    TileCoord scatter[2][GHOST_COUNT];
+
+    for(int32_t built_in = 0; built_in < 2; built_in++) {
+        double start = get_time_seconds();
+        for(uint32_t i = 0; i < HEADLESS_BEHAVIOR_REPEATS; i++) {
+            get_game_ghost_targets(ctx, built_in, chase[built_in], scatter[built_in]);
+        }
+
+        double seconds = get_time_seconds() - start;
+        if(built_in) {
+            result->built_in_behavior_seconds += seconds;
+        } else {
+            result->behavior_seconds += seconds;
+        }
+    }
+
+    for(int32_t i = 0; i < GHOST_COUNT; i++) {
+        if(chase[0][i].x != chase[1][i].x || chase[0][i].y != chase[1][i].y ||
+           scatter[0][i].x != scatter[1][i].x || scatter[0][i].y != scatter[1][i].y) {
+            result->behavior_mismatches++;
+            break;
+        }
+    }
+}
+
+static void run_headless_game(const GameAssets *assets, const HeadlessConfig *config, HeadlessGame *game) {
+    assert(assets && config && game && game->input_callback);
+
+    HeadlessResult *result = &game->result;
+    memset(result, 0, sizeof(*result));
+
+    GameContext *ctx = create_game_context(assets);
+    seed_game(ctx, config->seed, game->stream);
+    set_game_ghost_pathing(ctx, config->ghost_pathing);
+    set_game_scalar_ghosts(ctx, config->scalar_ghosts);
+
+    GameContext *reference = NULL;
+    void *snapshot = NULL;
+    if(config->check_lanes) {
+        reference = create_game_context(assets);
+        seed_game(reference, config->seed, game->stream);
+        set_game_ghost_pathing(reference, config->ghost_pathing);
+        set_game_scalar_ghosts(reference, true);
+        snapshot = malloc(get_game_snapshot_capacity(ctx));
+    }
+
+    // Eaten swarm ghosts are replaced right away, with their own random stream
+    GhostSwarm *swarm = NULL;
+    RandomState swarm_random;
+    if(config->swarm_size > 0) {
+        swarm = create_ghost_swarm(config->swarm_size);
+        seed_random_stream(&swarm_random, config->seed ^ 0x5357524dull, game->stream);
+    }
+
+    double start = get_time_seconds();
+    bool running = true;
+    while(running && result->ticks < config->max_ticks) {
+        uint32_t input = game->input_callback(result->ticks, game->user_data);
+        if(game->recorder) {
+            record_replay_tick(game->recorder, input, config->dt);
+        }
+        running = update_loop(ctx, config->dt, input);
+        result->ticks++;
+
+        if(swarm) {
+            double swarm_start = get_time_seconds();
+            if(get_ghost_swarm_count(swarm) < config->swarm_size) {
+                scatter_swarm_ghosts(swarm, ctx, config->swarm_size - get_ghost_swarm_count(swarm), &swarm_random);
+            }
+            update_ghost_swarm(swarm, ctx, config->dt);
+            result->swarm_seconds += get_time_seconds() - swarm_start;
+        }
+
+        if(config->bench_behaviors) {
+            bench_ghost_behaviors(ctx, result);
+        }
+
+        if(reference) {
+            update_loop(reference, config->dt, input);
+            if(get_game_state_hash(reference) != get_game_state_hash(ctx)) {
+                result->lane_mismatches++;
+                // Resynchronize, so that every mismatch is counted where it starts
+                save_game_snapshot(ctx, snapshot);
+                load_game_snapshot(reference, snapshot);
+            }
+        }
+        // Summed up per tick, since the score is already reset when the game is over
+        result->score += get_game_points(ctx);
+
+        if(get_game_events(ctx) & GAME_EVENT_GAME_OVER) {
+            result->game_over = true;
+            break;
+        }
+    }
+    result->seconds = get_time_seconds() - start;
+
+    if(game->recorder && !destroy_replay_recorder(&game->recorder, get_game_state_hash(ctx))) {
+        fprintf(stderr, "Failed to write the replay file\n");
+    }
+
+    free(snapshot);
+    destroy_ghost_swarm(&swarm);
+    destroy_game_context(&reference);
+    destroy_game_context(&ctx);
+}
+
+// Feeds a recorded session back into a fresh game and checks that it ends in the same state
+static bool run_headless_replay(const GameAssets *assets, Replay *replay) {
+    GameContext *ctx = create_game_context(assets);
+    seed_game(ctx, get_replay_seed(replay), 0);
+
+    uint64_t ticks = 0;
+    uint64_t score = 0;
+    uint32_t input;
+    float dt;
+    double start = get_time_seconds();
+    while(next_replay_tick(replay, &input, &dt)) {
+        update_loop(ctx, dt, input);
+        ticks++;
+        // The score is already reset when the game is over
+        score += get_game_points(ctx);
+    }
+    double seconds = get_time_seconds() - start;
+
+    uint64_t state_hash = get_game_state_hash(ctx);
+    uint64_t expected_ticks, expected_hash;
+    bool has_result = get_replay_result(replay, &expected_ticks, &expected_hash);
+    bool match = has_result && expected_ticks == ticks && expected_hash == state_hash;
+
+    printf("ticks: %llu\n", (unsigned long long)ticks);
+    printf("seconds: %.3f\n", seconds);
+    printf("ticks/s: %.0f\n", (seconds > 0.0) ? (double)ticks / seconds : 0.0);
+    printf("score: %llu\n", (unsigned long long)score);
+    printf("state hash: %016llx\n", (unsigned long long)state_hash);
+    if(has_result) {
+        printf("replay: %s\n", match ? "match" : "MISMATCH");
+    } else {
+        printf("replay: no recorded result, the recording was cut short\n");
+    }
+
+    destroy_game_context(&ctx);
+    return match || !has_result;
+}
+
+// Whether the tile channels of an observation show exactly the walls, gate and
+// pellets of the level, with nothing in the padding
+static bool env_tiles_match(const GameEnv *env, const Level *level, const uint8_t *observation) {
+    uint32_t rows, columns;
+    get_game_env_observation_shape(env, NULL, &rows, &columns);
+    size_t plane_size = (size_t)rows * columns;
+
+    for(uint32_t y = 0; y < rows; y++) {
+        for(uint32_t x = 0; x < columns; x++) {
+            uint8_t sprite = ATLAS_SPRITE_COUNT;
+            if(x < level->columns && y < level->rows) {
+                sprite = get_level_tile_sprite(level, get_level_tile_index(level, x, y));
+            }
+
+            const uint8_t *tile = observation + y * columns + x;
+            bool wall = sprite == ATLAS_SPRITE_WALL_NORMAL || sprite == ATLAS_SPRITE_WALL_BOTTOM;
+            if((tile[ENV_CHANNEL_WALL * plane_size] != 0) != wall ||
+               (tile[ENV_CHANNEL_GATE * plane_size] != 0) != (sprite == ATLAS_SPRITE_GHOST_HOUSE_GATE) ||
+               (tile[ENV_CHANNEL_PELLET * plane_size] != 0) != (sprite == ATLAS_SPRITE_PELLET) ||
+               (tile[ENV_CHANNEL_POWER_PELLET * plane_size] != 0) != (sprite == ATLAS_SPRITE_POWER_PELLET)) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+// Steps a batch of environments with random actions, next to a plain game per
+// environment that gets the same input. Checks every reward against the points
+// and lives the plain game lost over the same ticks, and every observation
+// against the tiles of the level it shows.
+static bool run_headless_env(const GameAssets *assets, const HeadlessConfig *config, uint32_t count) {
+    GameEnv *env = create_game_env(assets, count, HEADLESS_ENV_TICKS_PER_STEP);
+    GameContext **games = calloc(count, sizeof(*games));
+    uint8_t *actions = calloc(count, sizeof(*actions));
+    float *rewards = calloc(count, sizeof(*rewards));
+    uint8_t *observations = env ? malloc(count * get_game_env_observation_size(env)) : NULL;
+
+    bool allocated = env && games && actions && rewards && observations;
+    for(uint32_t i = 0; allocated && i < count; i++) {
+        games[i] = create_game_context(assets);
+        allocated = games[i] != NULL;
+    }
+
+    if(!allocated) {
+        fprintf(stderr, "Failed to create %u environments\n", count);
+    }
+
+    RandomState random;
+    seed_random(&random, config->seed);
+
+    uint64_t steps = config->max_ticks / HEADLESS_ENV_TICKS_PER_STEP;
+    uint64_t reward_mismatches = 0;
+    uint64_t tile_mismatches = 0;
+    double total_reward = 0.0;
+    double seconds = 0.0;
+
+    if(allocated) {
+        for(uint32_t i = 0; i < count; i++) {
+            reset_game_env(env, i, config->seed + i);
+            seed_game(games[i], config->seed + i, 0);
+            reset_game(games[i]);
+        }
+
+        for(uint64_t step = 0; step < steps; step++) {
+            for(uint32_t i = 0; i < count; i++) {
+                actions[i] = (uint8_t)next_random_range(&random, ENV_ACTION_COUNT);
+            }
+
+            double start = get_time_seconds();
+            step_game_env(env, actions, rewards, NULL);
+            observe_game_env_batch(env, observations);
+            seconds += get_time_seconds() - start;
+
+            for(uint32_t i = 0; i < count; i++) {
+                uint32_t input = action_inputs[actions[i]];
+                float expected = 0.0f;
+                for(uint32_t tick = 0; tick < HEADLESS_ENV_TICKS_PER_STEP; tick++) {
+                    update_loop(games[i], SIMULATION_TICK_TIME, input);
+                    expected += (float)get_game_points(games[i]);
+                    if(get_game_events(games[i]) & GAME_EVENT_PLAYER_DIED) {
+                        expected += ENV_REWARD_PLAYER_DIED;
+                    }
+                }
+
+                total_reward += rewards[i];
+                reward_mismatches += rewards[i] != expected;
+
+                const uint8_t *observation = observations + i * get_game_env_observation_size(env);
+                tile_mismatches += !env_tiles_match(env, get_game_env_context(env, i)->level, observation);
+            }
+        }
+
+        printf("environments: %u\n", count);
+        printf("steps: %llu of %d ticks\n", (unsigned long long)steps, HEADLESS_ENV_TICKS_PER_STEP);
+        printf("seconds: %.3f\n", seconds);
+        printf("steps/s: %.0f\n", (seconds > 0.0) ? (double)(steps * count) / seconds : 0.0);
+        printf("reward: %.1f\n", total_reward / (double)count);
+        printf("env rewards: %s (%llu steps differ)\n", reward_mismatches ? "MISMATCH" : "match",
+               (unsigned long long)reward_mismatches);
+        printf("env tiles: %s (%llu observations differ)\n", tile_mismatches ? "MISMATCH" : "match",
+               (unsigned long long)tile_mismatches);
+    }
+
+    for(uint32_t i = 0; games && i < count; i++) {
+        destroy_game_context(&games[i]);
+    }
+    free(observations);
+    free(rewards);
+    free(actions);
+    free(games);
+    destroy_game_env(&env);
+    return allocated && reward_mismatches == 0 && tile_mismatches == 0;
+}
+
+// Keeps a rewind history of a single game, then rewinds it one tick at a time and
+// checks every restored state against the hash that was seen on the way forward
+static bool run_headless_rewind(const GameAssets *assets, const HeadlessConfig *config,
+                                HeadlessGame *game, size_t capacity) {
+    GameContext *ctx = create_game_context(assets);
+    seed_game(ctx, config->seed, game->stream);
+    set_game_ghost_pathing(ctx, config->ghost_pathing);
+    set_game_scalar_ghosts(ctx, config->scalar_ghosts);
+
+    RewindBuffer *buffer = create_rewind_buffer(ctx, capacity);
+    uint64_t *hashes = malloc((config->max_ticks + 1) * sizeof(*hashes));
+    if(!buffer || !hashes) {
+        fprintf(stderr, "Failed to allocate the rewind history\n");
+        free(hashes);
+        destroy_rewind_buffer(&buffer);
+        destroy_game_context(&ctx);
+        return false;
+    }
+
+    uint64_t ticks = 0;
+    hashes[0] = get_game_state_hash(ctx);
+    push_rewind_snapshot(buffer, ctx);
+
+    double start = get_time_seconds();
+    while(ticks < config->max_ticks) {
+        if(!update_loop(ctx, config->dt, game->input_callback(ticks, game->user_data))) {
+            break;
+        }
+        hashes[++ticks] = get_game_state_hash(ctx);
+        push_rewind_snapshot(buffer, ctx);
+    }
+    double seconds = get_time_seconds() - start;
+
+    uint32_t length = get_rewind_length(buffer);
+    size_t memory = get_rewind_memory_usage(buffer);
+
+    uint32_t mismatches = 0;
+    for(uint32_t i = 1; i <= length; i++) {
+        if(rewind_game(buffer, ctx, 1) != 1 || get_game_state_hash(ctx) != hashes[ticks - i]) {
+            mismatches++;
+        }
+    }
+
+    printf("ticks: %llu\n", (unsigned long long)ticks);
+    printf("seconds: %.3f\n", seconds);
+    printf("ticks/s: %.0f\n", (seconds > 0.0) ? (double)ticks / seconds : 0.0);
+    printf("rewind length: %u ticks (%.1f s)\n", length, (double)length * config->dt);
+    printf("rewind memory: %zu bytes (%.1f bytes/tick)\n", memory, length ? (double)memory / length : 0.0);
+    printf("rewind: %s\n", mismatches ? "MISMATCH" : "match");
+
+    free(hashes);
+    destroy_rewind_buffer(&buffer);
+    destroy_game_context(&ctx);
+    return mismatches == 0;
+}
+
+static void exchange_versus_packets(HeadlessVersusSide *side, const HeadlessNetConfig *net,
+                                    uint64_t frame, unsigned int *loss_seed) {
+    uint8_t buffer[ROLLBACK_PACKET_SIZE_MAX];
+    ssize_t received;
+    while((received = recv(side->socket, buffer, sizeof(buffer), 0)) > 0) {
+        read_rollback_packet(side->session, buffer, (size_t)received);
+    }
+
+    HeadlessPacketQueue *queue = &side->queue;
+    if(queue->count < HEADLESS_VERSUS_QUEUE_SIZE) {
+        uint32_t index = (queue->first + queue->count) % HEADLESS_VERSUS_QUEUE_SIZE;
+        queue->packets[index].size = write_rollback_packet(side->session, queue->packets[index].data,
+                                                           ROLLBACK_PACKET_SIZE_MAX);
+        queue->packets[index].due_frame = frame + net->latency;
+        if(queue->packets[index].size > 0) {
+            queue->count++;
+        }
+    }
+
+    while(queue->count > 0 && queue->packets[queue->first].due_frame <= frame) {
+        if((uint32_t)(rand_r(loss_seed) % 100) >= net->loss) {
+            sendto(side->socket, queue->packets[queue->first].data, queue->packets[queue->first].size, 0,
+                   (struct sockaddr *)&side->peer, sizeof(side->peer));
+        }
+        queue->first = (queue->first + 1) % HEADLESS_VERSUS_QUEUE_SIZE;
+        queue->count--;
+    }
+}
+
+// Plays a versus game between two rollback sessions that talk over UDP on the
+// loopback interface, one frame per tick, and checks that both ended up in the same state
+static bool run_headless_versus(const GameAssets *assets, const HeadlessConfig *config,
+                                const HeadlessNetConfig *net, HeadlessGame *player, HeadlessGame *ghost) {
+    HeadlessVersusSide sides[2] = {
+        { .input_callback = player->input_callback, .user_data = player->user_data },
+        { .input_callback = ghost->input_callback, .user_data = ghost->user_data }
+    };
+
+    bool ok = true;
+    for(uint32_t i = 0; i < 2; i++) {
+        sides[i].ctx = create_game_context(assets);
+        sides[i].session = create_rollback_session(sides[i].ctx, i ? ROLLBACK_SIDE_GHOST : ROLLBACK_SIDE_PLAYER,
+                                                   config->seed);
+        sides[i].socket = open_udp_socket("127.0.0.1", 0);
+        ok = ok && sides[i].ctx && sides[i].session && sides[i].socket >= 0;
+    }
+
+    if(ok) {
+        for(uint32_t i = 0; i < 2; i++) {
+            sides[i].peer = (struct sockaddr_in){
+                .sin_family = AF_INET,
+                .sin_port = htons(get_udp_socket_port(sides[1 - i].socket)),
+                .sin_addr.s_addr = htonl(INADDR_LOOPBACK)
+            };
+        }
+    } else {
+        fprintf(stderr, "Failed to set up the loopback versus game\n");
+    }
+
+    unsigned int loss_seed = (unsigned int)config->seed;
+    uint64_t frame = 0;
+    uint64_t max_frames = config->max_ticks * 4 + net->latency * 8 + 1000;
+    double start = get_time_seconds();
+
+    while(ok && frame < max_frames) {
+        bool finished = true;
+        for(uint32_t i = 0; i < 2; i++) {
+            HeadlessVersusSide *side = &sides[i];
+            exchange_versus_packets(side, net, frame, &loss_seed);
+
+            uint32_t tick = get_rollback_tick(side->session);
+            if(tick < config->max_ticks) {
+                double advance_start = get_time_seconds();
+                bool running = true;
+                advance_rollback_session(side->session, side->input_callback(tick, side->user_data), &running);
+                double advance_seconds = get_time_seconds() - advance_start;
+
+                side->advance_seconds += advance_seconds;
+                side->max_advance_seconds = MAX(side->max_advance_seconds, advance_seconds);
+                side->advances++;
+                finished = false;
+            } else {
+                update_rollback_session(side->session);
+
+                uint32_t confirmed_tick;
+                if(!get_rollback_confirmed_hash(side->session, &confirmed_tick, NULL) ||
+                   confirmed_tick + 1 < config->max_ticks) {
+                    finished = false;
+                }
+            }
+        }
+
+        frame++;
+        if(finished) {
+            break;
+        }
+    }
+    double seconds = get_time_seconds() - start;
+
+    bool match = false;
+    if(ok) {
+        uint64_t hashes[2] = { 0, 0 };
+        uint32_t ticks[2] = { 0, 0 };
+        bool confirmed = get_rollback_confirmed_hash(sides[0].session, &ticks[0], &hashes[0]) &&
+                         get_rollback_confirmed_hash(sides[1].session, &ticks[1], &hashes[1]);
+        match = confirmed && ticks[0] == ticks[1] && hashes[0] == hashes[1] &&
+                hashes[0] == get_game_state_hash(sides[0].ctx) && hashes[1] == get_game_state_hash(sides[1].ctx);
+
+        printf("frames: %llu\n", (unsigned long long)frame);
+        printf("seconds: %.3f\n", seconds);
+        for(uint32_t i = 0; i < 2; i++) {
+            const RollbackStats *stats = get_rollback_stats(sides[i].session);
+            printf("%s: ticks %u, rollbacks %u, resimulated %u, max rollback %u ticks, stalls %u, "
+                   "checksums %u%s\n",
+                   i ? "ghost" : "player", get_rollback_tick(sides[i].session), stats->rollbacks,
+                   stats->resimulated_ticks, stats->max_rollback_ticks, stats->stalls,
+                   stats->checksums_compared, stats->desynced ? ", DESYNC" : "");
+            printf("%s: advance %.1f us average, %.1f us max\n", i ? "ghost" : "player",
+                   sides[i].advances ? sides[i].advance_seconds * 1e6 / (double)sides[i].advances : 0.0,
+                   sides[i].max_advance_seconds * 1e6);
+            match = match && !stats->desynced;
+        }
+        printf("state hash: %016llx\n", (unsigned long long)hashes[0]);
+        printf("versus: %s\n", match ? "match" : "MISMATCH");
+    }
+
+    for(uint32_t i = 0; i < 2; i++) {
+        if(sides[i].socket >= 0) {
+            close(sides[i].socket);
+        }
+        destroy_rollback_session(&sides[i].session);
+        destroy_game_context(&sides[i].ctx);
+    }
+
+    return match;
+}
+
+// Steps all of the games in lockstep until every one of them is over or out of ticks
+static void run_headless_batch(const GameAssets *assets, const HeadlessConfig *config,
+                               HeadlessGame *games, uint32_t count) {
+    assert(assets && config && games);
+
+    GameBatch *batch = create_game_batch(assets, count);
+    if(!batch) {
+        fprintf(stderr, "Failed to create a batch of %u games\n", count);
+        return;
+    }
+
+    uint32_t *inputs = calloc(count, sizeof(*inputs));
+    bool *running = calloc(count, sizeof(*running));
+    bool *done = calloc(count, sizeof(*done));
+
+    for(uint32_t i = 0; i < count; i++) {
+        memset(&games[i].result, 0, sizeof(games[i].result));
+        seed_game(get_game_batch_context(batch, i), config->seed, games[i].stream);
+        set_game_ghost_pathing(get_game_batch_context(batch, i), config->ghost_pathing);
+    }
+
+    double start = get_time_seconds();
+    uint32_t remaining = count;
+    for(uint64_t tick = 0; remaining > 0 && tick < config->max_ticks; tick++) {
+        for(uint32_t i = 0; i < count; i++) {
+            inputs[i] = done[i] ? 0 : games[i].input_callback(tick, games[i].user_data);
+        }
+
+        step_game_batch(batch, config->dt, inputs, running);
+
+        // Finished games keep stepping with the rest, only their results are frozen
+        for(uint32_t i = 0; i < count; i++) {
+            if(done[i]) {
+                continue;
+            }
+
+            HeadlessResult *result = &games[i].result;
+            GameContext *ctx = get_game_batch_context(batch, i);
+            result->ticks++;
+            result->score += get_game_points(ctx);
+
+            if(get_game_events(ctx) & GAME_EVENT_GAME_OVER) {
+                result->game_over = true;
+            }
+            if(result->game_over || !running[i]) {
+                done[i] = true;
+                remaining--;
+            }
+        }
+    }
+
+    double seconds = get_time_seconds() - start;
+    for(uint32_t i = 0; i < count; i++) {
+        games[i].result.seconds = seconds;
+    }
+
+    free(done);
+    free(running);
+    free(inputs);
+    destroy_game_batch(&batch);
+}
+
+static void * headless_worker(void *parameter) {
+    HeadlessJobQueue *queue = parameter;
+    uint32_t job_size = MAX(queue->batch_size, 1);
+
+    for(;;) {
+        pthread_mutex_lock(&queue->lock);
+        uint32_t index = queue->next_game;
+        queue->next_game += job_size;
+        pthread_mutex_unlock(&queue->lock);
+
+        if(index >= queue->game_count) {
+            break;
+        }
+
+        if(queue->batch_size > 0) {
+            uint32_t count = MIN(job_size, queue->game_count - index);
+            run_headless_batch(queue->assets, queue->config, &queue->games[index], count);
+        } else {
+            run_headless_game(queue->assets, queue->config, &queue->games[index]);
+        }
+    }
+
+    return NULL;
+}
+
+// A size by size level of walls and pellets in the text format, with walls on
+// the tiles with even coordinates and random ones in between
+static char * generate_level_text(uint32_t size, uint64_t seed, size_t *length) {
+    // At most "-1," per tile and a newline per row
+    char *text = malloc((size_t)size * (size * 3 + 1));
+    if(!text) {
+        return NULL;
+    }
+
+    RandomState random;
+    seed_random(&random, seed);
+
+    char *c = text;
+    for(uint32_t y = 0; y < size; y++) {
+        for(uint32_t x = 0; x < size; x++) {
+            int32_t tile = ATLAS_SPRITE_PELLET;
+            uint32_t r = next_random(&random);
+
+            if(x == 0 || y == 0 || x == size - 1 || y == size - 1) {
+                tile = ATLAS_SPRITE_WALL_NORMAL;
+            } else if(x == 1 && y == 1) {
+                tile = ATLAS_SPRITE_PLAYER_FRAME1;
+            } else if(y == 1 && x < 2 + 2 * GHOST_COUNT && (x % 2) == 1) {
+                tile = ATLAS_SPRITE_BLINKY_FRAME1 + (x / 2 - 1) * 2;
+            } else if((x % 2) == 0 && (y % 2) == 0) {
+                tile = ATLAS_SPRITE_WALL_BOTTOM;
+            } else if((x % 2) != (y % 2) && (r % 3) == 0) {
+                tile = ATLAS_SPRITE_WALL_BOTTOM;
+            } else if((r % 64) == 1) {
+                tile = -1;
+            } else if((r % 512) == 2) {
+                tile = ATLAS_SPRITE_POWER_PELLET;
+            }
+
+            c += sprintf(c, (x + 1 < size) ? "%d," : "%d\n", tile);
+        }
+    }
+
+    *length = (size_t)(c - text);
+    return text;
+}
+
+static int bench_level_parse(uint32_t size, uint64_t seed) {
+    size_t length = 0;
+    char *text = generate_level_text(size, seed, &length);
+    if(!text) {
+        fprintf(stderr, "Not enough memory for a %u by %u level\n", size, size);
+        return -1;
+    }
+
+    double best = 0.0;
+    Level *level = NULL;
+    for(uint32_t i = 0; i < HEADLESS_LEVEL_PARSE_REPEATS; i++) {
+        unload_level(&level);
+
+        char error[128];
+        double start = get_time_seconds();
+        level = parse_level(text, length, error, sizeof(error));
+        double seconds = get_time_seconds() - start;
+
+        if(!level) {
+            fprintf(stderr, "generated level: %s\n", error);
+            free(text);
+            return -1;
+        }
+        best = (i == 0) ? seconds : MIN(best, seconds);
+    }
+
+    printf("level parse: %ux%u tiles, %.1f MB in %.2f ms, %.0f MB/s, %u pellets\n",
+           level->columns, level->rows, (double)length / (1024.0 * 1024.0), best * 1000.0,
+           best > 0.0 ? (double)length / (1024.0 * 1024.0) / best : 0.0, level->pellet_count);
+
+    unload_level(&level);
+    free(text);
+    return 0;
+}
+
+static void print_usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --ticks N      Run each game for at most N ticks (default %d)\n"
+            "  --dt SECONDS   Fixed time step per tick (default 1/%d)\n"
+            "  --script FILE  Read input from a script instead of the random bot\n"
+            "  --seed N       Seed for the random number generators\n"
+            "  --games N      Number of independent games to run (default 1)\n"
+            "  --threads N    Number of worker threads (default: one per core)\n"
+            "  --batch N      Step games in lockstep batches of N (default: one game at a time)\n"
+            "  --record FILE  Record the input of a single game to a replay file\n"
+            "  --replay FILE  Play back a replay file and verify the final state\n"
+            "  --rewind KB    Keep a rewind history of a single game and verify rewinding it\n"
+            "  --versus       Play a rollback versus game between two bots over loopback UDP\n"
+            "  --latency N    Frames of added one-way latency for --versus (default 0)\n"
+            "  --loss N       Percentage of dropped packets for --versus (default 0)\n"
+            "  --shortest-paths  Ghosts follow shortest paths to the gate and scatter corners\n"
+            "  --scalar-ghosts   Update the ghosts one at a time instead of with SSE2\n"
+            "  --check-lanes     Compare every tick of every game against the scalar ghost code\n"
+            "  --swarm N         Add N extra ghosts to every game, see src/swarm.h\n"
+            "  --behaviors FILE  Load the ghost behaviors from FILE instead of data/ghosts.txt\n"
+            "  --built-in-behaviors  Ignore data/ghosts.txt\n"
+            "  --bench-behaviors     Time the ghost targets from the behaviors against the built-in ones\n"
+            "  --bench-level-parse N Time parsing a generated N by N level and exit\n"
+            "  --env N        Step N agent environments with random actions and check their rewards\n"
+            "                 and observations, see src/env.h\n",
+            name, HEADLESS_DEFAULT_TICKS, SIMULATION_TICK_RATE);
+}
+
+int main(int argc, char **argv) {
+    HeadlessConfig config = {
+        .max_ticks = HEADLESS_DEFAULT_TICKS,
+        .dt = SIMULATION_TICK_TIME,
+        .seed = (uint64_t)time(NULL)
+    };
+
+    const char *script_path = NULL;
+    uint32_t game_count = 1;
+    long thread_count = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t batch_size = 0;
+    const char *record_path = NULL;
+    const char *replay_path = NULL;
+    size_t rewind_kb = 0;
+    bool versus = false;
+    HeadlessNetConfig net = { 0 };
+    const char *behaviors_path = NULL;
+    bool built_in_behaviors = false;
+    uint32_t bench_level_size = 0;
+    uint32_t env_count = 0;
+
+    for(int i = 1; i < argc; i++) {
+        bool has_value = (i + 1) < argc;
+
+        if(strcmp(argv[i], "--ticks") == 0 && has_value) {
+            config.max_ticks = strtoull(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--dt") == 0 && has_value) {
+            config.dt = strtof(argv[++i], NULL);
+        } else if(strcmp(argv[i], "--script") == 0 && has_value) {
+            script_path = argv[++i];
+        } else if(strcmp(argv[i], "--seed") == 0 && has_value) {
+            config.seed = strtoull(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--games") == 0 && has_value) {
+            game_count = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--threads") == 0 && has_value) {
+            thread_count = strtol(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--batch") == 0 && has_value) {
+            batch_size = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--record") == 0 && has_value) {
+            record_path = argv[++i];
+        } else if(strcmp(argv[i], "--replay") == 0 && has_value) {
+            replay_path = argv[++i];
+        } else if(strcmp(argv[i], "--rewind") == 0 && has_value) {
+            rewind_kb = strtoull(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--versus") == 0) {
+            versus = true;
+        } else if(strcmp(argv[i], "--latency") == 0 && has_value) {
+            net.latency = strtoull(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--loss") == 0 && has_value) {
+            net.loss = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--shortest-paths") == 0) {
+            config.ghost_pathing = GHOST_PATHING_SHORTEST;
+        } else if(strcmp(argv[i], "--scalar-ghosts") == 0) {
+            config.scalar_ghosts = true;
+        } else if(strcmp(argv[i], "--check-lanes") == 0) {
+            config.check_lanes = true;
+        } else if(strcmp(argv[i], "--swarm") == 0 && has_value) {
+            config.swarm_size = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--behaviors") == 0 && has_value) {
+            behaviors_path = argv[++i];
+        } else if(strcmp(argv[i], "--built-in-behaviors") == 0) {
+            built_in_behaviors = true;
+        } else if(strcmp(argv[i], "--bench-behaviors") == 0) {
+            config.bench_behaviors = true;
+        } else if(strcmp(argv[i], "--bench-level-parse") == 0 && has_value) {
+            bench_level_size = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--env") == 0 && has_value) {
+            env_count = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else {
+            print_usage(argv[0]);
+            return -1;
+        }
+    }
+
+    if(bench_level_size > 0) {
+        if(bench_level_size < HEADLESS_LEVEL_PARSE_MIN_SIZE) {
+            fprintf(stderr, "Generated levels are at least %d tiles across\n", HEADLESS_LEVEL_PARSE_MIN_SIZE);
+            return -1;
+        }
+
+        return bench_level_parse(bench_level_size, config.seed);
+    }
+
+    if(config.dt <= 0.0f || game_count == 0) {
+        fprintf(stderr, "The time step and the number of games must be greater than zero\n");
+        return -1;
+    }
+
+    if(record_path && (game_count > 1 || batch_size > 0)) {
+        fprintf(stderr, "Only a single game without --batch can be recorded\n");
+        return -1;
+    }
+
+    if(rewind_kb > 0 && (game_count > 1 || batch_size > 0 || record_path)) {
+        fprintf(stderr, "Rewinding only works with a single game without --batch or --record\n");
+        return -1;
+    }
+
+    if(net.loss > 100) {
+        fprintf(stderr, "The packet loss is a percentage\n");
+        return -1;
+    }
+
+    if(versus && (batch_size > 0 || record_path || rewind_kb > 0)) {
+        fprintf(stderr, "--versus can't be combined with --batch, --record or --rewind\n");
+        return -1;
+    }
+    // Replays and versus packets don't carry the pathing mode
+    if(config.ghost_pathing != GHOST_PATHING_GREEDY && (record_path || replay_path || versus)) {
+        fprintf(stderr, "--shortest-paths can't be combined with --record, --replay or --versus\n");
+        return -1;
+    }
+
+    if(config.check_lanes && (batch_size > 0 || rewind_kb > 0 || replay_path || versus)) {
+        fprintf(stderr, "--check-lanes can't be combined with --batch, --rewind, --replay or --versus\n");
+        return -1;
+    }
+
+    // Snapshots, replays and the other modes don't know about the swarm
+    if(config.swarm_size > 0 && (batch_size > 0 || rewind_kb > 0 || record_path || replay_path ||
+                                 versus || config.check_lanes)) {
+        fprintf(stderr, "--swarm can't be combined with --batch, --rewind, --record, --replay, --versus or --check-lanes\n");
+        return -1;
+    }
+
+    // Replays and versus packets don't carry the behaviors either
+    if((behaviors_path || built_in_behaviors) && (record_path || replay_path || versus)) {
+        fprintf(stderr, "--behaviors and --built-in-behaviors can't be combined with --record, --replay or --versus\n");
+        return -1;
+    }
+
+    if(config.bench_behaviors && (batch_size > 0 || rewind_kb > 0 || replay_path || versus)) {
+        fprintf(stderr, "--bench-behaviors can't be combined with --batch, --rewind, --replay or --versus\n");
+        return -1;
+    }
+
+    // The environments pick their own input, step with the fixed tick and don't
+    // expose the other settings of their games
+    if(env_count > 0 && (script_path || game_count > 1 || batch_size > 0 || record_path || replay_path ||
+                         rewind_kb > 0 || versus || config.dt != SIMULATION_TICK_TIME ||
+                         config.ghost_pathing != GHOST_PATHING_GREEDY || config.scalar_ghosts ||
+                         config.check_lanes || config.swarm_size > 0 || config.bench_behaviors)) {
+        fprintf(stderr, "--env only combines with --ticks, --seed, --behaviors and --built-in-behaviors\n");
+        return -1;
+    }
+
+    if(config.swarm_size > SWARM_CAPACITY_MAX) {
+        fprintf(stderr, "At most %u swarm ghosts are supported\n", SWARM_CAPACITY_MAX);
+        return -1;
+    }
+
+    if(versus) {
+        // The second game slot drives the ghost
+        game_count = 2;
+    }
+
+    batch_size = MIN(batch_size, game_count);
+    uint32_t job_count = batch_size ? (game_count + batch_size - 1) / batch_size : game_count;
+    thread_count = CLAMP(thread_count, 1, (long)job_count);
+
+    InputScript script = { 0 };
+    if(script_path && !load_input_script(script_path, &script)) {
+        fprintf(stderr, "Could not open input script %s\n", script_path);
+        return -1;
+    }
+
+    GameAssets *assets = create_game_assets();
+    if(!assets) {
+        fprintf(stderr, "Failed to load any level data!\n");
+        return -1;
+    }
+
+    if((behaviors_path || built_in_behaviors) && !load_game_ghost_behaviors(assets, behaviors_path)) {
+        destroy_game_assets(&assets);
+        return -1;
+    }
+
+    if(config.ghost_pathing == GHOST_PATHING_SHORTEST) {
+        for(uint32_t i = 0; i < get_game_level_count(assets); i++) {
+            double start = get_time_seconds();
+            size_t size = build_game_next_hops(assets, i);
+            double seconds = get_time_seconds() - start;
+
+            if(size > 0) {
+                printf("next hops for level %u: %.1f KB in %.2f ms\n", i, (double)size / 1024.0, seconds * 1000.0);
+            } else {
+                printf("next hops for level %u: too many tiles, chasing stays greedy\n", i);
+            }
+        }
+    }
+
+    if(env_count > 0) {
+        bool match = run_headless_env(assets, &config, env_count);
+
+        destroy_game_assets(&assets);
+        return match ? 0 : 1;
+    }
+
+    if(replay_path) {
+        Replay *replay = load_replay(replay_path);
+        if(!replay) {
+            fprintf(stderr, "Could not load replay file %s\n", replay_path);
+            destroy_game_assets(&assets);
+            return -1;
+        }
+
+        bool match = run_headless_replay(assets, replay);
+
+        unload_replay(&replay);
+        destroy_game_assets(&assets);
+        return match ? 0 : 1;
+    }
+
+    HeadlessGame *games = calloc(game_count, sizeof(*games));
+    InputScriptCursor *cursors = calloc(game_count, sizeof(*cursors));
+    RandomBot *bots = calloc(game_count, sizeof(*bots));
+
+    for(uint32_t i = 0; i < game_count; i++) {
+        games[i].stream = i;
+        if(script_path) {
+            cursors[i].script = &script;
+            games[i].input_callback = script_input_callback;
+            games[i].user_data = &cursors[i];
+        } else {
+            bots[i].seed = (unsigned int)config.seed + i;
+            games[i].input_callback = random_input_callback;
+            games[i].user_data = &bots[i];
+        }
+    }
+
+    if(record_path) {
+        games[0].recorder = create_replay_recorder(record_path, config.seed);
+        if(!games[0].recorder) {
+            fprintf(stderr, "Could not create replay file %s\n", record_path);
+        }
+    }
+
+    if(rewind_kb > 0) {
+        bool match = run_headless_rewind(assets, &config, &games[0], rewind_kb * 1024);
+
+        free(bots);
+        free(cursors);
+        free(games);
+        free(script.steps);
+        destroy_game_assets(&assets);
+        return match ? 0 : 1;
+    }
+
+    if(versus) {
+        bool match = run_headless_versus(assets, &config, &net, &games[0], &games[1]);
+
+        free(bots);
+        free(cursors);
+        free(games);
+        free(script.steps);
+        destroy_game_assets(&assets);
+        return match ? 0 : 1;
+    }
+
+    HeadlessJobQueue queue = {
+        .assets = assets,
+        .config = &config,
+        .games = games,
+        .game_count = game_count,
+        .batch_size = batch_size
+    };
+    pthread_mutex_init(&queue.lock, NULL);
+
+    pthread_t *threads = calloc(thread_count, sizeof(*threads));
+
+    double start = get_time_seconds();
+    for(long i = 0; i < thread_count; i++) {
+        pthread_create(&threads[i], NULL, headless_worker, &queue);
+    }
+    for(long i = 0; i < thread_count; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    double seconds = get_time_seconds() - start;
+
+    uint64_t total_ticks = 0;
+    uint64_t total_score = 0;
+    uint32_t games_over = 0;
+    uint64_t lane_mismatches = 0;
+    double swarm_seconds = 0.0;
+    double built_in_behavior_seconds = 0.0;
+    double behavior_seconds = 0.0;
+    uint64_t behavior_mismatches = 0;
+    for(uint32_t i = 0; i < game_count; i++) {
+        total_ticks += games[i].result.ticks;
+        total_score += games[i].result.score;
+        games_over += games[i].result.game_over;
+        lane_mismatches += games[i].result.lane_mismatches;
+        swarm_seconds += games[i].result.swarm_seconds;
+        built_in_behavior_seconds += games[i].result.built_in_behavior_seconds;
+        behavior_seconds += games[i].result.behavior_seconds;
+        behavior_mismatches += games[i].result.behavior_mismatches;
+    }
+
+    printf("games: %u\n", game_count);
+    printf("threads: %ld\n", thread_count);
+    if(batch_size > 0) {
+        printf("batch: %u\n", batch_size);
+    }
+    printf("ticks: %llu\n", (unsigned long long)total_ticks);
+    printf("seconds: %.3f\n", seconds);
+    printf("ticks/s: %.0f\n", (seconds > 0.0) ? (double)total_ticks / seconds : 0.0);
+    printf("simulated: %.1f s\n", (double)total_ticks * config.dt);
+    printf("score: %.1f\n", (double)total_score / (double)game_count);
+    printf("game over: %u/%u\n", games_over, game_count);
+    if(config.swarm_size > 0) {
+        printf("swarm: %u ghosts per game, %.1f us per tick\n", config.swarm_size,
+               total_ticks ? swarm_seconds * 1000000.0 / (double)total_ticks : 0.0);
+    }
+    if(config.bench_behaviors) {
+        // Each call works out a chase and a scatter target for every ghost
+        double targets = (double)total_ticks * HEADLESS_BEHAVIOR_REPEATS * GHOST_COUNT * 2;
+        printf("ghost behaviors: built-in %.1f ns, loaded %.1f ns per target, %llu ticks where they differ\n",
+               targets > 0.0 ? built_in_behavior_seconds * 1e9 / targets : 0.0,
+               targets > 0.0 ? behavior_seconds * 1e9 / targets : 0.0,
+               (unsigned long long)behavior_mismatches);
+    }
+    if(config.check_lanes) {
+        printf("ghost lanes: %s (%llu ticks differ)\n", lane_mismatches ? "MISMATCH" : "match",
+               (unsigned long long)lane_mismatches);
+    }
+
+    pthread_mutex_destroy(&queue.lock);
+    free(threads);
+    free(bots);
+    free(cursors);
+    free(games);
+    free(script.steps);
+    destroy_game_assets(&assets);
+
+    return lane_mismatches ? 1 : 0;
+}
@@ -0,0 +1,103 @@
+/*
+ * Pacman Clone
+ *
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ */
+
+// Level compiler. Turns the .csv files in data/level into compiled levels next
+// to them, see src/levelfile.h, and checks that they load back the same.
+
+#define PACMAN_HEADLESS
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../platform.h"
+
+#include "../game.c"
+#include "linux_platform.c"
+
+static bool compile_level(const char *file_name, bool with_fields) {
+    char path[MAX_PATH + 16];
+    get_compiled_level_path(file_name, path, sizeof(path));
+
+    Level *level = load_level(file_name);
+    LevelGraph *graph = create_level_graph(level);
+    if(!level || !graph) {
+        fprintf(stderr, "%s: could not be loaded\n", file_name);
+        unload_level(&level);
+        destroy_level_graph(&graph);
+        return false;
+    }
+
+    size_t file_size = save_compiled_level(file_name, level, with_fields ? graph : NULL);
+    bool compiled = file_size > 0;
+    if(!compiled) {
+        fprintf(stderr, "%s: could not be written\n", path);
+    }
+
+    Level *loaded_level = NULL;
+    LevelGraph *loaded_graph = NULL;
+    if(compiled) {
+        compiled = load_compiled_level(file_name, &loaded_level, &loaded_graph) &&
+                   memcmp(level, loaded_level, get_level_size(level)) == 0 &&
+                   memcmp(graph->exits, loaded_graph->exits, get_level_graph_fields_size(graph)) == 0;
+        if(!compiled) {
+            fprintf(stderr, "%s: doesn't load back the same as %s\n", path, file_name);
+            remove(path);
+        }
+    }
+
+    if(compiled) {
+        // The rest is the header and the padding before the fields
+        printf("%s -> %s: %zu bytes, %zu of level", file_name, path, file_size, get_level_size(level));
+        if(with_fields) {
+            printf(" and %zu of graph fields", get_level_graph_fields_size(graph));
+        }
+        printf("\n");
+    }
+
+    unload_level(&loaded_level);
+    destroy_level_graph(&loaded_graph);
+    unload_level(&level);
+    destroy_level_graph(&graph);
+
+    return compiled;
+}
+
+int main(int argc, char **argv) {
+    bool with_fields = true;
+    int first_file = argc;
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "--no-fields") == 0) {
+            with_fields = false;
+        } else if(argv[i][0] == '-') {
+            fprintf(stderr,
+                    "Usage: %s [--no-fields] [FILE...]\n"
+                    "  Compiles the given .csv files in data/level, or all of them\n"
+                    "  --no-fields  Leave out the exit masks and distance fields\n",
+                    argv[0]);
+            return -1;
+        } else {
+            first_file = i;
+            break;
+        }
+    }
+
+    int failures = 0;
+    if(first_file < argc) {
+        for(int i = first_file; i < argc; i++) {
+            failures += !compile_level(argv[i], with_fields);
+        }
+    } else {
+        LevelFileData level_files = { 0 };
+        init_level_names(&level_files);
+        for(uint32_t i = 0; i < level_files.count; i++) {
+            failures += !compile_level(get_level_file_name(&level_files, i), with_fields);
+        }
+        destroy_level_names(&level_files);
+    }
+
+    return failures ? -1 : 0;
+}
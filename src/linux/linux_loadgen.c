@@ -0,0 +1,357 @@
+/*
+ * Pacman Clone
+ *
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ */
+
+// Load generator for pacman_server. Runs many bot clients, each with its own UDP
+// socket and therefore its own server session, decodes every state it gets back
+// and reports how the server kept up.
+
+#define PACMAN_HEADLESS
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../platform.h"
+
+#include "../game.c"
+#include "linux_platform.c"
+#include "linux_net.c"
+
+#define LOADGEN_DEFAULT_SESSIONS 256
+#define LOADGEN_DEFAULT_DURATION 10.0
+#define LOADGEN_DEFAULT_RATE 30
+#define LOADGEN_BOT_DECISION_SECONDS 0.5
+#define LOADGEN_PELLET_HISTORY 32
+#define LOADGEN_SAMPLES_MAX (1 << 20)
+// Expected state rate, see SERVER_SEND_TICKS in linux_server.c
+#define LOADGEN_SERVER_SEND_TICKS 4
+
+typedef struct {
+    int socket;
+    unsigned int seed;
+    uint8_t input;
+    uint32_t sends;
+
+    uint32_t acked_sequence;
+    // Decoded pellet bits by sequence % LOADGEN_PELLET_HISTORY
+    uint8_t *pellet_history;
+    uint32_t history_sequences[LOADGEN_PELLET_HISTORY];
+    uint32_t states;
+} LoadClient;
+
+typedef struct {
+    const struct sockaddr_in *server;
+    double start;
+    double duration;
+    uint32_t rate;
+    size_t pellet_bytes;
+
+    LoadClient *clients;
+    uint32_t client_count;
+
+    uint64_t states;
+    uint64_t bytes;
+    uint64_t full_states;
+    uint64_t decode_failures;
+    uint32_t workers;
+    uint32_t *latency_us;
+    uint32_t *tick_us;
+    uint32_t sample_count;
+} LoadThread;
+
+static double get_time_seconds(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double)t.tv_sec + (double)t.tv_nsec / 1e9;
+}
+
+static int compare_uint32(const void *lhs, const void *rhs) {
+    uint32_t a = *(const uint32_t *)lhs;
+    uint32_t b = *(const uint32_t *)rhs;
+    return (a > b) - (a < b);
+}
+
+static inline uint32_t get_percentile(const uint32_t *sorted, uint32_t count, uint32_t percentile) {
+    return count ? sorted[(uint64_t)(count - 1) * percentile / 100] : 0;
+}
+
+static void receive_states(LoadThread *thread, LoadClient *client, uint32_t now_us) {
+    uint8_t packet[NET_STATE_PACKET_SIZE_MAX];
+    ssize_t size;
+
+    while((size = recv(client->socket, packet, sizeof(packet), 0)) >= 0) {
+        NetState state;
+        size_t header_size = read_net_state(packet, (size_t)size, &state);
+        if(header_size == 0) {
+            thread->decode_failures++;
+            continue;
+        }
+
+        const uint8_t *base_bits = NULL;
+        if(state.base_sequence != NET_NO_SEQUENCE) {
+            uint32_t base_slot = state.base_sequence % LOADGEN_PELLET_HISTORY;
+            if(client->history_sequences[base_slot] != state.base_sequence) {
+                thread->decode_failures++;
+                continue;
+            }
+            base_bits = client->pellet_history + base_slot * thread->pellet_bytes;
+        }
+
+        uint32_t slot = state.sequence % LOADGEN_PELLET_HISTORY;
+        uint8_t *pellet_bits = client->pellet_history + slot * thread->pellet_bytes;
+        client->history_sequences[slot] = NET_NO_SEQUENCE;
+        if(!read_net_state_pellets(packet + header_size, (size_t)size - header_size, &state,
+                                   base_bits, pellet_bits, thread->pellet_bytes)) {
+            thread->decode_failures++;
+            continue;
+        }
+        client->history_sequences[slot] = state.sequence;
+
+        if(client->acked_sequence == NET_NO_SEQUENCE || state.sequence > client->acked_sequence) {
+            client->acked_sequence = state.sequence;
+        }
+
+        client->states++;
+        thread->states++;
+        thread->bytes += (uint64_t)size;
+        thread->full_states += (state.base_sequence == NET_NO_SEQUENCE);
+        thread->workers = MAX(thread->workers, state.workers);
+
+        if(thread->sample_count < LOADGEN_SAMPLES_MAX) {
+            thread->latency_us[thread->sample_count] = now_us - state.echo_time;
+            thread->tick_us[thread->sample_count] = state.server_tick_us;
+            thread->sample_count++;
+        }
+    }
+}
+
+static void send_inputs(LoadThread *thread, uint32_t now_us) {
+    static const uint8_t directions[4] = { INPUT_UP, INPUT_LEFT, INPUT_DOWN, INPUT_RIGHT };
+    uint32_t decision_sends = MAX((uint32_t)(LOADGEN_BOT_DECISION_SECONDS * thread->rate), 1);
+
+    uint8_t packet[NET_INPUT_PACKET_SIZE];
+    for(uint32_t i = 0; i < thread->client_count; i++) {
+        LoadClient *client = &thread->clients[i];
+        if((client->sends++ % decision_sends) == 0) {
+            client->input = directions[rand_r(&client->seed) % 4];
+        }
+
+        size_t size = write_net_input(client->acked_sequence, now_us, client->input, packet);
+        sendto(client->socket, packet, size, 0, (const struct sockaddr *)thread->server, sizeof(*thread->server));
+    }
+}
+
+static void * load_thread(void *parameter) {
+    LoadThread *thread = parameter;
+
+    int epoll = epoll_create1(0);
+    int timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    long interval_ns = 1000000000L / thread->rate;
+    struct itimerspec interval = {
+        .it_interval = { .tv_sec = interval_ns / 1000000000L, .tv_nsec = interval_ns % 1000000000L },
+        .it_value = { .tv_sec = 0, .tv_nsec = 1 }
+    };
+    timerfd_settime(timer, 0, &interval, NULL);
+
+    struct epoll_event timer_event = { .events = EPOLLIN, .data.u32 = UINT32_MAX };
+    epoll_ctl(epoll, EPOLL_CTL_ADD, timer, &timer_event);
+    for(uint32_t i = 0; i < thread->client_count; i++) {
+        struct epoll_event event = { .events = EPOLLIN, .data.u32 = i };
+        epoll_ctl(epoll, EPOLL_CTL_ADD, thread->clients[i].socket, &event);
+    }
+
+    struct epoll_event events[256];
+    double now = get_time_seconds();
+    while(now - thread->start < thread->duration) {
+        int count = epoll_wait(epoll, events, 256, 100);
+        now = get_time_seconds();
+        uint32_t now_us = (uint32_t)((now - thread->start) * 1e6);
+
+        for(int i = 0; i < count; i++) {
+            if(events[i].data.u32 == UINT32_MAX) {
+                uint64_t expirations;
+                if(read(timer, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+                    send_inputs(thread, now_us);
+                }
+            } else {
+                receive_states(thread, &thread->clients[events[i].data.u32], now_us);
+            }
+        }
+    }
+
+    close(timer);
+    close(epoll);
+    return NULL;
+}
+
+static void print_usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --server HOST:PORT  Server to connect to (default 127.0.0.1:7100)\n"
+            "  --sessions N        Number of bot clients (default %d)\n"
+            "  --threads N         Number of client threads (default 1)\n"
+            "  --duration N        Seconds to run for (default %.0f)\n"
+            "  --rate N            Inputs sent per second and client (default %d)\n",
+            name, LOADGEN_DEFAULT_SESSIONS, LOADGEN_DEFAULT_DURATION, LOADGEN_DEFAULT_RATE);
+}
+
+int main(int argc, char **argv) {
+    const char *server_name = "127.0.0.1:7100";
+    uint32_t session_count = LOADGEN_DEFAULT_SESSIONS;
+    uint32_t thread_count = 1;
+    double duration = LOADGEN_DEFAULT_DURATION;
+    uint32_t rate = LOADGEN_DEFAULT_RATE;
+
+    for(int i = 1; i < argc; i++) {
+        bool has_value = (i + 1) < argc;
+
+        if(strcmp(argv[i], "--server") == 0 && has_value) {
+            server_name = argv[++i];
+        } else if(strcmp(argv[i], "--sessions") == 0 && has_value) {
+            session_count = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--threads") == 0 && has_value) {
+            thread_count = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--duration") == 0 && has_value) {
+            duration = strtod(argv[++i], NULL);
+        } else if(strcmp(argv[i], "--rate") == 0 && has_value) {
+            rate = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else {
+            print_usage(argv[0]);
+            return -1;
+        }
+    }
+
+    if(session_count == 0 || rate == 0 || duration <= 0.0) {
+        fprintf(stderr, "The sessions, rate and duration must be greater than zero\n");
+        return -1;
+    }
+    thread_count = CLAMP(thread_count, 1, session_count);
+
+    struct sockaddr_in server;
+    if(!parse_socket_address(server_name, &server)) {
+        fprintf(stderr, "Could not resolve %s\n", server_name);
+        return -1;
+    }
+
+    // Every client needs its own socket
+    struct rlimit limit;
+    if(getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < session_count + 64) {
+        limit.rlim_cur = MIN(limit.rlim_max, (rlim_t)session_count + 64);
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    GameAssets *assets = create_game_assets();
+    if(!assets) {
+        fprintf(stderr, "Failed to load any level data!\n");
+        return -1;
+    }
+    size_t pellet_bytes = get_net_pellet_bytes_max(assets);
+    destroy_game_assets(&assets);
+
+    LoadClient *clients = calloc(session_count, sizeof(*clients));
+    LoadThread *threads = calloc(thread_count, sizeof(*threads));
+    pthread_t *handles = calloc(thread_count, sizeof(*handles));
+    uint32_t *latency_us = malloc((size_t)LOADGEN_SAMPLES_MAX * thread_count * sizeof(*latency_us));
+    uint32_t *tick_us = malloc((size_t)LOADGEN_SAMPLES_MAX * thread_count * sizeof(*tick_us));
+    if(!clients || !threads || !handles || !latency_us || !tick_us) {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+    }
+
+    uint32_t opened = 0;
+    for(; opened < session_count; opened++) {
+        LoadClient *client = &clients[opened];
+        client->socket = open_udp_socket("0.0.0.0", 0);
+        client->pellet_history = malloc(LOADGEN_PELLET_HISTORY * pellet_bytes);
+        if(client->socket < 0 || !client->pellet_history) {
+            fprintf(stderr, "Could only open %u sockets\n", opened);
+            free(client->pellet_history);
+            break;
+        }
+
+        client->seed = opened;
+        client->acked_sequence = NET_NO_SEQUENCE;
+        memset(client->history_sequences, 0xff, sizeof(client->history_sequences));
+    }
+    session_count = opened;
+    thread_count = CLAMP(thread_count, 1, MAX(session_count, 1));
+
+    double start = get_time_seconds();
+    uint32_t first_client = 0;
+    for(uint32_t i = 0; i < thread_count; i++) {
+        uint32_t count = session_count / thread_count + (i < session_count % thread_count);
+        threads[i] = (LoadThread){
+            .server = &server,
+            .start = start,
+            .duration = duration,
+            .rate = rate,
+            .pellet_bytes = pellet_bytes,
+            .clients = clients + first_client,
+            .client_count = count,
+            .latency_us = latency_us + (size_t)i * LOADGEN_SAMPLES_MAX,
+            .tick_us = tick_us + (size_t)i * LOADGEN_SAMPLES_MAX
+        };
+        first_client += count;
+        pthread_create(&handles[i], NULL, load_thread, &threads[i]);
+    }
+
+    uint64_t states = 0, bytes = 0, full_states = 0, decode_failures = 0;
+    uint32_t workers = 0, sample_count = 0;
+    for(uint32_t i = 0; i < thread_count; i++) {
+        pthread_join(handles[i], NULL);
+
+        LoadThread *thread = &threads[i];
+        states += thread->states;
+        bytes += thread->bytes;
+        full_states += thread->full_states;
+        decode_failures += thread->decode_failures;
+        workers = MAX(workers, thread->workers);
+
+        memmove(latency_us + sample_count, thread->latency_us, thread->sample_count * sizeof(*latency_us));
+        memmove(tick_us + sample_count, thread->tick_us, thread->sample_count * sizeof(*tick_us));
+        sample_count += thread->sample_count;
+    }
+    double seconds = get_time_seconds() - start;
+
+    uint32_t active = 0;
+    for(uint32_t i = 0; i < session_count; i++) {
+        active += (clients[i].states > 0);
+    }
+
+    qsort(latency_us, sample_count, sizeof(*latency_us), compare_uint32);
+    qsort(tick_us, sample_count, sizeof(*tick_us), compare_uint32);
+    double expected_states = (double)session_count * seconds * SIMULATION_TICK_RATE / LOADGEN_SERVER_SEND_TICKS;
+
+    printf("sessions: %u (%u received states)\n", session_count, active);
+    printf("server workers: %u\n", workers);
+    printf("sessions per core: %.1f\n", workers ? (double)active / (double)workers : 0.0);
+    printf("states: %.0f/s (%.1f%% of the expected rate)\n", (double)states / seconds,
+           expected_states > 0.0 ? 100.0 * (double)states / expected_states : 0.0);
+    printf("state size: %.1f bytes average, %.1f%% sent in full\n",
+           states ? (double)bytes / (double)states : 0.0, states ? 100.0 * (double)full_states / (double)states : 0.0);
+    printf("decode failures: %llu\n", (unsigned long long)decode_failures);
+    printf("input to state latency: p50 %u us, p99 %u us\n",
+           get_percentile(latency_us, sample_count, 50), get_percentile(latency_us, sample_count, 99));
+    printf("server tick: p50 %u us, p99 %u us\n",
+           get_percentile(tick_us, sample_count, 50), get_percentile(tick_us, sample_count, 99));
+
+    for(uint32_t i = 0; i < session_count; i++) {
+        close(clients[i].socket);
+        free(clients[i].pellet_history);
+    }
+    free(tick_us);
+    free(latency_us);
+    free(handles);
+    free(threads);
+    free(clients);
+
+    return 0;
+}
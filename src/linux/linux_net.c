@@ -0,0 +1,76 @@
+/*
+ * Pacman Clone
+ *
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ */
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Parses "host:port", where host is a name or an IPv4 address
+bool parse_socket_address(const char *text, struct sockaddr_in *address) {
+    const char *separator = strrchr(text, ':');
+    if(!separator || separator == text || separator[1] == '\0') {
+        return false;
+    }
+
+    char host[256];
+    size_t host_length = (size_t)(separator - text);
+    if(host_length >= sizeof(host)) {
+        return false;
+    }
+    memcpy(host, text, host_length);
+    host[host_length] = '\0';
+
+    struct addrinfo hints = { .ai_family = AF_INET, .ai_socktype = SOCK_DGRAM };
+    struct addrinfo *result = NULL;
+    if(getaddrinfo(host, separator + 1, &hints, &result) != 0 || !result) {
+        return false;
+    }
+
+    memcpy(address, result->ai_addr, sizeof(*address));
+    freeaddrinfo(result);
+    return true;
+}
+
+// Non-blocking UDP socket on the given IPv4 address, port 0 picks a free one.
+// Returns -1 on failure.
+int open_udp_socket(const char *host, uint16_t port) {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if(fd < 0) {
+        return -1;
+    }
+
+    struct sockaddr_in address = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port)
+    };
+
+    if(inet_pton(AF_INET, host, &address.sin_addr) != 1 ||
+       bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+       fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+uint16_t get_udp_socket_port(int fd) {
+    struct sockaddr_in address;
+    socklen_t length = sizeof(address);
+    if(getsockname(fd, (struct sockaddr *)&address, &length) != 0) {
+        return 0;
+    }
+
+    return ntohs(address.sin_port);
+}
@@ -0,0 +1,221 @@
+/*
+ * Pacman Clone
+ *
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ */
+
+// Asset packer. Puts the decoded texture atlas, the ghost behaviors and every
+// level in data/, compiled, into one pack, see src/pack.h, and checks that it
+// reads back the same. With --embed it writes the pack as C source instead,
+// which PACMAN_EMBED_ASSETS builds into the executable.
+
+#define PACMAN_HEADLESS
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../platform.h"
+
+#include "../game.c"
+#include "../texture.c"
+#include "linux_platform.c"
+
+#define PACK_ENTRIES_MAX 256
+#define PACK_NAME_MAX 64
+#define PACK_EMBED_WORDS_PER_LINE 8
+
+typedef struct {
+    char name[PACK_NAME_MAX];
+    const void *data;
+    size_t size;
+    bool mapped; // Otherwise it's allocated
+} PackInput;
+
+static int pack_input_compare(const void *lhs, const void *rhs) {
+    return strcmp(((const PackInput *)lhs)->name, ((const PackInput *)rhs)->name);
+}
+
+static bool add_pack_file(PackInput *inputs, uint32_t *count, const char *name) {
+    char path[MAX_PATH + 16];
+    snprintf(path, sizeof(path), "data/%s", name);
+
+    PackInput *input = &inputs[*count];
+    input->data = map_file(path, &input->size);
+    if(!input->data) {
+        fprintf(stderr, "%s: could not be read\n", path);
+        return false;
+    }
+
+    snprintf(input->name, sizeof(input->name), "%s", name);
+    input->mapped = true;
+    (*count)++;
+    return true;
+}
+
+// Stored the way the renderer uses it, so the game doesn't decode anything
+static bool add_pack_texture(PackInput *inputs, uint32_t *count, const char *name, const char *bitmap) {
+    char path[MAX_PATH + 16];
+    snprintf(path, sizeof(path), "data/%s", bitmap);
+
+    PackInput *input = &inputs[*count];
+    Texture2D *texture = load_texture(path, ATLAS_CHROMA_KEY);
+    if(!texture) {
+        fprintf(stderr, "%s: could not be read\n", path);
+        return false;
+    }
+
+    snprintf(input->name, sizeof(input->name), "%s", name);
+    input->data = texture;
+    input->size = get_texture_size(texture);
+    input->mapped = false;
+    (*count)++;
+    return true;
+}
+
+static bool add_pack_level(PackInput *inputs, uint32_t *count, const char *file_name) {
+    Level *level = load_level(file_name);
+    LevelGraph *graph = create_level_graph(level);
+
+    PackInput *input = &inputs[*count];
+    input->data = (level && graph) ? create_compiled_level(level, graph, file_name, &input->size) : NULL;
+    unload_level(&level);
+    destroy_level_graph(&graph);
+
+    if(!input->data) {
+        fprintf(stderr, "%s: could not be compiled\n", file_name);
+        return false;
+    }
+
+    const char *extension = strrchr(file_name, '.');
+    int32_t stem_length = (int32_t)(extension ? (size_t)(extension - file_name) : strlen(file_name));
+    input->mapped = false;
+    if(snprintf(input->name, sizeof(input->name), "level/%.*s.lvl", stem_length, file_name) >= PACK_NAME_MAX) {
+        fprintf(stderr, "%s: the name is too long\n", file_name);
+        free((void *)input->data);
+        return false;
+    }
+
+    (*count)++;
+    return true;
+}
+
+// Every entry has to be found by name and match what went in
+static bool check_pack(const void *data, size_t size, const PackInput *inputs, uint32_t count) {
+    Pack *pack = open_pack_in_memory(data, size);
+    bool same = pack && get_pack_entry_count(pack) == count;
+
+    for(uint32_t i = 0; same && i < count; i++) {
+        size_t entry_size = 0;
+        const void *entry = find_pack_entry(pack, inputs[i].name, &entry_size);
+        same = entry && entry_size == inputs[i].size && memcmp(entry, inputs[i].data, entry_size) == 0;
+    }
+
+    close_pack(&pack);
+    return same;
+}
+
+// As an array of words, which keeps it aligned for open_pack_in_memory
+static bool write_embedded_pack(FILE *f, const uint8_t *pack, size_t size) {
+    fprintf(f,
+            "/*\n"
+            " * Pacman Clone\n"
+            " *\n"
+            " * Copyright (c) 2021 Amanch Esmailzadeh\n"
+            " */\n"
+            "\n"
+            "// Written by pacman_pack --embed from data/, don't edit\n"
+            "\n"
+            "static const size_t embedded_pack_size = %zu;\n"
+            "static const uint32_t embedded_pack[] = {",
+            size);
+
+    size_t word_count = (size + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+    for(size_t i = 0; i < word_count; i++) {
+        uint32_t word = 0;
+        memcpy(&word, &pack[i * sizeof(word)], MIN(sizeof(word), size - i * sizeof(word)));
+        fprintf(f, "%s0x%08x,", (i % PACK_EMBED_WORDS_PER_LINE) ? " " : "\n    ", word);
+    }
+
+    return fprintf(f, "\n};\n") > 0;
+}
+
+int main(int argc, char **argv) {
+    const char *path = PACK_PATH;
+    bool embed = false;
+    if(argc == 3 && (strcmp(argv[1], "-o") == 0 || strcmp(argv[1], "--embed") == 0)) {
+        path = argv[2];
+        embed = (strcmp(argv[1], "--embed") == 0);
+    } else if(argc != 1) {
+        fprintf(stderr,
+                "Usage: %s [-o FILE | --embed FILE]\n"
+                "  Packs the assets in data/ into %s, or FILE\n"
+                "  --embed FILE  Write the pack as C source for PACMAN_EMBED_ASSETS\n",
+                argv[0], PACK_PATH);
+        return -1;
+    }
+
+    static PackInput inputs[PACK_ENTRIES_MAX];
+    uint32_t count = 0;
+    bool added = add_pack_texture(inputs, &count, "texture_atlas.tex", "texture_atlas.bmp");
+
+    // The ghost behaviors are optional, the same as in the game
+    FILE *behaviors = fopen("data/ghosts.txt", "rb");
+    if(behaviors) {
+        fclose(behaviors);
+        added = add_pack_file(inputs, &count, "ghosts.txt") && added;
+    }
+
+    LevelFileData level_files = { 0 };
+    init_level_names(&level_files);
+    if(level_files.count == 0 || level_files.count > PACK_ENTRIES_MAX - count) {
+        fprintf(stderr, "data/level: %u levels, there have to be between 1 and %u\n",
+                level_files.count, PACK_ENTRIES_MAX - count);
+        added = false;
+    }
+    for(uint32_t i = 0; added && i < level_files.count; i++) {
+        added = add_pack_level(inputs, &count, get_level_file_name(&level_files, i));
+    }
+    destroy_level_names(&level_files);
+
+    qsort(inputs, count, sizeof(*inputs), pack_input_compare);
+
+    const char *names[PACK_ENTRIES_MAX];
+    const void *data[PACK_ENTRIES_MAX];
+    size_t sizes[PACK_ENTRIES_MAX];
+    for(uint32_t i = 0; i < count; i++) {
+        names[i] = inputs[i].name;
+        data[i] = inputs[i].data;
+        sizes[i] = inputs[i].size;
+    }
+
+    size_t size = 0;
+    uint8_t *pack = added ? create_pack(names, data, sizes, count, &size) : NULL;
+    bool packed = pack && check_pack(pack, size, inputs, count);
+    if(pack && !packed) {
+        fprintf(stderr, "The pack doesn't read back the same\n");
+    }
+
+    if(packed) {
+        FILE *f = fopen(path, "wb");
+        packed = f && (embed ? write_embedded_pack(f, pack, size) : fwrite(pack, size, 1, f) == 1);
+        packed = f && (fclose(f) == 0) && packed;
+
+        if(packed) {
+            printf("%s: %u entries, %zu bytes\n", path, count, size);
+        } else {
+            fprintf(stderr, "%s: could not be written\n", path);
+            remove(path);
+        }
+    }
+
+    free(pack);
+    for(uint32_t i = 0; i < count; i++) {
+        if(inputs[i].mapped) {
+            unmap_file(inputs[i].data, inputs[i].size);
+        } else {
+            free((void *)inputs[i].data);
+        }
+    }
+
+    return packed ? 0 : -1;
+}
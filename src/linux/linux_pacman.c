@@ -7,9 +7,9 @@
 #include <X11/Xlib.h>
 #include <GL/gl.h>
 #include <GL/glx.h>
-#include <dirent.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -17,6 +17,8 @@
 
 #include "../glfuncs.h"
 #include "../game.c"
+#include "linux_platform.c"
+#include "linux_net.c"
 
 #define LINUX_CHECK_CREATION_ERROR(expr, msg) \
     do { \
@@ -58,8 +60,55 @@ static int select_best_fb(Display *display, GLXFBConfig *framebuffers, int count
     return idx;
 }
 
+static void print_usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --record FILE                       Record the input to a replay file\n"
+            "  --versus player|ghost PORT HOST:PORT  Play against a second player over UDP,\n"
+            "                                      listening on PORT and sending to HOST:PORT\n"
+            "  --first-frame-time                  Print how long the assets and the first frame took, then quit\n",
+            name);
+}
+
+static double get_time_seconds(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double)t.tv_sec + (double)t.tv_nsec / (double)1000000000;
+}
+
 int main(int argc, char **argv) {
-    srand((unsigned int)time(NULL));
+    double start_time = get_time_seconds();
+    uint64_t seed = (uint64_t)time(NULL);
+
+    ReplayRecorder *recorder = NULL;
+    RollbackSession *session = NULL;
+    RollbackSide side = ROLLBACK_SIDE_PLAYER;
+    int versus_socket = -1;
+    struct sockaddr_in versus_peer;
+    bool first_frame_time = false;
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "--record") == 0 && (i + 1) < argc && !recorder) {
+            recorder = create_replay_recorder(argv[++i], seed);
+            LINUX_CHECK_CREATION_ERROR(recorder, "Could not create the replay file!\n");
+        } else if(strcmp(argv[i], "--versus") == 0 && (i + 3) < argc && versus_socket < 0) {
+            const char *side_name = argv[++i];
+            LINUX_CHECK_CREATION_ERROR(strcmp(side_name, "player") == 0 || strcmp(side_name, "ghost") == 0,
+                                       "The versus side has to be player or ghost!\n");
+            side = (strcmp(side_name, "ghost") == 0) ? ROLLBACK_SIDE_GHOST : ROLLBACK_SIDE_PLAYER;
+
+            versus_socket = open_udp_socket("0.0.0.0", (uint16_t)strtoul(argv[++i], NULL, 10));
+            LINUX_CHECK_CREATION_ERROR(versus_socket >= 0, "Could not open the versus UDP port!\n");
+            LINUX_CHECK_CREATION_ERROR(parse_socket_address(argv[++i], &versus_peer),
+                                       "Could not resolve the versus peer address!\n");
+        } else if(strcmp(argv[i], "--first-frame-time") == 0) {
+            first_frame_time = true;
+        } else {
+            print_usage(argv[0]);
+            return -1;
+        }
+    }
+    LINUX_CHECK_CREATION_ERROR(!recorder || versus_socket < 0, "Versus games can't be recorded!\n");
 
     Display *display = XOpenDisplay(NULL);
     LINUX_CHECK_CREATION_ERROR(display, "Failed to connect to the X Server\n");
@@ -128,11 +177,24 @@ int main(int argc, char **argv) {
                                "Could not obtain an OpenGL 3.3 or newer context!\n");
 
     glXSwapIntervalEXT(display, window, 1);
-    initialize_game();
+
+    double assets_start_time = get_time_seconds();
+    GameAssets *assets = create_game_assets();
+    LINUX_CHECK_CREATION_ERROR(assets, "Failed to load any level data!\n");
+    double assets_time = get_time_seconds() - assets_start_time;
+    GameContext *game = create_game_context(assets);
+    seed_game(game, seed, 0);
+    if(versus_socket >= 0) {
+        // The player side picks the seed, the ghost side gets it from the first packet
+        session = create_rollback_session(game, side, seed);
+        LINUX_CHECK_CREATION_ERROR(session, "Could not create the versus session!\n");
+    }
+    initialize_renderer();
 
     struct timespec current, previous;
     clock_gettime(CLOCK_MONOTONIC, &current);
     double elapsed_time = 0.0;
+    double accumulator = 0.0;
 
     XEvent event;
     uint32_t input = 0;
@@ -176,7 +238,7 @@ int main(int argc, char **argv) {
                     break;
                 case ConfigureNotify: {
                     XConfigureEvent config_event = event.xconfigure;
-                    signal_window_resize(config_event.width, config_event.height);
+                    signal_window_resize(game, config_event.width, config_event.height);
                     received_resize_event = true;
                     break;
                 }
@@ -201,10 +263,49 @@ int main(int argc, char **argv) {
             }
         }
 
-        running = update_loop((float)elapsed_time, input);
-        render_loop((float)elapsed_time);
+        // Clamp long frames so a stall doesn't make us run a huge amount of ticks to catch up
+        accumulator += MIN(elapsed_time, SIMULATION_MAX_FRAME_TIME);
+        if(session) {
+            uint8_t packet[ROLLBACK_PACKET_SIZE_MAX];
+            ssize_t received;
+            while((received = recv(versus_socket, packet, sizeof(packet), 0)) > 0) {
+                read_rollback_packet(session, packet, (size_t)received);
+            }
+
+            while(running && accumulator >= SIMULATION_TICK_TIME) {
+                if(!advance_rollback_session(session, input, &running)) {
+                    // Waiting for the other side, don't build up ticks to catch up on
+                    accumulator = 0.0;
+                    break;
+                }
+                accumulator -= SIMULATION_TICK_TIME;
+            }
+            update_rollback_session(session);
+
+            size_t size = write_rollback_packet(session, packet, sizeof(packet));
+            if(size > 0) {
+                sendto(versus_socket, packet, size, 0, (struct sockaddr *)&versus_peer, sizeof(versus_peer));
+            }
+        }
+        while(running && accumulator >= SIMULATION_TICK_TIME) {
+            if(recorder) {
+                record_replay_tick(recorder, input, SIMULATION_TICK_TIME);
+            }
+            running = update_loop(game, SIMULATION_TICK_TIME, input);
+            accumulator -= SIMULATION_TICK_TIME;
+        }
+
+        render_loop(game, (float)elapsed_time, (float)(accumulator / SIMULATION_TICK_TIME));
         glXSwapBuffers(display, window);
 
+        if(first_frame_time) {
+            // Only once the frame is on screen
+            glFinish();
+            printf("first frame: %.2f ms, %.2f ms of it loading the assets\n",
+                   (get_time_seconds() - start_time) * 1e3, assets_time * 1e3);
+            running = false;
+        }
+
         previous = current;
         clock_gettime(CLOCK_MONOTONIC, &current);
         uint64_t ticks_current = (current.tv_sec * 1000000000) + current.tv_nsec;
@@ -213,6 +314,21 @@ int main(int argc, char **argv) {
 
     }
 
+    if(recorder && !destroy_replay_recorder(&recorder, get_game_state_hash(game))) {
+        fprintf(stderr, "Failed to write the replay file\n");
+    }
+
+    if(session) {
+        if(get_rollback_stats(session)->desynced) {
+            fprintf(stderr, "The versus game went out of sync!\n");
+        }
+        destroy_rollback_session(&session);
+        close(versus_socket);
+    }
+
+    destroy_game_context(&game);
+    destroy_game_assets(&assets);
+
     glXMakeCurrent(display, None, NULL);
     glXDestroyContext(display, gl_context);
     XFree(visual_info);
@@ -221,33 +337,3 @@ int main(int argc, char **argv) {
 
     return 0;
 }
-
-void init_level_names(LevelFileData *data) {
-    DIR *d = opendir("data/level");
-    struct dirent *dir;
-    if(d) {
-        while((dir = readdir(d)) != NULL) {
-            if(dir->d_type == DT_REG) {
-                data->count++;
-            }
-        }
-        rewinddir(d);
-
-        data->names = calloc(1, (MAX_PATH + 1) * data->count);
-
-        int32_t index = 0;
-        while((dir = readdir(d)) != NULL) {
-            if(dir->d_type == DT_REG) {
-                memcpy(&data->names[index * (MAX_PATH + 1)], dir->d_name, MAX_PATH);
-                index++;
-            }
-        }
-
-        qsort(data->names, data->count, MAX_PATH + 1, level_name_compare);
-        closedir(d);
-    }
-}
-
-void destroy_level_names(LevelFileData *data) {
-    free(data->names);
-}
@@ -0,0 +1,183 @@
+/*
+ * Pacman Clone
+ *
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../platform.h"
+
+// Only the .csv files, the same as on Windows. Compiled levels sit next to them.
+static bool is_level_file(const struct dirent *dir) {
+    size_t length = strlen(dir->d_name);
+    return dir->d_type == DT_REG && length > 4 && strcmp(&dir->d_name[length - 4], ".csv") == 0;
+}
+
+void init_level_names(LevelFileData *data) {
+    DIR *d = opendir("data/level");
+    struct dirent *dir;
+    if(d) {
+        while((dir = readdir(d)) != NULL) {
+            if(is_level_file(dir)) {
+                data->count++;
+            }
+        }
+        rewinddir(d);
+
+        data->names = calloc(1, (MAX_PATH + 1) * data->count);
+
+        int32_t index = 0;
+        while((dir = readdir(d)) != NULL) {
+            if(is_level_file(dir)) {
+                memcpy(&data->names[index * (MAX_PATH + 1)], dir->d_name, MAX_PATH);
+                index++;
+            }
+        }
+
+        qsort(data->names, data->count, MAX_PATH + 1, level_name_compare);
+        closedir(d);
+    }
+}
+
+void destroy_level_names(LevelFileData *data) {
+    free(data->names);
+}
+
+const void * map_file(const char *path, size_t *size) {
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) {
+        return NULL;
+    }
+
+    struct stat info;
+    void *data = NULL;
+    if(fstat(fd, &info) == 0 && info.st_size > 0) {
+        data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        *size = (size_t)info.st_size;
+    }
+    close(fd);
+
+    return (data != MAP_FAILED) ? data : NULL;
+}
+
+void unmap_file(const void *data, size_t size) {
+    if(data) {
+        munmap((void *)data, size);
+    }
+}
+
+bool get_file_stamp(const char *path, uint64_t *size, uint64_t *write_time) {
+    struct stat info;
+    if(stat(path, &info) != 0) {
+        return false;
+    }
+
+    *size = (uint64_t)info.st_size;
+    *write_time = (uint64_t)info.st_mtime;
+    return true;
+}
+
+// The worker threads are started by the first call and then wait for more jobs,
+// so running jobs every tick doesn't create threads every tick
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+    void (*job)(void *data, uint32_t index);
+    void *data;
+    uint32_t count;
+    uint32_t next;
+    uint32_t finished;
+    uint64_t generation;
+    long thread_count; // Including the calling thread
+} ParallelJobs;
+
+static ParallelJobs parallel_jobs = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER
+};
+// Only one set of jobs runs at a time
+static pthread_mutex_t parallel_jobs_call_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Expects the lock to be held and returns with it held
+static void work_on_parallel_jobs(ParallelJobs *jobs) {
+    while(jobs->next < jobs->count) {
+        void (*job)(void *data, uint32_t index) = jobs->job;
+        void *data = jobs->data;
+        uint32_t index = jobs->next++;
+
+        pthread_mutex_unlock(&jobs->lock);
+        job(data, index);
+        pthread_mutex_lock(&jobs->lock);
+
+        if(++jobs->finished == jobs->count) {
+            pthread_cond_signal(&jobs->done);
+        }
+    }
+}
+
+static void * parallel_job_worker(void *param) {
+    ParallelJobs *jobs = param;
+    uint64_t generation = 0;
+
+    pthread_mutex_lock(&jobs->lock);
+    for(;;) {
+        while(jobs->generation == generation) {
+            pthread_cond_wait(&jobs->wake, &jobs->lock);
+        }
+
+        generation = jobs->generation;
+        work_on_parallel_jobs(jobs);
+    }
+
+    return NULL;
+}
+
+void run_parallel_jobs(void (*job)(void *data, uint32_t index), void *data, uint32_t count) {
+    ParallelJobs *jobs = &parallel_jobs;
+    if(count == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&parallel_jobs_call_lock);
+    pthread_mutex_lock(&jobs->lock);
+
+    // If no worker can be started, the calling thread does all of the jobs
+    if(jobs->thread_count == 0) {
+        long core_count = sysconf(_SC_NPROCESSORS_ONLN);
+        for(jobs->thread_count = 1; jobs->thread_count < core_count; jobs->thread_count++) {
+            pthread_t thread;
+            if(pthread_create(&thread, NULL, parallel_job_worker, jobs) != 0) {
+                break;
+            }
+            pthread_detach(thread);
+        }
+    }
+
+    jobs->job = job;
+    jobs->data = data;
+    jobs->count = count;
+    jobs->next = 0;
+    jobs->finished = 0;
+    jobs->generation++;
+    if(count > 1 && jobs->thread_count > 1) {
+        pthread_cond_broadcast(&jobs->wake);
+    }
+
+    // The calling thread works through jobs as well
+    work_on_parallel_jobs(jobs);
+    while(jobs->finished < jobs->count) {
+        pthread_cond_wait(&jobs->done, &jobs->lock);
+    }
+
+    pthread_mutex_unlock(&jobs->lock);
+    pthread_mutex_unlock(&parallel_jobs_call_lock);
+}
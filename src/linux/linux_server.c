@@ -0,0 +1,589 @@
+/*
+ * Pacman Clone
+ *
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ */
+
+// Authoritative game server. Every client gets its own game session, stepped on
+// the fixed simulation tick. Sessions are sharded over worker threads, each with
+// its own epoll loop and UDP socket on the shared port (SO_REUSEPORT), so the
+// kernel keeps sending a client's packets to the same worker and the workers
+// never share any state.
+
+#define PACMAN_HEADLESS
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../platform.h"
+
+#include "../game.c"
+#include "linux_platform.c"
+#include "linux_net.c"
+
+#define SERVER_DEFAULT_PORT 7100
+#define SERVER_DEFAULT_SESSIONS 4096
+#define SERVER_DEFAULT_TIMEOUT 5
+#define SERVER_REPORT_SECONDS 5
+// States go out at 30 Hz, with the game running at 120 Hz
+#define SERVER_SEND_TICKS 4
+#define SERVER_PELLET_HISTORY 32
+// Ticks a worker that fell behind may run back to back before it skips ahead
+#define SERVER_MAX_CATCHUP_TICKS 4
+#define SERVER_TICK_SAMPLES 8192
+#define SERVER_SOCKET_BUFFER_SIZE (4 * 1024 * 1024)
+#define SERVER_INPUT_MASK (INPUT_UP | INPUT_LEFT | INPUT_DOWN | INPUT_RIGHT)
+
+typedef struct {
+    struct sockaddr_in address;
+    GameContext *ctx;
+    uint8_t input;
+    uint32_t echo_time;
+    uint32_t next_sequence;
+    uint32_t acked_sequence;
+    uint64_t last_packet_tick;
+    // Pellet bits of the last states sent, by sequence % SERVER_PELLET_HISTORY
+    uint8_t *pellet_history;
+    uint32_t history_tile_counts[SERVER_PELLET_HISTORY];
+    bool used;
+} ServerSession;
+
+typedef struct {
+    uint32_t sessions;
+    uint64_t ticks;
+    uint64_t overruns; // Ticks that were skipped because the worker fell behind
+    uint64_t packets_in;
+    uint64_t packets_out;
+    uint64_t bytes_out;
+    uint32_t tick_us[SERVER_TICK_SAMPLES];
+    uint32_t tick_sample_count;
+} ServerStats;
+
+typedef struct {
+    uint32_t index;
+    uint32_t worker_count;
+    const GameAssets *assets;
+    size_t pellet_bytes;
+    uint16_t port;
+    uint64_t timeout_ticks;
+
+    int socket;
+    int timer;
+    int epoll;
+
+    ServerSession *sessions;
+    uint32_t session_capacity;
+    uint32_t *free_sessions;
+    uint32_t free_count;
+    // Open addressing table from client address to session index + 1
+    uint32_t *lookup;
+    uint32_t lookup_mask;
+
+    uint64_t tick;
+    // Longest tick since the last states went out, sent along with them
+    uint32_t recent_tick_us;
+
+    pthread_mutex_t lock;
+    ServerStats stats;
+} ServerWorker;
+
+static volatile sig_atomic_t server_stopping = 0;
+
+static void handle_stop_signal(int signal) {
+    (void)signal;
+    server_stopping = 1;
+}
+
+static double get_time_seconds(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double)t.tv_sec + (double)t.tv_nsec / 1e9;
+}
+
+static int compare_uint32(const void *lhs, const void *rhs) {
+    uint32_t a = *(const uint32_t *)lhs;
+    uint32_t b = *(const uint32_t *)rhs;
+    return (a > b) - (a < b);
+}
+
+static inline uint32_t hash_socket_address(const struct sockaddr_in *address) {
+    uint32_t hash = address->sin_addr.s_addr * 0x9e3779b1u;
+    return (hash ^ address->sin_port) * 0x85ebca6bu;
+}
+
+static inline bool socket_addresses_equal(const struct sockaddr_in *a, const struct sockaddr_in *b) {
+    return a->sin_addr.s_addr == b->sin_addr.s_addr && a->sin_port == b->sin_port;
+}
+
+static void insert_session_lookup(ServerWorker *worker, uint32_t index) {
+    uint32_t slot = hash_socket_address(&worker->sessions[index].address) & worker->lookup_mask;
+    while(worker->lookup[slot]) {
+        slot = (slot + 1) & worker->lookup_mask;
+    }
+    worker->lookup[slot] = index + 1;
+}
+
+static ServerSession * find_session(ServerWorker *worker, const struct sockaddr_in *address) {
+    uint32_t slot = hash_socket_address(address) & worker->lookup_mask;
+    while(worker->lookup[slot]) {
+        ServerSession *session = &worker->sessions[worker->lookup[slot] - 1];
+        if(socket_addresses_equal(&session->address, address)) {
+            return session;
+        }
+        slot = (slot + 1) & worker->lookup_mask;
+    }
+
+    return NULL;
+}
+
+static ServerSession * create_session(ServerWorker *worker, const struct sockaddr_in *address) {
+    if(worker->free_count == 0) {
+        return NULL;
+    }
+
+    uint32_t index = worker->free_sessions[--worker->free_count];
+    ServerSession *session = &worker->sessions[index];
+
+    session->ctx = create_game_context(worker->assets);
+    if(!session->ctx) {
+        worker->free_count++;
+        return NULL;
+    }
+
+    // Every session plays its own random stream
+    seed_game(session->ctx, (uint64_t)time(NULL) ^ ((uint64_t)worker->index << 32), index);
+
+    session->address = *address;
+    session->input = 0;
+    session->echo_time = 0;
+    session->next_sequence = 0;
+    session->acked_sequence = NET_NO_SEQUENCE;
+    session->last_packet_tick = worker->tick;
+    session->used = true;
+    insert_session_lookup(worker, index);
+
+    return session;
+}
+
+// Drops the sessions whose clients went quiet and rebuilds the lookup table, which
+// is cheap next to how rarely this happens
+static void drop_idle_sessions(ServerWorker *worker) {
+    bool dropped = false;
+    for(uint32_t i = 0; i < worker->session_capacity; i++) {
+        ServerSession *session = &worker->sessions[i];
+        if(session->used && session->last_packet_tick + worker->timeout_ticks < worker->tick) {
+            destroy_game_context(&session->ctx);
+            session->used = false;
+            worker->free_sessions[worker->free_count++] = i;
+            dropped = true;
+        }
+    }
+
+    if(dropped) {
+        memset(worker->lookup, 0, (worker->lookup_mask + 1) * sizeof(*worker->lookup));
+        for(uint32_t i = 0; i < worker->session_capacity; i++) {
+            if(worker->sessions[i].used) {
+                insert_session_lookup(worker, i);
+            }
+        }
+    }
+}
+
+static void receive_inputs(ServerWorker *worker) {
+    uint8_t packet[NET_INPUT_PACKET_SIZE + 1];
+    struct sockaddr_in address;
+    socklen_t address_length = sizeof(address);
+    ssize_t size;
+
+    while((size = recvfrom(worker->socket, packet, sizeof(packet), 0,
+                           (struct sockaddr *)&address, &address_length)) >= 0) {
+        address_length = sizeof(address);
+
+        uint32_t ack_sequence, client_time;
+        uint8_t input;
+        if(!read_net_input(packet, (size_t)size, &ack_sequence, &client_time, &input)) {
+            continue;
+        }
+
+        ServerSession *session = find_session(worker, &address);
+        if(!session) {
+            session = create_session(worker, &address);
+            if(!session) {
+                continue;
+            }
+        }
+
+        session->input = input & SERVER_INPUT_MASK;
+        session->echo_time = client_time;
+        session->last_packet_tick = worker->tick;
+        // Packets can arrive out of order, only move forward
+        if(ack_sequence < session->next_sequence &&
+           (session->acked_sequence == NET_NO_SEQUENCE || ack_sequence > session->acked_sequence)) {
+            session->acked_sequence = ack_sequence;
+        }
+
+        worker->stats.packets_in++;
+    }
+}
+
+static void send_states(ServerWorker *worker) {
+    uint8_t packet[NET_STATE_PACKET_SIZE_MAX];
+    NetState state = { .tick = (uint32_t)worker->tick, .workers = (uint8_t)MIN(worker->worker_count, UINT8_MAX) };
+
+    for(uint32_t i = 0; i < worker->session_capacity; i++) {
+        ServerSession *session = &worker->sessions[i];
+        if(!session->used) {
+            continue;
+        }
+
+        state.sequence = session->next_sequence++;
+        state.echo_time = session->echo_time;
+        state.server_tick_us = (uint16_t)MIN(worker->recent_tick_us, UINT16_MAX);
+
+        uint32_t slot = state.sequence % SERVER_PELLET_HISTORY;
+        uint8_t *pellet_bits = session->pellet_history + slot * worker->pellet_bytes;
+        get_net_state(session->ctx, &state, pellet_bits);
+        session->history_tile_counts[slot] = state.tile_count;
+
+        const uint8_t *base_bits = NULL;
+        uint32_t base_tile_count = 0;
+        if(session->acked_sequence != NET_NO_SEQUENCE &&
+           state.sequence - session->acked_sequence < SERVER_PELLET_HISTORY) {
+            uint32_t base_slot = session->acked_sequence % SERVER_PELLET_HISTORY;
+            base_bits = session->pellet_history + base_slot * worker->pellet_bytes;
+            base_tile_count = session->history_tile_counts[base_slot];
+        }
+
+        size_t size = write_net_state(&state, pellet_bits, session->acked_sequence, base_bits,
+                                      base_tile_count, packet, sizeof(packet));
+        if(size > 0 && sendto(worker->socket, packet, size, 0, (struct sockaddr *)&session->address,
+                              sizeof(session->address)) == (ssize_t)size) {
+            worker->stats.packets_out++;
+            worker->stats.bytes_out += size;
+        }
+    }
+}
+
+static void run_server_tick(ServerWorker *worker) {
+    double start = get_time_seconds();
+
+    uint32_t session_count = 0;
+    for(uint32_t i = 0; i < worker->session_capacity; i++) {
+        ServerSession *session = &worker->sessions[i];
+        if(session->used) {
+            update_loop(session->ctx, SIMULATION_TICK_TIME, session->input);
+            session_count++;
+        }
+    }
+
+    worker->tick++;
+    if((worker->tick % SERVER_SEND_TICKS) == 0) {
+        send_states(worker);
+        worker->recent_tick_us = 0;
+    }
+    if((worker->tick % SIMULATION_TICK_RATE) == 0) {
+        drop_idle_sessions(worker);
+    }
+
+    uint32_t tick_us = (uint32_t)((get_time_seconds() - start) * 1e6);
+    worker->recent_tick_us = MAX(worker->recent_tick_us, tick_us);
+
+    worker->stats.sessions = session_count;
+    worker->stats.ticks++;
+    if(worker->stats.tick_sample_count < SERVER_TICK_SAMPLES) {
+        worker->stats.tick_us[worker->stats.tick_sample_count++] = tick_us;
+    }
+}
+
+static void * server_worker(void *parameter) {
+    ServerWorker *worker = parameter;
+
+    while(!server_stopping) {
+        struct epoll_event events[2];
+        int count = epoll_wait(worker->epoll, events, 2, 100);
+
+        // Only the reports from the main thread ever wait on this
+        pthread_mutex_lock(&worker->lock);
+        for(int i = 0; i < count; i++) {
+            if(events[i].data.fd == worker->socket) {
+                receive_inputs(worker);
+            } else if(events[i].data.fd == worker->timer) {
+                uint64_t expirations = 0;
+                if(read(worker->timer, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+                    continue;
+                }
+
+                uint64_t ticks = MIN(expirations, SERVER_MAX_CATCHUP_TICKS);
+                for(uint64_t t = 0; t < ticks; t++) {
+                    run_server_tick(worker);
+                }
+                worker->stats.overruns += expirations - ticks;
+            }
+        }
+        pthread_mutex_unlock(&worker->lock);
+    }
+
+    return NULL;
+}
+
+static bool create_server_worker(ServerWorker *worker) {
+    pthread_mutex_init(&worker->lock, NULL);
+
+    worker->socket = socket(AF_INET, SOCK_DGRAM, 0);
+    worker->timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    worker->epoll = epoll_create1(0);
+    if(worker->socket < 0 || worker->timer < 0 || worker->epoll < 0) {
+        return false;
+    }
+
+    int enable = 1;
+    int buffer_size = SERVER_SOCKET_BUFFER_SIZE;
+    struct sockaddr_in address = {
+        .sin_family = AF_INET,
+        .sin_port = htons(worker->port),
+        .sin_addr.s_addr = htonl(INADDR_ANY)
+    };
+    // Only a hint, the kernel caps it at net.core.rmem_max and wmem_max
+    setsockopt(worker->socket, SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size));
+    setsockopt(worker->socket, SOL_SOCKET, SO_SNDBUF, &buffer_size, sizeof(buffer_size));
+
+    if(setsockopt(worker->socket, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) != 0 ||
+       bind(worker->socket, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+       fcntl(worker->socket, F_SETFL, fcntl(worker->socket, F_GETFL, 0) | O_NONBLOCK) != 0) {
+        return false;
+    }
+
+    long tick_ns = 1000000000L / SIMULATION_TICK_RATE;
+    struct itimerspec interval = {
+        .it_interval = { .tv_sec = 0, .tv_nsec = tick_ns },
+        .it_value = { .tv_sec = 0, .tv_nsec = tick_ns }
+    };
+    if(timerfd_settime(worker->timer, 0, &interval, NULL) != 0) {
+        return false;
+    }
+
+    struct epoll_event socket_event = { .events = EPOLLIN, .data.fd = worker->socket };
+    struct epoll_event timer_event = { .events = EPOLLIN, .data.fd = worker->timer };
+    if(epoll_ctl(worker->epoll, EPOLL_CTL_ADD, worker->socket, &socket_event) != 0 ||
+       epoll_ctl(worker->epoll, EPOLL_CTL_ADD, worker->timer, &timer_event) != 0) {
+        return false;
+    }
+
+    uint32_t lookup_size = 1;
+    while(lookup_size < worker->session_capacity * 2) {
+        lookup_size <<= 1;
+    }
+
+    worker->sessions = calloc(worker->session_capacity, sizeof(*worker->sessions));
+    worker->free_sessions = malloc(worker->session_capacity * sizeof(*worker->free_sessions));
+    worker->lookup = calloc(lookup_size, sizeof(*worker->lookup));
+    worker->lookup_mask = lookup_size - 1;
+    if(!worker->sessions || !worker->free_sessions || !worker->lookup) {
+        return false;
+    }
+
+    for(uint32_t i = 0; i < worker->session_capacity; i++) {
+        worker->sessions[i].pellet_history = malloc(SERVER_PELLET_HISTORY * worker->pellet_bytes);
+        if(!worker->sessions[i].pellet_history) {
+            return false;
+        }
+
+        // Hand out the low indices first
+        worker->free_sessions[i] = worker->session_capacity - 1 - i;
+    }
+    worker->free_count = worker->session_capacity;
+
+    return true;
+}
+
+static void destroy_server_worker(ServerWorker *worker) {
+    if(worker->sessions) {
+        for(uint32_t i = 0; i < worker->session_capacity; i++) {
+            destroy_game_context(&worker->sessions[i].ctx);
+            free(worker->sessions[i].pellet_history);
+        }
+    }
+    pthread_mutex_destroy(&worker->lock);
+
+    free(worker->lookup);
+    free(worker->free_sessions);
+    free(worker->sessions);
+
+    if(worker->epoll >= 0) {
+        close(worker->epoll);
+    }
+    if(worker->timer >= 0) {
+        close(worker->timer);
+    }
+    if(worker->socket >= 0) {
+        close(worker->socket);
+    }
+}
+
+// Collects and resets the statistics of all workers since the last report
+static void print_server_report(ServerWorker *workers, uint32_t worker_count, double seconds) {
+    ServerStats total = { 0 };
+    uint32_t *samples = malloc((size_t)worker_count * SERVER_TICK_SAMPLES * sizeof(*samples));
+    uint32_t sample_count = 0;
+
+    for(uint32_t i = 0; i < worker_count; i++) {
+        ServerStats *stats = &workers[i].stats;
+
+        pthread_mutex_lock(&workers[i].lock);
+        total.sessions += stats->sessions;
+        total.ticks += stats->ticks;
+        total.overruns += stats->overruns;
+        total.packets_in += stats->packets_in;
+        total.packets_out += stats->packets_out;
+        total.bytes_out += stats->bytes_out;
+        if(samples) {
+            memcpy(samples + sample_count, stats->tick_us, stats->tick_sample_count * sizeof(*samples));
+            sample_count += stats->tick_sample_count;
+        }
+
+        uint32_t sessions = stats->sessions;
+        memset(stats, 0, sizeof(*stats));
+        stats->sessions = sessions;
+        pthread_mutex_unlock(&workers[i].lock);
+    }
+
+    uint32_t p99 = 0;
+    if(samples && sample_count > 0) {
+        qsort(samples, sample_count, sizeof(*samples), compare_uint32);
+        p99 = samples[(sample_count - 1) * 99 / 100];
+    }
+    free(samples);
+
+    printf("sessions: %u, workers: %u, ticks/s per worker: %.0f, p99 tick: %u us, skipped ticks: %llu, "
+           "in: %.0f packets/s, out: %.0f packets/s (%.1f KB/s)\n",
+           total.sessions, worker_count, (double)total.ticks / seconds / (double)worker_count, p99,
+           (unsigned long long)total.overruns, (double)total.packets_in / seconds,
+           (double)total.packets_out / seconds, (double)total.bytes_out / seconds / 1024.0);
+    fflush(stdout);
+}
+
+static void print_usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --port N       UDP port to listen on (default %d)\n"
+            "  --workers N    Number of worker threads (default: one per core)\n"
+            "  --sessions N   Maximum number of sessions per worker (default %d)\n"
+            "  --timeout N    Seconds without input before a session is dropped (default %d)\n"
+            "  --duration N   Stop after N seconds (default: run until interrupted)\n",
+            name, SERVER_DEFAULT_PORT, SERVER_DEFAULT_SESSIONS, SERVER_DEFAULT_TIMEOUT);
+}
+
+int main(int argc, char **argv) {
+    uint16_t port = SERVER_DEFAULT_PORT;
+    long worker_count = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t session_capacity = SERVER_DEFAULT_SESSIONS;
+    uint64_t timeout = SERVER_DEFAULT_TIMEOUT;
+    double duration = 0.0;
+
+    for(int i = 1; i < argc; i++) {
+        bool has_value = (i + 1) < argc;
+
+        if(strcmp(argv[i], "--port") == 0 && has_value) {
+            port = (uint16_t)strtoul(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--workers") == 0 && has_value) {
+            worker_count = strtol(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--sessions") == 0 && has_value) {
+            session_capacity = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--timeout") == 0 && has_value) {
+            timeout = strtoull(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--duration") == 0 && has_value) {
+            duration = strtod(argv[++i], NULL);
+        } else {
+            print_usage(argv[0]);
+            return -1;
+        }
+    }
+
+    if(session_capacity == 0) {
+        fprintf(stderr, "The number of sessions must be greater than zero\n");
+        return -1;
+    }
+    worker_count = CLAMP(worker_count, 1, 256);
+
+    GameAssets *assets = create_game_assets();
+    if(!assets) {
+        fprintf(stderr, "Failed to load any level data!\n");
+        return -1;
+    }
+
+    // Every level starts with all of its pellet bits, which have to fit in one packet
+    if(get_net_state_size_max(assets) > NET_STATE_PACKET_SIZE_MAX) {
+        fprintf(stderr, "The largest level needs %zu byte states, packets only take %d bytes\n",
+                get_net_state_size_max(assets), NET_STATE_PACKET_SIZE_MAX);
+        destroy_game_assets(&assets);
+        return -1;
+    }
+
+    signal(SIGINT, handle_stop_signal);
+    signal(SIGTERM, handle_stop_signal);
+
+    ServerWorker *workers = calloc(worker_count, sizeof(*workers));
+    pthread_t *threads = calloc(worker_count, sizeof(*threads));
+    bool ok = workers && threads;
+
+    for(long i = 0; ok && i < worker_count; i++) {
+        ServerWorker *worker = &workers[i];
+        worker->index = (uint32_t)i;
+        worker->worker_count = (uint32_t)worker_count;
+        worker->assets = assets;
+        worker->pellet_bytes = get_net_pellet_bytes_max(assets);
+        worker->port = port;
+        worker->timeout_ticks = timeout * SIMULATION_TICK_RATE;
+        worker->session_capacity = session_capacity;
+
+        if(!create_server_worker(worker)) {
+            fprintf(stderr, "Failed to set up worker %ld on port %u\n", i, port);
+            worker_count = i + 1;
+            ok = false;
+        }
+    }
+
+    if(ok) {
+        printf("listening on port %u with %ld workers\n", port, worker_count);
+        fflush(stdout);
+
+        for(long i = 0; i < worker_count; i++) {
+            pthread_create(&threads[i], NULL, server_worker, &workers[i]);
+        }
+
+        double start = get_time_seconds();
+        double last_report = start;
+        while(!server_stopping) {
+            usleep(100000);
+
+            double now = get_time_seconds();
+            if(now - last_report >= SERVER_REPORT_SECONDS) {
+                print_server_report(workers, (uint32_t)worker_count, now - last_report);
+                last_report = now;
+            }
+            if(duration > 0.0 && now - start >= duration) {
+                server_stopping = 1;
+            }
+        }
+
+        for(long i = 0; i < worker_count; i++) {
+            pthread_join(threads[i], NULL);
+        }
+        print_server_report(workers, (uint32_t)worker_count, get_time_seconds() - last_report);
+    }
+
+    for(long i = 0; workers && i < worker_count; i++) {
+        destroy_server_worker(&workers[i]);
+    }
+    free(threads);
+    free(workers);
+    destroy_game_assets(&assets);
+
+    return ok ? 0 : -1;
+}
@@ -0,0 +1,314 @@
+/*
+ * Pacman Clone
+ *
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ */
+
+#include <string.h>
+
+#include "netstate.h"
+
+// Varints are written with encode_varint from replay.c
+#define NET_STATE_HEADER_SIZE (29 + NET_STATE_ENTITY_COUNT * 8)
+#define NET_VARINT_MAX_SIZE 5
+
+static const uint8_t net_state_magic[4] = { 'P', 'M', 'S', 'D' };
+static const uint8_t net_input_magic[4] = { 'P', 'M', 'S', 'I' };
+
+static inline void put_net_bytes(uint8_t *out, uint32_t value, uint32_t size) {
+    for(uint32_t i = 0; i < size; i++) {
+        out[i] = (uint8_t)(value >> (i * 8));
+    }
+}
+
+static inline uint32_t get_net_bytes(const uint8_t *in, uint32_t size) {
+    uint32_t value = 0;
+    for(uint32_t i = 0; i < size; i++) {
+        value |= (uint32_t)in[i] << (i * 8);
+    }
+
+    return value;
+}
+
+static bool read_net_varint(const uint8_t **data, const uint8_t *end, uint32_t *value) {
+    *value = 0;
+    for(uint32_t shift = 0; shift < 32 && *data < end; shift += 7) {
+        uint8_t byte = *(*data)++;
+        *value |= (uint32_t)(byte & 0x7f) << shift;
+
+        if(!(byte & 0x80)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void get_net_entity_state(const GameEntity *entity, uint8_t flags, NetEntityState *state) {
+    state->x = (int16_t)entity->coord.x;
+    state->y = (int16_t)entity->coord.y;
+    state->sub_x = (int8_t)(entity->coord.sub.x / (FIXED_ONE / 128));
+    state->sub_y = (int8_t)(entity->coord.sub.y / (FIXED_ONE / 128));
+    state->dir = (uint8_t)entity->dir;
+    state->flags = flags;
+}
+
+static uint32_t get_net_tile_count_max(const GameAssets *assets) {
+    uint32_t tile_count = 0;
+    for(uint32_t i = 0; i < assets->level_count; i++) {
+        tile_count = MAX(tile_count, assets->levels[i]->rows * assets->levels[i]->columns);
+    }
+
+    return tile_count;
+}
+
+size_t get_net_pellet_bytes_max(const GameAssets *assets) {
+    assert(assets);
+    return get_net_pellet_bytes(get_net_tile_count_max(assets));
+}
+
+size_t get_net_state_size_max(const GameAssets *assets) {
+    assert(assets);
+
+    uint8_t tile_count[NET_VARINT_MAX_SIZE];
+    size_t tile_count_size = encode_varint(get_net_tile_count_max(assets), tile_count);
+    return NET_STATE_HEADER_SIZE + tile_count_size + get_net_pellet_bytes_max(assets);
+}
+
+void get_net_state(const GameContext *ctx, NetState *state, uint8_t *pellet_bits) {
+    assert(ctx && state);
+
+    state->score = ctx->score;
+    state->lives = (uint8_t)CLAMP(ctx->lives, 0, UINT8_MAX);
+    state->level_index = (uint8_t)ctx->level_index;
+
+    get_net_entity_state(&ctx->player.entity, 0, &state->entities[0]);
+    for(int32_t i = 0; i < GHOST_COUNT; i++) {
+        const GhostEntity *ghost = &ctx->ghosts[i];
+        uint8_t flags = (ghost->frightened ? NET_ENTITY_FRIGHTENED : 0) |
+                        ((ghost->state == GHOST_STATE_EATEN) ? NET_ENTITY_EATEN : 0);
+        get_net_entity_state(&ghost->entity, flags, &state->entities[i + 1]);
+    }
+
+    const Level *level = ctx->level;
+    state->tile_count = level->rows * level->columns;
+
+    if(pellet_bits) {
+        memset(pellet_bits, 0, get_net_pellet_bytes(state->tile_count));
+        // The wire format has no border
+        for(uint32_t y = 0, i = 0; y < level->rows; y++) {
+            uint32_t row = get_level_tile_index(level, 0, y);
+            for(uint32_t x = 0; x < level->columns; x++, i++) {
+                if(level_tile_has_pellet(level, row + x)) {
+                    pellet_bits[i / 8] |= 1 << (i % 8);
+                }
+            }
+        }
+    }
+}
+
+// Changed bits are stored as a count followed by the gaps between their indices
+static size_t write_net_pellet_changes(const uint8_t *bits, const uint8_t *base_bits, size_t byte_count,
+                                       uint8_t *out, size_t capacity) {
+    uint32_t change_count = 0;
+    for(size_t i = 0; i < byte_count; i++) {
+        uint8_t changed = bits[i] ^ base_bits[i];
+        while(changed) {
+            change_count++;
+            changed &= changed - 1;
+        }
+    }
+
+    uint8_t varint[NET_VARINT_MAX_SIZE];
+    size_t size = encode_varint(change_count, varint);
+    if(size > capacity) {
+        return 0;
+    }
+    memcpy(out, varint, size);
+
+    uint32_t next_index = 0;
+    for(size_t i = 0; i < byte_count; i++) {
+        uint8_t changed = bits[i] ^ base_bits[i];
+        for(uint32_t bit = 0; changed; bit++, changed >>= 1) {
+            if(changed & 1) {
+                uint32_t index = (uint32_t)i * 8 + bit;
+                size_t varint_size = encode_varint(index - next_index, varint);
+                if(size + varint_size > capacity) {
+                    return 0;
+                }
+
+                memcpy(out + size, varint, varint_size);
+                size += varint_size;
+                next_index = index + 1;
+            }
+        }
+    }
+
+    return size;
+}
+
+size_t write_net_state(const NetState *state, const uint8_t *pellet_bits, uint32_t base_sequence,
+                       const uint8_t *base_bits, uint32_t base_tile_count, uint8_t *out, size_t capacity) {
+    assert(state && pellet_bits && out);
+
+    uint8_t tile_count[NET_VARINT_MAX_SIZE];
+    size_t tile_count_size = encode_varint(state->tile_count, tile_count);
+    size_t byte_count = get_net_pellet_bytes(state->tile_count);
+    size_t full_size = NET_STATE_HEADER_SIZE + tile_count_size + byte_count;
+
+    size_t offset = NET_STATE_HEADER_SIZE + tile_count_size;
+    if(offset > capacity) {
+        return 0;
+    }
+
+    // The changes only have to beat the full bits when those fit as well
+    size_t size = 0;
+    if(base_bits && base_tile_count == state->tile_count) {
+        size_t changes_size = write_net_pellet_changes(pellet_bits, base_bits, byte_count,
+                                                       out + offset, MIN(full_size, capacity) - offset);
+        size = changes_size ? offset + changes_size : 0;
+    }
+
+    if(size == 0 || size >= full_size) {
+        if(full_size > capacity) {
+            return 0;
+        }
+
+        base_sequence = NET_NO_SEQUENCE;
+        memcpy(out + NET_STATE_HEADER_SIZE + tile_count_size, pellet_bits, byte_count);
+        size = full_size;
+    }
+
+    memcpy(out, net_state_magic, sizeof(net_state_magic));
+    put_net_bytes(out + 4, state->sequence, 4);
+    put_net_bytes(out + 8, base_sequence, 4);
+    put_net_bytes(out + 12, state->tick, 4);
+    put_net_bytes(out + 16, state->score, 4);
+    put_net_bytes(out + 20, state->echo_time, 4);
+    put_net_bytes(out + 24, state->server_tick_us, 2);
+    out[26] = state->lives;
+    out[27] = state->level_index;
+    out[28] = state->workers;
+
+    uint8_t *entity = out + 29;
+    for(uint32_t i = 0; i < NET_STATE_ENTITY_COUNT; i++, entity += 8) {
+        put_net_bytes(entity, (uint16_t)state->entities[i].x, 2);
+        put_net_bytes(entity + 2, (uint16_t)state->entities[i].y, 2);
+        entity[4] = (uint8_t)state->entities[i].sub_x;
+        entity[5] = (uint8_t)state->entities[i].sub_y;
+        entity[6] = state->entities[i].dir;
+        entity[7] = state->entities[i].flags;
+    }
+
+    memcpy(out + NET_STATE_HEADER_SIZE, tile_count, tile_count_size);
+    return size;
+}
+
+size_t read_net_state(const uint8_t *data, size_t size, NetState *state) {
+    assert(data && state);
+
+    if(size < NET_STATE_HEADER_SIZE || memcmp(data, net_state_magic, sizeof(net_state_magic)) != 0) {
+        return 0;
+    }
+
+    state->sequence = get_net_bytes(data + 4, 4);
+    state->base_sequence = get_net_bytes(data + 8, 4);
+    state->tick = get_net_bytes(data + 12, 4);
+    state->score = get_net_bytes(data + 16, 4);
+    state->echo_time = get_net_bytes(data + 20, 4);
+    state->server_tick_us = (uint16_t)get_net_bytes(data + 24, 2);
+    state->lives = data[26];
+    state->level_index = data[27];
+    state->workers = data[28];
+
+    const uint8_t *entity = data + 29;
+    for(uint32_t i = 0; i < NET_STATE_ENTITY_COUNT; i++, entity += 8) {
+        state->entities[i].x = (int16_t)get_net_bytes(entity, 2);
+        state->entities[i].y = (int16_t)get_net_bytes(entity + 2, 2);
+        state->entities[i].sub_x = (int8_t)entity[4];
+        state->entities[i].sub_y = (int8_t)entity[5];
+        state->entities[i].dir = entity[6];
+        state->entities[i].flags = entity[7];
+    }
+
+    const uint8_t *pellets = data + NET_STATE_HEADER_SIZE;
+    if(!read_net_varint(&pellets, data + size, &state->tile_count)) {
+        return 0;
+    }
+
+    return (size_t)(pellets - data);
+}
+
+bool read_net_state_pellets(const uint8_t *data, size_t size, const NetState *state,
+                            const uint8_t *base_bits, uint8_t *pellet_bits, size_t capacity) {
+    assert(data && state && pellet_bits);
+
+    size_t byte_count = get_net_pellet_bytes(state->tile_count);
+    if(byte_count > capacity) {
+        return false;
+    }
+
+    if(state->base_sequence == NET_NO_SEQUENCE) {
+        if(size != byte_count) {
+            return false;
+        }
+
+        memcpy(pellet_bits, data, byte_count);
+        return true;
+    }
+
+    if(!base_bits) {
+        return false;
+    }
+    if(pellet_bits != base_bits) {
+        memcpy(pellet_bits, base_bits, byte_count);
+    }
+
+    const uint8_t *end = data + size;
+    uint32_t change_count;
+    if(!read_net_varint(&data, end, &change_count)) {
+        return false;
+    }
+
+    uint32_t index = 0;
+    for(uint32_t i = 0; i < change_count; i++) {
+        uint32_t gap;
+        if(!read_net_varint(&data, end, &gap) || gap >= state->tile_count - index) {
+            return false;
+        }
+
+        index += gap;
+        pellet_bits[index / 8] ^= 1 << (index % 8);
+        index++;
+    }
+
+    return data == end;
+}
+
+size_t write_net_input(uint32_t ack_sequence, uint32_t time, uint8_t input, uint8_t *out) {
+    assert(out);
+
+    memcpy(out, net_input_magic, sizeof(net_input_magic));
+    put_net_bytes(out + 4, ack_sequence, 4);
+    put_net_bytes(out + 8, time, 4);
+    out[12] = input;
+
+    return NET_INPUT_PACKET_SIZE;
+}
+
+bool read_net_input(const uint8_t *data, size_t size, uint32_t *ack_sequence, uint32_t *time, uint8_t *input) {
+    assert(data && ack_sequence && time && input);
+
+    if(size != NET_INPUT_PACKET_SIZE || memcmp(data, net_input_magic, sizeof(net_input_magic)) != 0) {
+        return false;
+    }
+
+    *ack_sequence = get_net_bytes(data + 4, 4);
+    *time = get_net_bytes(data + 8, 4);
+    *input = data[12];
+
+    return true;
+}
+
+#undef NET_STATE_HEADER_SIZE
+#undef NET_VARINT_MAX_SIZE
@@ -0,0 +1,82 @@
+/*
+ * Pacman Clone
+ *
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ */
+
+#ifndef NETSTATE_H
+#define NETSTATE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "game.h"
+
+// Packets between pacman_server and its clients. Clients send their input and
+// the sequence number of the newest state they received. The server answers with
+// compact states: entity positions, score and lives in full, and the pellets as
+// the bits that changed since the acknowledged state. When there is nothing to
+// compare against, or the level changed, all of the pellet bits are sent.
+
+#define NET_STATE_ENTITY_COUNT (GHOST_COUNT + 1) // The player comes first
+#define NET_STATE_PACKET_SIZE_MAX 1400
+#define NET_INPUT_PACKET_SIZE 13
+#define NET_NO_SEQUENCE UINT32_MAX
+
+enum {
+    NET_ENTITY_FRIGHTENED = 1 << 0,
+    NET_ENTITY_EATEN = 1 << 1
+};
+
+typedef struct {
+    int16_t x;
+    int16_t y;
+    int8_t sub_x; // In 1/128 of a tile
+    int8_t sub_y;
+    uint8_t dir;
+    uint8_t flags;
+} NetEntityState;
+
+typedef struct {
+    uint32_t sequence;
+    uint32_t base_sequence; // NET_NO_SEQUENCE when all pellet bits were sent
+    uint32_t tick;
+    uint32_t score;
+    uint32_t echo_time; // Time stamp of the newest input, sent back for round trip times
+    uint16_t server_tick_us; // Longest server tick since the previous state
+    uint8_t lives;
+    uint8_t level_index;
+    uint8_t workers;
+    NetEntityState entities[NET_STATE_ENTITY_COUNT];
+    uint32_t tile_count; // One pellet bit per level tile
+} NetState;
+
+static inline size_t get_net_pellet_bytes(uint32_t tile_count) {
+    return (tile_count + 7) / 8;
+}
+
+// Enough room for the pellet bits of any level in the assets
+size_t get_net_pellet_bytes_max(const GameAssets *assets);
+// The size of a state with all of the pellet bits of the largest level, which
+// every level starts with. It has to fit in NET_STATE_PACKET_SIZE_MAX.
+size_t get_net_state_size_max(const GameAssets *assets);
+// Fills everything that comes from the game, and the pellet bits if not NULL
+void get_net_state(const GameContext *ctx, NetState *state, uint8_t *pellet_bits);
+
+// Writes the pellet bits relative to base_bits, or in full if base_bits is NULL,
+// the tile counts differ, or that turns out to be smaller and fits. Returns 0 if
+// the packet doesn't fit either way.
+size_t write_net_state(const NetState *state, const uint8_t *pellet_bits, uint32_t base_sequence,
+                       const uint8_t *base_bits, uint32_t base_tile_count, uint8_t *out, size_t capacity);
+// Reads everything but the pellets. Returns the size of that part, or 0 if the
+// packet is malformed.
+size_t read_net_state(const uint8_t *data, size_t size, NetState *state);
+// Decodes the rest of the packet. base_bits has to be the pellet bits of the
+// state's base sequence, unless all of them were sent.
+bool read_net_state_pellets(const uint8_t *data, size_t size, const NetState *state,
+                            const uint8_t *base_bits, uint8_t *pellet_bits, size_t capacity);
+
+size_t write_net_input(uint32_t ack_sequence, uint32_t time, uint8_t input, uint8_t *out);
+bool read_net_input(const uint8_t *data, size_t size, uint32_t *ack_sequence, uint32_t *time, uint8_t *input);
+
+#endif /* NETSTATE_H */
@@ -0,0 +1,196 @@
+/*
+ * Pacman Clone
+ *
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pack.h"
+#include "platform.h"
+
+static inline size_t get_pack_aligned_offset(size_t offset) {
+    return (offset + PACK_ALIGNMENT - 1) & ~(size_t)(PACK_ALIGNMENT - 1);
+}
+
+// Checks that everything the entries point at is inside the pack, so lookups
+// don't have to
+static bool pack_valid(const uint8_t *data, size_t size) {
+    const PackHeader *header = (const PackHeader *)(const void *)data;
+    if(size < sizeof(*header) || header->magic != PACK_MAGIC || header->version != PACK_VERSION ||
+       header->slot_count == 0 || (header->slot_count & (header->slot_count - 1)) != 0 ||
+       header->slot_count / 2 < header->entry_count) {
+        return false;
+    }
+
+    size_t table_end = sizeof(*header) + (size_t)header->entry_count * sizeof(PackEntry) +
+                       (size_t)header->slot_count * sizeof(uint32_t);
+    if(table_end > size) {
+        return false;
+    }
+
+    const PackEntry *entries = (const PackEntry *)(header + 1);
+    for(uint32_t i = 0; i < header->entry_count; i++) {
+        const PackEntry *entry = &entries[i];
+        if(entry->name_offset < table_end || entry->name_offset >= size ||
+           !memchr(&data[entry->name_offset], '\0', size - entry->name_offset) ||
+           entry->offset % PACK_ALIGNMENT != 0 || entry->offset > size || size - entry->offset <= entry->size ||
+           data[entry->offset + entry->size] != '\0') {
+            return false;
+        }
+    }
+
+    // Lookups stop at the first empty slot, so there have to be some
+    const uint32_t *slots = (const uint32_t *)(entries + header->entry_count);
+    uint32_t used_slots = 0;
+    for(uint32_t i = 0; i < header->slot_count; i++) {
+        if(slots[i] > header->entry_count) {
+            return false;
+        }
+        used_slots += (slots[i] != 0);
+    }
+
+    return used_slots == header->entry_count;
+}
+
+Pack * open_pack_in_memory(const void *data, size_t size) {
+    assert(data);
+
+    // The tables are read in place, which needs them aligned
+    if(((uintptr_t)data % sizeof(uint32_t)) != 0 || !pack_valid(data, size)) {
+        return NULL;
+    }
+
+    Pack *pack = calloc(1, sizeof(*pack));
+    if(pack) {
+        pack->data = data;
+        pack->size = size;
+        pack->entries = (const PackEntry *)(const void *)(pack->data + sizeof(PackHeader));
+        pack->slots = (const uint32_t *)(pack->entries + get_pack_entry_count(pack));
+    }
+
+    return pack;
+}
+
+Pack * open_pack(const char *path) {
+    assert(path);
+
+    size_t size = 0;
+    const void *data = map_file(path, &size);
+    if(!data) {
+        return NULL;
+    }
+
+    Pack *pack = open_pack_in_memory(data, size);
+    if(pack) {
+        pack->mapped = true;
+    } else {
+        fprintf(stderr, "%s: not a pack of version %d for this machine\n", path, PACK_VERSION);
+        unmap_file(data, size);
+    }
+
+    return pack;
+}
+
+void close_pack(Pack **pack) {
+    if(pack && *pack) {
+        if((*pack)->mapped) {
+            unmap_file((*pack)->data, (*pack)->size);
+        }
+        free(*pack);
+        *pack = NULL;
+    }
+}
+
+const void * get_pack_entry(const Pack *pack, uint32_t index, size_t *size) {
+    assert(pack && index < get_pack_entry_count(pack) && size);
+
+    const PackEntry *entry = &pack->entries[index];
+    const uint8_t *data = &pack->data[entry->offset];
+    if(get_pack_checksum(data, entry->size) != entry->checksum) {
+        fprintf(stderr, "%s in the pack is damaged\n", get_pack_entry_name(pack, index));
+        return NULL;
+    }
+
+    *size = entry->size;
+    return data;
+}
+
+const void * find_pack_entry(const Pack *pack, const char *name, size_t *size) {
+    assert(pack && name && size);
+
+    const PackHeader *header = (const PackHeader *)(const void *)pack->data;
+    uint32_t hash = get_pack_name_hash(name);
+    uint32_t mask = header->slot_count - 1;
+
+    // Linear probing, the table is at most half full
+    for(uint32_t slot = hash & mask; pack->slots[slot] != 0; slot = (slot + 1) & mask) {
+        uint32_t index = pack->slots[slot] - 1;
+        if(pack->entries[index].name_hash == hash && strcmp(get_pack_entry_name(pack, index), name) == 0) {
+            return get_pack_entry(pack, index, size);
+        }
+    }
+
+    return NULL;
+}
+
+void * create_pack(const char **names, const void **data, const size_t *sizes, uint32_t count, size_t *size) {
+    assert(names && data && sizes && size);
+
+    PackHeader header = {
+        .magic = PACK_MAGIC,
+        .version = PACK_VERSION,
+        .entry_count = count,
+        .slot_count = 1
+    };
+    while(header.slot_count < count * 2) {
+        header.slot_count *= 2;
+    }
+
+    // The names come right after the tables, then the data of every entry
+    size_t names_offset = sizeof(header) + count * sizeof(PackEntry) + header.slot_count * sizeof(uint32_t);
+    *size = names_offset;
+    for(uint32_t i = 0; i < count; i++) {
+        *size += strlen(names[i]) + 1;
+    }
+    for(uint32_t i = 0; i < count; i++) {
+        *size = get_pack_aligned_offset(*size) + sizes[i] + 1;
+    }
+
+    uint8_t *pack = (*size <= UINT32_MAX) ? calloc(1, *size) : NULL;
+    if(!pack) {
+        return NULL;
+    }
+
+    memcpy(pack, &header, sizeof(header));
+    PackEntry *entries = (PackEntry *)(void *)(pack + sizeof(header));
+    uint32_t *slots = (uint32_t *)(entries + count);
+
+    size_t offset = names_offset;
+    for(uint32_t i = 0; i < count; i++) {
+        assert(i == 0 || strcmp(names[i - 1], names[i]) < 0);
+        entries[i].name_offset = (uint32_t)offset;
+        entries[i].name_hash = get_pack_name_hash(names[i]);
+        memcpy(&pack[offset], names[i], strlen(names[i]) + 1);
+        offset += strlen(names[i]) + 1;
+
+        uint32_t slot = entries[i].name_hash & (header.slot_count - 1);
+        while(slots[slot] != 0) {
+            slot = (slot + 1) & (header.slot_count - 1);
+        }
+        slots[slot] = i + 1;
+    }
+
+    for(uint32_t i = 0; i < count; i++) {
+        offset = get_pack_aligned_offset(offset);
+        entries[i].offset = (uint32_t)offset;
+        entries[i].size = (uint32_t)sizes[i];
+        entries[i].checksum = get_pack_checksum(data[i], sizes[i]);
+        memcpy(&pack[offset], data[i], sizes[i]);
+        offset += sizes[i] + 1;
+    }
+
+    return pack;
+}
@@ -0,0 +1,92 @@
+/*
+ * Pacman Clone
+ *
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ */
+
+#ifndef PACK_H
+#define PACK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// An asset pack puts all of the game data in one file that is mapped once, or
+// built into the executable with PACMAN_EMBED_ASSETS, and used in place. It
+// starts with a header, the entries and a hash table of slots that each hold an
+// entry index plus one, or 0 when empty. The entries are named by their path
+// under data/, such as "level/level0.lvl", and sorted by name. The texture atlas
+// is stored decoded, as "texture_atlas.tex". Entry data starts on PACK_ALIGNMENT
+// and is followed by a zero byte, so text can be used as a string without a
+// copy. In memory the pack only has to start on four bytes. Everything is in the
+// byte order of the machine that built the pack.
+#define PACK_MAGIC 0x4b434150 // "PACK" little endian
+#define PACK_VERSION 1
+#define PACK_ALIGNMENT 16
+#define PACK_PATH "data/pacman.pack"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entry_count;
+    uint32_t slot_count; // A power of two, at least twice the entry count
+} PackHeader;
+
+typedef struct {
+    uint32_t name_offset; // From the start of the pack, zero terminated
+    uint32_t name_hash;
+    uint32_t offset;
+    uint32_t size;
+    uint32_t checksum; // get_pack_checksum of the data
+} PackEntry;
+
+typedef struct Pack {
+    const uint8_t *data;
+    size_t size;
+    bool mapped; // Unmapped again by close_pack
+    const PackEntry *entries;
+    const uint32_t *slots;
+} Pack;
+
+static inline uint32_t get_pack_name_hash(const char *name) {
+    uint32_t hash = 2166136261u;
+    for(; *name; name++) {
+        hash = (hash ^ (uint8_t)*name) * 16777619u;
+    }
+
+    return hash;
+}
+
+static inline uint32_t get_pack_checksum(const void *data, size_t size) {
+    const uint8_t *bytes = data;
+    uint32_t hash = 2166136261u;
+    for(size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+
+    return hash;
+}
+
+// Returns NULL if the file is missing or isn't a pack of this version, which is
+// also reported on stderr unless it's missing
+Pack * open_pack(const char *path);
+// The data has to stay around until the pack is closed
+Pack * open_pack_in_memory(const void *data, size_t size);
+// Lays out a pack of count entries, which have to be sorted by name
+void * create_pack(const char **names, const void **data, const size_t *sizes, uint32_t count, size_t *size);
+void close_pack(Pack **pack);
+
+static inline uint32_t get_pack_entry_count(const Pack *pack) {
+    return ((const PackHeader *)(const void *)pack->data)->entry_count;
+}
+
+static inline const char * get_pack_entry_name(const Pack *pack, uint32_t index) {
+    return (const char *)&pack->data[pack->entries[index].name_offset];
+}
+
+// Both return NULL if there is no such entry or its checksum doesn't match,
+// which is reported on stderr
+const void * get_pack_entry(const Pack *pack, uint32_t index, size_t *size);
+const void * find_pack_entry(const Pack *pack, const char *name, size_t *size);
+
+#endif /* PACK_H */
@@ -7,6 +7,7 @@
 #ifndef PLATFORM_H
 #define PLATFORM_H
 
+#include <stddef.h>
 #include <string.h>
 
 #include "level.h"
@@ -14,6 +15,18 @@
 void init_level_names(LevelFileData *data);
 void destroy_level_names(LevelFileData *data);
 
+// Calls job once for every index from 0 to count - 1, spread over one thread per
+// core. Returns once all of them are done. The threads are kept around between
+// calls, which are cheap enough to make every tick. Jobs must not call it again.
+void run_parallel_jobs(void (*job)(void *data, uint32_t index), void *data, uint32_t count);
+
+// Maps a whole file read only. Returns NULL if it can't be opened or is empty.
+const void * map_file(const char *path, size_t *size);
+void unmap_file(const void *data, size_t size);
+// The size of a file and when it was last written, in seconds since 1970.
+// Returns false if it doesn't exist.
+bool get_file_stamp(const char *path, uint64_t *size, uint64_t *write_time);
+
 static int level_name_compare(const void *lhs, const void *rhs) {
     return strcmp(lhs, rhs) > 0;
 }
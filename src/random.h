@@ -0,0 +1,77 @@
+/*
+ * Pacman Clone
+ *
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ */
+
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <stdint.h>
+
+// xoshiro128** by David Blackman and Sebastiano Vigna. Small and fast, and every
+// game can own an independent stream of numbers.
+typedef struct {
+    uint32_t s[4];
+} RandomState;
+
+static inline uint32_t rotate_left32(uint32_t x, uint32_t k) {
+    return (x << k) | (x >> (32 - k));
+}
+
+static inline uint64_t splitmix64(uint64_t *x) {
+    uint64_t z = (*x += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+static inline uint32_t next_random(RandomState *state) {
+    uint32_t *s = state->s;
+    uint32_t result = rotate_left32(s[1] * 5, 7) * 9;
+    uint32_t t = s[1] << 9;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotate_left32(s[3], 11);
+
+    return result;
+}
+
+// The state must never be all zeros, splitmix64 makes sure it isn't
+static inline void seed_random(RandomState *state, uint64_t seed) {
+    uint64_t a = splitmix64(&seed);
+    uint64_t b = splitmix64(&seed);
+
+    state->s[0] = (uint32_t)a;
+    state->s[1] = (uint32_t)(a >> 32);
+    state->s[2] = (uint32_t)b;
+    state->s[3] = (uint32_t)(b >> 32);
+}
+
+// Picks one of many streams of the same seed in constant time. Stream 0 is
+// seed_random itself, the others start from the seed hashed together with the
+// stream, which keeps them apart with overwhelming odds.
+static inline void seed_random_stream(RandomState *state, uint64_t seed, uint32_t stream) {
+    if(stream > 0) {
+        uint64_t mixed = seed ^ ((uint64_t)stream * 0xd1342543de82ef95ull);
+        seed = splitmix64(&mixed);
+    }
+
+    seed_random(state, seed);
+}
+
+// Uniform in [0, 1)
+static inline float next_random_float(RandomState *state) {
+    return (float)(next_random(state) >> 8) * (1.0f / 16777216.0f);
+}
+
+// Uniform in [0, count)
+static inline uint32_t next_random_range(RandomState *state, uint32_t count) {
+    return (uint32_t)(((uint64_t)next_random(state) * count) >> 32);
+}
+
+#endif /* RANDOM_H */
@@ -6,6 +6,7 @@
 
 #include "render.h"
 #include <float.h>
+#include <stdarg.h>
 #include <stdbool.h>
 #include <math.h>
 
@@ -260,7 +261,7 @@ void draw_text(const Texture2D *texture, int32_t x, int32_t y, const char *text)
 }
 
 void draw_formatted_text(const Texture2D *texture, int32_t x, int32_t y, const char *text, ...) {
-    static char buf[999];
+    char buf[999];
     va_list list;
     va_start(list, text);
     vsnprintf(buf, sizeof(buf), text, list);
@@ -115,7 +115,7 @@ static inline Matrix3x3 get_rotation_mat3(float angle) {
     };
 }
 
-static Matrix3x3 get_inverse_matrix(const Matrix3x3 *mat) {
+static inline Matrix3x3 get_inverse_matrix(const Matrix3x3 *mat) {
     assert(mat);
 
     float determinant =
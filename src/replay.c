@@ -0,0 +1,276 @@
+/*
+ * Pacman Clone
+ *
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "replay.h"
+
+#define REPLAY_MAGIC "PMRP"
+#define REPLAY_VARINT_MAX_SIZE 10
+
+struct ReplayRecorder {
+    FILE *file;
+    bool failed;
+
+    uint32_t previous_input;
+    uint32_t previous_dt_bits;
+
+    uint32_t run_input;
+    uint32_t run_dt_bits;
+    uint64_t run_length;
+
+    uint64_t ticks;
+};
+
+struct Replay {
+    uint8_t *data;
+    size_t size;
+    size_t offset;
+    uint64_t seed;
+
+    uint32_t input;
+    uint32_t dt_bits;
+    uint64_t run_left;
+
+    bool finished;
+    bool has_result;
+    uint64_t ticks;
+    uint64_t state_hash;
+};
+
+static inline uint32_t float_to_bits(float f) {
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return bits;
+}
+
+static inline float bits_to_float(uint32_t bits) {
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+static inline uint32_t zigzag_encode(int32_t value) {
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static inline int32_t zigzag_decode(uint32_t value) {
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+static size_t encode_varint(uint64_t value, uint8_t *out) {
+    size_t size = 0;
+    while(value >= 0x80) {
+        out[size++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[size++] = (uint8_t)value;
+
+    return size;
+}
+
+static bool decode_varint(Replay *replay, uint64_t *value) {
+    *value = 0;
+    for(uint32_t shift = 0; shift < 64 && replay->offset < replay->size; shift += 7) {
+        uint8_t byte = replay->data[replay->offset++];
+        *value |= (uint64_t)(byte & 0x7f) << shift;
+
+        if(!(byte & 0x80)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void write_replay_bytes(ReplayRecorder *recorder, const void *data, size_t size) {
+    if(fwrite(data, 1, size, recorder->file) != size) {
+        recorder->failed = true;
+    }
+}
+
+static void flush_replay_run(ReplayRecorder *recorder) {
+    if(recorder->run_length == 0) {
+        return;
+    }
+
+    uint8_t buffer[REPLAY_VARINT_MAX_SIZE * 3];
+    size_t size = encode_varint(recorder->run_length, buffer);
+    size += encode_varint(recorder->run_input ^ recorder->previous_input, buffer + size);
+    size += encode_varint(zigzag_encode((int32_t)(recorder->run_dt_bits - recorder->previous_dt_bits)), buffer + size);
+    write_replay_bytes(recorder, buffer, size);
+
+    recorder->previous_input = recorder->run_input;
+    recorder->previous_dt_bits = recorder->run_dt_bits;
+    recorder->run_length = 0;
+}
+
+ReplayRecorder * create_replay_recorder(const char *path, uint64_t seed) {
+    FILE *file = fopen(path, "wb");
+    if(!file) {
+        return NULL;
+    }
+
+    ReplayRecorder *recorder = calloc(1, sizeof(*recorder));
+    if(!recorder) {
+        fclose(file);
+        return NULL;
+    }
+
+    recorder->file = file;
+
+    uint8_t header[4 + 1 + REPLAY_VARINT_MAX_SIZE];
+    memcpy(header, REPLAY_MAGIC, 4);
+    header[4] = REPLAY_VERSION;
+    size_t size = 5 + encode_varint(seed, header + 5);
+    write_replay_bytes(recorder, header, size);
+
+    return recorder;
+}
+
+void record_replay_tick(ReplayRecorder *recorder, uint32_t input, float dt) {
+    assert(recorder);
+
+    uint32_t dt_bits = float_to_bits(dt);
+    if(recorder->run_length == 0 || input != recorder->run_input || dt_bits != recorder->run_dt_bits) {
+        flush_replay_run(recorder);
+        recorder->run_input = input;
+        recorder->run_dt_bits = dt_bits;
+    }
+
+    recorder->run_length++;
+    recorder->ticks++;
+}
+
+bool destroy_replay_recorder(ReplayRecorder **recorder, uint64_t state_hash) {
+    bool result = false;
+
+    if(recorder && *recorder) {
+        ReplayRecorder *r = *recorder;
+        flush_replay_run(r);
+
+        uint8_t trailer[1 + REPLAY_VARINT_MAX_SIZE + sizeof(uint64_t)];
+        size_t size = encode_varint(0, trailer);
+        size += encode_varint(r->ticks, trailer + size);
+        for(uint32_t i = 0; i < sizeof(uint64_t); i++) {
+            trailer[size++] = (uint8_t)(state_hash >> (i * 8));
+        }
+        write_replay_bytes(r, trailer, size);
+
+        result = (fclose(r->file) == 0) && !r->failed;
+        free(r);
+        *recorder = NULL;
+    }
+
+    return result;
+}
+
+Replay * load_replay(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if(!file) {
+        return NULL;
+    }
+
+    Replay *replay = calloc(1, sizeof(*replay));
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    if(!replay || size < 6) {
+        free(replay);
+        fclose(file);
+        return NULL;
+    }
+
+    replay->size = (size_t)size;
+    replay->data = malloc(replay->size);
+    bool read_ok = replay->data && fread(replay->data, 1, replay->size, file) == replay->size;
+    fclose(file);
+
+    replay->offset = 5;
+    if(!read_ok || memcmp(replay->data, REPLAY_MAGIC, 4) != 0 ||
+       replay->data[4] != REPLAY_VERSION || !decode_varint(replay, &replay->seed)) {
+        unload_replay(&replay);
+        return NULL;
+    }
+
+    return replay;
+}
+
+void unload_replay(Replay **replay) {
+    if(replay && *replay) {
+        free((*replay)->data);
+        free(*replay);
+        *replay = NULL;
+    }
+}
+
+uint64_t get_replay_seed(const Replay *replay) {
+    assert(replay);
+    return replay->seed;
+}
+
+bool next_replay_tick(Replay *replay, uint32_t *input, float *dt) {
+    assert(replay && input && dt);
+
+    if(replay->run_left == 0 && !replay->finished) {
+        uint64_t run_length, input_delta, dt_delta;
+
+        // A file that was cut short simply ends without a result
+        if(!decode_varint(replay, &run_length) || run_length == 0) {
+            replay->finished = true;
+
+            uint64_t ticks;
+            if(decode_varint(replay, &ticks) &&
+               replay->offset + sizeof(uint64_t) <= replay->size) {
+                replay->ticks = ticks;
+                replay->state_hash = 0;
+                for(uint32_t i = 0; i < sizeof(uint64_t); i++) {
+                    replay->state_hash |= (uint64_t)replay->data[replay->offset++] << (i * 8);
+                }
+                replay->has_result = true;
+            }
+        } else if(decode_varint(replay, &input_delta) && decode_varint(replay, &dt_delta)) {
+            replay->input ^= (uint32_t)input_delta;
+            replay->dt_bits += (uint32_t)zigzag_decode((uint32_t)dt_delta);
+            replay->run_left = run_length;
+        } else {
+            replay->finished = true;
+        }
+    }
+
+    if(replay->run_left == 0) {
+        return false;
+    }
+
+    replay->run_left--;
+    *input = replay->input;
+    *dt = bits_to_float(replay->dt_bits);
+
+    return true;
+}
+
+bool get_replay_result(const Replay *replay, uint64_t *ticks, uint64_t *state_hash) {
+    assert(replay);
+
+    if(!replay->has_result) {
+        return false;
+    }
+
+    if(ticks) {
+        *ticks = replay->ticks;
+    }
+    if(state_hash) {
+        *state_hash = replay->state_hash;
+    }
+
+    return true;
+}
+
+#undef REPLAY_MAGIC
+#undef REPLAY_VARINT_MAX_SIZE
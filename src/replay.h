@@ -0,0 +1,39 @@
+/*
+ * Pacman Clone
+ *
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ */
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Replay files start with "PMRP", a version byte and the seed as a varint.
+// Then follow runs of ticks that share the same input and dt, each stored as
+// three varints: the run length, the input XOR the previous run's input, and
+// the zigzag encoded difference between the bits of dt and the previous dt.
+// A run length of zero ends the runs, followed by the total tick count as a
+// varint and the 64 bit state hash after the last tick (little endian).
+
+#define REPLAY_VERSION 2
+
+typedef struct ReplayRecorder ReplayRecorder;
+typedef struct Replay Replay;
+
+ReplayRecorder * create_replay_recorder(const char *path, uint64_t seed);
+void record_replay_tick(ReplayRecorder *recorder, uint32_t input, float dt);
+// Writes the end of the file and closes it. Returns false if any write failed.
+bool destroy_replay_recorder(ReplayRecorder **recorder, uint64_t state_hash);
+
+Replay * load_replay(const char *path);
+void unload_replay(Replay **replay);
+
+uint64_t get_replay_seed(const Replay *replay);
+// Returns false once all of the recorded ticks have been read
+bool next_replay_tick(Replay *replay, uint32_t *input, float *dt);
+// Only available after the last tick was read, and if the recording was finished
+bool get_replay_result(const Replay *replay, uint64_t *ticks, uint64_t *state_hash);
+
+#endif /* REPLAY_H */
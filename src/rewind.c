@@ -0,0 +1,293 @@
+/*
+ * Pacman Clone
+ *
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "rewind.h"
+
+// Varints are written with encode_varint from replay.c
+#define REWIND_VARINT_MAX_SIZE 10
+// Zero runs shorter than this are cheaper to keep inside the literals
+#define REWIND_MIN_ZERO_RUN 3
+
+typedef struct {
+    size_t offset;
+    uint32_t size;
+    uint32_t state_size;
+    bool keyframe; // Stores the state itself instead of the XOR with the next one
+} RewindEntry;
+
+struct RewindBuffer {
+    uint8_t *current;
+    size_t current_size;
+    bool has_current;
+
+    size_t state_capacity;
+    uint8_t *state;
+    uint8_t *encoded;
+
+    uint8_t *arena;
+    size_t arena_size;
+    size_t head;
+    size_t used;
+
+    RewindEntry *entries;
+    uint32_t entry_capacity;
+    uint32_t first;
+    uint32_t count;
+};
+
+static const uint8_t * decode_rewind_varint(const uint8_t *in, uint64_t *value) {
+    *value = 0;
+    for(uint32_t shift = 0; shift < 64; shift += 7) {
+        uint8_t byte = *in++;
+        *value |= (uint64_t)(byte & 0x7f) << shift;
+
+        if(!(byte & 0x80)) {
+            break;
+        }
+    }
+
+    return in;
+}
+
+static inline uint8_t rewind_byte(const uint8_t *a, const uint8_t *b, size_t i) {
+    return b ? (a[i] ^ b[i]) : a[i];
+}
+
+// Encodes a XOR b (or just a if b is NULL) as pairs of a zero run length and a
+// literal run length, each pair followed by the literal bytes. Trailing zeros
+// are left out.
+static size_t encode_rewind_runs(const uint8_t *a, const uint8_t *b, size_t size, uint8_t *out) {
+    size_t written = 0;
+    size_t i = 0;
+
+    while(i < size) {
+        size_t zero_start = i;
+        while(i < size && rewind_byte(a, b, i) == 0) {
+            i++;
+        }
+
+        size_t literal_start = i;
+        size_t literal_end = i;
+        while(i < size) {
+            if(rewind_byte(a, b, i) != 0) {
+                literal_end = ++i;
+                continue;
+            }
+
+            size_t zeros = 0;
+            while(i + zeros < size && zeros < REWIND_MIN_ZERO_RUN && rewind_byte(a, b, i + zeros) == 0) {
+                zeros++;
+            }
+            if(zeros == REWIND_MIN_ZERO_RUN || i + zeros == size) {
+                break;
+            }
+            i += zeros;
+        }
+
+        if(literal_end == literal_start) {
+            break;
+        }
+
+        written += encode_varint(literal_start - zero_start, out + written);
+        written += encode_varint(literal_end - literal_start, out + written);
+        for(size_t j = literal_start; j < literal_end; j++) {
+            out[written++] = rewind_byte(a, b, j);
+        }
+        i = literal_end;
+    }
+
+    return written;
+}
+
+// XORs the runs into state, or writes them over it for keyframes
+static void decode_rewind_runs(const uint8_t *in, size_t in_size, uint8_t *state, size_t size, bool keyframe) {
+    const uint8_t *end = in + in_size;
+    size_t i = 0;
+
+    while(in < end) {
+        uint64_t zeros, literals;
+        in = decode_rewind_varint(in, &zeros);
+        in = decode_rewind_varint(in, &literals);
+        assert(i + zeros + literals <= size);
+
+        if(keyframe) {
+            memset(state + i, 0, zeros);
+            memcpy(state + i + zeros, in, literals);
+        } else {
+            for(uint64_t j = 0; j < literals; j++) {
+                state[i + zeros + j] ^= in[j];
+            }
+        }
+
+        i += zeros + literals;
+        in += literals;
+    }
+
+    if(keyframe) {
+        memset(state + i, 0, size - i);
+    }
+}
+
+static void drop_oldest_rewind_entry(RewindBuffer *buffer) {
+    buffer->used -= buffer->entries[buffer->first].size;
+    buffer->first = (buffer->first + 1) % buffer->entry_capacity;
+    buffer->count--;
+}
+
+static void store_rewind_entry(RewindBuffer *buffer, size_t size, bool keyframe) {
+    if(size > buffer->arena_size) {
+        clear_rewind_buffer(buffer);
+        return;
+    }
+
+    if(buffer->count == buffer->entry_capacity) {
+        drop_oldest_rewind_entry(buffer);
+    }
+
+    // Entries never wrap around the end of the arena. When the tail is too small,
+    // everything that lives there is older than what comes next at the front.
+    if(buffer->head + size > buffer->arena_size) {
+        while(buffer->count > 0 && buffer->entries[buffer->first].offset >= buffer->head) {
+            drop_oldest_rewind_entry(buffer);
+        }
+        buffer->head = 0;
+    }
+
+    while(buffer->count > 0) {
+        const RewindEntry *oldest = &buffer->entries[buffer->first];
+        if(oldest->offset >= buffer->head + size || oldest->offset + oldest->size <= buffer->head) {
+            break;
+        }
+        drop_oldest_rewind_entry(buffer);
+    }
+
+    RewindEntry *entry = &buffer->entries[(buffer->first + buffer->count) % buffer->entry_capacity];
+    entry->offset = buffer->head;
+    entry->size = (uint32_t)size;
+    entry->state_size = (uint32_t)buffer->current_size;
+    entry->keyframe = keyframe;
+    memcpy(buffer->arena + buffer->head, buffer->encoded, size);
+
+    buffer->head += size;
+    buffer->used += size;
+    buffer->count++;
+}
+
+RewindBuffer * create_rewind_buffer(const GameContext *ctx, size_t capacity) {
+    if(!ctx || capacity == 0) {
+        return NULL;
+    }
+
+    RewindBuffer *buffer = calloc(1, sizeof(*buffer));
+    if(!buffer) {
+        return NULL;
+    }
+
+    // Worst case every literal run is a single byte between two short zero runs
+    size_t state_capacity = get_game_snapshot_capacity(ctx);
+    size_t encoded_capacity = state_capacity + (state_capacity / REWIND_MIN_ZERO_RUN + 1) * 2 * REWIND_VARINT_MAX_SIZE;
+
+    buffer->state_capacity = state_capacity;
+    buffer->current = malloc(state_capacity);
+    buffer->state = malloc(state_capacity);
+    buffer->encoded = malloc(encoded_capacity);
+    buffer->arena = malloc(capacity);
+    buffer->arena_size = capacity;
+    // Even the smallest deltas carry a few timers
+    buffer->entry_capacity = (uint32_t)MIN(capacity / 8 + 1, UINT32_MAX);
+    buffer->entries = malloc(buffer->entry_capacity * sizeof(*buffer->entries));
+
+    if(!buffer->current || !buffer->state || !buffer->encoded || !buffer->arena || !buffer->entries) {
+        destroy_rewind_buffer(&buffer);
+        return NULL;
+    }
+
+    return buffer;
+}
+
+void destroy_rewind_buffer(RewindBuffer **buffer) {
+    if(buffer && *buffer) {
+        free((*buffer)->entries);
+        free((*buffer)->arena);
+        free((*buffer)->encoded);
+        free((*buffer)->state);
+        free((*buffer)->current);
+        free(*buffer);
+        *buffer = NULL;
+    }
+}
+
+void clear_rewind_buffer(RewindBuffer *buffer) {
+    assert(buffer);
+
+    buffer->has_current = false;
+    buffer->head = 0;
+    buffer->used = 0;
+    buffer->first = 0;
+    buffer->count = 0;
+}
+
+void push_rewind_snapshot(RewindBuffer *buffer, const GameContext *ctx) {
+    assert(buffer && ctx);
+
+    size_t size = get_game_snapshot_size(ctx);
+    assert(size <= buffer->state_capacity);
+    save_game_snapshot(ctx, buffer->state);
+
+    if(buffer->has_current) {
+        // The entry turns the new state back into the previous one. A level change
+        // also changes the snapshot size, so that one is stored whole.
+        bool keyframe = (size != buffer->current_size);
+        size_t encoded_size = encode_rewind_runs(buffer->current, keyframe ? NULL : buffer->state,
+                                                 buffer->current_size, buffer->encoded);
+        store_rewind_entry(buffer, encoded_size, keyframe);
+    }
+
+    uint8_t *previous = buffer->current;
+    buffer->current = buffer->state;
+    buffer->state = previous;
+    buffer->current_size = size;
+    buffer->has_current = true;
+}
+
+uint32_t rewind_game(RewindBuffer *buffer, GameContext *ctx, uint32_t ticks) {
+    assert(buffer && ctx);
+
+    if(!buffer->has_current) {
+        return 0;
+    }
+
+    uint32_t rewound = 0;
+    for(; rewound < ticks && buffer->count > 0; rewound++) {
+        uint32_t newest = (buffer->first + buffer->count - 1) % buffer->entry_capacity;
+        const RewindEntry *entry = &buffer->entries[newest];
+
+        decode_rewind_runs(buffer->arena + entry->offset, entry->size, buffer->current,
+                           entry->state_size, entry->keyframe);
+        buffer->current_size = entry->state_size;
+
+        buffer->head = entry->offset;
+        buffer->used -= entry->size;
+        buffer->count--;
+    }
+
+    load_game_snapshot(ctx, buffer->current);
+    return rewound;
+}
+
+uint32_t get_rewind_length(const RewindBuffer *buffer) {
+    return buffer ? buffer->count : 0;
+}
+
+size_t get_rewind_memory_usage(const RewindBuffer *buffer) {
+    return buffer ? buffer->used : 0;
+}
+
+#undef REWIND_VARINT_MAX_SIZE
+#undef REWIND_MIN_ZERO_RUN
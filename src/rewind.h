@@ -0,0 +1,38 @@
+/*
+ * Pacman Clone
+ *
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ */
+
+#ifndef REWIND_H
+#define REWIND_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "game.h"
+
+// Keeps a history of game snapshots in a fixed amount of memory. Only the newest
+// snapshot is stored in full, every older one is stored as the run length encoded
+// XOR with the snapshot after it. Consecutive ticks differ in a few dozen bytes,
+// so a couple hundred KB hold tens of seconds. The oldest ticks are dropped once
+// the memory is used up.
+typedef struct RewindBuffer RewindBuffer;
+
+// capacity is the number of bytes available for the encoded history
+RewindBuffer * create_rewind_buffer(const GameContext *ctx, size_t capacity);
+void destroy_rewind_buffer(RewindBuffer **buffer);
+void clear_rewind_buffer(RewindBuffer *buffer);
+
+// Meant to be called after every simulation tick
+void push_rewind_snapshot(RewindBuffer *buffer, const GameContext *ctx);
+// Restores the state from ticks pushes ago and drops the newer history. Returns
+// how many ticks were rewound, which is less than ticks if the history ran out.
+uint32_t rewind_game(RewindBuffer *buffer, GameContext *ctx, uint32_t ticks);
+
+// Number of ticks that can be rewound
+uint32_t get_rewind_length(const RewindBuffer *buffer);
+// Bytes used by the encoded history
+size_t get_rewind_memory_usage(const RewindBuffer *buffer);
+
+#endif /* REWIND_H */
@@ -0,0 +1,308 @@
+/*
+ * Pacman Clone
+ *
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "rollback.h"
+
+// Has to hold more than two prediction windows, since the other side can be a
+// whole window ahead while still waiting for acknowledgements from a window ago
+#define ROLLBACK_RING_SIZE 64
+#define ROLLBACK_NO_TICK UINT32_MAX
+#define ROLLBACK_PACKET_HEADER_SIZE 34
+
+static const uint8_t rollback_magic[4] = { 'P', 'M', 'N', 'P' };
+
+struct RollbackSession {
+    GameContext *ctx;
+    RollbackSide side;
+    uint64_t seed;
+    bool started;
+
+    uint32_t tick;
+    // Remote inputs are known for all ticks before remote_received, the other
+    // side knows ours for all ticks before remote_acked
+    uint32_t remote_received;
+    uint32_t remote_acked;
+    // Oldest tick that was simulated with a wrong prediction
+    uint32_t rollback_tick;
+
+    // All of these are indexed by tick % ROLLBACK_RING_SIZE
+    uint8_t local_inputs[ROLLBACK_RING_SIZE];
+    uint8_t remote_inputs[ROLLBACK_RING_SIZE];
+    uint64_t hashes[ROLLBACK_RING_SIZE]; // State after the tick
+    uint8_t *snapshots; // State before the tick
+    size_t snapshot_capacity;
+
+    bool has_remote_hash;
+    uint32_t remote_hash_tick;
+    uint64_t remote_hash;
+
+    RollbackStats stats;
+};
+
+static inline uint8_t * get_rollback_snapshot(RollbackSession *session, uint32_t tick) {
+    return session->snapshots + (tick % ROLLBACK_RING_SIZE) * session->snapshot_capacity;
+}
+
+static inline uint32_t get_confirmed_tick_count(const RollbackSession *session) {
+    return MIN(MIN(session->tick, session->remote_received), session->rollback_tick);
+}
+
+static inline void put_rollback_bytes(uint8_t *out, uint64_t value, uint32_t size) {
+    for(uint32_t i = 0; i < size; i++) {
+        out[i] = (uint8_t)(value >> (i * 8));
+    }
+}
+
+static inline uint64_t get_rollback_bytes(const uint8_t *in, uint32_t size) {
+    uint64_t value = 0;
+    for(uint32_t i = 0; i < size; i++) {
+        value |= (uint64_t)in[i] << (i * 8);
+    }
+
+    return value;
+}
+
+static bool simulate_rollback_tick(RollbackSession *session, uint32_t tick) {
+    uint32_t index = tick % ROLLBACK_RING_SIZE;
+    save_game_snapshot(session->ctx, get_rollback_snapshot(session, tick));
+
+    // Predict that the remote side keeps doing what it did last
+    if(tick >= session->remote_received) {
+        session->remote_inputs[index] = (session->remote_received > 0) ?
+            session->remote_inputs[(session->remote_received - 1) % ROLLBACK_RING_SIZE] : 0;
+    }
+
+    uint32_t local = session->local_inputs[index];
+    uint32_t remote = session->remote_inputs[index];
+    bool running = (session->side == ROLLBACK_SIDE_PLAYER) ?
+        update_versus_loop(session->ctx, SIMULATION_TICK_TIME, local, remote) :
+        update_versus_loop(session->ctx, SIMULATION_TICK_TIME, remote, local);
+
+    session->hashes[index] = get_game_state_hash(session->ctx);
+    return running;
+}
+
+static void check_remote_hash(RollbackSession *session) {
+    if(!session->has_remote_hash || session->remote_hash_tick >= get_confirmed_tick_count(session)) {
+        return;
+    }
+
+    // Too old to still be in the ring when we fall far behind
+    if(session->remote_hash_tick + ROLLBACK_RING_SIZE >= session->tick) {
+        session->stats.checksums_compared++;
+        if(session->hashes[session->remote_hash_tick % ROLLBACK_RING_SIZE] != session->remote_hash) {
+            session->stats.desynced = true;
+        }
+    }
+
+    session->has_remote_hash = false;
+}
+
+RollbackSession * create_rollback_session(GameContext *ctx, RollbackSide side, uint64_t seed) {
+    if(!ctx) {
+        return NULL;
+    }
+
+    RollbackSession *session = calloc(1, sizeof(*session));
+    if(!session) {
+        return NULL;
+    }
+
+    session->snapshot_capacity = get_game_snapshot_capacity(ctx);
+    session->snapshots = malloc(ROLLBACK_RING_SIZE * session->snapshot_capacity);
+    if(!session->snapshots) {
+        destroy_rollback_session(&session);
+        return NULL;
+    }
+
+    session->ctx = ctx;
+    session->side = side;
+    session->rollback_tick = ROLLBACK_NO_TICK;
+    set_game_controlled_ghost(ctx, ROLLBACK_CONTROLLED_GHOST);
+
+    if(side == ROLLBACK_SIDE_PLAYER) {
+        session->seed = seed;
+        session->started = true;
+        seed_game(ctx, seed, 0);
+    }
+
+    return session;
+}
+
+void destroy_rollback_session(RollbackSession **session) {
+    if(session && *session) {
+        free((*session)->snapshots);
+        free(*session);
+        *session = NULL;
+    }
+}
+
+void update_rollback_session(RollbackSession *session) {
+    assert(session);
+
+    if(session->rollback_tick < session->tick) {
+        uint32_t ticks = session->tick - session->rollback_tick;
+
+        load_game_snapshot(session->ctx, get_rollback_snapshot(session, session->rollback_tick));
+        for(uint32_t tick = session->rollback_tick; tick < session->tick; tick++) {
+            simulate_rollback_tick(session, tick);
+        }
+
+        session->stats.rollbacks++;
+        session->stats.resimulated_ticks += ticks;
+        session->stats.max_rollback_ticks = MAX(session->stats.max_rollback_ticks, ticks);
+    }
+
+    session->rollback_tick = ROLLBACK_NO_TICK;
+    check_remote_hash(session);
+}
+
+bool advance_rollback_session(RollbackSession *session, uint32_t local_input, bool *running) {
+    assert(session);
+
+    update_rollback_session(session);
+
+    if(!session->started || session->tick >= session->remote_received + ROLLBACK_MAX_PREDICTION) {
+        session->stats.stalls++;
+        return false;
+    }
+
+    session->local_inputs[session->tick % ROLLBACK_RING_SIZE] = (uint8_t)local_input;
+    bool still_running = simulate_rollback_tick(session, session->tick);
+    session->tick++;
+
+    if(running) {
+        *running = still_running;
+    }
+
+    check_remote_hash(session);
+    return true;
+}
+
+// Layout, all little endian: magic, sender side (1), seed (8), number of remote
+// inputs received (4), hash tick + 1 or 0 (4), hash (8), first input tick (4),
+// input count (1), one byte per input
+size_t write_rollback_packet(RollbackSession *session, uint8_t *buffer, size_t capacity) {
+    assert(session && buffer);
+
+    if(!session->started) {
+        return 0;
+    }
+
+    uint32_t first_tick = session->remote_acked;
+    uint32_t count = session->tick - first_tick;
+    assert(count <= ROLLBACK_RING_SIZE);
+
+    size_t size = ROLLBACK_PACKET_HEADER_SIZE + count;
+    if(size > capacity) {
+        return 0;
+    }
+
+    uint32_t confirmed = get_confirmed_tick_count(session);
+    uint64_t hash = (confirmed > 0) ? session->hashes[(confirmed - 1) % ROLLBACK_RING_SIZE] : 0;
+
+    memcpy(buffer, rollback_magic, sizeof(rollback_magic));
+    buffer[4] = (uint8_t)session->side;
+    put_rollback_bytes(buffer + 5, session->seed, 8);
+    put_rollback_bytes(buffer + 13, session->remote_received, 4);
+    put_rollback_bytes(buffer + 17, confirmed, 4);
+    put_rollback_bytes(buffer + 21, hash, 8);
+    put_rollback_bytes(buffer + 29, first_tick, 4);
+    buffer[33] = (uint8_t)count;
+
+    for(uint32_t i = 0; i < count; i++) {
+        buffer[ROLLBACK_PACKET_HEADER_SIZE + i] = session->local_inputs[(first_tick + i) % ROLLBACK_RING_SIZE];
+    }
+
+    return size;
+}
+
+bool read_rollback_packet(RollbackSession *session, const uint8_t *data, size_t size) {
+    assert(session && data);
+
+    if(size < ROLLBACK_PACKET_HEADER_SIZE || memcmp(data, rollback_magic, sizeof(rollback_magic)) != 0 ||
+       data[4] == session->side || size != ROLLBACK_PACKET_HEADER_SIZE + data[33]) {
+        return false;
+    }
+
+    uint64_t seed = get_rollback_bytes(data + 5, 8);
+    uint32_t received = (uint32_t)get_rollback_bytes(data + 13, 4);
+    uint32_t hash_ticks = (uint32_t)get_rollback_bytes(data + 17, 4);
+    uint64_t hash = get_rollback_bytes(data + 21, 8);
+    uint32_t first_tick = (uint32_t)get_rollback_bytes(data + 29, 4);
+    uint32_t count = data[33];
+
+    if(!session->started) {
+        session->seed = seed;
+        session->started = true;
+        seed_game(session->ctx, seed, 0);
+    } else if(seed != session->seed || received > session->tick) {
+        return false;
+    }
+
+    session->remote_acked = MAX(session->remote_acked, received);
+
+    for(uint32_t i = 0; i < count; i++) {
+        uint32_t tick = first_tick + i;
+        if(tick < session->remote_received) {
+            continue;
+        } else if(tick > session->remote_received || tick >= session->tick + ROLLBACK_RING_SIZE) {
+            break;
+        }
+
+        uint8_t input = data[ROLLBACK_PACKET_HEADER_SIZE + i];
+        uint8_t *slot = &session->remote_inputs[tick % ROLLBACK_RING_SIZE];
+        if(tick < session->tick && *slot != input) {
+            session->rollback_tick = MIN(session->rollback_tick, tick);
+        }
+
+        *slot = input;
+        session->remote_received++;
+    }
+
+    if(hash_ticks > 0) {
+        session->has_remote_hash = true;
+        session->remote_hash_tick = hash_ticks - 1;
+        session->remote_hash = hash;
+        check_remote_hash(session);
+    }
+
+    return true;
+}
+
+uint32_t get_rollback_tick(const RollbackSession *session) {
+    return session ? session->tick : 0;
+}
+
+bool get_rollback_confirmed_hash(const RollbackSession *session, uint32_t *tick, uint64_t *hash) {
+    assert(session);
+
+    uint32_t confirmed = get_confirmed_tick_count(session);
+    if(confirmed == 0) {
+        return false;
+    }
+
+    if(tick) {
+        *tick = confirmed - 1;
+    }
+    if(hash) {
+        *hash = session->hashes[(confirmed - 1) % ROLLBACK_RING_SIZE];
+    }
+
+    return true;
+}
+
+const RollbackStats * get_rollback_stats(const RollbackSession *session) {
+    assert(session);
+    return &session->stats;
+}
+
+#undef ROLLBACK_RING_SIZE
+#undef ROLLBACK_NO_TICK
+#undef ROLLBACK_PACKET_HEADER_SIZE
@@ -0,0 +1,72 @@
+/*
+ * Pacman Clone
+ *
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ */
+
+#ifndef ROLLBACK_H
+#define ROLLBACK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "game.h"
+
+// Two player versus mode with rollback. One side plays Pac-Man, the other one
+// steers a ghost. Local input is simulated right away, with the remote input
+// predicted to stay the same as the last one received. When the real remote input
+// for an already simulated tick turns out to be different, the game is restored
+// to the snapshot before that tick and simulated forward again, all within the
+// next advance call.
+//
+// The session doesn't do any networking. It writes and reads packets, which the
+// platform layer moves between the two sides (over UDP for example). Every packet
+// carries all of the local inputs the other side hasn't acknowledged yet, so lost
+// packets need no resending, and the state hash of the newest tick with known
+// inputs on both sides, which detects desyncs.
+
+#define ROLLBACK_MAX_PREDICTION 30
+#define ROLLBACK_PACKET_SIZE_MAX 512
+// Index of the ghost the second player steers
+#define ROLLBACK_CONTROLLED_GHOST GHOST_BLINKY
+
+typedef enum {
+    ROLLBACK_SIDE_PLAYER,
+    ROLLBACK_SIDE_GHOST
+} RollbackSide;
+
+typedef struct {
+    uint32_t rollbacks;
+    uint32_t resimulated_ticks;
+    uint32_t max_rollback_ticks;
+    uint32_t stalls; // Advance calls that had to wait for the remote side
+    uint32_t checksums_compared;
+    bool desynced;
+} RollbackStats;
+
+typedef struct RollbackSession RollbackSession;
+
+// The player side owns the seed and sends it along, the ghost side doesn't start
+// until the first packet arrived. The context has to be freshly created.
+RollbackSession * create_rollback_session(GameContext *ctx, RollbackSide side, uint64_t seed);
+void destroy_rollback_session(RollbackSession **session);
+
+// Applies any late remote input, then simulates one tick with local_input.
+// Returns false without simulating if the remote side is too far behind to keep
+// predicting, or hasn't started yet. running turns false when the game was exited.
+bool advance_rollback_session(RollbackSession *session, uint32_t local_input, bool *running);
+// Only applies late remote input, for when no new tick should be simulated
+void update_rollback_session(RollbackSession *session);
+
+size_t write_rollback_packet(RollbackSession *session, uint8_t *buffer, size_t capacity);
+// Returns false for malformed packets, which are ignored
+bool read_rollback_packet(RollbackSession *session, const uint8_t *data, size_t size);
+
+// Number of simulated ticks
+uint32_t get_rollback_tick(const RollbackSession *session);
+// Returns false until the inputs of a tick are known on both sides. Otherwise gives
+// the newest such tick and the state hash after it.
+bool get_rollback_confirmed_hash(const RollbackSession *session, uint32_t *tick, uint64_t *hash);
+const RollbackStats * get_rollback_stats(const RollbackSession *session);
+
+#endif /* ROLLBACK_H */
@@ -0,0 +1,552 @@
+/*
+ * Pacman Clone
+ *
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "swarm.h"
+
+#define SWARM_INDEX_BITS 20
+#define SWARM_INDEX_MASK ((1u << SWARM_INDEX_BITS) - 1)
+#define SWARM_GENERATION_MASK 0xfff
+#define SWARM_JOB_SIZE 256
+// In tiles walked from where the player starts
+#define SWARM_SPAWN_MIN_DISTANCE 8
+
+struct GhostSwarm {
+    uint32_t capacity;
+    uint32_t count;
+    uint32_t level_index;
+
+    // Dense, the first count entries are the ghosts that exist. Removing a ghost
+    // moves the last one into its place.
+    SwarmGhost *handles;
+    int32_t *x;
+    int32_t *y;
+    fixed32 *progress; // Towards the next tile in dir
+    uint8_t *dir;
+    uint8_t *type;
+    uint32_t *spawn_tile;
+    uint32_t *random;
+
+    // Per handle index, the dense index of its ghost and how often it was reused
+    uint32_t *slots;
+    uint16_t *generations;
+    uint32_t *free_handles;
+    uint32_t free_count;
+
+    // A grid with one cell per stored level tile. Ghosts are sorted into the cell of
+    // the tile they are closest to, the ones in cell c are cell_ghosts[cell_start[c]]
+    // up to cell_ghosts[cell_start[c + 1]].
+    uint32_t *cell_start;
+    uint32_t *cell_ghosts;
+    uint32_t cell_count;
+    uint32_t *ghost_cells; // Cell of each ghost while the grid is built
+    SwarmGhost *eaten; // Ghosts eaten during the collision pass
+};
+
+typedef struct {
+    GhostSwarm *swarm;
+    const GameContext *ctx;
+    fixed32 dt;
+    fixed32 speeds[GHOST_COUNT]; // Same as the regular ghosts of each type
+    bool frightened;
+} SwarmUpdate;
+
+static inline uint32_t get_swarm_handle_index(SwarmGhost ghost) {
+    return ghost & SWARM_INDEX_MASK;
+}
+
+static inline bool swarm_tile_walkable(const GameContext *ctx, uint32_t index) {
+    return get_level_graph(ctx)->junctions[index] != LEVEL_NO_JUNCTION &&
+        ctx->level->data[index] != ATLAS_SPRITE_GHOST_HOUSE_GATE;
+}
+
+static inline MovementDirection get_first_exit(uint32_t exits) {
+    for(int32_t dir = 0; dir < 4; dir++) {
+        if(exits & (1 << dir)) {
+            return (MovementDirection)dir;
+        }
+    }
+
+    return MOVEMENT_DIR_NONE;
+}
+
+// Swarm ghosts never walk into the tunnels or the ghost house
+static inline uint32_t get_swarm_exits(const GameContext *ctx, int32_t x, int32_t y) {
+    return get_level_exits(get_level_graph(ctx), get_level_tile_index(ctx->level, x, y), false, false);
+}
+
+static inline uint32_t get_swarm_cell_size(const GhostSwarm *swarm, uint32_t cell) {
+    return swarm->cell_start[cell + 1] - swarm->cell_start[cell];
+}
+
+GhostSwarm * create_ghost_swarm(uint32_t capacity) {
+    if(capacity == 0 || capacity > SWARM_CAPACITY_MAX) {
+        return NULL;
+    }
+
+    GhostSwarm *swarm = calloc(1, sizeof(*swarm));
+    if(!swarm) {
+        return NULL;
+    }
+
+    swarm->capacity = capacity;
+    swarm->level_index = UINT32_MAX;
+    swarm->handles = malloc(capacity * sizeof(*swarm->handles));
+    swarm->x = malloc(capacity * sizeof(*swarm->x));
+    swarm->y = malloc(capacity * sizeof(*swarm->y));
+    swarm->progress = malloc(capacity * sizeof(*swarm->progress));
+    swarm->dir = malloc(capacity * sizeof(*swarm->dir));
+    swarm->type = malloc(capacity * sizeof(*swarm->type));
+    swarm->spawn_tile = malloc(capacity * sizeof(*swarm->spawn_tile));
+    swarm->random = malloc(capacity * sizeof(*swarm->random));
+    swarm->slots = malloc(capacity * sizeof(*swarm->slots));
+    swarm->generations = calloc(capacity, sizeof(*swarm->generations));
+    swarm->free_handles = malloc(capacity * sizeof(*swarm->free_handles));
+    swarm->cell_ghosts = malloc(capacity * sizeof(*swarm->cell_ghosts));
+    swarm->ghost_cells = malloc(capacity * sizeof(*swarm->ghost_cells));
+    swarm->eaten = malloc(capacity * sizeof(*swarm->eaten));
+
+    if(!swarm->handles || !swarm->x || !swarm->y || !swarm->progress || !swarm->dir || !swarm->type ||
+       !swarm->spawn_tile || !swarm->random || !swarm->slots || !swarm->generations ||
+       !swarm->free_handles || !swarm->cell_ghosts || !swarm->ghost_cells || !swarm->eaten) {
+        destroy_ghost_swarm(&swarm);
+        return NULL;
+    }
+
+    // Handed out lowest index first
+    for(uint32_t i = 0; i < capacity; i++) {
+        swarm->free_handles[i] = capacity - 1 - i;
+    }
+    swarm->free_count = capacity;
+
+    return swarm;
+}
+
+void destroy_ghost_swarm(GhostSwarm **swarm) {
+    if(swarm && *swarm) {
+        free((*swarm)->handles);
+        free((*swarm)->x);
+        free((*swarm)->y);
+        free((*swarm)->progress);
+        free((*swarm)->dir);
+        free((*swarm)->type);
+        free((*swarm)->spawn_tile);
+        free((*swarm)->random);
+        free((*swarm)->slots);
+        free((*swarm)->generations);
+        free((*swarm)->free_handles);
+        free((*swarm)->cell_start);
+        free((*swarm)->cell_ghosts);
+        free((*swarm)->ghost_cells);
+        free((*swarm)->eaten);
+        free(*swarm);
+        *swarm = NULL;
+    }
+}
+
+static void clear_ghost_swarm(GhostSwarm *swarm) {
+    while(swarm->count > 0) {
+        despawn_swarm_ghost(swarm, swarm->handles[swarm->count - 1]);
+    }
+}
+
+// Empties the swarm and resizes the grid whenever the game moved on to another
+// level. Returns false if the grid couldn't be allocated.
+static bool sync_swarm_level(GhostSwarm *swarm, const GameContext *ctx) {
+    if(swarm->level_index == ctx->level_index && swarm->cell_start) {
+        return true;
+    }
+
+    clear_ghost_swarm(swarm);
+
+    free(swarm->cell_start);
+    swarm->cell_count = (ctx->level->rows + 2) * ctx->level->stride;
+    swarm->cell_start = calloc(swarm->cell_count + 1, sizeof(*swarm->cell_start));
+    swarm->level_index = swarm->cell_start ? ctx->level_index : UINT32_MAX;
+
+    return swarm->cell_start != NULL;
+}
+
+static void reset_swarm_ghost(GhostSwarm *swarm, const GameContext *ctx, uint32_t i) {
+    uint32_t stride = ctx->level->stride;
+    swarm->x[i] = (int32_t)(swarm->spawn_tile[i] % stride) - 1;
+    swarm->y[i] = (int32_t)(swarm->spawn_tile[i] / stride) - 1;
+    swarm->progress[i] = 0;
+    swarm->dir[i] = (uint8_t)get_first_exit(get_swarm_exits(ctx, swarm->x[i], swarm->y[i]));
+}
+
+SwarmGhost spawn_swarm_ghost(GhostSwarm *swarm, const GameContext *ctx, uint32_t type, int32_t x, int32_t y) {
+    assert(swarm && ctx && type < GHOST_COUNT);
+
+    if(swarm->free_count == 0 || !level_coords_valid(ctx->level, x, y) || !sync_swarm_level(swarm, ctx)) {
+        return SWARM_GHOST_NONE;
+    }
+
+    uint32_t tile = get_level_tile_index(ctx->level, x, y);
+    if(!swarm_tile_walkable(ctx, tile)) {
+        return SWARM_GHOST_NONE;
+    }
+
+    uint32_t index = swarm->free_handles[--swarm->free_count];
+    SwarmGhost ghost = ((uint32_t)swarm->generations[index] << SWARM_INDEX_BITS) | index;
+
+    uint32_t i = swarm->count++;
+    swarm->slots[index] = i;
+    swarm->handles[i] = ghost;
+    swarm->type[i] = (uint8_t)type;
+    swarm->spawn_tile[i] = tile;
+    // Any non-zero xorshift state will do
+    swarm->random[i] = (index + 1) * 2654435761u | 1;
+    reset_swarm_ghost(swarm, ctx, i);
+
+    return ghost;
+}
+
+bool swarm_ghost_exists(const GhostSwarm *swarm, SwarmGhost ghost) {
+    assert(swarm);
+
+    uint32_t index = get_swarm_handle_index(ghost);
+    return ghost != SWARM_GHOST_NONE && index < swarm->capacity &&
+        swarm->generations[index] == (ghost >> SWARM_INDEX_BITS) &&
+        swarm->slots[index] < swarm->count && swarm->handles[swarm->slots[index]] == ghost;
+}
+
+bool despawn_swarm_ghost(GhostSwarm *swarm, SwarmGhost ghost) {
+    if(!swarm_ghost_exists(swarm, ghost)) {
+        return false;
+    }
+
+    uint32_t index = get_swarm_handle_index(ghost);
+    uint32_t i = swarm->slots[index];
+    uint32_t last = --swarm->count;
+
+    if(i != last) {
+        swarm->handles[i] = swarm->handles[last];
+        swarm->x[i] = swarm->x[last];
+        swarm->y[i] = swarm->y[last];
+        swarm->progress[i] = swarm->progress[last];
+        swarm->dir[i] = swarm->dir[last];
+        swarm->type[i] = swarm->type[last];
+        swarm->spawn_tile[i] = swarm->spawn_tile[last];
+        swarm->random[i] = swarm->random[last];
+        swarm->slots[get_swarm_handle_index(swarm->handles[i])] = i;
+    }
+
+    swarm->generations[index] = (swarm->generations[index] + 1) & SWARM_GENERATION_MASK;
+    swarm->free_handles[swarm->free_count++] = index;
+
+    return true;
+}
+
+uint32_t scatter_swarm_ghosts(GhostSwarm *swarm, const GameContext *ctx, uint32_t count, RandomState *random) {
+    assert(swarm && ctx && random);
+
+    if(!sync_swarm_level(swarm, ctx)) {
+        return 0;
+    }
+
+    // Walk out from the player's start, the tiles found far enough away are the candidates
+    const Level *level = ctx->level;
+    const LevelGraph *graph = get_level_graph(ctx);
+    uint32_t *queue = malloc(graph->tile_count * sizeof(*queue));
+    uint32_t *distances = malloc(graph->tile_count * sizeof(*distances));
+    if(!queue || !distances) {
+        free(queue);
+        free(distances);
+        return 0;
+    }
+
+    memset(distances, 0xff, graph->tile_count * sizeof(*distances));
+    uint32_t start = get_level_tile_index(level, level->player_start.x, level->player_start.y);
+    uint32_t head = 0;
+    uint32_t tail = 0;
+    uint32_t candidate_count = 0;
+
+    distances[start] = 0;
+    queue[tail++] = start;
+    while(head < tail) {
+        uint32_t index = queue[head++];
+        uint32_t exits = get_level_exits(graph, index, false, false);
+
+        for(int32_t dir = 0; dir < 4; dir++) {
+            uint32_t next = get_neighboring_tile_index(level, index, (TileNeighbor)dir);
+            if((exits & (1 << dir)) && distances[next] == UINT32_MAX) {
+                distances[next] = distances[index] + 1;
+                queue[tail++] = next;
+            }
+        }
+    }
+
+    // The queue is done with, it now collects the candidates
+    for(uint32_t i = 0; i < tail; i++) {
+        if(distances[queue[i]] >= SWARM_SPAWN_MIN_DISTANCE && swarm_tile_walkable(ctx, queue[i])) {
+            queue[candidate_count++] = queue[i];
+        }
+    }
+
+    uint32_t spawned = 0;
+    for(; candidate_count > 0 && spawned < count; spawned++) {
+        uint32_t tile = queue[next_random_range(random, candidate_count)];
+        uint32_t type = next_random_range(random, GHOST_COUNT);
+        int32_t x = (int32_t)(tile % level->stride) - 1;
+        int32_t y = (int32_t)(tile / level->stride) - 1;
+
+        if(spawn_swarm_ghost(swarm, ctx, type, x, y) == SWARM_GHOST_NONE) {
+            break;
+        }
+    }
+
+    free(queue);
+    free(distances);
+    return spawned;
+}
+
+uint32_t get_ghost_swarm_count(const GhostSwarm *swarm) {
+    return swarm ? swarm->count : 0;
+}
+
+static inline uint32_t next_swarm_random(uint32_t *state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+// Picks the way on from the tile a ghost just entered, with the same greedy
+// choice as the regular ghosts. Only reads the grid and the game, which stay
+// the same during the update, so ghosts can be steered in any order.
+static MovementDirection steer_swarm_ghost(const SwarmUpdate *update, uint32_t i) {
+    const GhostSwarm *swarm = update->swarm;
+    const GameContext *ctx = update->ctx;
+    MovementDirection dir = (MovementDirection)swarm->dir[i];
+    TileCoord coord = { .x = swarm->x[i], .y = swarm->y[i] };
+
+    uint32_t index = get_level_tile_index(ctx->level, coord.x, coord.y);
+    uint32_t exits = get_level_exits(get_level_graph(ctx), index, false, false);
+    uint32_t candidates = exits & get_forward_exits(dir);
+    if(candidates == 0) {
+        // Dead ends are the only place where ghosts turn around
+        return (exits & (1 << (dir ^ 2))) ? (MovementDirection)(dir ^ 2) : MOVEMENT_DIR_NONE;
+    }
+
+    if(get_level_exit_count(candidates) == 1) {
+        return get_first_exit(candidates);
+    }
+
+    // Spread out instead of piling up, unless every way on is taken
+    uint32_t empty = 0;
+    for(int32_t d = 0; d < 4; d++) {
+        if((candidates & (1 << d)) &&
+           get_swarm_cell_size(swarm, get_neighboring_tile_index(ctx->level, index, (TileNeighbor)d)) == 0) {
+            empty |= 1 << d;
+        }
+    }
+    if(empty) {
+        candidates = empty;
+    }
+
+    if(update->frightened) {
+        uint32_t pick = next_swarm_random(&swarm->random[i]) % get_level_exit_count(candidates);
+        for(int32_t d = 0; d < 4; d++) {
+            if((candidates & (1 << d)) && pick-- == 0) {
+                return (MovementDirection)d;
+            }
+        }
+    }
+
+    GhostEntity ghost = { .entity = { .coord = coord } };
+    if(ctx->mode == GAME_MODE_CHASE) {
+        get_ghost_chase_target(ctx, swarm->type[i], &coord, &ghost.target);
+    } else {
+        get_ghost_scatter_target(ctx, swarm->type[i], &coord, &ghost.target);
+    }
+
+    return pick_ghost_direction(&ghost, candidates);
+}
+
+static void move_swarm_ghosts(void *data, uint32_t job) {
+    const SwarmUpdate *update = data;
+    GhostSwarm *swarm = update->swarm;
+
+    uint32_t end = MIN((job + 1) * SWARM_JOB_SIZE, swarm->count);
+    for(uint32_t i = job * SWARM_JOB_SIZE; i < end; i++) {
+        if(swarm->dir[i] == MOVEMENT_DIR_NONE) {
+            continue;
+        }
+
+        fixed32 speed = update->speeds[swarm->type[i]];
+        if(update->frightened) {
+            speed = fixed_mul(speed, FIXED_FROM_FLOAT(FRIGHTENED_SPEED_MOD));
+        }
+
+        swarm->progress[i] += fixed_mul(speed, update->dt);
+        while(swarm->progress[i] >= FIXED_ONE && swarm->dir[i] != MOVEMENT_DIR_NONE) {
+            swarm->progress[i] -= FIXED_ONE;
+            swarm->x[i] += (int32_t)direction_vectors[swarm->dir[i]].x;
+            swarm->y[i] += (int32_t)direction_vectors[swarm->dir[i]].y;
+            swarm->dir[i] = (uint8_t)steer_swarm_ghost(update, i);
+        }
+
+        if(swarm->dir[i] == MOVEMENT_DIR_NONE) {
+            swarm->progress[i] = 0;
+        }
+    }
+}
+
+// Position in tiles, as fixed point
+static inline void get_swarm_ghost_position(const GhostSwarm *swarm, uint32_t i, fixed32 *x, fixed32 *y) {
+    *x = swarm->x[i] * FIXED_ONE;
+    *y = swarm->y[i] * FIXED_ONE;
+    if(swarm->dir[i] != MOVEMENT_DIR_NONE) {
+        *x += (int32_t)direction_vectors[swarm->dir[i]].x * swarm->progress[i];
+        *y += (int32_t)direction_vectors[swarm->dir[i]].y * swarm->progress[i];
+    }
+}
+
+// Counting sort of the ghosts into the cells, which keeps each cell in dense order
+static void build_swarm_grid(GhostSwarm *swarm, const Level *level) {
+    uint32_t *cell_start = swarm->cell_start;
+    memset(cell_start, 0, (swarm->cell_count + 1) * sizeof(*cell_start));
+
+    for(uint32_t i = 0; i < swarm->count; i++) {
+        int32_t x = swarm->x[i];
+        int32_t y = swarm->y[i];
+        if(swarm->progress[i] >= FIXED_ONE / 2) {
+            x += (int32_t)direction_vectors[swarm->dir[i]].x;
+            y += (int32_t)direction_vectors[swarm->dir[i]].y;
+        }
+
+        swarm->ghost_cells[i] = get_level_tile_index(level, x, y);
+        cell_start[swarm->ghost_cells[i] + 1]++;
+    }
+
+    for(uint32_t c = 0; c < swarm->cell_count; c++) {
+        cell_start[c + 1] += cell_start[c];
+    }
+
+    // Every start moves up to the start of the next cell while filling
+    for(uint32_t i = 0; i < swarm->count; i++) {
+        swarm->cell_ghosts[cell_start[swarm->ghost_cells[i]]++] = i;
+    }
+
+    memmove(cell_start + 1, cell_start, swarm->cell_count * sizeof(*cell_start));
+    cell_start[0] = 0;
+}
+
+// Ghosts that touch the player are in the 3x3 cells around the player's closest tile
+static void handle_player_swarm_collisions(GhostSwarm *swarm, GameContext *ctx) {
+    const Level *level = ctx->level;
+    const TileCoord *player = &ctx->player.entity.coord;
+    fixed32 player_x = player->x * FIXED_ONE + player->sub.x;
+    fixed32 player_y = player->y * FIXED_ONE + player->sub.y;
+    int32_t tile_x = (player_x + FIXED_ONE / 2) >> FIXED_SHIFT;
+    int32_t tile_y = (player_y + FIXED_ONE / 2) >> FIXED_SHIFT;
+
+    int32_t min_x = MAX(tile_x - 1, -1);
+    int32_t max_x = MIN(tile_x + 1, (int32_t)level->columns);
+    int32_t min_y = MAX(tile_y - 1, -1);
+    int32_t max_y = MIN(tile_y + 1, (int32_t)level->rows);
+
+    // Eaten ghosts are only removed at the end, removing one reorders the others
+    uint32_t eaten_count = 0;
+    for(int32_t y = min_y; y <= max_y; y++) {
+        for(int32_t x = min_x; x <= max_x; x++) {
+            uint32_t cell = get_level_tile_index(level, x, y);
+
+            for(uint32_t c = swarm->cell_start[cell]; c < swarm->cell_start[cell + 1]; c++) {
+                uint32_t i = swarm->cell_ghosts[c];
+
+                fixed32 ghost_x, ghost_y;
+                get_swarm_ghost_position(swarm, i, &ghost_x, &ghost_y);
+                fixed32 dist_x = fixed_abs(player_x - ghost_x);
+                fixed32 dist_y = fixed_abs(player_y - ghost_y);
+
+                if(dist_x >= PLAYER_GHOST_TOUCH_SIZE || dist_y >= PLAYER_GHOST_TOUCH_SIZE) {
+                    continue;
+                }
+
+                if(ctx->frightened_timer != TIMER_NONE) {
+                    swarm->eaten[eaten_count++] = swarm->handles[i];
+
+                    increase_player_score(ctx, SCORE_GHOST_EATEN);
+                    ctx->events |= GAME_EVENT_GHOST_EATEN;
+                    camera_shake(ctx);
+                } else if(dist_x < PLAYER_GHOST_HIT_SIZE && dist_y < PLAYER_GHOST_HIT_SIZE) {
+                    kill_player(ctx);
+                    return;
+                }
+            }
+        }
+    }
+
+    for(uint32_t i = 0; i < eaten_count; i++) {
+        despawn_swarm_ghost(swarm, swarm->eaten[i]);
+    }
+}
+
+void update_ghost_swarm(GhostSwarm *swarm, GameContext *ctx, float dt) {
+    assert(swarm && ctx);
+
+    // With a single level, clearing it starts the same one over
+    if(ctx->events & GAME_EVENT_LEVEL_CLEARED) {
+        swarm->level_index = UINT32_MAX;
+    }
+    if(!sync_swarm_level(swarm, ctx)) {
+        return;
+    }
+
+    if(ctx->events & GAME_EVENT_PLAYER_DIED) {
+        for(uint32_t i = 0; i < swarm->count; i++) {
+            reset_swarm_ghost(swarm, ctx, i);
+        }
+    }
+
+    if(ctx->current_state != GAME_STATE_NORMAL) {
+        return;
+    }
+
+    SwarmUpdate update = {
+        .swarm = swarm,
+        .ctx = ctx,
+        .dt = FIXED_FROM_FLOAT(dt),
+        .frightened = ctx->frightened_timer != TIMER_NONE
+    };
+    for(int32_t i = 0; i < GHOST_COUNT; i++) {
+        update.speeds[i] = FIXED_FROM_FLOAT(get_ghost_speed(ctx, i));
+    }
+    run_parallel_jobs(move_swarm_ghosts, &update, (swarm->count + SWARM_JOB_SIZE - 1) / SWARM_JOB_SIZE);
+
+    build_swarm_grid(swarm, ctx->level);
+    handle_player_swarm_collisions(swarm, ctx);
+
+    if(ctx->events & GAME_EVENT_PLAYER_DIED) {
+        for(uint32_t i = 0; i < swarm->count; i++) {
+            reset_swarm_ghost(swarm, ctx, i);
+        }
+        build_swarm_grid(swarm, ctx->level);
+    }
+}
+
+uint32_t count_swarm_ghosts_on_tile(const GhostSwarm *swarm, const GameContext *ctx, int32_t x, int32_t y) {
+    assert(swarm && ctx);
+
+    if(swarm->level_index != ctx->level_index || x < -1 || y < -1 ||
+       x > (int32_t)ctx->level->columns || y > (int32_t)ctx->level->rows) {
+        return 0;
+    }
+
+    return get_swarm_cell_size(swarm, get_level_tile_index(ctx->level, x, y));
+}
+
+#undef SWARM_INDEX_BITS
+#undef SWARM_INDEX_MASK
+#undef SWARM_GENERATION_MASK
+#undef SWARM_JOB_SIZE
+#undef SWARM_SPAWN_MIN_DISTANCE
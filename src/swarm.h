@@ -0,0 +1,50 @@
+/*
+ * Pacman Clone
+ *
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ */
+
+#ifndef SWARM_H
+#define SWARM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "game.h"
+#include "random.h"
+
+// Any number of extra ghosts for stress tests and custom modes, on top of the four
+// regular ones of a game. They live in dense arrays and are found through a grid
+// over the level tiles, so moving them and testing them against the player and
+// each other costs the same per ghost however many there are. They aren't part of
+// the game state, snapshots and replays don't include them.
+typedef struct GhostSwarm GhostSwarm;
+
+// Handles of despawned ghosts are never mistaken for new ones, at least until the
+// same slot has been reused 4096 times
+typedef uint32_t SwarmGhost;
+#define SWARM_GHOST_NONE UINT32_MAX
+#define SWARM_CAPACITY_MAX ((1u << 20) - 1)
+
+GhostSwarm * create_ghost_swarm(uint32_t capacity);
+void destroy_ghost_swarm(GhostSwarm **swarm);
+
+// type picks which of the regular ghosts it chases and scatters like (GHOST_BLINKY
+// and so on). Returns SWARM_GHOST_NONE when the swarm is full or the tile isn't
+// one a ghost can walk on.
+SwarmGhost spawn_swarm_ghost(GhostSwarm *swarm, const GameContext *ctx, uint32_t type, int32_t x, int32_t y);
+bool despawn_swarm_ghost(GhostSwarm *swarm, SwarmGhost ghost);
+bool swarm_ghost_exists(const GhostSwarm *swarm, SwarmGhost ghost);
+// Spawns up to count ghosts of random types on random tiles that the player can
+// reach, away from where the player starts. Returns how many were spawned.
+uint32_t scatter_swarm_ghosts(GhostSwarm *swarm, const GameContext *ctx, uint32_t count, RandomState *random);
+uint32_t get_ghost_swarm_count(const GhostSwarm *swarm);
+
+// Moves every ghost, spread over all cores, then handles the ones touching the
+// player like the regular ghosts. Call it after every update_loop. Swarm ghosts
+// go back to where they spawned when the player dies, and are all removed when
+// the level changes.
+void update_ghost_swarm(GhostSwarm *swarm, GameContext *ctx, float dt);
+// Ghosts closest to the tile as of the last update
+uint32_t count_swarm_ghosts_on_tile(const GhostSwarm *swarm, const GameContext *ctx, int32_t x, int32_t y);
+
+#endif /* SWARM_H */
@@ -7,6 +7,7 @@
 #include "texture.h"
 #include "game.h"
 
+#include <emmintrin.h>
 #include <stdio.h>
 #include <stddef.h>
 #include <string.h>
@@ -35,78 +36,123 @@ typedef struct {
 } BitmapFile;
 #pragma pack(pop)
 
-static inline uint32_t get_y_bottom_up(uint32_t y, uint32_t height) { return height - 1 - y; }
-static inline uint32_t get_y_top_down(uint32_t y, uint32_t height) { IGNORED_VARIABLE(height); return y; }
+#define BITMAP_RGB 0
+#define BITMAP_BITFIELDS 3
+#define BITMAP_ALPHA_MASK 0xff000000
 
-static inline void assign_color_opaque(unsigned char *data, uint32_t color, uint32_t chroma_key) {
-    IGNORED_VARIABLE(chroma_key);
-    data[0] = (color >> 16) & 0xff;
-    data[1] = (color >> 8) & 0xff;
-    data[2] = color & 0xff;
-    data[3] = 0xff;
+// The stored color has blue in the low byte, the texture wants red first. The
+// chroma key is compared against the whole stored color, like the bitmap has it.
+static inline uint32_t convert_pixel(uint32_t color, uint32_t chroma_key) {
+    uint32_t rgba = ((color >> 16) & 0xff) | (color & 0xff00) | ((color & 0xff) << 16) | BITMAP_ALPHA_MASK;
+    return (chroma_key != CHROMA_KEY_UNUSED && color == chroma_key) ? 0 : rgba;
 }
 
-static void assign_color_transparent(unsigned char *data, uint32_t color, uint32_t chroma_key) {
-    if(color != chroma_key) {
-        assign_color_opaque(data, color, chroma_key);
-    } else {
-        memset(data, 0, sizeof(color));
-    }
-}
-
-Texture2D * load_texture(const char *path, uint32_t chroma_key) {
-    Texture2D *tex = NULL;
-
-    if(path) {
-        FILE *f = fopen(path, "rb");
-        if(f) {
-            BitmapFile bmp = { 0 };
-            fread(&bmp, sizeof(bmp), 1, f);
+static inline __m128i convert_pixels(__m128i color, __m128i key, __m128i use_key) {
+    __m128i low = _mm_set1_epi32(0xff);
+    __m128i rgba = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(color, 16), low),
+                                _mm_and_si128(color, _mm_set1_epi32(0xff00)));
+    rgba = _mm_or_si128(rgba, _mm_slli_epi32(_mm_and_si128(color, low), 16));
+    rgba = _mm_or_si128(rgba, _mm_set1_epi32((int32_t)BITMAP_ALPHA_MASK));
 
-            // We only support bitmaps that have the Windows header type and are at most v3
-            if(bmp.file_header.type == 0x4d42 && bmp.bitmap_header.size == 40 &&
-               (bmp.bitmap_header.bits_per_pixel == 24 || bmp.bitmap_header.bits_per_pixel == 32)) {
+    __m128i keyed = _mm_and_si128(_mm_cmpeq_epi32(color, key), use_key);
+    return _mm_andnot_si128(keyed, rgba);
+}
 
-                uint32_t bytes_per_pixel = bmp.bitmap_header.bits_per_pixel / 8;
+// Converts a row of width pixels, four at a time. Rows of 24 bit pixels are read
+// 16 bytes at a time, so the last few pixels, which could read past the row, are
+// done one by one.
+static void convert_row(unsigned char *dst, const unsigned char *src, uint32_t width,
+                        uint32_t bytes_per_pixel, uint32_t chroma_key) {
+    __m128i key = _mm_set1_epi32((int32_t)chroma_key);
+    __m128i use_key = _mm_set1_epi32((chroma_key != CHROMA_KEY_UNUSED) ? -1 : 0);
+    uint32_t x = 0;
+
+    if(bytes_per_pixel == 4) {
+        for(; x + 4 <= width; x += 4) {
+            __m128i color = _mm_loadu_si128((const __m128i *)&src[x * 4]);
+            _mm_storeu_si128((__m128i *)&dst[x * CHANNEL_COUNT], convert_pixels(color, key, use_key));
+        }
+    } else {
+        __m128i rgb_mask = _mm_set1_epi32(0xffffff);
+        for(; x + 6 <= width; x += 4) {
+            __m128i bytes = _mm_loadu_si128((const __m128i *)&src[x * 3]);
+            __m128i first = _mm_unpacklo_epi32(bytes, _mm_srli_si128(bytes, 3));
+            __m128i second = _mm_unpacklo_epi32(_mm_srli_si128(bytes, 6), _mm_srli_si128(bytes, 9));
+            __m128i color = _mm_and_si128(_mm_unpacklo_epi64(first, second), rgb_mask);
+            _mm_storeu_si128((__m128i *)&dst[x * CHANNEL_COUNT], convert_pixels(color, key, use_key));
+        }
+    }
 
-                uint32_t width = bmp.bitmap_header.width;
-                uint32_t height = ABSOLUTE_VAL(bmp.bitmap_header.height);
-                tex = malloc(offsetof(struct Texture2D, data) + (width * height * CHANNEL_COUNT));
-                tex->width = width;
-                tex->height = height;
+    for(; x < width; x++) {
+        uint32_t color = 0;
+        memcpy(&color, &src[x * bytes_per_pixel], bytes_per_pixel);
 
-                width *= bytes_per_pixel;
-                uint32_t scanline = (width + 3) & ~3;
-                uint32_t pixel_row_size = bmp.bitmap_header.width * CHANNEL_COUNT;
+        uint32_t rgba = convert_pixel(color, chroma_key);
+        memcpy(&dst[x * CHANNEL_COUNT], &rgba, sizeof(rgba));
+    }
+}
 
-                unsigned char *row_buffer = malloc(sizeof(*row_buffer) * scanline); // TODO: Perhaps change to alloca()?
+Texture2D * load_texture_from_memory(const void *data, size_t size, uint32_t chroma_key) {
+    Texture2D *tex = NULL;
+    BitmapFile bmp = { 0 };
+
+    if(data && size >= sizeof(bmp)) {
+        memcpy(&bmp, data, sizeof(bmp));
+
+        // Negative heights are stored top down
+        int64_t signed_height = bmp.bitmap_header.height;
+        uint32_t bytes_per_pixel = bmp.bitmap_header.bits_per_pixel / 8;
+        uint32_t width = (uint32_t)bmp.bitmap_header.width;
+        uint32_t height = (uint32_t)ABSOLUTE_VAL(signed_height);
+        size_t scanline = ((size_t)width * bytes_per_pixel + 3) & ~(size_t)3;
+
+        // We only support uncompressed bitmaps with the Windows header type, at most v3
+        if(bmp.file_header.type == 0x4d42 && bmp.bitmap_header.size == 40 &&
+           (bmp.bitmap_header.bits_per_pixel == 24 || bmp.bitmap_header.bits_per_pixel == 32) &&
+           (bmp.bitmap_header.compression == BITMAP_RGB || bmp.bitmap_header.compression == BITMAP_BITFIELDS) &&
+           bmp.bitmap_header.width > 0 && width < 65536 && height > 0 && height < 65536 &&
+           bmp.file_header.offset >= sizeof(bmp) && bmp.file_header.offset <= size &&
+           (size - bmp.file_header.offset) / scanline >= height) {
+
+            tex = malloc(offsetof(struct Texture2D, data) + (size_t)width * height * CHANNEL_COUNT);
+        }
 
-                uint32_t (*get_row_op)(uint32_t, uint32_t) = (bmp.bitmap_header.height >= 0) ?
-                    get_y_bottom_up : get_y_top_down;
-                void (*assign_color_op)(unsigned char *, uint32_t, uint32_t) = (chroma_key == CHROMA_KEY_UNUSED) ?
-                    assign_color_opaque : assign_color_transparent;
+        if(tex) {
+            tex->width = width;
+            tex->height = height;
 
-                fseek(f, bmp.file_header.offset, SEEK_SET);
+            const unsigned char *pixels = (const unsigned char *)data + bmp.file_header.offset;
+            size_t pixel_row_size = (size_t)width * CHANNEL_COUNT;
+            for(uint32_t y = 0; y < height; y++) {
+                uint32_t row = (signed_height >= 0) ? height - 1 - y : y;
+                convert_row(&tex->data[row * pixel_row_size], &pixels[y * scanline], width, bytes_per_pixel, chroma_key);
+            }
+        }
+    }
 
-                for(uint32_t y = 0; y < height; y++) {
-                    fread(row_buffer, sizeof(*row_buffer) * scanline, 1, f);
-                    uint32_t row_start = get_row_op(y, height) * pixel_row_size;
+    return tex;
+}
 
-                    for(uint32_t xb = 0, xd = 0; xb < width; xb += bytes_per_pixel, xd += CHANNEL_COUNT) {
-                        uint32_t data_index = row_start + xd;
+// The file is mapped rather than read, the pixels are converted straight from it
+Texture2D * load_texture(const char *path, uint32_t chroma_key) {
+    Texture2D *tex = NULL;
 
-                        uint32_t color = 0;
-                        memcpy(&color, &row_buffer[xb], bytes_per_pixel);
+    if(path) {
+        size_t size = 0;
+        const void *data = map_file(path, &size);
+        tex = load_texture_from_memory(data, size, chroma_key);
+        unmap_file(data, size);
+    }
 
-                        assign_color_op(&tex->data[data_index], color, chroma_key);
-                    }
-                }
+    return tex;
+}
 
-                free(row_buffer);
-            }
+const Texture2D * open_decoded_texture(const void *data, size_t size) {
+    const Texture2D *tex = data;
 
-            fclose(f);
-        }
+    if(!data || ((uintptr_t)data % sizeof(uint32_t)) != 0 || size < offsetof(struct Texture2D, data) ||
+       tex->width >= 65536 || tex->height >= 65536 || get_texture_size(tex) != size) {
+        return NULL;
     }
 
     return tex;
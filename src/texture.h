@@ -7,6 +7,7 @@
 #ifndef TEXTURE_H
 #define TEXTURE_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 typedef struct Texture2D {
@@ -20,7 +21,18 @@ typedef struct Texture2D {
 #define ABSOLUTE_VAL(v) (((v) >= 0) ? (v) : -(v))
 
 
+// Reads 24 and 32 bit bitmaps, either straight from a file or from one that is
+// already in memory
 Texture2D * load_texture(const char *path, uint32_t chroma_key);
+Texture2D * load_texture_from_memory(const void *data, size_t size, uint32_t chroma_key);
+
+static inline size_t get_texture_size(const Texture2D *texture) {
+    return offsetof(struct Texture2D, data) + (size_t)texture->width * texture->height * CHANNEL_COUNT;
+}
+
+// For textures that are stored already decoded, such as in a pack. Returns data
+// itself, or NULL if the size doesn't match.
+const Texture2D * open_decoded_texture(const void *data, size_t size);
 void destroy_texture(Texture2D **texture);
 
 #endif /* TEXTURE_H */
@@ -0,0 +1,156 @@
+/*
+ * Pacman Clone
+ *
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ */
+
+#include <assert.h>
+#include "timerwheel.h"
+
+#define TIMER_WHEEL_SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_TOP_SHIFT ((TIMER_WHEEL_LEVELS - 1) * TIMER_WHEEL_SLOT_BITS)
+
+void init_timer_wheel(TimerWheel *wheel) {
+    assert(wheel);
+
+    wheel->now = 0;
+    for(uint32_t i = 0; i < TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS; i++) {
+        wheel->lists[i] = TIMER_NONE;
+    }
+
+    // Free timers are chained through next
+    for(uint16_t i = 0; i < TIMER_WHEEL_CAPACITY; i++) {
+        wheel->timers[i].list = TIMER_NONE;
+        wheel->timers[i].next = (i + 1 < TIMER_WHEEL_CAPACITY) ? i + 1 : TIMER_NONE;
+    }
+    wheel->free_timers = 0;
+}
+
+// The lowest level whose slots reach the expiry. A slot is only reused once the
+// one before it wrapped around, so the timer is there in time to move down.
+static uint16_t get_timer_list(const TimerWheel *wheel, uint32_t expiry) {
+    uint32_t delta = expiry - wheel->now;
+    for(uint32_t level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        uint32_t shift = level * TIMER_WHEEL_SLOT_BITS;
+        if(delta < (1u << (shift + TIMER_WHEEL_SLOT_BITS))) {
+            return (uint16_t)(level * TIMER_WHEEL_SLOTS + ((expiry >> shift) & TIMER_WHEEL_SLOT_MASK));
+        }
+    }
+
+    // Out of reach, it's placed again once the top level gets back to this slot
+    return (uint16_t)((TIMER_WHEEL_LEVELS - 1) * TIMER_WHEEL_SLOTS +
+                      (((wheel->now >> TIMER_WHEEL_TOP_SHIFT) - 1) & TIMER_WHEEL_SLOT_MASK));
+}
+
+static void link_wheel_timer(TimerWheel *wheel, TimerHandle handle) {
+    WheelTimer *timer = &wheel->timers[handle];
+    timer->list = get_timer_list(wheel, timer->expiry);
+    timer->prev = TIMER_NONE;
+    timer->next = wheel->lists[timer->list];
+    if(timer->next != TIMER_NONE) {
+        wheel->timers[timer->next].prev = handle;
+    }
+    wheel->lists[timer->list] = handle;
+}
+
+static void unlink_wheel_timer(TimerWheel *wheel, TimerHandle handle) {
+    WheelTimer *timer = &wheel->timers[handle];
+    if(timer->prev != TIMER_NONE) {
+        wheel->timers[timer->prev].next = timer->next;
+    } else {
+        wheel->lists[timer->list] = timer->next;
+    }
+
+    if(timer->next != TIMER_NONE) {
+        wheel->timers[timer->next].prev = timer->prev;
+    }
+}
+
+static void free_wheel_timer(TimerWheel *wheel, TimerHandle handle) {
+    unlink_wheel_timer(wheel, handle);
+    wheel->timers[handle].list = TIMER_NONE;
+    wheel->timers[handle].next = wheel->free_timers;
+    wheel->free_timers = handle;
+}
+
+TimerHandle start_wheel_timer(TimerWheel *wheel, uint32_t ticks, uint16_t event) {
+    assert(wheel);
+
+    TimerHandle handle = wheel->free_timers;
+    if(handle == TIMER_NONE) {
+        return TIMER_NONE;
+    }
+
+    WheelTimer *timer = &wheel->timers[handle];
+    wheel->free_timers = timer->next;
+
+    timer->start = wheel->now;
+    timer->expiry = wheel->now + (ticks > 0 ? ticks : 1);
+    timer->event = event;
+    link_wheel_timer(wheel, handle);
+
+    return handle;
+}
+
+void stop_wheel_timer(TimerWheel *wheel, TimerHandle timer) {
+    assert(wheel);
+
+    if(timer != TIMER_NONE) {
+        assert(timer < TIMER_WHEEL_CAPACITY && wheel->timers[timer].list != TIMER_NONE);
+        free_wheel_timer(wheel, timer);
+    }
+}
+
+// Every timer in the slot expires within the slot's span, so they all end up
+// on a lower level, or in the first level's slot for this tick
+static void cascade_wheel_slot(TimerWheel *wheel, uint32_t level) {
+    uint32_t shift = level * TIMER_WHEEL_SLOT_BITS;
+    uint16_t list = (uint16_t)(level * TIMER_WHEEL_SLOTS + ((wheel->now >> shift) & TIMER_WHEEL_SLOT_MASK));
+
+    TimerHandle handle = wheel->lists[list];
+    wheel->lists[list] = TIMER_NONE;
+    while(handle != TIMER_NONE) {
+        TimerHandle next = wheel->timers[handle].next;
+        link_wheel_timer(wheel, handle);
+        handle = next;
+    }
+}
+
+void advance_timer_wheel(TimerWheel *wheel, TimerCallback fire, void *data) {
+    assert(wheel && fire);
+
+    wheel->now++;
+
+    // Higher levels first, they can fill the slot that's moved down next
+    for(uint32_t level = TIMER_WHEEL_LEVELS - 1; level > 0; level--) {
+        uint32_t mask = (1u << (level * TIMER_WHEEL_SLOT_BITS)) - 1;
+        if((wheel->now & mask) == 0) {
+            cascade_wheel_slot(wheel, level);
+        }
+    }
+
+    // Timers fired from here expire later, so they never land in this slot
+    uint16_t list = (uint16_t)(wheel->now & TIMER_WHEEL_SLOT_MASK);
+    while(wheel->lists[list] != TIMER_NONE) {
+        TimerHandle handle = wheel->lists[list];
+        assert(wheel->timers[handle].expiry == wheel->now);
+
+        uint16_t event = wheel->timers[handle].event;
+        free_wheel_timer(wheel, handle);
+        fire(data, handle, event);
+    }
+}
+
+float get_wheel_timer_progress(const TimerWheel *wheel, TimerHandle timer) {
+    assert(wheel);
+
+    if(timer == TIMER_NONE) {
+        return 0.0f;
+    }
+
+    const WheelTimer *t = &wheel->timers[timer];
+    return (float)(wheel->now - t->start) / (float)(t->expiry - t->start);
+}
+
+#undef TIMER_WHEEL_SLOT_MASK
+#undef TIMER_WHEEL_TOP_SHIFT
@@ -0,0 +1,58 @@
+/*
+ * Pacman Clone
+ *
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ */
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Hierarchical timing wheel counting whole ticks. The first level has one slot per
+// tick for the next 64 ticks, every level above has slots 64 times as long, and a
+// slot's timers move down a level when the level below wraps around. Starting,
+// stopping and firing are O(1), a tick only touches the timers that fire or move
+// down. It holds no pointers, so it can be copied along with the game state.
+#define TIMER_WHEEL_SLOT_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_SLOT_BITS)
+#define TIMER_WHEEL_LEVELS 3
+#define TIMER_WHEEL_CAPACITY 16
+#define TIMER_NONE UINT16_MAX
+
+// Only valid until the timer fires or is stopped, after that the slot is reused
+typedef uint16_t TimerHandle;
+
+typedef struct {
+    uint32_t start;
+    uint32_t expiry;
+    uint16_t event;
+    uint16_t list; // Wheel slot it's queued in, TIMER_NONE when free
+    uint16_t prev;
+    uint16_t next;
+} WheelTimer;
+
+typedef struct {
+    uint32_t now;
+    uint16_t free_timers;
+    uint16_t lists[TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS];
+    WheelTimer timers[TIMER_WHEEL_CAPACITY];
+} TimerWheel;
+
+typedef void (*TimerCallback)(void *data, TimerHandle timer, uint16_t event);
+
+void init_timer_wheel(TimerWheel *wheel);
+// Fires after the given number of ticks, at least one. Timers further out than
+// the wheel reaches (64^3 ticks) wait in the top level. Returns TIMER_NONE when
+// all of them are in use.
+TimerHandle start_wheel_timer(TimerWheel *wheel, uint32_t ticks, uint16_t event);
+// Does nothing for TIMER_NONE
+void stop_wheel_timer(TimerWheel *wheel, TimerHandle timer);
+// Moves on by one tick and calls fire for every timer that expires. The timer
+// is already free by then, so fire can start it again.
+void advance_timer_wheel(TimerWheel *wheel, TimerCallback fire, void *data);
+// How much of a timer's time has passed, from 0 to 1. 0 for TIMER_NONE.
+float get_wheel_timer_progress(const TimerWheel *wheel, TimerHandle timer);
+
+#endif /* TIMER_WHEEL_H */
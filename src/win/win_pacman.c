@@ -30,10 +30,12 @@ HGLRC win_setup_opengl(HDC device_context);
 
 volatile struct {
     HANDLE semaphore;
+    GameContext *game;
     uint32_t input;
     bool running;
 } game_env_data = {
     .semaphore = NULL,
+    .game = NULL,
     .input = 0,
     .running = true
 };
@@ -68,7 +70,7 @@ LRESULT CALLBACK window_proc(HWND window, UINT message, WPARAM w_param, LPARAM l
             UNSET_INPUT(w_param == VK_ESCAPE, INPUT_MENU);
             break;
         case WM_SIZE: {
-            signal_window_resize(LOWORD(l_param), HIWORD(l_param));
+            signal_window_resize(game_env_data.game, LOWORD(l_param), HIWORD(l_param));
             break;
         }
         case WM_SIZING: {
@@ -105,7 +107,14 @@ DWORD WINAPI win_game_init_and_run(LPVOID parameter) {
     HDC device_context = GetDC(window);
     HGLRC rendering_context = win_setup_opengl(device_context);
 
+    GameAssets *assets = create_game_assets();
+    WIN_CHECK_CREATION_ERROR(assets, "Failed to load any level data!\n");
+    GameContext *game = create_game_context(assets);
+    seed_game(game, (uint64_t)time(NULL), 0);
+    game_env_data.game = game;
+
     double elapsed_time = 0.0;
+    double accumulator = 0.0;
     LARGE_INTEGER perf_freq;
     LARGE_INTEGER current_time;
     LARGE_INTEGER prev_time;
@@ -113,9 +122,14 @@ DWORD WINAPI win_game_init_and_run(LPVOID parameter) {
     QueryPerformanceCounter(&current_time);
 
     while(game_env_data.running) {
-        game_env_data.running = update_loop((float)elapsed_time, game_env_data.input);
+        // Clamp long frames so a stall doesn't make us run a huge amount of ticks to catch up
+        accumulator += MIN(elapsed_time, SIMULATION_MAX_FRAME_TIME);
+        while(game_env_data.running && accumulator >= SIMULATION_TICK_TIME) {
+            game_env_data.running = update_loop(game, SIMULATION_TICK_TIME, game_env_data.input);
+            accumulator -= SIMULATION_TICK_TIME;
+        }
 
-        render_loop((float)elapsed_time);
+        render_loop(game, (float)elapsed_time, (float)(accumulator / SIMULATION_TICK_TIME));
         SwapBuffers(device_context);
 
         prev_time = current_time;
@@ -128,7 +142,9 @@ DWORD WINAPI win_game_init_and_run(LPVOID parameter) {
         ReleaseSemaphore(game_env_data.semaphore, 1, NULL);
     }
 
-    close_game();
+    game_env_data.game = NULL;
+    destroy_game_context(&game);
+    destroy_game_assets(&assets);
 
     ReleaseDC(window, device_context);
     wglMakeCurrent(NULL, NULL);
@@ -138,8 +154,6 @@ DWORD WINAPI win_game_init_and_run(LPVOID parameter) {
 }
 
 int WINAPI WinMain(HINSTANCE instance, HINSTANCE prev, LPSTR args, int cmd_show) {
-    srand((unsigned int)time(NULL));
-
     IGNORED_VARIABLE(prev);
     IGNORED_VARIABLE(args);
     IGNORED_VARIABLE(cmd_show);
@@ -274,7 +288,7 @@ HGLRC win_setup_opengl(HDC device_context) {
 
     wglSwapIntervalEXT(1);
 
-    initialize_game();
+    initialize_renderer();
 
     return rendering_context;
 }
@@ -308,3 +322,144 @@ void init_level_names(LevelFileData *data) {
 void destroy_level_names(LevelFileData *data) {
     free(data->names);
 }
+
+const void * map_file(const char *path, size_t *size) {
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(file == INVALID_HANDLE_VALUE) {
+        return NULL;
+    }
+
+    // The view stays valid after both handles are closed
+    void *data = NULL;
+    LARGE_INTEGER file_size;
+    if(GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0) {
+        HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if(mapping) {
+            data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            *size = (size_t)file_size.QuadPart;
+            CloseHandle(mapping);
+        }
+    }
+    CloseHandle(file);
+
+    return data;
+}
+
+void unmap_file(const void *data, size_t size) {
+    IGNORED_VARIABLE(size);
+    if(data) {
+        UnmapViewOfFile(data);
+    }
+}
+
+bool get_file_stamp(const char *path, uint64_t *size, uint64_t *write_time) {
+    WIN32_FILE_ATTRIBUTE_DATA info;
+    if(!GetFileAttributesExA(path, GetFileExInfoStandard, &info)) {
+        return false;
+    }
+
+    // File times count 100 ns steps from 1601
+    uint64_t time = ((uint64_t)info.ftLastWriteTime.dwHighDateTime << 32) | info.ftLastWriteTime.dwLowDateTime;
+    *size = ((uint64_t)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+    *write_time = (time - 116444736000000000ull) / 10000000;
+    return true;
+}
+
+// The worker threads are started by the first call and then wait for more jobs,
+// so running jobs every tick doesn't create threads every tick
+typedef struct {
+    SRWLOCK lock;
+    CONDITION_VARIABLE wake;
+    CONDITION_VARIABLE done;
+    void (*job)(void *data, uint32_t index);
+    void *data;
+    uint32_t count;
+    uint32_t next;
+    uint32_t finished;
+    uint64_t generation;
+    DWORD thread_count; // Including the calling thread
+} WinParallelJobs;
+
+static WinParallelJobs win_parallel_jobs = {
+    .lock = SRWLOCK_INIT,
+    .wake = CONDITION_VARIABLE_INIT,
+    .done = CONDITION_VARIABLE_INIT
+};
+// Only one set of jobs runs at a time
+static SRWLOCK win_parallel_jobs_call_lock = SRWLOCK_INIT;
+
+// Expects the lock to be held and returns with it held
+static void win_work_on_parallel_jobs(WinParallelJobs *jobs) {
+    while(jobs->next < jobs->count) {
+        void (*job)(void *data, uint32_t index) = jobs->job;
+        void *data = jobs->data;
+        uint32_t index = jobs->next++;
+
+        ReleaseSRWLockExclusive(&jobs->lock);
+        job(data, index);
+        AcquireSRWLockExclusive(&jobs->lock);
+
+        if(++jobs->finished == jobs->count) {
+            WakeConditionVariable(&jobs->done);
+        }
+    }
+}
+
+static DWORD WINAPI win_parallel_job_worker(LPVOID parameter) {
+    WinParallelJobs *jobs = parameter;
+    uint64_t generation = 0;
+
+    AcquireSRWLockExclusive(&jobs->lock);
+    for(;;) {
+        while(jobs->generation == generation) {
+            SleepConditionVariableSRW(&jobs->wake, &jobs->lock, INFINITE, 0);
+        }
+
+        generation = jobs->generation;
+        win_work_on_parallel_jobs(jobs);
+    }
+
+    return 0;
+}
+
+void run_parallel_jobs(void (*job)(void *data, uint32_t index), void *data, uint32_t count) {
+    WinParallelJobs *jobs = &win_parallel_jobs;
+    if(count == 0) {
+        return;
+    }
+
+    AcquireSRWLockExclusive(&win_parallel_jobs_call_lock);
+    AcquireSRWLockExclusive(&jobs->lock);
+
+    // If no worker can be started, the calling thread does all of the jobs
+    if(jobs->thread_count == 0) {
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        for(jobs->thread_count = 1; jobs->thread_count < info.dwNumberOfProcessors; jobs->thread_count++) {
+            HANDLE thread = CreateThread(NULL, 0, win_parallel_job_worker, jobs, 0, NULL);
+            if(!thread) {
+                break;
+            }
+            CloseHandle(thread);
+        }
+    }
+
+    jobs->job = job;
+    jobs->data = data;
+    jobs->count = count;
+    jobs->next = 0;
+    jobs->finished = 0;
+    jobs->generation++;
+    if(count > 1 && jobs->thread_count > 1) {
+        WakeAllConditionVariable(&jobs->wake);
+    }
+
+    // The calling thread works through jobs as well
+    win_work_on_parallel_jobs(jobs);
+    while(jobs->finished < jobs->count) {
+        SleepConditionVariableSRW(&jobs->done, &jobs->lock, INFINITE, 0);
+    }
+
+    ReleaseSRWLockExclusive(&jobs->lock);
+    ReleaseSRWLockExclusive(&win_parallel_jobs_call_lock);
+}